@@ -0,0 +1,24 @@
+/// @file alloc_counter.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+// force included into every translation unit of the benchmark (core sources too)
+// so armadillo allocates through a counter. it has to be seen before armadillo is.
+
+#pragma once
+
+#include <cstddef>
+
+namespace mlmat_bench {
+
+void* counted_malloc(std::size_t n);
+void counted_free(void* p);
+
+// number of heap allocations made through armadillo or operator new so far
+std::size_t allocation_count();
+
+}
+
+#define ARMA_ALIEN_MEM_ALLOC_FUNCTION mlmat_bench::counted_malloc
+#define ARMA_ALIEN_MEM_FREE_FUNCTION mlmat_bench::counted_free
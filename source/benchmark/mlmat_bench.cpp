@@ -0,0 +1,708 @@
+/// @file mlmat_bench.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+/*
+ times the conversion layer and the per frame step of the objects against the core,
+ without max. buffers are laid out the way jitter lays out a matrix in each mode.
+
+ prints one json object per line so runs can be diffed between releases:
+ {"benchmark":"to_arma","type":"float32","mode":1,"features":8,"cells":1024,...}
+
+ cells is the number of samples (jitter cells in mode 0, columns of the arma matrix),
+ ns_per_cell is the time for one call divided by that. allocations_per_iter counts
+ armadillo allocations and operator new. peak_rss_kb is the peak of the whole process
+ at the time the benchmark finished, so it only ever grows through a run.
+
+ usage: mlmat_bench [--filter=<substring>] [--min-time=<ms>] [--quick]
+ */
+
+#include "alloc_counter.hpp"
+
+#include "core/conversions.hpp"
+#include "core/scaler.hpp"
+#include "core/neighbor_search.hpp"
+#include "core/kmeans.hpp"
+#include "core/gmm.hpp"
+#include "core/som.hpp"
+#include "pca_ext.hpp"
+#include "pca_ext_impl.hpp"
+
+#include <mlpack/methods/hmm.hpp>
+#include <mlpack/methods/ann/ffn.hpp>
+#include <mlpack/methods/linear_svm.hpp>
+#include <mlpack/methods/hoeffding_trees/hoeffding_tree.hpp>
+#include <mlpack/methods/decision_tree/decision_tree.hpp>
+#include <ensmallen.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace mlpack;
+
+namespace mlmat_bench {
+
+static std::atomic<std::size_t> g_allocations { 0 };
+
+void* counted_malloc(std::size_t n) {
+    g_allocations++;
+    return std::malloc(n);
+}
+
+void counted_free(void* p) {
+    std::free(p);
+}
+
+std::size_t allocation_count() {
+    return g_allocations.load();
+}
+
+}
+
+void* operator new(std::size_t n) {
+    mlmat_bench::g_allocations++;
+    if(void* p = std::malloc(n ? n : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+
+namespace {
+
+long peak_rss_kb() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return long(pmc.PeakWorkingSetSize / 1024);
+    }
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return long(usage.ru_maxrss / 1024);//bytes on macOS
+#else
+    return long(usage.ru_maxrss);
+#endif
+#endif
+}
+
+const char* type_name(const mlmat::cell_type type) {
+    switch(type) {
+        case mlmat::cell_type::char8: return "char";
+        case mlmat::cell_type::long32: return "long";
+        case mlmat::cell_type::float32: return "float32";
+        case mlmat::cell_type::float64: return "float64";
+        default: return "unknown";
+    }
+}
+
+struct options {
+    std::string filter;
+    double min_time_ms = 200.;
+    bool quick = false;
+};
+
+struct result {
+    std::string name;
+    std::string type;       //empty when the benchmark works on arma data only
+    int mode = -1;          //-1 when the benchmark works on arma data only
+    long features = 0;
+    long cells = 0;
+    size_t iterations = 0;
+    double ns_per_iter = 0.;
+    double allocations_per_iter = 0.;
+    long peak_rss_kb = 0;
+};
+
+void print(const result& r) {
+    std::cout << "{\"benchmark\":\"" << r.name << "\"";
+    if(!r.type.empty()) {
+        std::cout << ",\"type\":\"" << r.type << "\"";
+    }
+    if(r.mode >= 0) {
+        std::cout << ",\"mode\":" << r.mode;
+    }
+    std::cout << ",\"features\":" << r.features
+    << ",\"cells\":" << r.cells
+    << ",\"iterations\":" << r.iterations
+    << ",\"ns_per_iter\":" << r.ns_per_iter
+    << ",\"ns_per_cell\":" << (r.cells ? r.ns_per_iter / r.cells : 0.)
+    << ",\"allocations_per_iter\":" << r.allocations_per_iter
+    << ",\"peak_rss_kb\":" << r.peak_rss_kb
+    << "}" << std::endl;
+}
+
+class runner {
+public:
+    explicit runner(const options& opts) : m_opts(opts) {}
+
+    bool wanted(const std::string& name) const {
+        return m_opts.filter.empty() || name.find(m_opts.filter) != std::string::npos;
+    }
+
+    // calls f in doubling batches until min_time has passed. the first call is not
+    // timed, objects size their buffers on the first frame and reuse them after that
+    template <typename F>
+    void run(result r, F&& f) {
+        typedef std::chrono::steady_clock clock;
+
+        if(!wanted(r.name)) {
+            return;
+        }
+
+        f();
+
+        const double min_ns = m_opts.min_time_ms * 1e6;
+        const size_t allocations = mlmat_bench::allocation_count();
+        size_t batch = 1;
+        double elapsed = 0.;
+        const auto start = clock::now();
+
+        while(elapsed < min_ns) {
+            for(size_t i=0;i<batch;i++) {
+                f();
+            }
+            r.iterations += batch;
+            elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            batch *= 2;
+        }
+
+        r.ns_per_iter = elapsed / r.iterations;
+        r.allocations_per_iter = double(mlmat_bench::allocation_count() - allocations) / r.iterations;
+        r.peak_rss_kb = peak_rss_kb();
+        print(r);
+    }
+
+private:
+    options m_opts;
+};
+
+
+/*
+ a block of cells laid out the way a jitter matrix holding features x cells
+ would be in the given mode. rows are padded to 16 bytes like jitter does.
+ */
+struct jit_buffer {
+    std::vector<unsigned char> storage;
+    mlmat::matrix_desc desc;
+};
+
+jit_buffer make_buffer(const mlmat::cell_type type, const int mode, const long features, const long cells) {
+    jit_buffer b;
+    mlmat::matrix_desc& d = b.desc;
+    d.type = type;
+
+    switch(mode) {
+        case 0:
+            d.planecount = features;
+            d.dimcount = 1;
+            d.dim[0] = cells;
+            break;
+        case 1:
+            d.dimcount = 2;
+            d.dim[0] = features;
+            d.dim[1] = cells;
+            break;
+        default:
+            d.dimcount = 2;
+            d.dim[0] = cells;
+            d.dim[1] = features;
+            break;
+    }
+
+    d.dimstride[0] = d.planecount * mlmat::cell_size(type);
+    d.dimstride[1] = ((d.dim[0] * d.dimstride[0]) + 15) & ~15L;
+    const long rows = (d.dimcount > 1) ? d.dim[1] : 1;
+    b.storage.assign(d.dimstride[1] * rows, 0);
+    d.data = b.storage.data();
+
+    mlmat::type_dispatch(type, [&](auto tag) {
+        typedef std::remove_pointer_t<decltype(tag)> T;
+        for(long r=0;r<rows;r++) {
+            T* p = reinterpret_cast<T*>(d.data + (r * d.dimstride[1]));
+            for(long i=0;i<d.dim[0]*d.planecount;i++) {
+                p[i] = T(std::rand() % 100);
+            }
+        }
+    });
+    return b;
+}
+
+const mlmat::cell_type all_types[] = {
+    mlmat::cell_type::char8,
+    mlmat::cell_type::long32,
+    mlmat::cell_type::float32,
+    mlmat::cell_type::float64
+};
+
+
+void bench_conversions(runner& bench, const std::vector<long>& sizes, const long features) {
+    for(int mode=0;mode<3;mode++) {
+        for(auto cells : sizes) {
+            for(auto type : all_types) {
+                jit_buffer in = make_buffer(type, mode, features, cells);
+                arma::mat dat;
+                arma::Mat<size_t> labels;
+
+                bench.run({"to_arma", type_name(type), mode, features, cells}, [&]() {
+                    mlmat::to_arma(mode, in.desc, dat);
+                });
+                bench.run({"to_arma_size_t", type_name(type), mode, features, cells}, [&]() {
+                    mlmat::to_arma(mode, in.desc, labels);
+                });
+
+                if(type == mlmat::cell_type::float64) {
+                    bench.run({"to_arma_view", type_name(type), mode, features, cells}, [&]() {
+                        mlmat::to_arma_view(mode, in.desc, dat);
+                    });
+                    dat.reset();
+                }
+            }
+
+            arma::mat dat(features, cells, arma::fill::randu);
+            arma::Mat<size_t> labels = arma::randi<arma::Mat<size_t>>(features, cells, arma::distr_param(0, 99));
+            for(auto type : all_types) {
+                jit_buffer out = make_buffer(type, mode, features, cells);
+                bench.run({"from_arma", type_name(type), mode, features, cells}, [&]() {
+                    mlmat::from_arma(mode, dat, out.desc);
+                });
+                bench.run({"from_arma_size_t", type_name(type), mode, features, cells}, [&]() {
+                    mlmat::from_arma(mode, labels, out.desc);
+                });
+            }
+        }
+    }
+}
+
+
+void bench_lookup(runner& bench, const std::vector<long>& sizes, const long features, const long references) {
+    arma::mat data(features, references, arma::fill::randu);
+    for(auto cells : sizes) {
+        jit_buffer in = make_buffer(mlmat::cell_type::long32, 0, 1, cells);
+        arma::Col<arma::uword> query;
+        arma::mat resulting;
+        bench.run({"lookup", type_name(in.desc.type), 0, features, cells}, [&]() {
+            mlmat::to_arma_limit(0, in.desc, query, references, 1);
+            query.clamp(0, data.n_cols-1);
+            resulting = data.cols(query);
+        });
+    }
+}
+
+
+void bench_scalers(runner& bench, const std::vector<long>& sizes, const arma::mat& training) {
+    const char* scalers[] = {"standard", "min_max", "normalization", "abs", "pca_whitening", "zca_whitening"};
+    for(auto name : scalers) {
+        auto scaler = mlmat::make_scaler(name, 0, 1, 0.00001);
+        scaler->Fit(training);
+        for(auto cells : sizes) {
+            arma::mat query(training.n_rows, cells, arma::fill::randu);
+            arma::mat scaled;
+            bench.run({std::string("scaling.") + name, "", -1, long(training.n_rows), cells}, [&]() {
+                mlmat::scaler_transform(scaler.get(), query, scaled);
+            });
+            bench.run({std::string("scaling_inverse.") + name, "", -1, long(training.n_rows), cells}, [&]() {
+                mlmat::scaler_inverse_transform(scaler.get(), query, scaled);
+            });
+        }
+    }
+}
+
+
+// times f(query) for each of queries under name, f keeps its buffers between calls so
+// only the first (untimed) call of each size allocates them
+template <typename F>
+void run_queries(runner& bench, const std::string& name, const std::vector<arma::mat>& queries, F&& f) {
+    for(auto& query : queries) {
+        bench.run({name, "", -1, long(query.n_rows), long(query.n_cols)}, [&]() {
+            f(query);
+        });
+    }
+}
+
+// builds IndexType over training with params and times finding the k neighbors of each of queries
+template <typename IndexType>
+void bench_index(runner& bench, const std::string& name, const arma::mat& training, const std::vector<arma::mat>& queries,
+                 const mlmat::neighbor_search_params& params, const size_t k,
+                 const mlmat::neighbor_query_params& query_params = mlmat::neighbor_query_params()) {
+    if(!bench.wanted(name)) {
+        return;
+    }
+    IndexType model;
+    mlmat::build_neighbor_model(model, params, arma::mat(training));
+    arma::Mat<size_t> neighbors;
+    arma::mat distances;
+    run_queries(bench, name, queries, [&](const arma::mat& query) {
+        //the objects hand over their scaled copy of the query
+        arma::mat q = query;
+        mlmat::search_neighbors(model, std::move(q), k, query_params, neighbors, distances);
+    });
+}
+
+template <typename ModelType>
+void bench_neighbors(runner& bench, const std::string& name, const std::vector<arma::mat>& queries, const arma::mat& training) {
+    const char* trees[] = {"kd", "ball", "cover", "r", "vp", "rp", "max-rp", "ub", "oct"};
+    for(auto tree : trees) {
+        const std::string full_name = name + "." + tree;
+        if(!bench.wanted(full_name)) {
+            continue;
+        }
+        ModelType model;
+        mlmat::neighbor_search_params params;
+        params.tree_type = tree;
+        mlmat::build_neighbor_model(model, params, arma::mat(training));
+
+        arma::Mat<size_t> neighbors;
+        arma::mat distances;
+        run_queries(bench, full_name, queries, [&](const arma::mat& query) {
+            arma::mat q = query;
+            mlmat::search_neighbors(model, std::move(q), 5, neighbors, distances);
+        });
+    }
+}
+
+
+void bench_models(runner& bench, const std::vector<long>& sizes, const arma::mat& training) {
+    const long features = training.n_rows;
+    const size_t classes = 4;
+
+    //cluster the training set so the classifiers have labels that mean something
+    mlmat::kmeans_params kparams;
+    arma::Row<size_t> labels;
+    arma::mat centroids;
+    mlmat::kmeans_cluster(kparams, training, classes, labels, centroids, false, false);
+
+    std::vector<arma::mat> queries;
+    for(auto cells : sizes) {
+        queries.emplace_back(features, cells, arma::fill::randu);
+    }
+
+    bench_neighbors<mlmat::knn_model>(bench, "knn", queries, training);
+    bench_neighbors<mlmat::kfn_model>(bench, "kfn", queries, training);
+
+    if(bench.wanted("knn.appended")) {
+        //a full append_buffer of points searched next to the kd tree
+        mlmat::knn_model model;
+        mlmat::build_neighbor_model(model, mlmat::neighbor_search_params(), arma::mat(training));
+        const arma::mat appended(features, 1024, arma::fill::randu);
+        arma::Mat<size_t> neighbors;
+        arma::mat distances;
+        run_queries(bench, "knn.appended", queries, [&](const arma::mat& query) {
+            arma::mat q = query;
+            mlmat::search_neighbors(model, appended, std::move(q), 5, neighbors, distances);
+        });
+    }
+
+    mlmat::neighbor_search_params hnsw;
+    hnsw.tree_type = "hnsw";
+    bench_index<mlmat::knn_index>(bench, "knn.hnsw", training, queries, hnsw, 10);
+
+    //the graph with its points kept as 8 byte codes, reranked with a float32 copy
+    mlmat::neighbor_search_params pq = hnsw;
+    pq.storage = "pq";
+    pq.rerank = true;
+    bench_index<mlmat::knn_index>(bench, "knn.hnsw.pq", training, queries, pq, 10);
+
+    if(bench.wanted("knn.range")) {
+        //every point within the mean distance to the 10th neighbor, from a kd range tree
+        mlmat::knn_index model;
+        mlmat::neighbor_search_params params;
+        params.range = true;
+        mlmat::build_neighbor_model(model, params, arma::mat(training));
+        arma::Mat<size_t> nearest;
+        arma::mat nearest_distances;
+        mlmat::search_neighbors(model, arma::mat(queries.front()), 10, mlmat::neighbor_query_params(), nearest, nearest_distances);
+        const double radius = arma::mean(nearest_distances.row(9));
+        const arma::mat none;
+        arma::Row<size_t> offsets;
+        arma::Row<size_t> neighbors;
+        arma::Row<double> distances;
+        run_queries(bench, "knn.range", queries, [&](const arma::mat& query) {
+            arma::mat q = query;
+            mlmat::search_range(model, nullptr, none, std::move(q), radius, mlmat::neighbor_query_params(), offsets, neighbors, distances);
+        });
+    }
+
+    if(bench.wanted("knn.coherent")) {
+        //the graph started from last frame's neighbors, with the query moving a little every frame
+        mlmat::knn_index model;
+        mlmat::build_neighbor_model(model, hnsw, arma::mat(training));
+        for(auto& query : queries) {
+            arma::Mat<size_t> neighbors;
+            arma::Mat<size_t> previous;
+            arma::mat distances;
+            arma::mat moving = query;
+            arma::mat step(query.n_rows, query.n_cols);
+            mlmat::neighbor_query_params query_params;
+            mlmat::search_neighbors(model, arma::mat(moving), 10, query_params, previous, distances);
+            query_params.previous = &previous;
+            run_queries(bench, "knn.coherent", {query}, [&](const arma::mat&) {
+                step.randn();
+                moving += step * .001;
+                arma::mat q = moving;
+                mlmat::search_neighbors(model, std::move(q), 10, query_params, neighbors, distances);
+                previous = neighbors;
+            });
+        }
+    }
+
+    if(bench.wanted("knn.threads")) {
+        //a single tree kd tree and the graph split across every core
+        mlmat::worker_pool workers(std::thread::hardware_concurrency());
+        mlmat::neighbor_query_params query_params;
+        query_params.workers = &workers;
+        for(auto tree : {"kd", "hnsw"}) {
+            mlmat::neighbor_search_params params;
+            params.tree_type = tree;
+            params.algorithm = "single_tree";
+            bench_index<mlmat::knn_index>(bench, std::string("knn.threads.") + tree, training, queries, params, 10, query_params);
+        }
+    }
+
+    //the approximate furthest neighbor engines, from their 25 candidates
+    for(auto algorithm : {"drusilla", "qdafn"}) {
+        mlmat::neighbor_search_params params;
+        params.algorithm = algorithm;
+        bench_index<mlmat::kfn_index>(bench, std::string("kfn.") + algorithm, training, queries, params, 1);
+    }
+
+    if(bench.wanted("kmeans")) {
+        arma::Row<size_t> assignments;
+        arma::mat c;
+        run_queries(bench, "kmeans", queries, [&](const arma::mat& query) {
+            mlmat::kmeans_cluster(kparams, query, classes, assignments, c, false, false);
+        });
+    }
+
+    if(bench.wanted("kmeans.init")) {
+        //full clustering of the training set from each way of picking the starting centroids
+        for(const char* init : {"sample", "kmeans++", "kmeans||"}) {
+            mlmat::kmeans_params iparams = kparams;
+            iparams.init = init;
+            arma::Row<size_t> assignments;
+            arma::mat c;
+            run_queries(bench, std::string("kmeans.init.") + init, {training}, [&](const arma::mat& points) {
+                mlmat::kmeans_cluster(iparams, points, classes, assignments, c, false, false);
+            });
+        }
+    }
+
+    if(bench.wanted("kmeans.threads")) {
+        //the naive lloyd step split across every core
+        mlmat::worker_pool workers(std::thread::hardware_concurrency());
+        mlmat::kmeans_params tparams = kparams;
+        tparams.workers = &workers;
+        arma::Row<size_t> assignments;
+        arma::mat c;
+        run_queries(bench, "kmeans.threads", {training}, [&](const arma::mat& points) {
+            mlmat::kmeans_cluster(tparams, points, classes, assignments, c, false, false);
+        });
+    }
+
+    if(bench.wanted("kmeans.predict")) {
+        //nearest centroid only, against the centroids the training set was clustered into
+        arma::mat cross;
+        arma::rowvec norms;
+        arma::Row<size_t> assignments;
+        run_queries(bench, "kmeans.predict", queries, [&](const arma::mat& query) {
+            mlmat::kmeans_assign(centroids, query, assignments, cross, norms);
+        });
+    }
+
+    if(bench.wanted("kmeans.minibatch")) {
+        //one mini-batch step per frame against centroids kept from the training set
+        for(auto& query : queries) {
+            mlmat::kmeans_minibatch stream;
+            arma::Row<size_t> assignments;
+            stream.update(training, classes, 1., assignments);
+            run_queries(bench, "kmeans.minibatch", {query}, [&](const arma::mat& batch) {
+                stream.update(batch, classes, .99, assignments);
+            });
+        }
+    }
+
+    if(bench.wanted("gmm")) {
+        GMM gmm(classes, features);
+        gmm.Train(training, 1);
+        arma::Row<double> probs, logprobs;
+        arma::Row<size_t> predicted;
+        arma::mat likelihoods;
+        run_queries(bench, "gmm.score", queries, [&](const arma::mat& query) {
+            mlmat::gmm_score(gmm, query, probs, logprobs);
+        });
+        run_queries(bench, "gmm.classify", queries, [&](const arma::mat& query) {
+            mlmat::gmm_classify(gmm, query, predicted);
+        });
+        //scoring and classifying from one batched pass, on one thread and across every core
+        mlmat::gmm_scorer scorer;
+        scorer.prepare(gmm);
+        mlmat::worker_pool workers(std::thread::hardware_concurrency());
+        run_queries(bench, "gmm.batched", queries, [&](const arma::mat& query) {
+            scorer.score(query, likelihoods, probs, logprobs);
+            mlmat::gmm_classify(likelihoods, predicted);
+        });
+        run_queries(bench, "gmm.batched.threads", queries, [&](const arma::mat& query) {
+            scorer.score(query, likelihoods, probs, logprobs, &workers);
+            mlmat::gmm_classify(likelihoods, predicted);
+        });
+    }
+
+    if(bench.wanted("gmm.train")) {
+        //four EM trials on the training set, one after another and side by side on every core
+        for(size_t threads : {size_t(1), size_t(std::thread::hardware_concurrency())}) {
+            mlmat::gmm_train_params params;
+            params.gaussians = classes;
+            params.trials = 4;
+            params.seed = 1;
+            params.threads = threads;
+            GMM gmm(classes, features);
+            run_queries(bench, threads == 1 ? "gmm.train" : "gmm.train.threads", {training}, [&](const arma::mat& points) {
+                mlmat::gmm_train(params, points, gmm);
+            });
+        }
+    }
+
+    if(bench.wanted("hmm")) {
+        HMM<GaussianDistribution> hmm(classes, GaussianDistribution(features));
+        std::vector<arma::mat> sequences { training };
+        hmm.Train(sequences);
+        double loglik = 0.;
+        run_queries(bench, "hmm", queries, [&](const arma::mat& query) {
+            loglik += hmm.LogLikelihood(query);
+        });
+    }
+
+    if(bench.wanted("som")) {
+        for(auto& query : queries) {
+            mlmat::SOM som(10, 10, features, 1, 5);
+            arma::mat q = query;
+            run_queries(bench, "som", {query}, [&](const arma::mat&) {
+                som.run_batch_knn(q);
+            });
+        }
+    }
+
+    if(bench.wanted("mlp_classifier")) {
+        FFN<> model;
+        model.Add<Linear>(32);
+        model.Add<Sigmoid>();
+        model.Add<Linear>(classes);
+        model.Add<LogSoftMax>();
+        model.Reset(features);
+        arma::mat likelihoods;
+        run_queries(bench, "mlp_classifier", queries, [&](const arma::mat& query) {
+            model.Predict(query, likelihoods);
+        });
+    }
+
+    if(bench.wanted("linear_svm")) {
+        LinearSVM<> svm(training, labels, classes);
+        arma::Row<size_t> predictions;
+        arma::mat scores;
+        run_queries(bench, "linear_svm", queries, [&](const arma::mat& query) {
+            svm.Classify(query, predictions, scores);
+        });
+    }
+
+    if(bench.wanted("hoeffding_tree")) {
+        data::DatasetInfo info(features);
+        HoeffdingTree<> tree(training, info, labels, classes);
+        arma::Row<size_t> predictions;
+        arma::Row<double> probabilities;
+        run_queries(bench, "hoeffding_tree", queries, [&](const arma::mat& query) {
+            tree.Classify(query, predictions, probabilities);
+        });
+    }
+
+    if(bench.wanted("id3_tree")) {
+        DecisionTree<> tree(training, labels, classes);
+        arma::Row<size_t> predictions;
+        arma::mat probabilities;
+        run_queries(bench, "id3_tree", queries, [&](const arma::mat& query) {
+            tree.Classify(query, predictions, probabilities);
+        });
+    }
+
+    if(bench.wanted("pca")) {
+        pca::PCA_EXT<> p(false);
+        arma::mat dataset;
+        arma::vec eigval;
+        arma::mat eigvec;
+        run_queries(bench, "pca", queries, [&](const arma::mat& query) {
+            //the object reduces the incoming matrix in place
+            dataset = query;
+            p.Apply(dataset, eigval, eigvec, features / 2);
+        });
+    }
+}
+
+bool parse_args(int argc, char** argv, options& opts) {
+    for(int i=1;i<argc;i++) {
+        const std::string arg = argv[i];
+        if(arg.rfind("--filter=", 0) == 0) {
+            opts.filter = arg.substr(9);
+        } else if(arg.rfind("--min-time=", 0) == 0) {
+            opts.min_time_ms = std::atof(arg.c_str() + 11);
+        } else if(arg == "--quick") {
+            opts.quick = true;
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--filter=<substring>] [--min-time=<ms>] [--quick]" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+
+int main(int argc, char** argv) {
+    options opts;
+    if(!parse_args(argc, argv, opts)) {
+        return 1;
+    }
+
+    std::srand(1);
+    mlpack::RandomSeed(1);
+
+    const long features = 8;
+    const long references = opts.quick ? 512 : 2048;
+    const std::vector<long> conversion_sizes = opts.quick ? std::vector<long>{64, 1024} : std::vector<long>{64, 1024, 16384};
+    const std::vector<long> model_sizes = opts.quick ? std::vector<long>{64} : std::vector<long>{64, 1024};
+
+    runner bench(opts);
+    arma::mat training(features, references, arma::fill::randu);
+
+    bench_conversions(bench, conversion_sizes, features);
+    bench_lookup(bench, conversion_sizes, features, references);
+    bench_scalers(bench, model_sizes, training);
+    bench_models(bench, model_sizes, training);
+
+    return 0;
+}
@@ -0,0 +1,882 @@
+/// @file mlmat_check.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+/*
+ checks what the core promises beyond speed, the things mlmat_bench only times.
+ prints a line per failed check and exits with the number of failures, so it runs
+ as a ctest test.
+
+ usage: mlmat_check [--filter=<substring>]
+ */
+
+#include "core/gmm.hpp"
+#include "core/kmeans.hpp"
+#include "core/neighbor_search.hpp"
+#include "core/reference_file.hpp"
+#include "core/result_cache.hpp"
+#include "core/scaler.hpp"
+#include "core/trainer.hpp"
+#include "core/worker_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+std::string g_filter;
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+void check(const bool passed, const char* what, const char* file, const int line) {
+    if(!passed) {
+        std::cerr << file << ":" << line << ": failed: " << what << std::endl;
+        g_failures++;
+    }
+}
+
+bool wanted(const std::string& name) {
+    return g_filter.empty() || name.find(g_filter) != std::string::npos;
+}
+
+// every part runs exactly once per run, also after the pool has been resized between runs
+void check_worker_pool() {
+    mlmat::worker_pool pool(2);
+    const size_t parts = 64;
+
+    auto run_all = [&](const size_t threads) {
+        pool.resize(threads);
+        // gives the new threads time to wake up wrongly before the run, if they are going to
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        std::vector<std::atomic<int>> calls(parts);
+        for(auto& c : calls) {
+            c = 0;
+        }
+        pool.run(parts, [&](const size_t i) {
+            calls[i]++;
+        });
+        for(size_t i = 0; i < parts; i++) {
+            CHECK(calls[i] == 1);
+        }
+    };
+
+    run_all(2);
+    run_all(1);
+    run_all(3);
+    run_all(3);
+    run_all(5);
+    run_all(2);
+
+    bool thrown = false;
+    try {
+        pool.run(parts, [](const size_t i) {
+            if(i == 7) {
+                throw std::runtime_error("part 7");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    run_all(4);
+
+    // threads started by a resize right before a run used to wake for the runs before they existed
+    for(size_t i = 0; i < 200; i++) {
+        run_all(1 + i % 4);
+    }
+}
+
+// a model the job finished is taken once. cancel drops one nobody took yet, which is what clear does
+// before adopt_trained_model looks, so clear then adopt publishes nothing. a job cancelled while
+// running hands nothing over either
+void check_trainer() {
+    typedef mlmat::trainer<arma::mat> trainer_type;
+    std::atomic<bool> release { true };
+    auto job = [&](mlmat::training_status&) {
+        while(!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        auto trained = std::make_unique<trainer_type::result_type>();
+        trained->model = std::make_unique<arma::mat>(2, 2, arma::fill::ones);
+        return trained;
+    };
+    auto finish = [](trainer_type& trainer) {
+        while(trainer.running()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+    trainer_type trainer;
+
+    CHECK(trainer.start(job, []() {}));
+    finish(trainer);
+    auto taken = trainer.take();
+    CHECK(taken && taken->model);
+    CHECK(!trainer.take());
+
+    CHECK(trainer.start(job, []() {}));
+    finish(trainer);
+    CHECK(trainer.cancel());
+    CHECK(!trainer.take());
+    CHECK(!trainer.cancel());
+
+    release = false;
+    CHECK(trainer.start(job, []() {}));
+    CHECK(!trainer.start(job, []() {}));
+    CHECK(trainer.cancel());
+    release = true;
+    finish(trainer);
+    CHECK(!trainer.take());
+}
+
+// fraction of the true 10 nearest a graph built with params finds for query, on one thread and split
+// across four, whichever is lower. bytes is what its points take
+double hnsw_recall(const arma::mat& training, const arma::mat& query, const mlmat::neighbor_search_params& params, size_t& bytes) {
+    mlmat::knn_index model;
+    mlmat::build_neighbor_model(model, params, arma::mat(training));
+    CHECK(model.size() == training.n_cols);
+    bytes = model.graph->point_bytes();
+
+    mlmat::worker_pool workers(4);
+    mlmat::neighbor_query_params query_params;
+    const double single = mlmat::neighbor_recall(model, query, 10, query_params);
+    query_params.workers = &workers;
+    return std::min(single, mlmat::neighbor_recall(model, query, 10, query_params));
+}
+
+void check_hnsw_recall(const arma::mat& training, const arma::mat& query) {
+    mlmat::neighbor_search_params params;
+    params.tree_type = "hnsw";
+    params.seed = 1;
+    size_t bytes = 0;
+    CHECK(hnsw_recall(training, query, params, bytes) >= .95);
+}
+
+// the graph keeping float32 points or product quantization codes still finds most of the true neighbors
+// in less memory, and reranking the codes' candidates with a float32 copy finds nearly all of them
+void check_hnsw_storage(const arma::mat& training, const arma::mat& query) {
+    mlmat::neighbor_search_params params;
+    params.tree_type = "hnsw";
+    params.seed = 1;
+    size_t float64_bytes = 0, float32_bytes = 0, pq_bytes = 0, rerank_bytes = 0;
+    hnsw_recall(training, query, params, float64_bytes);
+
+    params.storage = "float32";
+    CHECK(hnsw_recall(training, query, params, float32_bytes) >= .95);
+    CHECK(float32_bytes < float64_bytes);
+
+    params.storage = "pq";
+    CHECK(hnsw_recall(training, query, params, pq_bytes) >= .8);
+    CHECK(pq_bytes < float32_bytes);
+
+    params.rerank = true;
+    CHECK(hnsw_recall(training, query, params, rerank_bytes) >= .9);
+}
+
+// a query that moves a little each frame, searched from its neighbors in the frame before, finds as many
+// of the true neighbors as searching from the top of the graph, and every column starts from them
+void check_hnsw_coherent(const arma::mat& training, const arma::mat& query) {
+    mlmat::neighbor_search_params params;
+    params.tree_type = "hnsw";
+    params.seed = 1;
+    mlmat::knn_index model;
+    mlmat::build_neighbor_model(model, params, arma::mat(training));
+
+    mlmat::worker_pool workers(4);
+    mlmat::neighbor_query_params cold, warm;
+    arma::Mat<size_t> previous, neighbors;
+    arma::mat distances;
+    arma::mat moving = query;
+    CHECK(mlmat::search_neighbors(model, arma::mat(moving), 10, cold, previous, distances) == 0);
+    warm.previous = &previous;
+
+    const int frames = 16;
+    double cold_recall = 0., warm_recall = 0.;
+    for(int frame = 0; frame < frames; frame++) {
+        moving += .002 * arma::randn<arma::mat>(moving.n_rows, moving.n_cols);
+        cold_recall += mlmat::neighbor_recall(model, moving, 10, cold) / frames;
+        warm_recall += mlmat::neighbor_recall(model, moving, 10, warm) / frames;
+        warm.workers = frame % 2 ? &workers : nullptr;
+        CHECK(mlmat::search_neighbors(model, arma::mat(moving), 10, warm, neighbors, distances) == moving.n_cols);
+        previous = neighbors;
+    }
+    CHECK(cold_recall >= .95);
+    CHECK(warm_recall >= cold_recall - .02);
+}
+
+// a dual tree search split across workers searches the tree single tree, finds what one thread finds
+// and leaves the tree dual tree
+void check_tree_threads(const arma::mat& training, const arma::mat& query) {
+    mlmat::worker_pool workers(4);
+    mlmat::neighbor_search_params params;
+    mlmat::neighbor_query_params single, split;
+    split.workers = &workers;
+
+    mlmat::knn_index knn;
+    mlmat::build_neighbor_model(knn, params, arma::mat(training));
+    arma::Mat<size_t> neighbors, split_neighbors;
+    arma::mat distances, split_distances;
+    mlmat::search_neighbors(knn, arma::mat(query), 10, single, neighbors, distances);
+    mlmat::search_neighbors(knn, arma::mat(query), 10, split, split_neighbors, split_distances);
+    CHECK(neighbors.n_cols == query.n_cols && arma::all(arma::vectorise(neighbors == split_neighbors)));
+    CHECK(arma::approx_equal(distances, split_distances, "absdiff", 1e-12));
+    CHECK(knn.tree && knn.tree->SearchMode() == mlpack::DUAL_TREE_MODE);
+
+    mlmat::kfn_index kfn;
+    mlmat::build_neighbor_model(kfn, params, arma::mat(training));
+    mlmat::search_neighbors(kfn, arma::mat(query), 10, single, neighbors, distances);
+    mlmat::search_neighbors(kfn, arma::mat(query), 10, split, split_neighbors, split_distances);
+    CHECK(neighbors.n_cols == query.n_cols && arma::all(arma::vectorise(neighbors == split_neighbors)));
+    CHECK(arma::approx_equal(distances, split_distances, "absdiff", 1e-12));
+    CHECK(kfn.tree && kfn.tree->SearchMode() == mlpack::DUAL_TREE_MODE);
+}
+
+// drusilla and qdafn find points nearly as far as the true furthest neighbors exact kfn finds, with the
+// distances to the points they name, the same split across workers and again from the same seed
+void check_kfn_approximate(const arma::mat& training, const arma::mat& query) {
+    const size_t k = 10;
+    mlmat::worker_pool workers(4);
+    mlmat::neighbor_query_params single, split;
+    split.workers = &workers;
+
+    arma::Mat<size_t> exact;
+    arma::mat exact_distances;
+    mlmat::search_reference<mlpack::FurthestNeighborSort>(training, arma::mat(query), k, single, exact, exact_distances);
+
+    for(const char* algorithm : {"drusilla", "qdafn"}) {
+        mlmat::neighbor_search_params params;
+        params.algorithm = algorithm;
+        params.num_tables = 10;
+        params.num_projections = 30;
+        mlmat::kfn_index model, again;
+        mlpack::RandomSeed(2);
+        mlmat::build_neighbor_model(model, params, arma::mat(training));
+        mlpack::RandomSeed(2);
+        mlmat::build_neighbor_model(again, params, arma::mat(training));
+
+        arma::Mat<size_t> neighbors, split_neighbors, again_neighbors;
+        arma::mat distances, split_distances, again_distances;
+        mlmat::search_neighbors(model, arma::mat(query), k, single, neighbors, distances);
+        mlmat::search_neighbors(model, arma::mat(query), k, split, split_neighbors, split_distances);
+        mlmat::search_neighbors(again, arma::mat(query), k, single, again_neighbors, again_distances);
+        CHECK(neighbors.n_rows == k && neighbors.n_cols == query.n_cols);
+        if(neighbors.n_rows != k || neighbors.n_cols != query.n_cols) {
+            continue;
+        }
+        CHECK(arma::all(arma::vectorise(neighbors == split_neighbors)));
+        CHECK(arma::all(arma::vectorise(neighbors == again_neighbors)));
+
+        // a subset of the set, so its j-th furthest can not be further than the set's
+        bool named = true, bounded = true;
+        double ratio = 0.;
+        for(size_t i = 0; i < query.n_cols; i++) {
+            for(size_t j = 0; j < k; j++) {
+                const size_t n = neighbors(j, i);
+                named = named && n < training.n_cols &&
+                        std::abs(arma::norm(training.col(n) - query.col(i)) - distances(j, i)) <= 1e-9;
+                bounded = bounded && distances(j, i) <= exact_distances(j, i) * (1. + 1e-9);
+                ratio += distances(j, i) / exact_distances(j, i);
+            }
+        }
+        CHECK(named);
+        CHECK(bounded);
+        CHECK(ratio / double(k * query.n_cols) >= .9);
+    }
+}
+
+// a radius search finds what brute force finds within radius, nearest first, with offsets saying where
+// each query point's results start, also for a query point with nothing in range. over a range tree,
+// the graph and a flat set, with points appended after them, split across workers or not
+void check_search_range(const arma::mat& training, const arma::mat& query) {
+    const double radius = .4;
+    const arma::mat appended = training.cols(0, 63) + .01;
+    const arma::mat reference = arma::join_rows(training, appended);
+    arma::mat queries = query;
+    queries.col(0).fill(100.);
+
+    std::vector<std::vector<std::pair<double, size_t>>> expected(queries.n_cols);
+    size_t total = 0;
+    for(size_t i = 0; i < queries.n_cols; i++) {
+        for(size_t j = 0; j < reference.n_cols; j++) {
+            const double d = arma::norm(reference.col(j) - queries.col(i));
+            if(d <= radius) {
+                expected[i].emplace_back(d, j);
+            }
+        }
+        std::sort(expected[i].begin(), expected[i].end());
+        total += expected[i].size();
+    }
+    CHECK(expected[0].empty());
+    CHECK(total > queries.n_cols);
+
+    auto matches = [&](const arma::Row<size_t>& offsets, const arma::Row<size_t>& neighbors, const arma::Row<double>& distances) {
+        if(offsets.n_elem != queries.n_cols + 1 || offsets(0) != 0 || offsets(queries.n_cols) != neighbors.n_elem ||
+           distances.n_elem != neighbors.n_elem) {
+            return false;
+        }
+        for(size_t i = 0; i < queries.n_cols; i++) {
+            if(offsets(i + 1) - offsets(i) != expected[i].size()) {
+                return false;
+            }
+            for(size_t j = 0; j < expected[i].size(); j++) {
+                if(neighbors(offsets(i) + j) != expected[i][j].second ||
+                   std::abs(distances(offsets(i) + j) - expected[i][j].first) > 1e-9) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    mlmat::worker_pool workers(4);
+    mlmat::knn_index tree, graph, flat;
+    mlmat::neighbor_search_params params;
+    params.range = true;
+    mlmat::build_neighbor_model(tree, params, arma::mat(training));
+    CHECK(tree.range != nullptr);
+    params.range = false;
+    params.tree_type = "hnsw";
+    params.seed = 1;
+    mlmat::build_neighbor_model(graph, params, arma::mat(training));
+    flat.flat = std::make_shared<const arma::mat>(training);
+
+    for(mlmat::knn_index* model : {&tree, &graph, &flat}) {
+        for(mlmat::worker_pool* pool : {(mlmat::worker_pool*)nullptr, &workers}) {
+            mlmat::neighbor_query_params query_params;
+            query_params.workers = pool;
+            arma::Row<size_t> offsets, neighbors;
+            arma::Row<double> distances;
+            mlmat::search_range(*model, nullptr, appended, arma::mat(queries), radius, query_params, offsets, neighbors, distances);
+            CHECK(matches(offsets, neighbors, distances));
+        }
+    }
+    CHECK(!tree.range->SingleMode());
+}
+
+// points appended to a tree are found as brute force over the set with them added at the end finds
+// them, both while they are searched beside the tree and once the tree is rebuilt with them folded in
+void check_append(const arma::mat& training, const arma::mat& query) {
+    // close to the first query points, so they are among the neighbors found
+    const arma::mat appended = query.cols(0, 31) + .001;
+    const arma::mat reference = arma::join_rows(training, appended);
+    mlmat::worker_pool workers(4);
+    mlmat::neighbor_query_params single, split;
+    split.workers = &workers;
+
+    arma::Mat<size_t> expected;
+    arma::mat expected_distances;
+    mlmat::search_reference<mlpack::NearestNeighborSort>(reference, arma::mat(query), 10, single, expected, expected_distances);
+    CHECK(arma::any(arma::vectorise(expected >= training.n_cols)));
+
+    auto matches = [&](const arma::Mat<size_t>& neighbors, const arma::mat& distances) {
+        return neighbors.n_rows == expected.n_rows && neighbors.n_cols == expected.n_cols &&
+               arma::all(arma::vectorise(neighbors == expected)) &&
+               arma::approx_equal(distances, expected_distances, "absdiff", 1e-9);
+    };
+
+    for(const char* tree_type : {"kd", "ball"}) {
+        mlmat::neighbor_search_params params;
+        params.tree_type = tree_type;
+        mlmat::knn_index buffered, rebuilt;
+        mlmat::build_neighbor_model(buffered, params, arma::mat(training));
+        mlmat::build_neighbor_model(rebuilt, params, arma::mat(reference));
+
+        for(const mlmat::neighbor_query_params* query_params : {&single, &split}) {
+            arma::Mat<size_t> neighbors;
+            arma::mat distances;
+            mlmat::search_neighbors(buffered, appended, arma::mat(query), 10, *query_params, neighbors, distances);
+            CHECK(matches(neighbors, distances));
+            mlmat::search_neighbors(rebuilt, arma::mat(query), 10, *query_params, neighbors, distances);
+            CHECK(matches(neighbors, distances));
+        }
+    }
+}
+
+// a reference set written to a file reads back as the same points and settings, from a mapping of it
+void check_reference_file(const arma::mat& training, const arma::mat& query) {
+    const std::string path = (std::filesystem::temp_directory_path() / "mlmat_check.refs").string();
+    const std::string other = (std::filesystem::temp_directory_path() / "mlmat_check.txt").string();
+
+    mlmat::reference_file_settings written;
+    written.params.tree_type = "hnsw";
+    written.params.m = 24;
+    written.params.seed = 7;
+    written.dim0 = long(training.n_cols);
+    written.autoscale = true;
+    written.scaler = mlmat::make_scaler("standard", 0, 1, .00005);
+    written.scaler->Fit(training);
+    mlmat::write_reference_file(path, written, training.n_rows, training.n_cols,
+                                [&](const size_t first, const size_t count, arma::mat& out) {
+        out = training.cols(first, first + count - 1);
+    });
+    std::ofstream(other) << "not a reference set";
+    CHECK(mlmat::is_reference_file(path));
+    CHECK(!mlmat::is_reference_file(other));
+
+    mlmat::reference_file_settings read;
+    std::shared_ptr<const arma::mat> points = mlmat::read_reference_file(path, read);
+    CHECK(points && arma::approx_equal(*points, training, "absdiff", 0.));
+    CHECK(read.params.tree_type == "hnsw" && read.params.m == 24 && read.params.seed == 7);
+    CHECK(read.dim0 == written.dim0 && read.dimcount == 1 && read.autoscale);
+    CHECK(read.scaler != nullptr);
+    if(read.scaler) {
+        arma::mat q = query;
+        arma::mat expected, scaled;
+        mlmat::scaler_transform(written.scaler.get(), q, expected);
+        mlmat::scaler_transform(read.scaler.get(), q, scaled);
+        CHECK(arma::approx_equal(scaled, expected, "absdiff", 0.));
+    }
+    points.reset();
+
+    // a file missing the end of its points is refused instead of read past
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - sizeof(double));
+    bool thrown = false;
+    try {
+        mlmat::read_reference_file(path, read);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(other);
+}
+
+// a float64 matrix of m's columns, planes for its rows, over m's memory
+mlmat::matrix_desc describe(arma::mat& m) {
+    mlmat::matrix_desc d;
+    d.type = mlmat::cell_type::float64;
+    d.planecount = long(m.n_rows);
+    d.dimcount = 1;
+    d.dim[0] = long(m.n_cols);
+    mlmat::set_packed_strides(d);
+    d.data = reinterpret_cast<unsigned char*>(m.memptr());
+    return d;
+}
+
+// a hit is only ever the same input under the same key, the least recently used entry goes first,
+// and padding between rows is not part of an input
+void check_result_cache() {
+    mlmat::result_cache cache;
+    arma::mat a(4, 16, arma::fill::randu), b(4, 16, arma::fill::randu), c(4, 16, arma::fill::randu);
+    arma::mat out(2, 16, arma::fill::randu);
+    const std::vector<mlmat::matrix_desc> outputs { describe(out) };
+
+    // each input hashed once for a find and the store after it, as the objects do
+    auto find = [&cache](const mlmat::matrix_desc& input, const uint64_t key) {
+        return cache.find(input, mlmat::hash_cells(input), key);
+    };
+    auto store = [&cache, &outputs](const mlmat::matrix_desc& input, const uint64_t key) {
+        cache.store(input, mlmat::hash_cells(input), key, outputs);
+    };
+
+    cache.resize(2);
+    CHECK(find(describe(a), 1) == nullptr);
+    store(describe(a), 1);
+    const std::vector<mlmat::cached_matrix>* found = find(describe(a), 1);
+    CHECK(found && found->size() == 1 && (*found)[0].cells.size() == out.n_elem * sizeof(double));
+    if(found && found->size() == 1 && (*found)[0].cells.size() == out.n_elem * sizeof(double)) {
+        CHECK(std::memcmp((*found)[0].cells.data(), out.memptr(), out.n_elem * sizeof(double)) == 0);
+    }
+
+    // another key stands for a new model or changed attributes
+    CHECK(find(describe(a), 2) == nullptr);
+    // a changed cell is another input, also if it hashes the same
+    const uint64_t hash = mlmat::hash_cells(describe(a));
+    const double kept = a(3, 15);
+    a(3, 15) += 1.;
+    CHECK(cache.find(describe(a), hash, 1) == nullptr);
+    a(3, 15) = kept;
+    CHECK(find(describe(a), 1) != nullptr);
+    CHECK(cache.hits() == 2 && cache.misses() == 3);
+
+    store(describe(b), 1);
+    CHECK(find(describe(a), 1) != nullptr);
+    store(describe(c), 1);
+    CHECK(find(describe(a), 1) != nullptr);
+    CHECK(find(describe(b), 1) == nullptr);
+    CHECK(find(describe(c), 1) != nullptr);
+
+    cache.clear();
+    CHECK(find(describe(a), 1) == nullptr);
+    CHECK(find(describe(c), 1) == nullptr);
+
+    // rows of 5 chars padded to 16 bytes, with different bytes in the padding
+    std::vector<unsigned char> padded(48, 0), repadded(48, 0xff);
+    mlmat::matrix_desc first;
+    first.type = mlmat::cell_type::char8;
+    first.dimcount = 2;
+    first.dim[0] = 5;
+    first.dim[1] = 3;
+    first.dimstride[0] = 1;
+    first.dimstride[1] = 16;
+    mlmat::matrix_desc second = first;
+    for(size_t row = 0; row < 3; row++) {
+        for(size_t i = 0; i < 5; i++) {
+            padded[row * 16 + i] = repadded[row * 16 + i] = (unsigned char)(row * 5 + i);
+        }
+    }
+    first.data = padded.data();
+    second.data = repadded.data();
+    CHECK(mlmat::hash_cells(first) == mlmat::hash_cells(second));
+    store(first, 1);
+    CHECK(find(second, 1) != nullptr);
+
+    cache.resize(0);
+    store(first, 1);
+    CHECK(find(first, 1) == nullptr);
+}
+
+// points around blobs centers, each with every coordinate at 10 times its number, spread by .1.
+// point i is from blob i / per_blob
+arma::mat make_blobs(const size_t blobs, const size_t per_blob) {
+    arma::mat points(8, blobs * per_blob, arma::fill::randn);
+    points *= .1;
+    for(size_t i = 0; i < points.n_cols; i++) {
+        points.col(i) += 10. * double(i / per_blob);
+    }
+    return points;
+}
+
+// the blob a point or centroid is from
+size_t blob_of(const arma::vec& point) {
+    return size_t(std::lround(arma::mean(point) / 10.));
+}
+
+// kmeans++ and kmeans|| pick clusters of the points, one from each blob when there are as many blobs,
+// and pick the same ones again from the same seed
+void check_kmeans_seeding() {
+    const arma::mat points = make_blobs(4, 64);
+    mlmat::worker_pool workers(4);
+
+    for(const size_t rounds : {size_t(0), size_t(5)}) {
+        for(mlmat::worker_pool* pool : {(mlmat::worker_pool*)nullptr, &workers}) {
+            arma::mat centroids, again;
+            mlpack::RandomSeed(3);
+            mlmat::kmeans_plusplus(points, 4, rounds, 2., pool, centroids);
+            mlpack::RandomSeed(3);
+            mlmat::kmeans_plusplus(points, 4, rounds, 2., pool, again);
+            CHECK(centroids.n_rows == points.n_rows && centroids.n_cols == 4);
+            CHECK(arma::approx_equal(centroids, again, "absdiff", 0.));
+
+            std::set<size_t> blobs;
+            for(size_t c = 0; c < centroids.n_cols; c++) {
+                const arma::vec centroid = centroids.col(c);
+                // a point itself, not a mean of them
+                CHECK(arma::min(arma::sum(arma::abs(points.each_col() - centroid), 0)) == 0.);
+                blobs.insert(blob_of(centroid));
+            }
+            CHECK(blobs.size() == 4);
+        }
+    }
+
+    bool thrown = false;
+    try {
+        arma::mat centroids;
+        mlmat::kmeans_plusplus(points.cols(0, 2), 4, 0, 2., nullptr, centroids);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    // a whole clustering from either gives every blob its own cluster
+    for(const char* init : {"kmeans++", "kmeans||"}) {
+        mlmat::kmeans_params params;
+        params.init = init;
+        params.seed = 3;
+        arma::Row<size_t> assignments;
+        arma::mat centroids;
+        mlmat::kmeans_cluster(params, points, 4, assignments, centroids, false, false);
+        CHECK(assignments.n_elem == points.n_cols);
+        std::set<size_t> labels;
+        for(size_t b = 0; b < 4 && assignments.n_elem == points.n_cols; b++) {
+            const arma::Row<size_t> blob = assignments.cols(b * 64, b * 64 + 63);
+            CHECK(arma::all(blob == blob[0]));
+            labels.insert(blob[0]);
+        }
+        CHECK(labels.size() == 4);
+    }
+}
+
+// the naive lloyd step split across workers clusters the same as on one thread, and guesses that
+// do not fit the points are refused before they are read
+void check_kmeans_threads() {
+    const arma::mat points = make_blobs(4, 64);
+    mlmat::worker_pool workers(4);
+    mlmat::kmeans_params params;
+    params.seed = 5;
+    arma::Row<size_t> single, split;
+    arma::mat single_centroids, split_centroids;
+    mlmat::kmeans_cluster(params, points, 4, single, single_centroids, false, false);
+    params.workers = &workers;
+    mlmat::kmeans_cluster(params, points, 4, split, split_centroids, false, false);
+    CHECK(single.n_elem == points.n_cols && arma::all(single == split));
+    CHECK(arma::approx_equal(single_centroids, split_centroids, "absdiff", 1e-9));
+
+    auto refused = [&](arma::Row<size_t> assignments, arma::mat centroids, const bool assignment_guess) {
+        try {
+            mlmat::kmeans_cluster(params, points, 4, assignments, centroids, assignment_guess, !assignment_guess);
+        } catch (const std::invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    CHECK(refused(arma::Row<size_t>(points.n_cols - 1, arma::fill::zeros), arma::mat(), true));
+    CHECK(refused(arma::Row<size_t>(arma::ones<arma::Row<size_t>>(points.n_cols) * 4), arma::mat(), true));
+    CHECK(refused(arma::Row<size_t>(), arma::mat(points.n_rows, 3, arma::fill::zeros), false));
+    CHECK(refused(arma::Row<size_t>(), arma::mat(points.n_rows + 1, 4, arma::fill::zeros), false));
+    CHECK(!refused(single, arma::mat(), true));
+}
+
+// centroids in the order of the blobs they are in, empty when two are in the same blob
+arma::mat by_blob(const arma::mat& centroids) {
+    arma::mat ordered(centroids.n_rows, centroids.n_cols);
+    std::set<size_t> blobs;
+    for(size_t c = 0; c < centroids.n_cols; c++) {
+        const size_t b = blob_of(centroids.col(c));
+        if(b >= centroids.n_cols || !blobs.insert(b).second) {
+            return arma::mat();
+        }
+        ordered.col(b) = centroids.col(c);
+    }
+    return ordered;
+}
+
+// mini-batches of a shuffled stream move centroids started one to a blob to where lloyd ends. decay scales
+// the counts before each batch, with it the centroids follow blobs that move and without it they lag behind
+void check_kmeans_minibatch() {
+    const arma::mat points = make_blobs(4, 256);
+    const arma::mat stream = points.cols(arma::randperm(points.n_cols));
+    const size_t batch = 64;
+
+    mlmat::kmeans_params params;
+    params.seed = 3;
+    arma::Row<size_t> assignments;
+    arma::mat lloyd;
+    mlmat::kmeans_cluster(params, points, 4, assignments, lloyd, false, false);
+    lloyd = by_blob(lloyd);
+    CHECK(lloyd.n_cols == 4);
+    arma::mat start;
+    mlpack::RandomSeed(3);
+    mlmat::kmeans_plusplus(points, 4, 0, 2., nullptr, start);
+
+    mlmat::kmeans_minibatch kept;
+    kept.start_from(start);
+    for(int epoch = 0; epoch < 2; epoch++) {
+        for(size_t first = 0; first < stream.n_cols; first += batch) {
+            kept.update(stream.cols(first, first + batch - 1), 4, 1., assignments);
+        }
+    }
+    const arma::mat converged = by_blob(kept.centroids());
+    CHECK(converged.n_cols == 4 && lloyd.n_cols == 4 && arma::approx_equal(converged, lloyd, "absdiff", .01));
+    // started as if given a point each, then every point twice
+    CHECK(arma::accu(kept.counts()) == double(4 + 2 * points.n_cols));
+
+    // the same blobs moved by 1 along every dimension
+    mlmat::kmeans_minibatch decayed = kept;
+    const arma::mat moved = stream + 1.;
+    bool scaled = true;
+    for(size_t first = 0; first < moved.n_cols; first += batch) {
+        const arma::vec before = decayed.counts();
+        decayed.update(moved.cols(first, first + batch - 1), 4, .5, assignments);
+        arma::vec expected = .5 * before;
+        for(const size_t c : assignments) {
+            expected[c] += 1.;
+        }
+        scaled = scaled && arma::approx_equal(decayed.counts(), expected, "absdiff", 1e-9);
+        kept.update(moved.cols(first, first + batch - 1), 4, 1., assignments);
+    }
+    CHECK(scaled);
+    const arma::mat followed = by_blob(decayed.centroids());
+    const arma::mat lagging = by_blob(kept.centroids());
+    CHECK(followed.n_cols == 4 && lloyd.n_cols == 4 && arma::approx_equal(followed, lloyd + 1., "absdiff", .1));
+    // about a third of the way there, the points before the move still count as much as ever
+    CHECK(lagging.n_cols == 4 && lloyd.n_cols == 4 && arma::min(arma::vectorise(arma::abs(lagging - lloyd - 1.))) > .5);
+}
+
+// predict assigns new points to the nearest of a fixed model's centroids, the same as a brute force
+// search over them, and leaves the centroids as they were
+void check_kmeans_predict() {
+    const arma::mat points = make_blobs(4, 64);
+    mlmat::kmeans_params params;
+    params.seed = 7;
+    arma::Row<size_t> clustered;
+    mlmat::kmeans_model model;
+    mlmat::kmeans_cluster(params, points, 4, clustered, model.centroids, false, false);
+    const arma::mat fit = model.centroids;
+
+    const arma::mat fresh = make_blobs(4, 16);
+    arma::Row<size_t> assignments;
+    arma::mat cross;
+    arma::rowvec norms;
+    for(int pass = 0; pass < 2; pass++) {
+        mlmat::kmeans_assign(model.centroids, fresh, assignments, cross, norms);
+        CHECK(assignments.n_elem == fresh.n_cols);
+        for(size_t i = 0; i < fresh.n_cols && assignments.n_elem == fresh.n_cols; i++) {
+            const arma::rowvec distances = arma::sum(arma::square(model.centroids.each_col() - fresh.col(i)), 0);
+            CHECK(assignments[i] == distances.index_min());
+            CHECK(blob_of(model.centroids.col(assignments[i])) == i / 16);
+        }
+    }
+    CHECK(arma::approx_equal(model.centroids, fit, "absdiff", 0.));
+}
+
+// within tolerance of the larger of 1 and reference
+bool close_to(const double value, const double reference, const double tolerance) {
+    return std::abs(value - reference) <= tolerance * std::max(1., std::abs(reference));
+}
+
+// the batched scorer gives the probabilities and labels mlpack's GMM does, on one thread and split across four
+void check_gmm_scorer() {
+    const arma::mat points = make_blobs(4, 64);
+    const arma::mat query = make_blobs(4, 128);
+    mlpack::GMM gmm(4, points.n_rows);
+    gmm.Train(points, 1);
+
+    mlmat::gmm_scorer scorer;
+    CHECK(scorer.prepare(gmm));
+    if(!scorer.ready()) {
+        return;
+    }
+    arma::Row<size_t> expected_labels;
+    gmm.Classify(query, expected_labels);
+
+    mlmat::worker_pool workers(4);
+    for(mlmat::worker_pool* pool : {(mlmat::worker_pool*)nullptr, &workers}) {
+        arma::mat log_likelihoods;
+        arma::Row<double> probabilities, log_probabilities;
+        arma::Row<size_t> labels;
+        scorer.score(query, log_likelihoods, probabilities, log_probabilities, pool);
+        mlmat::gmm_classify(log_likelihoods, labels);
+        CHECK(log_likelihoods.n_rows == 4 && log_likelihoods.n_cols == query.n_cols);
+        CHECK(probabilities.n_elem == query.n_cols && log_probabilities.n_elem == query.n_cols);
+
+        size_t wrong = 0;
+        for(size_t i = 0; i < query.n_cols && probabilities.n_elem == query.n_cols; i++) {
+            const arma::vec column = query.col(i);
+            if(!close_to(log_probabilities[i], gmm.LogProbability(column), 1e-8) ||
+               !close_to(probabilities[i], gmm.Probability(column), 1e-8)) {
+                wrong++;
+            }
+        }
+        CHECK(wrong == 0);
+        CHECK(labels.n_elem == expected_labels.n_elem && arma::all(labels == expected_labels));
+    }
+}
+
+// EM trials run side by side give the model they give one after another, from the same seed
+void check_gmm_train() {
+    const arma::mat points = make_blobs(4, 64);
+    mlmat::gmm_train_params params;
+    params.gaussians = 4;
+    params.trials = 4;
+    params.seed = 11;
+
+    mlpack::GMM single(4, points.n_rows);
+    params.threads = 1;
+    const double likelihood = mlmat::gmm_train(params, points, single);
+    CHECK(std::isfinite(likelihood));
+
+    // up to a thread per trial. more would also split each trial's steps, which can round differently
+    for(const size_t threads : {size_t(2), size_t(4)}) {
+        mlpack::GMM side_by_side(4, points.n_rows);
+        params.threads = threads;
+        CHECK(mlmat::gmm_train(params, points, side_by_side) == likelihood);
+        CHECK(arma::approx_equal(side_by_side.Weights(), single.Weights(), "absdiff", 0.));
+        for(size_t g = 0; g < 4; g++) {
+            CHECK(arma::approx_equal(side_by_side.Component(g).Mean(), single.Component(g).Mean(), "absdiff", 0.));
+            CHECK(arma::approx_equal(side_by_side.Component(g).Covariance(), single.Component(g).Covariance(), "absdiff", 0.));
+        }
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    for(int i=1;i<argc;i++) {
+        const std::string arg = argv[i];
+        if(arg.rfind("--filter=", 0) == 0) {
+            g_filter = arg.substr(9);
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--filter=<substring>]" << std::endl;
+            return 1;
+        }
+    }
+
+    arma::arma_rng::set_seed(1);
+    mlpack::RandomSeed(1);
+    const arma::mat training(8, 2048, arma::fill::randu);
+    const arma::mat query(8, 256, arma::fill::randu);
+
+    if(wanted("worker_pool")) {
+        check_worker_pool();
+    }
+    if(wanted("trainer")) {
+        check_trainer();
+    }
+    if(wanted("hnsw.recall")) {
+        check_hnsw_recall(training, query);
+    }
+    if(wanted("hnsw.storage")) {
+        check_hnsw_storage(training, query);
+    }
+    if(wanted("hnsw.coherent")) {
+        check_hnsw_coherent(training, query);
+    }
+    if(wanted("tree.threads")) {
+        check_tree_threads(training, query);
+    }
+    if(wanted("kfn.approximate")) {
+        check_kfn_approximate(training, query);
+    }
+    if(wanted("search_range")) {
+        check_search_range(training, query);
+    }
+    if(wanted("append")) {
+        check_append(training, query);
+    }
+    if(wanted("reference_file")) {
+        check_reference_file(training, query);
+    }
+    if(wanted("result_cache")) {
+        check_result_cache();
+    }
+    if(wanted("kmeans.seeding")) {
+        check_kmeans_seeding();
+    }
+    if(wanted("kmeans.threads")) {
+        check_kmeans_threads();
+    }
+    if(wanted("kmeans.minibatch")) {
+        check_kmeans_minibatch();
+    }
+    if(wanted("kmeans.predict")) {
+        check_kmeans_predict();
+    }
+    if(wanted("gmm.scorer")) {
+        check_gmm_scorer();
+    }
+    if(wanted("gmm.train")) {
+        check_gmm_train();
+    }
+
+    if(g_failures) {
+        std::cerr << g_failures << " checks failed" << std::endl;
+    }
+    return g_failures;
+}
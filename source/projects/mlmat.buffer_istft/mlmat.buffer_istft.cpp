@@ -4,8 +4,9 @@
 /// @license  Use of this source code is governed by the MIT License found in the License.md file.
 
 
-#include <Accelerate/Accelerate.h>
 #include "c74_min.h"
+#include "matrix_conversions.hpp"
+#include "core/stft.hpp"
 #include <algorithm>
 #include <iostream>
 #include <iterator>
@@ -129,145 +130,42 @@ public:
         max::t_jit_matrix_info in_minfo;
         auto in_matrix = max::object_method(inputs, max::_jit_sym_getindex, 0);
         long in_savelock = (long) max::object_method(in_matrix, max::_jit_sym_lock, 1);
+        max::t_object* in_matrix32 = nullptr;
+        mlmat::stft_params params;
+        size_t output_length = 0;
        
         max::object_method(in_matrix,max::_jit_sym_getinfo, &in_minfo);
-        
-        size_t b_frame_count = full_spectrum ? (in_minfo.dim[0] * in_minfo.dim[1]) / 2 : (in_minfo.dim[0] * in_minfo.dim[1]);
-        size_t output_length = (b_frame_count*2) / overlap;
 
+        params.fftsize = fftsize;
+        params.overlap = overlap;
+        params.window = mlmat::window_from_string(window.get().c_str());
+        params.full_spectrum = full_spectrum;
+        params.polar = input_polar;
+
+        output_length = m_istft.sample_count(params, in_minfo.dim[0]);
         
         max::t_buffer_obj *buffer = max::buffer_ref_getobject(m_buffer_reference);
         
         max::object_method(static_cast<max::t_object*>(buffer), max::gensym("sizeinsamps"), (void*)output_length, 0);
     
         float *tab = buffer_locksamples(buffer);
-    
-        err = (max::t_jit_err)max::object_method(in_matrix, max::_jit_sym_getinfo, &in_minfo);
         
-        max::t_object* in_matrix32 = convert_to_float32(static_cast<max::t_object*>(in_matrix), in_minfo);
+        in_matrix32 = convert_to_float32(static_cast<max::t_object*>(in_matrix), in_minfo);
         
         err = (max::t_jit_err)max::object_method(in_matrix32, max::_jit_sym_getinfo, &in_minfo);
         
-        // what to do if error
-
-        // need to check fftsize to matrrix dims
-        
-        
         if (buffer && tab) {
-
-            max::t_atom_long b_channel_count = max::buffer_getchannelcount(buffer);
-            size_t chan = std::min<size_t>(channel - 1, b_channel_count);
-        
-            size_t step = fftsize / overlap;
-            size_t fftsize_2 = fftsize / 2;
-            
-            std::vector<float> in_real(b_frame_count+step);
-            std::vector<float> in_imag(b_frame_count+step);
-            
-            std::vector<float> frame_real(fftsize_2, 0.0f);
-            std::vector<float> frame_imag(fftsize_2, 0.0f);
-
-            m_samples.resize(b_frame_count+step);
-            m_samples.assign(b_frame_count+step, 0.0f);
-            std::vector<float>signal(fftsize);
-            std::vector<float> window_vector(fftsize);
-            
-            
-            size_t num_bins = fftsize_2;
-            
-            /* window */
-            
-            const string window_string = window.get().c_str();
-            
-            if(window_string == "triangle") {
-                float tristart = 0.0f;
-                float tritop = 1.0f;
-                float up = 1.0f/fftsize_2;
-                float down = -1.0f/fftsize_2;
-                vDSP_vramp(&tristart, &up,window_vector.data(), 1, fftsize_2);
-                vDSP_vramp(&tritop, &down,window_vector.data()+((fftsize/2)-1), 1, fftsize_2);
-            } else if (window_string == "hanning") {
-                vDSP_hann_window(window_vector.data(), fftsize, vDSP_HANN_NORM );
-            } else if (window_string == "hamming") {
-                vDSP_hamm_window(window_vector.data(), fftsize, 0);
-            } else if (window_string == "blackman") {
-                vDSP_blkman_window(window_vector.data(), fftsize, 0);
-            }
-            
-            vDSP_DFT_Setup tmp_setup = m_setup; m_setup = vDSP_DFT_zrop_CreateSetup(tmp_setup, fftsize, vDSP_DFT_INVERSE );
-            if(m_setup == 0) {
-                cerr << "fftsize " << fftsize << " is not valid." << endl;
-                goto out;
-            }
-            
-            if(tmp_setup != NULL) {
-                vDSP_DFT_DestroySetup(tmp_setup);
-            }
-            
-            // if full_spectrum just going to get half of matrix
-            
-            
-            DSPSplitComplex complex_input = { in_real.data(), in_imag.data()};
-            DSPSplitComplex complex_output = { frame_real.data(), frame_imag.data()};
-    
-            
-            /* write fft frames to vector*/
             max::uchar *dataptr = nullptr;
-            max::uchar *ip = nullptr;
-            float *fp = nullptr;
-            
-            err = (max::t_jit_err)max::object_method(in_matrix32, max::_jit_sym_getdata, &dataptr);
-
-            long buf_pos = 0;
 
-           // input_polar
-           
-            
-            if(input_polar) {
-                float r = 0.0;
-                float theta = 0.0;
-                for(auto width=0;width<in_minfo.dim[0];width++) {
-                    ip = dataptr + (width*in_minfo.dimstride[0]);
-                    for(auto height=0;height<num_bins;height++) {
-                        fp = (float*)ip;
-                        r = *fp++;
-                        theta = *fp++;
-                        in_real[buf_pos] = r * cos(theta);
-                        in_imag[buf_pos++] = r * sin(theta);
-                        ip = ip + in_minfo.dimstride[1];
-                    }
-                }
-                
-            } else {
-                for(auto width=0;width<in_minfo.dim[0];width++) {
-                    ip = dataptr + (width*in_minfo.dimstride[0]);
-                    for(auto height=0;height<num_bins;height++) {
-                        fp = (float*)ip;
-                        in_real[buf_pos] = *fp++;
-                        in_imag[buf_pos++] = *fp++;
-                        ip = ip + in_minfo.dimstride[1];
-                    }
-                }
+            err = (max::t_jit_err)max::object_method(in_matrix32, max::_jit_sym_getdata, &dataptr);
+            if(!dataptr) {
+                cerr << "invalid input matrix" << endl;
+                err = max::JIT_ERR_INVALID_INPUT;
+                goto out;
             }
-            float scaling = 1.0f / fftsize / overlap;
-            
-            for (auto i = 0, j=0; i < (b_frame_count+step); i+=fftsize_2, j+=step) {
-                
-                vDSP_DFT_Execute(m_setup,complex_input.realp+i, complex_input.imagp+i,complex_output.realp,complex_output.imagp);
 
-                vDSP_ztoc(&complex_output, 1, ( DSPComplex *)signal.data(), 2,fftsize_2);
-                
-                vDSP_vsmul(signal.data(), 1, &scaling, signal.data(), 1, fftsize);
-                
-                if (window_string != "square") {
-                    vDSP_vmul(signal.data(), 1, window_vector.data(), 1, signal.data(), 1, fftsize);
-                }
-                
-                
-                
-                vDSP_vadd(signal.data(), 1, m_samples.data()+j, 1, m_samples.data()+j, 1, fftsize);
-                
-            }
+            // if full_spectrum only the first half of each frame is read
+            m_istft.run(params, jit_matrix_desc(in_minfo, dataptr), m_samples);
             
             max::buffer_setdirty(buffer);
             update_buffer.set();
@@ -295,10 +193,6 @@ public:
     }
     
     ~mlmat_buffer_istft() {
-        if(m_setup != NULL) {
-            vDSP_DFT_DestroySetup(m_setup);
-        }
-        
         if(m_buffer_reference) {
             object_free(m_buffer_reference);
         }
@@ -381,7 +275,7 @@ private:
     }};
 
     
-    vDSP_DFT_Setup m_setup = NULL;
+    mlmat::istft m_istft;
     std::vector<float> m_samples;
 
 };
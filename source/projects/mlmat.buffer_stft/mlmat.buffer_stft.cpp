@@ -4,8 +4,9 @@
 /// @license  Use of this source code is governed by the MIT License found in the License.md file.
 
 
-#include <Accelerate/Accelerate.h>
 #include "c74_min.h"
+#include "matrix_conversions.hpp"
+#include "core/stft.hpp"
 #include <algorithm>
 #include <iostream>
 #include <iterator>
@@ -23,20 +24,6 @@ max::t_object* maxob_from_jitob(max::t_object* job) {
     return mwrap;
 }
 
-max::t_object* convert_to_float64(max::t_object *matrix, max::t_jit_matrix_info& minfo) {
-    max::t_object *m; // destination matrix
-    if(minfo.type == max::_jit_sym_float64) {
-        return matrix;
-    }
-    max::t_jit_matrix_info dest_info = minfo;
-    
-    dest_info.type = max::_jit_sym_float64;
-    m = static_cast<max::t_object*>(max::jit_object_new(max::_jit_sym_jit_matrix,&dest_info));
-    max::object_method(m, max::_jit_sym_frommatrix,matrix,NULL);
-    return m;
-}
-   
-
 void mlmat_assist(void* x, void* b, long m, long a, char* s) ;
 max::t_jit_err mlmat_matrix_calc(max::t_object* x, max::t_object* inputs, max::t_object* outputs);
 void mlmat_outputmatrix(max_jit_wrapper *x);
@@ -140,160 +127,37 @@ public:
         if (buffer && tab) {
             size_t b_frame_count = max::buffer_getframecount(buffer);
             max::t_atom_long b_channel_count = max::buffer_getchannelcount(buffer);
-            size_t chan = std::min<size_t>(channel - 1, b_channel_count);
-            
-            size_t step = fftsize/overlap;
-            size_t out_len = (((b_frame_count * overlap) + fftsize - 1) / fftsize) * fftsize;
-            size_t num_fft_frames = out_len / fftsize;
-            size_t fftsize_2 = fftsize / 2;
-            
+            size_t chan = std::min<size_t>(channel - 1, b_channel_count - 1);
+            c74::max::uchar *dataptr = nullptr;
+            mlmat::matrix_desc out_desc;
+            mlmat::stft_params params;
+
+            params.fftsize = fftsize;
+            params.overlap = overlap;
+            params.window = mlmat::window_from_string(window.get().c_str());
+            params.full_spectrum = full_spectrum;
+            params.polar = output_polar;
+
+            out_minfo.flags = 0;
             out_minfo.planecount = 2;
             out_minfo.dimcount = 2;
-            out_minfo.dim[0] = num_fft_frames;
-            out_minfo.type = max::_jit_sym_float32;
+            out_minfo.dim[0] = m_stft.frames(params, b_frame_count);
+            out_minfo.dim[1] = m_stft.bins(params);
+            out_minfo.type = max::_jit_sym_float64;
 
-            if(full_spectrum) {
-                out_minfo.dim[1] = fftsize ;
-            } else {
-                out_minfo.dim[1] = fftsize_2;
-            }
-        
-            vDSP_DFT_Setup tmp_setup = m_setup;
+            // the stft is written straight into the output as float64
+            jit_matrix_setinfo_if_changed(out_matrix, out_minfo);
+            max::object_method(out_matrix, max::_jit_sym_getinfo, &out_minfo);
+            max::object_method(out_matrix, max::_jit_sym_getdata, &dataptr);
 
-            m_setup = vDSP_DFT_zrop_CreateSetup(tmp_setup, fftsize, vDSP_DFT_FORWARD );
-            if(m_setup == 0) {
-                cerr << "fftsize " << fftsize << " is not valid." << endl;
-                goto out;
-            }
-            
-            if(tmp_setup != NULL) {
-                vDSP_DFT_DestroySetup(tmp_setup);
-            }
-            
-            std::vector<float> in_samples(fftsize);
-            std::vector<float> in_real(fftsize_2);
-            std::vector<float> in_imag(fftsize_2, 0.0f);
-            std::vector<float> out_real(fftsize_2);
-            std::vector<float> out_imag(fftsize_2);
-            std::vector<float> window_vector(fftsize);
-            std::vector<float> magnitudes(fftsize_2);
-            std::vector<float> phases(fftsize_2);
-            std::vector<float> out_magnitudes;
-            std::vector<float> out_phases;
-            
-            /* window */
-            
-            const string window_string = window.get().c_str();
-            
-            if(window_string == "triangle") {
-                float tristart = 0.0f;
-                float tritop = 1.0f;
-                float up = 1.0f/fftsize_2;
-                float down = -1.0f/fftsize_2;
-                vDSP_vramp(&tristart, &up,window_vector.data(), 1, fftsize/2);
-                vDSP_vramp(&tritop, &down,window_vector.data()+((fftsize/2)-1), 1, fftsize/2);
-            } else if (window_string == "hanning") {
-                vDSP_hann_window(window_vector.data(), fftsize, vDSP_HANN_NORM );
-            } else if (window_string == "hamming") {
-                vDSP_hamm_window(window_vector.data(), fftsize, 0);
-            } else if (window_string == "blackman") {
-                vDSP_blkman_window(window_vector.data(), fftsize, 0);
-            }
-            
-            DSPSplitComplex complex_input = { in_real.data(), in_imag.data()};
-            DSPSplitComplex complex_output = { out_real.data(), out_imag.data()};
-            
-            
-            for (auto i = 0; i < b_frame_count; i+=step) {
-                //get next N samples
-                if(i+fftsize > b_frame_count) {
-                    for(auto j=0;j<fftsize;j++) {
-                        if((i+j) > b_frame_count) {
-                            in_samples[j] = 0.0f;
-                        } else {
-                            in_samples[j] = tab[(i+j)*b_channel_count + chan];
-                        }
-                    }
-                }
-                else {
-                    for(auto j=0;j<fftsize;j++) {
-                        in_samples[j] = tab[(i+j)*b_channel_count + chan];
-                    }
-                }
-                //window
-                if (window_string != "square") {
-                    vDSP_vmul(in_samples.data(), 1, window_vector.data(), 1, in_samples.data(), 1, fftsize);
-                }
-                
-                //put into SplitComplex
-                vDSP_ctoz((DSPComplex *)in_samples.data(), 2, &complex_input, 1, fftsize_2);
-
-                // dft
-                vDSP_DFT_Execute(m_setup,complex_input.realp, complex_input.imagp,complex_output.realp,complex_output.imagp);
-            
-
-                float scale = .5;
-            
-                vDSP_vsmul(complex_output.realp, 1, &scale, complex_output.realp, 1, fftsize_2);
-                vDSP_vsmul(complex_output.imagp, 1, &scale, complex_output.imagp, 1, fftsize_2);
-         
-            
-                complex_output.imagp[0] = 0.0;
-                
-                if(output_polar) {
-                    
-                    vDSP_zvabs(&complex_output, 1, magnitudes.data(), 1, fftsize_2);  // Compute magnitude
-                    vDSP_zvphas(&complex_output, 1, phases.data(), 1, fftsize_2);  // Compute phase (radians)
-                    std::copy(magnitudes.begin(), magnitudes.end(), std::back_inserter(out_magnitudes));
-                    std::copy(phases.begin(), phases.end(), std::back_inserter(out_phases));
-                    if(full_spectrum) {
-                        std::copy(magnitudes.rbegin(), magnitudes.rend(), std::back_inserter(out_magnitudes));
-                        std::copy(phases.rbegin(), phases.rend(), std::back_inserter(out_phases));
-                    }
-                
-                } else {
-                    std::copy(out_real.begin(), out_real.end(), std::back_inserter(out_magnitudes));
-                    std::copy(out_imag.begin(), out_imag.end(), std::back_inserter(out_phases));
-                    if(full_spectrum) {
-                        std::copy(out_real.rbegin(), out_real.rend(), std::back_inserter(out_magnitudes));
-                        std::copy(out_imag.rbegin(), out_imag.rend(), std::back_inserter(out_phases));
-                    }
-                }
-            }
-            
-            max::t_object* tmp_matrix = static_cast<max::t_object*>(max::jit_object_new(max::_jit_sym_jit_matrix,&out_minfo));
-            
-            if(!tmp_matrix) {
+            if(!dataptr) {
                 (std::cerr << "could not create matrix" << std::endl);
-                return err;
-            }
-            
-            c74::max::uchar *dataptr = nullptr;
-            c74::max::uchar *ip = nullptr;
-            float *fp = nullptr;
-            err = (max::t_jit_err)max::object_method(tmp_matrix, max::_jit_sym_getinfo, &out_minfo);
-            err = (max::t_jit_err)max::object_method(tmp_matrix, max::_jit_sym_getdata, &dataptr);
-            
-            long buf_pos = 0 ;
-
-            for(auto width=0;width<out_minfo.dim[0];width++) {
-                ip = dataptr + (width*out_minfo.dimstride[0]);
-                for(auto height=0;height<out_minfo.dim[1];height++) {
-                    fp = (float*)ip;
-                    *fp++ = out_magnitudes[buf_pos];
-                    *fp++ = out_phases[buf_pos++];
-                    ip = ip + out_minfo.dimstride[1];
-                }
+                err = max::JIT_ERR_INVALID_OUTPUT;
+                goto out;
             }
-            // not sure. seems easier to do fft in float32 since that is what buffer samples in and then convert to float64 matrix
-            max::t_object* out_matrix64 = convert_to_float64(static_cast<max::t_object*>(tmp_matrix), out_minfo);
-            err = (max::t_jit_err)max::object_method(out_matrix64, max::_jit_sym_getinfo, &out_minfo);
-            max::object_method(out_matrix, max::_jit_sym_setinfo,&out_minfo);
-            max::object_method(out_matrix, max::_jit_sym_frommatrix,out_matrix64,nullptr);
-            max::jit_object_free(tmp_matrix);
-            max::jit_object_free(out_matrix64);
-
 
+            out_desc = jit_matrix_desc(out_minfo, dataptr);
+            m_stft.run(params, tab, b_frame_count, b_channel_count, chan, out_desc);
         }
     out:
         buffer_unlocksamples(buffer);
@@ -317,10 +181,6 @@ public:
 
     
     ~mlmat_buffer_stft() {
-        if(m_setup != NULL) {
-            vDSP_DFT_DestroySetup(m_setup);
-        }
-        
         if(m_buffer_reference) {
             object_free(m_buffer_reference);
         }
@@ -377,7 +237,7 @@ private:
         return {};
     }};
     
-    vDSP_DFT_Setup m_setup = NULL;
+    mlmat::stft m_stft;
 };
 
 
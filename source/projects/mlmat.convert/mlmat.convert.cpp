@@ -37,53 +37,9 @@ public:
         }
     };
     
-    mlmat_convert() {
-        static c74::max::t_object *scanwrap=NULL;
-        if (!scanwrap) {
-            if((scanwrap = (c74::max::t_object*)c74::max::newinstance(c74::max::gensym("jit.scanwrap"),0,NULL)))
-                c74::max::freeobject(scanwrap);
-        }
-        
-        m_jit_scanwrap = (t_object*)jit_object_new(max::gensym("jit_scanwrap"));
-        
-        static c74::max::t_object *coerce=NULL;
-        if (!coerce) {
-            if((coerce = (c74::max::t_object*)c74::max::newinstance(c74::max::gensym("jit.coerce"),0,NULL)))
-                c74::max::freeobject(coerce);
-        }
-        
-        m_jit_coerce = (t_object*)jit_object_new(max::gensym("jit_coerce"));
-        
-        static c74::max::t_object *transpose=NULL;
-        if (!transpose) {
-            if((transpose = (c74::max::t_object*)c74::max::newinstance(c74::max::gensym("jit.transpose"),0,NULL)))
-                c74::max::freeobject(transpose);
-        }
-        
-        m_jit_transpose = (t_object*)jit_object_new(max::gensym("jit_transpose"));
-
-    }
-    
-    ~mlmat_convert() {
-        
-        if(m_jit_scanwrap) {
-            c74::max::freeobject(m_jit_scanwrap);
-        }
-        
-        if(m_jit_coerce) {
-            c74::max::freeobject(m_jit_coerce);
-        }
-        
-        if(m_jit_transpose) {
-            c74::max::freeobject(m_jit_transpose);
-        }
-    }
-    
-    
     t_jit_err matrix_calc(t_object* x, t_object* inputs, t_object* outputs) {
         t_jit_err err = JIT_ERR_NONE;
         t_jit_matrix_info out_minfo;
-        //t_object* flat_matrix = nullptr;
         
         auto in_matrix = object_method(inputs, _jit_sym_getindex, 0);
         auto out_matrix = object_method(outputs, _jit_sym_getindex, 0);
@@ -100,25 +56,7 @@ public:
             goto out;
         }
         
-        if(input_mode == 0) {
-            if(output_mode == 1) {
-                jitter_flatten((t_object*)in_matrix, (t_object*)out_matrix, false);
-            } else {
-                jitter_flatten((t_object*)in_matrix, (t_object*)out_matrix, true);
-            }
-        } else if(input_mode == 1) {
-            if(output_mode == 2) {
-                jitter_transpose((t_object*)in_matrix, (t_object*)out_matrix);
-            } else {
-                jitter_extrude((t_object*)in_matrix, (t_object*)out_matrix, false);
-            }
-        } else if(input_mode == 2) {
-            if(output_mode == 1) {
-                jitter_transpose((t_object*)in_matrix, (t_object*)out_matrix);
-            } else {
-                jitter_extrude((t_object*)in_matrix, (t_object*)out_matrix, true);
-            }
-        }
+        err = convert((t_object*)in_matrix, (t_object*)out_matrix);
         
     out:
        object_method(in_matrix,_jit_sym_lock,in_savelock);
@@ -128,211 +66,111 @@ public:
 
 private:
 
-    
-    t_jit_err jitter_transpose(t_object* in_matrix, t_object* out_matrix) {
-        t_jit_err err = JIT_ERR_NONE;
-        t_jit_matrix_info in_info, minfo;
-        
-        jit_object_method(in_matrix, _jit_sym_getinfo, &in_info);
-        
-        minfo = in_info;
-        
-        t_object* transposed_matrix = nullptr;
-        
-        minfo.dimcount = 2;
-        minfo.dim[0] = in_info.dim[1];
-        minfo.dim[1] = in_info.dim[0];
-        
-        transposed_matrix = static_cast<t_object*>(max::jit_object_new(_jit_sym_jit_matrix,&minfo));
-        
-        err = (t_jit_err)jit_object_method((t_object*)m_jit_transpose, _jit_sym_matrix_calc,in_matrix, transposed_matrix);
-        if(err) { std::cerr << err << std::endl;}
-        
-        err = (t_jit_err)max::object_method(out_matrix,_jit_sym_setinfo,&minfo);
-        if(err) { std::cerr << err << std::endl;}
-        err = (t_jit_err)max::object_method(out_matrix,max::_jit_sym_frommatrix,transposed_matrix,nullptr);
-        if(err) { std::cerr << err << std::endl;}
-        
-        if(transposed_matrix) {
-            jit_object_free(transposed_matrix);
-        }
-        
-        
-        return err;
-    }
-    
-    t_jit_err jitter_coerce(t_object* in_matrix, t_object* out_matrix, long planecount, t_symbol *type ) {
-        t_jit_err err = JIT_ERR_NONE;
-        t_jit_matrix_info minfo, in_info;
-        t_object* tmp_matrix = nullptr;
-        char *in_bp;
+    /*
+     changes mode in a single pass over the input, the same as the layout changes
+     done by jit_to_arma/arma_to_jit but without going through an arma matrix.
+     mode 0 <-> 1 copies each cell's planes, anything involving mode 2 is a transpose
+     */
+    t_jit_err convert(t_object* in_matrix, t_object* out_matrix) {
+        t_jit_matrix_info in_info, out_info;
+        uchar *in_bp = nullptr;
+        uchar *out_bp = nullptr;
+        long cells = 0;
+        long features = 0;
         
         jit_object_method(in_matrix, _jit_sym_getinfo, &in_info);
-        jit_object_method(in_matrix,_jit_sym_getdata,&in_bp);
-        
-        minfo = in_info;
-        minfo.flags = JIT_MATRIX_DATA_REFERENCE|JIT_MATRIX_DATA_FLAGS_USE;
-        minfo.planecount = planecount;
-        minfo.type = type;
-        
-        if(in_info.planecount > planecount) {
-            minfo.dim[0] = in_info.planecount*in_info.dim[0];
+        jit_object_method(in_matrix, _jit_sym_getdata, &in_bp);
+        
+        try {
+            check_mode(in_info, input_mode, "convert");
+        } catch (const std::invalid_argument& s) {
+            cerr << s.what() << endl;
+            return JIT_ERR_INVALID_INPUT;
+        }
+        
+        if(in_info.dimcount == 1) { in_info.dim[1] = 1;}
+        
+        switch(input_mode) {
+            case 0:
+                cells = in_info.dim[0]*in_info.dim[1];
+                features = in_info.planecount;
+                break;
+            case 1:
+                cells = in_info.dim[1];
+                features = in_info.dim[0];
+                break;
+            default:
+                cells = in_info.dim[0];
+                features = in_info.dim[1];
+                break;
+        }
+        
+        jit_matrix_info_default(&out_info);
+        out_info.type = in_info.type;
+        out_info.flags = 0;
+        
+        if(output_mode == 0) {
+            if(features > 32) {
+                (cerr << "can't create a matrix with more than 32 planes. " << endl);
+                return JIT_ERR_NONE;
+            }
+            out_info.planecount = features;
+            out_info.dimcount = 1;
+            out_info.dim[0] = cells;
         } else {
-            minfo.dim[0] = in_info.dim[0] / planecount;
+            out_info.planecount = 1;
+            out_info.dimcount = 2;
+            out_info.dim[0] = output_mode == 1 ? features : cells;
+            out_info.dim[1] = output_mode == 1 ? cells : features;
         }
         
-        tmp_matrix = static_cast<t_object*>(max::jit_object_new(_jit_sym_jit_matrix,&minfo));
-
-        jit_object_method(tmp_matrix,_jit_sym_data,in_bp);
-        
-        ///
-        err =  jit_attr_setlong(m_jit_coerce, _jit_sym_planecount, planecount);
-        if(err) { std::cerr << err << std::endl;}
-        err =  jit_attr_setsym(m_jit_coerce, _jit_sym_type, type);
-        if(err) { std::cerr << err << std::endl;}
-        
-        err = (t_jit_err)jit_object_method((t_object*)m_jit_coerce, _jit_sym_matrix_calc,in_matrix, tmp_matrix);
-        if(err) { std::cerr << err << std::endl;}
-
-        minfo.flags = 0 ;
-        
-        jit_object_method(out_matrix, _jit_sym_setinfo, &minfo);
-        
-        err = (t_jit_err)max::object_method(out_matrix,max::_jit_sym_frommatrix,tmp_matrix,nullptr);
-        
-        if(err) { std::cerr << err << std::endl;}
-
-        if (tmp_matrix) jit_object_free(tmp_matrix);
-        
-        return err;
-    }
-    
-    t_jit_err jitter_flatten(t_object* in_matrix, t_object* out_matrix, bool transposed = false) {
-        t_jit_err err = JIT_ERR_NONE;
-        t_jit_matrix_info in_info, minfo;
-        t_object* coerced_matrix = nullptr;
-        t_object* scanwrapped_matrix = nullptr;
-        
-        jit_object_method(in_matrix, _jit_sym_getinfo, &in_info);
-        
-        jit_matrix_info_default(&minfo);
-                          
-        minfo.type = in_info.type;
-        minfo.planecount = 1;
-        minfo.dim[0] = in_info.planecount*in_info.dim[0];
-        
-        coerced_matrix = static_cast<t_object*>(max::jit_object_new(_jit_sym_jit_matrix,&minfo));
-
-        jitter_coerce(in_matrix, coerced_matrix, 1, minfo.type);
-
-
-        minfo.type = in_info.type;
-        minfo.dimcount = 2;
-        minfo.planecount = 1;
-        minfo.flags = 0;
-        minfo.dim[0] = in_info.planecount;
-        minfo.dim[1] = in_info.dim[0]*in_info.dim[1];
-
-        scanwrapped_matrix = static_cast<t_object*>(max::jit_object_new(_jit_sym_jit_matrix,&minfo));
-        jit_object_method(scanwrapped_matrix, _jit_sym_getinfo, &minfo);
-
-        c74::max::t_atom_long newdim[2] = {minfo.dim[0], minfo.dim[1]};
-
-        err =  jit_attr_setlong_array(m_jit_scanwrap, _jit_sym_dim, 2, newdim);
-        if(err) { std::cerr << err << std::endl;}
-        err =  jit_attr_setlong(m_jit_coerce, _jit_sym_planecount, 1);
-        if(err) { std::cerr << err << std::endl;}
-        err =  jit_attr_setsym(m_jit_coerce, _jit_sym_type, minfo.type);
-        if(err) { std::cerr << err << std::endl;}
-
-        err = (t_jit_err)jit_object_method((t_object*)m_jit_scanwrap, _jit_sym_matrix_calc,coerced_matrix, scanwrapped_matrix);
-        if(err) { std::cerr << err << std::endl;}
+        jit_matrix_setinfo_if_changed(out_matrix, out_info);
+        jit_object_method(out_matrix, _jit_sym_getinfo, &out_info);
+        jit_object_method(out_matrix, _jit_sym_getdata, &out_bp);
         
-        if(!transposed) {
-            err = (t_jit_err)max::object_method(out_matrix,_jit_sym_setinfo,&minfo);
-            if(err) { std::cerr << err << std::endl;}
-            err = (t_jit_err)max::object_method(out_matrix,max::_jit_sym_frommatrix,scanwrapped_matrix,nullptr);
-            if(err) { std::cerr << err << std::endl;}
-        } else {
-            jitter_transpose(scanwrapped_matrix, out_matrix);
-        }
-
-        if(scanwrapped_matrix) {
-            jit_object_free(scanwrapped_matrix);
+        if(!in_bp || !out_bp) {
+            return JIT_ERR_INVALID_PTR;
         }
-
         
-        if(coerced_matrix) {
-            jit_object_free(coerced_matrix);
-        }
+        jit_type_dispatch(in_info.type, [&](auto tag) {
+            convert_cells<std::remove_pointer_t<decltype(tag)>>(in_info, in_bp, out_info, out_bp, cells, features);
+        });
         
-        return err;
+        return JIT_ERR_NONE;
     }
     
-    t_jit_err jitter_extrude(t_object* in_matrix, t_object* out_matrix, bool transposed = false) {
-        t_jit_err err = JIT_ERR_NONE;
-        t_jit_matrix_info in_info, minfo;
-        t_object* initial_matrix = nullptr;
-        t_object* coerced_matrix = nullptr;
+    template <typename T>
+    void convert_cells(const t_jit_matrix_info& in_info, const uchar* in_bp,
+                       const t_jit_matrix_info& out_info, uchar* out_bp,
+                       const long cells, const long features) {
+        const size_t cellsize = features * sizeof(T);
         
-        jit_object_method(in_matrix, _jit_sym_getinfo, &in_info);
-        initial_matrix = static_cast<t_object*>(max::jit_object_new(_jit_sym_jit_matrix,&in_info));
-        
-        if(!transposed) {
-            err = (t_jit_err)max::object_method(initial_matrix,max::_jit_sym_frommatrix,in_matrix,nullptr);
-            if(err) { std::cerr << err << std::endl;}
+        if(input_mode == 0) {
+            for(auto jrow=0;jrow<in_info.dim[1];jrow++) {
+                const uchar *row = in_bp + (jrow*in_info.dimstride[1]);
+                const long first = jrow*in_info.dim[0];
+                if(output_mode == 1) {
+                    for(auto jcell=0;jcell<in_info.dim[0];jcell++) {
+                        std::memcpy(out_bp + ((first + jcell)*out_info.dimstride[1]), row + (jcell*in_info.dimstride[0]), cellsize);
+                    }
+                } else {
+                    jit_transpose<T, T>(row, in_info.dimstride[0], out_bp + (first*sizeof(T)), out_info.dimstride[1], in_info.dim[0], features);
+                }
+            }
+        } else if(input_mode == 1) {
+            if(output_mode == 0) {
+                for(auto jcell=0;jcell<cells;jcell++) {
+                    std::memcpy(out_bp + (jcell*out_info.dimstride[0]), in_bp + (jcell*in_info.dimstride[1]), cellsize);
+                }
+            } else {
+                jit_transpose<T, T>(in_bp, in_info.dimstride[1], out_bp, out_info.dimstride[1], cells, features);
+            }
         } else {
-            jitter_transpose(in_matrix, initial_matrix);
-        }
-
-        jit_object_method(initial_matrix, _jit_sym_getinfo, &in_info);
-        
-        minfo.type = in_info.type;
-        minfo.dimcount = 1;
-        minfo.planecount = in_info.dim[0];
-        minfo.flags = 0;
-        minfo.dim[0] = in_info.dim[1];
-        
-        if(minfo.planecount > 32) {
-            (cerr << "can't create a matrix with more than 32 planes. " << endl);
-            goto out;
-        }
-        
-        coerced_matrix = static_cast<t_object*>(max::jit_object_new(_jit_sym_jit_matrix,&minfo));
-        
-        jitter_coerce(initial_matrix, coerced_matrix, minfo.planecount, minfo.type);
-        
-        jit_object_method(coerced_matrix, _jit_sym_getinfo, &minfo);
-
- 
-        err = (t_jit_err)jit_object_method(out_matrix,_jit_sym_setinfo,&minfo);
-        if(err) { std::cerr << err << std::endl;}
-        err = (t_jit_err)jit_object_method(out_matrix,max::_jit_sym_frommatrix,coerced_matrix,nullptr);
-        if(err) { std::cerr << err << std::endl;}
-        
-        if(coerced_matrix) {
-            jit_object_free(coerced_matrix);
+            const long dst_stride = output_mode == 0 ? out_info.dimstride[0] : out_info.dimstride[1];
+            jit_transpose<T, T>(in_bp, in_info.dimstride[1], out_bp, dst_stride, features, cells);
         }
-        
-    out:
-       
-        if(initial_matrix) {
-            jit_object_free(initial_matrix);
-        }
-        
-        return err;
     }
     
-    message<> fileusage {this, "fileusage",
-        MIN_FUNCTION {
-            void *w { args[0] };
-            c74::max::fileusage_addfilename(w, 0, "jit.scanwrap");
-            c74::max::fileusage_addfilename(w, 0, "jit.coerce");
-            c74::max::fileusage_addfilename(w, 0, "jit.transform");
-            return {};
-        }
-    };
-    
     message<> jitclass_setup {this, "jitclass_setup", MIN_FUNCTION {
         t_class* c = args[0];
         t_object* mop = static_cast<t_object*>(jit_object_new(_jit_sym_jit_mop, 1, 1));
@@ -355,10 +193,6 @@ private:
         return {};
     }};
     
-    t_object * m_jit_scanwrap;
-    t_object * m_jit_coerce;
-    t_object * m_jit_transpose;
-
 };
 
 
@@ -6,11 +6,8 @@
 
 
 #include "mlmat.hpp"
+#include "core/gmm.hpp"
 #include <mlpack/methods/gmm.hpp>
-#include <mlpack/methods/gmm/diagonal_gmm.hpp>
-#include <mlpack/methods/gmm/no_constraint.hpp>
-#include <mlpack/methods/gmm/diagonal_constraint.hpp>
-#include <mlpack/methods/kmeans/refined_start.hpp>
 
 using namespace c74::min;
 using namespace c74::max;
@@ -48,13 +45,13 @@ public:
     
     attribute<int> seed { this, "seed", 0,
         description {
-            "Random seed."
+            "Random seed. Each training trial gets its own random numbers from it, so training gives the same model whatever threads is. 0 indicates no seed."
         }
     };
     
     attribute<int> trials { this, "trials", 1,
         description {
-            "Number of trials to perform in training GMM."
+            "Number of trials to perform in training GMM. Each starts from its own k-means clustering and the one with the highest likelihood is kept. They run side by side when threads is above 1."
         },
         setter { MIN_FUNCTION {
             int value = args[0];
@@ -77,6 +74,20 @@ public:
         }
     };
     
+    attribute<int> threads { this, "threads", 1,
+        description {
+            "Number of threads the columns of a query matrix are scored across. Training runs up to this many trials side by side and splits the steps of each across the threads left over."
+        },
+        setter { MIN_FUNCTION {
+            int value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
+    };
+    
     attribute<double> noise { this, "noise", 0.,
         description {
             "Variance of zero-mean Gaussian noise to add to data."
@@ -152,10 +163,31 @@ public:
         range {0.0, 1.0}
     };
     
+    attribute<int> cache { this, "cache", 0,
+        description {
+            "Number of recent input matrices whose probabilities (and labels when classify is on) are kept. An input that matches one of them cell for cell, with the same model and attributes, gets the kept outputs again without being scored. Training or reading a model empties it. 0 turns it off."
+        },
+        setter { MIN_FUNCTION {
+            int value = args[0];
+            
+            if (value < 0)
+                value = 0;
+                return {value};
+        }}
+    };
+    
+    message<> cache_hits { this, "cache_hits", "Outputs how many frames the cache answered and how many it had to score via dump outlet.",
+        MIN_FUNCTION {
+            report_cache();
+            return {};
+        }
+    };
+    
     message<> clear { this, "clear", "clear data and model",
         MIN_FUNCTION {
             m_data.reset();
-            m_model.model.reset();
+            m_trainer.cancel();
+            m_model.clear();
             return {};
         }
     };
@@ -196,13 +228,10 @@ public:
 
     message<> train { this, "train", "Train model.",
         MIN_FUNCTION {
-            auto trials = 1;
+            gmm_training settings = training_settings();
         
             if(args.size() > 0) {
-                trials = args[0];
-                if(trials < 1) {
-                    trials = 1;
-                }
+                settings.fit.trials = std::max(1, int(args[0]));
             }
 
             if(!m_data) {
@@ -211,10 +240,17 @@ public:
                 (cerr << "need more observations than gaussians. have " <<  m_data->n_cols << ", need at least " << gaussians << "." << endl );
                 
             } else {
-                arma::Mat<double> scaled_data;
-                scaler_fit(m_model, *m_data);
-                scaled_data = scaler_transform(m_model, *m_data, scaled_data);
-                train_gmm(scaled_data);
+                // the job works on a copy, so new observations can arrive while it runs
+                train_in_background([data = *m_data, settings, scaling = scaler_settings()](mlmat_training_status& status) mutable {
+                    auto trained = std::make_unique<mlmat_trained_model<GMM>>();
+                    arma::Mat<double> scaled_data;
+                    arma::Mat<double>& out_data = scaling.fit_transform(trained->scaler, data, scaled_data);
+                    status.progress(0, 1);
+                    trained->model = std::make_unique<GMM>(settings.fit.gaussians, out_data.n_rows);
+                    status.loss(train_gmm(*trained->model, settings, out_data));
+                    status.progress(1, 1);
+                    return trained;
+                });
                 if(autoclear) m_data.reset();
             }
             return {};
@@ -232,6 +268,7 @@ public:
             t_atom a;
             arma::mat samples;
             arma::mat scaled_samples;
+            auto current = m_model.snapshot();
             
             auto* mob = maxob_from_jitob(maxobj());
             auto *mop = max_jit_obex_adornment_get(mob , _jit_sym_jit_mop);
@@ -240,12 +277,12 @@ public:
             
             auto genmatrix_savelock = object_method(genmatrix, _jit_sym_lock, 1);
 
-            if(!m_model.model) {
+            if(!current->model) {
                 (cerr << "no GMM model has been trained" << endl);
                 goto out;
             }
 
-            samples.set_size(m_model.model->Dimensionality(), num);
+            samples.set_size(current->model->Dimensionality(), num);
             
             if (seed == 0) {
               mlpack::RandomSeed(time(NULL));
@@ -258,11 +295,11 @@ public:
             }
             
             for (size_t i = 0; i < num; i++) {
-                samples.col(i) = WeightedRandom();
+                samples.col(i) = WeightedRandom(*current->model);
             }
             
         
-            scaled_samples = scaler_inverse_transform(m_model, samples, scaled_samples);
+            scaled_samples = scaler_inverse_transform(*current, samples, scaled_samples);
             
             t_jit_matrix_info minfo;
             minfo.type = _jit_sym_float64;
@@ -299,6 +336,7 @@ public:
             t_atom a;
             arma::mat samples;
             arma::mat scaled_samples;
+            auto current = m_model.snapshot();
             
             auto* mob = maxob_from_jitob(maxobj());
             auto *mop = max_jit_obex_adornment_get(mob , _jit_sym_jit_mop);
@@ -307,12 +345,12 @@ public:
             
             auto genmatrix_savelock = object_method(genmatrix, _jit_sym_lock, 1);
 
-            if(!m_model.model) {
+            if(!current->model) {
                 (cerr << "no GMM model has been trained" << endl);
                 goto out;
             }
 
-            samples.set_size(m_model.model->Dimensionality(), num);
+            samples.set_size(current->model->Dimensionality(), num);
             
             if (seed == 0) {
               mlpack::RandomSeed(time(NULL));
@@ -322,11 +360,11 @@ public:
         
             
             for (size_t i = 0; i < num; i++) {
-                samples.col(i) = m_model.model->Random();
+                samples.col(i) = current->model->Random();
             }
             
         
-            scaled_samples = scaler_inverse_transform(m_model, samples, scaled_samples);
+            scaled_samples = scaler_inverse_transform(*current, samples, scaled_samples);
             
             t_jit_matrix_info minfo;
             minfo.type = _jit_sym_float64;
@@ -383,6 +421,7 @@ public:
             t_atom a;
             arma::mat samples;
             arma::mat scaled_samples;
+            auto current = m_model.snapshot();
             
             auto* mob = maxob_from_jitob(maxobj());
             auto *mop = max_jit_obex_adornment_get(mob , _jit_sym_jit_mop);
@@ -391,12 +430,12 @@ public:
             
             auto genmatrix_savelock = object_method(genmatrix, _jit_sym_lock, 1);
 
-            if(!m_model.model) {
+            if(!current->model) {
                 (cerr << "no GMM model has been trained" << endl);
                 goto out;
             }
 
-            samples.set_size(m_model.model->Dimensionality(), num);
+            samples.set_size(current->model->Dimensionality(), num);
             
             if (seed == 0) {
               mlpack::RandomSeed(time(NULL));
@@ -405,10 +444,10 @@ public:
             }
             
             for (size_t i = 0; i < num; i++) {
-                samples.col(i) = m_model.model->Component(component).Random();
+                samples.col(i) = current->model->Component(component).Random();
             }
             
-            scaled_samples = scaler_inverse_transform(m_model, samples, scaled_samples);
+            scaled_samples = scaler_inverse_transform(*current, samples, scaled_samples);
 
             t_jit_matrix_info minfo;
             minfo.type = _jit_sym_float64;
@@ -471,11 +510,17 @@ public:
     t_jit_err matrix_calc(t_object* x, t_object* inputs, t_object* outputs) {
         t_jit_err err = JIT_ERR_NONE;
         t_jit_matrix_info in_query_info, out_probabilities_info;
-        arma::mat query;
-        arma::mat scaled_query;
-        arma::Row<double> probabilities;
-        arma::Row<double> log_probabilities;
-
+        arma::mat& query = m_scratch.query;
+        arma::mat& scaled_query = m_scratch.scaled_query;
+        arma::Row<double>& probabilities = m_scratch.values;
+        arma::Row<double>& log_probabilities = m_scratch.log_values;
+
+        m_scratch.begin_frame();
+        adopt_trained_model();
+        const uint64_t key = cache_key(cache, classify.get());
+        // labels are only written when classifying
+        const long cached = classify ? 3 : 2;
+        auto current = m_model.snapshot();
 
         auto in_matrix = object_method(inputs, _jit_sym_getindex, 0);
         auto observations_matrix = object_method(inputs, _jit_sym_getindex, 1);
@@ -489,9 +534,13 @@ public:
         
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
+        
+        if(cached_outputs(key, in_query_matrix, outputs, cached)) {
+            goto out;
+        }
             
-        if(!m_model.model) {
+        if(!current->model) {
             (cerr << "no GMM model has been trained" << endl);
             goto out;
         }
@@ -503,25 +552,28 @@ public:
             goto out;
         }
 
-        query = jit_to_arma(mode, static_cast<t_object*>(in_matrix64), query);
+        query = jit_to_arma(mode, static_cast<t_object*>(in_query_matrix), query);
 
         try {
-            mlpack::util::CheckSameDimensionality(query, m_model.model->Dimensionality(), "gmm");
+            mlpack::util::CheckSameDimensionality(query, current->model->Dimensionality(), "gmm");
         } catch (std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
         }
         
         
-        scaled_query = scaler_transform(m_model, query, scaled_query);
+        scaled_query = scaler_transform(*current, query, scaled_query);
         
-        probabilities.set_size(scaled_query.n_cols);
-        log_probabilities.set_size(scaled_query.n_cols);
-       
-     
-        for (size_t i = 0; i < scaled_query.n_cols; i++) {
-            probabilities[i] = m_model.model->Probability(scaled_query.unsafe_col(i));
-            log_probabilities[i] = m_model.model->LogProbability(scaled_query.unsafe_col(i));
+        if(current != m_scored) {
+            m_scored = current;
+            m_scorer.prepare(*current->model);
+        }
+        if(m_scorer.ready()) {
+            m_workers.resize(threads);
+            m_scorer.score(scaled_query, m_scratch.results, probabilities, log_probabilities, &m_workers);
+        } else {
+            // a covariance without a cholesky factor, leave it to mlpack
+            mlmat::gmm_score(*current->model, scaled_query, probabilities, log_probabilities);
         }
         
         if(classify) {
@@ -531,8 +583,12 @@ public:
             minfo = in_query_info;
             minfo.planecount = 1;
             minfo.type = _jit_sym_long;
-            arma::Row<size_t> labels;
-            m_model.model->Classify(scaled_query, labels);
+            arma::Row<size_t>& labels = m_scratch.labels;
+            if(m_scorer.ready()) {
+                mlmat::gmm_classify(m_scratch.results, labels);
+            } else {
+                mlmat::gmm_classify(*current->model, scaled_query, labels);
+            }
             
             out_labels = arma_to_jit(mode, labels,  static_cast<t_object*>(out_labels), minfo);
             
@@ -544,10 +600,11 @@ public:
      
         out_probabilities = arma_to_jit(mode, probabilities, static_cast<t_object*>(out_probabilities), out_probabilities_info);
         out_log_probabilities = arma_to_jit(mode, log_probabilities, static_cast<t_object*>(out_log_probabilities), out_probabilities_info);
+        cache_outputs(key, in_query_matrix, outputs, cached);
     
     out:
+        m_scratch.end_frame();
         
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         
         object_method(in_matrix,_jit_sym_lock,in_matrix_savelock);
         object_method(observations_matrix,_jit_sym_lock,observations_matrix_savelock);
@@ -559,6 +616,13 @@ public:
     }
     
     
+    // called by the base class once a trained model is published, keeps the likelihood output of synchronous training
+    void model_published() {
+        t_atom a[1];
+        atom_setfloat(a, m_last_loss);
+        outlet_anything(m_dumpoutlet, gensym("likelihood"), 1, a);
+    }
+    
 private:
     
     message<> jitclass_setup {this, "jitclass_setup",
@@ -569,6 +633,7 @@ private:
             
             // force type
             jit_mop_single_type(mop, _jit_sym_float64);
+            jit_mop_input_all_types(mop, 1);
             
             jit_class_addadornment(c, mop);
             
@@ -610,7 +675,7 @@ private:
  
     //adapted from gmm.cpp
     //
-    arma::vec WeightedRandom() {
+    arma::vec WeightedRandom(const GMM& model) {
         double gaussRand = mlpack::Random();
         size_t gaussian = 0;
         double sumProb = 0;
@@ -624,96 +689,55 @@ private:
        // std::cout << *m_weights << std::endl;
         arma::mat cholDecomp;
         
-        if (!arma::chol(cholDecomp, m_model.model->Component(gaussian).Covariance())) {
+        if (!arma::chol(cholDecomp, model.Component(gaussian).Covariance())) {
             cerr << "Cholesky decomposition failed." << endl;
         }
-        return trans(cholDecomp) * arma::randn<arma::vec>(m_model.model->Dimensionality()) + m_model.model->Component(gaussian).Mean();
+        return trans(cholDecomp) * arma::randn<arma::vec>(model.Dimensionality()) + model.Component(gaussian).Mean();
         
         
     }
      
 
         
-    void train_gmm(arma::Mat<double>& data) {
-        double likelihood;
-        t_atom a[1];
-        
-        if(noise > 0.) { //adding noise if specified. noise is variance of noise
-            data += noise * arma::randn(data.n_rows, data.n_cols);
-        }
-        
-        if(refined_start) {
-            m_model.model = std::make_unique<GMM>(gaussians,data.n_rows);
-                  
-            typedef KMeans<mlpack::SquaredEuclideanDistance, RefinedStart> KMeansType;
-
-            KMeansType k(kmeans_max_iterations, mlpack::SquaredEuclideanDistance(), RefinedStart(samplings, percentage));
-
-            if(diagonal_covariance) {
-                DiagonalGMM dgmm(m_model.model->Gaussians(), m_model.model->Dimensionality());
-                for (size_t i = 0; i < size_t(gaussians); ++i) {
-                    dgmm.Component(i).Mean() = m_model.model->Component(i).Mean();
-                    dgmm.Component(i).Covariance(std::move(arma::diagvec(m_model.model->Component(i).Covariance())));
-                }
-            
-                dgmm.Weights() = m_model.model->Weights();
-
-                EMFit<KMeansType, PositiveDefiniteConstraint, mlpack::DiagonalGaussianDistribution> em(max_iterations, tolerance, k);
-                likelihood = dgmm.Train(data, trials, false, em);
-                for (size_t i = 0; i < size_t(gaussians); ++i) {
-                    m_model.model->Component(i).Mean() = dgmm.Component(i).Mean();
-                    m_model.model->Component(i).Covariance(arma::diagmat(dgmm.Component(i).Covariance()));
-                }
-                m_model.model->Weights() = dgmm.Weights();
-            
-            } else if (no_force_positive) {
-                // Compute the parameters of the model using the EM algorithm.
-                EMFit<KMeansType> em(max_iterations, tolerance, k);
-                likelihood = m_model.model->Train(data, trials, false, em);
-            } else {
-                EMFit<KMeansType, NoConstraint> em(max_iterations, tolerance, k);
-                likelihood = m_model.model->Train(data, trials, false, em);
-            }
-        } else {
-            m_model.model = std::make_unique<GMM>(gaussians,m_data->n_rows);
-            typedef KMeans<mlpack::SquaredEuclideanDistance, RefinedStart> KMeansType;
-
-            KMeansType k(kmeans_max_iterations, mlpack::SquaredEuclideanDistance(), RefinedStart(samplings, percentage));
-
-            if(diagonal_covariance) {
-                DiagonalGMM dgmm(m_model.model->Gaussians(), m_model.model->Dimensionality());
-                for (size_t i = 0; i < size_t(gaussians); ++i) {
-                    dgmm.Component(i).Mean() = m_model.model->Component(i).Mean();
-                    dgmm.Component(i).Covariance(std::move(arma::diagvec(m_model.model->Component(i).Covariance())));
-                }
-            
-                dgmm.Weights() = m_model.model->Weights();
-
-                EMFit<KMeans<>, PositiveDefiniteConstraint, mlpack::DiagonalGaussianDistribution> em(max_iterations, tolerance, KMeans<>(kmeans_max_iterations));
-                likelihood = dgmm.Train(data, trials, false, em);
-                for (size_t i = 0; i < size_t(gaussians); ++i) {
-                    m_model.model->Component(i).Mean() = dgmm.Component(i).Mean();
-                    m_model.model->Component(i).Covariance(arma::diagmat(dgmm.Component(i).Covariance()));
-                }
-                m_model.model->Weights() = dgmm.Weights();
-            
-            } else if (no_force_positive) {
-                // Compute the parameters of the model using the EM algorithm.
-                EMFit<> em(max_iterations, tolerance, KMeans<>(kmeans_max_iterations));
-                likelihood = m_model.model->Train(data, trials, false, em);
-            } else {
-                KMeans<> k(kmeans_max_iterations);
-                EMFit<KMeans<>, NoConstraint> em(max_iterations, tolerance, k);
-                likelihood = m_model.model->Train(data, trials, false, em);
-            }
+    // the attributes training depends on, copied when training starts
+    struct gmm_training {
+        mlmat::gmm_train_params fit;
+        double noise;
+    };
+    
+    gmm_training training_settings() {
+        gmm_training settings;
+        settings.fit.gaussians = gaussians;
+        settings.fit.trials = trials;
+        settings.fit.max_iterations = max_iterations;
+        settings.fit.kmeans_max_iterations = kmeans_max_iterations;
+        settings.fit.samplings = samplings;
+        settings.fit.tolerance = tolerance;
+        settings.fit.percentage = percentage;
+        settings.fit.refined_start = refined_start;
+        settings.fit.diagonal_covariance = diagonal_covariance;
+        settings.fit.force_positive = !no_force_positive;
+        settings.fit.seed = seed;
+        settings.fit.threads = threads;
+        settings.noise = noise;
+        return settings;
+    }
+    
+    // runs on the training worker, returns the log likelihood of the trained model
+    static double train_gmm(GMM& model, const gmm_training& settings, arma::Mat<double>& data) {
+        if(settings.noise > 0.) { //adding noise if specified. noise is variance of noise
+            data += settings.noise * arma::randn(data.n_rows, data.n_cols);
         }
-        
-        atom_setfloat(a,likelihood);
-        outlet_anything(m_dumpoutlet, gensym("likelihood"), 1, a);
+        return mlmat::gmm_train(settings.fit, data, model);
     }
     
     std::unique_ptr<arma::Mat<double>> m_data { nullptr };
     std::unique_ptr<arma::vec> m_weights { nullptr };
+    
+    // the model version m_scorer was prepared from, all three only used from matrix_calc
+    std::shared_ptr<const model_version> m_scored { nullptr };
+    mlmat::gmm_scorer m_scorer;
+    mlmat::worker_pool m_workers;
 };
 
 
@@ -77,7 +77,8 @@ public:
         MIN_FUNCTION {
             m_observations.clear();
             m_labels.clear();
-            m_model.model.reset();
+            m_trainer.cancel();
+            m_model.clear();
             return {};
         }
     };
@@ -85,13 +86,11 @@ public:
     
     message<> train { this, "train", "train model.",
         MIN_FUNCTION {
-            arma::mat out_data;
-            
             const string type_string = hmm_type.get().c_str();
             
             if(m_observations.empty()) {
                 (cerr << "No training data. Training terminated!" << endl);
-                goto out;
+                return {};
             }
             
             HMMType typeId;
@@ -105,33 +104,35 @@ public:
                 typeId = HMMType::DiagonalGaussianMixtureModelHMM;
             }
             
-            m_model.model = std::make_unique<HMMModel>(typeId);
-            
-            
-            if(typeId == HMMType::DiscreteHMM) {
-                HMM<DiscreteDistribution>* hmm = m_model.model->DiscreteHMM();
-                init_hmm(hmm);
-            }
-            else if (typeId == HMMType::GaussianHMM) {
-                HMM<GaussianDistribution>* hmm = m_model.model->GaussianHMM();
-                init_hmm(hmm);
+            hmm_training settings;
+            settings.states = states;
+            settings.gaussians = gaussians;
+            settings.tolerance = tolerance;
+            settings.use_labels = use_labels;
+            
+            // the job works on copies, so more sequences can be added while it runs
+            train_in_background([typeId, settings, observations = m_observations, labels = m_labels](mlmat_training_status& status) mutable {
+                auto trained = std::make_unique<mlmat_trained_model<HMMModel>>();
+                trained->model = std::make_unique<HMMModel>(typeId);
+                status.progress(0, 1);
                 
-            } else if (typeId == HMMType::GaussianMixtureModelHMM) {
-                HMM<GMM>* hmm = m_model.model->GMMHMM();
-                init_hmm(hmm);
-            } else if(typeId == HMMType::DiagonalGaussianMixtureModelHMM) {
-                HMM<DiagonalGMM>* hmm = m_model.model->DiagGMMHMM();
-                init_hmm(hmm);
-            }
+                if(typeId == HMMType::DiscreteHMM) {
+                    init_hmm(trained->model->DiscreteHMM(), settings, observations, labels);
+                } else if (typeId == HMMType::GaussianHMM) {
+                    init_hmm(trained->model->GaussianHMM(), settings, observations, labels);
+                } else if (typeId == HMMType::GaussianMixtureModelHMM) {
+                    init_hmm(trained->model->GMMHMM(), settings, observations, labels);
+                } else if(typeId == HMMType::DiagonalGaussianMixtureModelHMM) {
+                    init_hmm(trained->model->DiagGMMHMM(), settings, observations, labels);
+                }
+                status.progress(1, 1);
+                return trained;
+            });
             
             if(autoclear) {
                 m_observations.clear();
                 m_labels.clear();
             }
-            
-            
-        out:
-            
             return {};
         }
     };
@@ -151,6 +152,7 @@ public:
             t_atom a;
             arma::Mat<double> samples;
             arma::Row<size_t> states;
+            auto current = m_model.snapshot();
             const string type_string = hmm_type.get().c_str();
             
             auto* mob = maxob_from_jitob(maxobj());
@@ -173,7 +175,7 @@ public:
                 typeId = HMMType::DiagonalGaussianMixtureModelHMM;
             }
             
-            if(!m_model.model) {
+            if(!current->model) {
                 (cerr << "no HMM model has been trained" << endl);
                 goto out;
             }
@@ -186,18 +188,18 @@ public:
             
             
             if(typeId == HMMType::DiscreteHMM) {
-                HMM<DiscreteDistribution>* hmm = m_model.model->DiscreteHMM();
+                HMM<DiscreteDistribution>* hmm = current->model->DiscreteHMM();
                 hmm->Generate(num, samples, states, start);
             }
             else if (typeId == HMMType::GaussianHMM) {
-                HMM<GaussianDistribution>* hmm = m_model.model->GaussianHMM();
+                HMM<GaussianDistribution>* hmm = current->model->GaussianHMM();
                 hmm->Generate(num, samples, states, start);
                 
             } else if (typeId == HMMType::GaussianMixtureModelHMM) {
-                HMM<GMM>* hmm = m_model.model->GMMHMM();
+                HMM<GMM>* hmm = current->model->GMMHMM();
                 hmm->Generate(num, samples, states, start);
             } else if(typeId == HMMType::DiagonalGaussianMixtureModelHMM) {
-                HMM<DiagonalGMM>* hmm = m_model.model->DiagGMMHMM();
+                HMM<DiagonalGMM>* hmm = current->model->DiagGMMHMM();
                 hmm->Generate(num, samples, states, start);
             }
             
@@ -242,6 +244,7 @@ public:
             
             // force type
             jit_mop_single_type(mop, _jit_sym_float64);
+            jit_mop_input_all_types(mop, 1);
             
             auto output1 = object_method(mop,_jit_sym_getoutput,1);
             auto output2 = object_method(mop,_jit_sym_getoutput,2);
@@ -298,20 +301,22 @@ public:
         
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
         
+        adopt_trained_model();
+        auto current = m_model.snapshot();
         
-        query = jit_to_arma(mode, static_cast<t_object*>(in_matrix64), query);
+        query = jit_to_arma(mode, static_cast<t_object*>(in_query_matrix), query);
         
-        if(!m_model.model) {
+        if(!current->model) {
             (cerr << "no HMM model has been trained" << endl);
             goto out;
         }
         
-        typeId = m_model.model->Type();
+        typeId = current->model->Type();
         
         if(typeId == HMMType::DiscreteHMM) {
-            HMM<DiscreteDistribution>* hmm = m_model.model->DiscreteHMM();
+            HMM<DiscreteDistribution>* hmm = current->model->DiscreteHMM();
             if(hmm != nullptr) {
                 try {
                     CheckSameDimensionality(query, hmm->Emission()[0].Dimensionality(), "gmm", "sequence");
@@ -325,7 +330,7 @@ public:
 //            k
             //(cout << "predict " << p << endl);
         }  else if (typeId == HMMType::GaussianHMM) {
-            HMM<GaussianDistribution>* hmm = m_model.model->GaussianHMM();
+            HMM<GaussianDistribution>* hmm = current->model->GaussianHMM();
             if(hmm != nullptr) {
                 try {
                     CheckSameDimensionality(query, hmm->Emission()[0].Dimensionality(), "gmm", "sequence");
@@ -338,7 +343,7 @@ public:
 
             //(cout << "predict " << p << endl);
         } else if (typeId == HMMType::GaussianMixtureModelHMM) {
-            HMM<GMM>* hmm = m_model.model->GMMHMM();
+            HMM<GMM>* hmm = current->model->GMMHMM();
             if(hmm != nullptr) {
                 try {
                     CheckSameDimensionality(query, hmm->Emission()[0].Dimensionality(), "gmm", "sequence");
@@ -351,7 +356,7 @@ public:
 
             //(cout << "predict " << p << endl);
         } else if(typeId == HMMType::DiagonalGaussianMixtureModelHMM) {
-            HMM<DiagonalGMM>* hmm = m_model.model->DiagGMMHMM();
+            HMM<DiagonalGMM>* hmm = current->model->DiagGMMHMM();
             if(hmm != nullptr) {
                 try {
                     CheckSameDimensionality(query, hmm->Emission()[0].Dimensionality(), "gmm", "sequence");
@@ -373,194 +378,146 @@ public:
         outlet_anything(m_dumpoutlet, gensym("loglik"), 1, a);
         
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         object_method(in_matrix,_jit_sym_lock,in_matrix_savelock);
         object_method(out_states,_jit_sym_lock,out_states_savelock);
         return err;
         
     }
     
-    t_jit_err init_hmm(HMM<DiscreteDistribution>* hmm) {
-        t_jit_err err = JIT_ERR_NONE;
-        arma::Col<size_t> maxEmissions(m_observations[0].n_rows);
+    // the attributes training depends on, copied when training starts
+    struct hmm_training {
+        int states;
+        int gaussians;
+        double tolerance;
+        bool use_labels;
+    };
+    
+    // the init_hmm functions run on the training worker and throw if the data does not fit the model
+    static void init_hmm(HMM<DiscreteDistribution>* hmm, const hmm_training& settings,
+                         vector<arma::Mat<double>>& observations, vector<arma::Row<size_t>>& labels) {
+        arma::Col<size_t> maxEmissions(observations[0].n_rows);
         maxEmissions.zeros();
-        for (vector<arma::mat>::iterator it = m_observations.begin(); it != m_observations.end(); ++it) {
+        for (vector<arma::mat>::iterator it = observations.begin(); it != observations.end(); ++it) {
             arma::Col<size_t> maxSeqs = arma::conv_to<arma::Col<size_t>>::from(arma::max(*it, 1)) + 1;
             maxEmissions = arma::max(maxEmissions, maxSeqs);
         }
         
-        if(hmm != nullptr) {
-            *hmm = HMM<DiscreteDistribution>(size_t(states), DiscreteDistribution(maxEmissions), tolerance);
-            std::vector<DiscreteDistribution>& e = hmm->Emission();
-            for (size_t i = 0; i < e.size(); ++i)
-            {
-                e[i].Probabilities().randu();
-                e[i].Probabilities() /= arma::accu(e[i].Probabilities());
-            }
+        *hmm = HMM<DiscreteDistribution>(size_t(settings.states), DiscreteDistribution(maxEmissions), settings.tolerance);
+        std::vector<DiscreteDistribution>& e = hmm->Emission();
+        for (size_t i = 0; i < e.size(); ++i)
+        {
+            e[i].Probabilities().randu();
+            e[i].Probabilities() /= arma::accu(e[i].Probabilities());
         }
-        if((err=check_observations(m_observations, hmm->Emission()[0].Dimensionality()))) {
-            return err;
-        };
         
-        if(use_labels) {
-            if(check_labels(m_labels, m_observations, hmm->Transition().n_cols)) {
-                return err;;
-            }
-            hmm->Train(m_observations, m_labels);
+        check_observations(observations, hmm->Emission()[0].Dimensionality());
+        
+        if(settings.use_labels) {
+            check_labels(labels, observations, settings.states);
+            hmm->Train(observations, labels);
         } else {
-            hmm->Train(m_observations);
+            hmm->Train(observations);
         }
-        return err;
     }
     
-    t_jit_err init_hmm(HMM<GaussianDistribution>* hmm) {
-        t_jit_err err = JIT_ERR_NONE;
+    static void init_hmm(HMM<GaussianDistribution>* hmm, const hmm_training& settings,
+                         vector<arma::Mat<double>>& observations, vector<arma::Row<size_t>>& labels) {
         // Find dimension of the data.
-        const size_t dimensionality = m_observations[0].n_rows;
+        const size_t dimensionality = observations[0].n_rows;
         
-        // Verify dimensionality of data.
-        for (size_t i = 0; i < m_observations.size(); ++i)
-        {
-            if (m_observations[i].n_rows != dimensionality)
-            {
-                (cerr << "Observation sequence " << i << " dimensionality ("
-                 << m_observations[i].n_rows << " is incorrect (should be "
-                 << dimensionality << ")!" << endl);
-            }
-        }
+        *hmm = HMM<GaussianDistribution>(size_t(settings.states), GaussianDistribution(dimensionality), settings.tolerance);
         
-        if(hmm != nullptr) {
-            *hmm = HMM<GaussianDistribution>(size_t(states), GaussianDistribution(dimensionality), tolerance);
-            
-            std::vector<GaussianDistribution>& e = hmm->Emission();
-            for (size_t i = 0; i < e.size(); ++i) {
-                const size_t dimensionality = e[i].Mean().n_rows;
-                e[i].Mean().randu();
-                // Generate random covariance.
-                arma::mat r = arma::randu<arma::mat>(dimensionality, dimensionality);
-                e[i].Covariance(r * r.t());
-            }
+        std::vector<GaussianDistribution>& e = hmm->Emission();
+        for (size_t i = 0; i < e.size(); ++i) {
+            const size_t dimensionality = e[i].Mean().n_rows;
+            e[i].Mean().randu();
+            // Generate random covariance.
+            arma::mat r = arma::randu<arma::mat>(dimensionality, dimensionality);
+            e[i].Covariance(r * r.t());
         }
-        if((err=check_observations(m_observations,hmm->Emission()[0].Dimensionality()))) {
-            return err;
-        };
         
-        if(use_labels) {
-            if(check_labels(m_labels, m_observations, hmm->Transition().n_cols)) {
-                return err;
-            }
-            // std::cout << m_labels[0] << std::endl;
-            hmm->Train(m_observations, m_labels);
+        check_observations(observations, hmm->Emission()[0].Dimensionality());
+        
+        if(settings.use_labels) {
+            check_labels(labels, observations, settings.states);
+            hmm->Train(observations, labels);
         } else {
-            hmm->Train(m_observations);
+            hmm->Train(observations);
         }
-        return err;
     }
     
-    t_jit_err init_hmm(HMM<GMM>* hmm) {
-        t_jit_err err = JIT_ERR_NONE;
+    static void init_hmm(HMM<GMM>* hmm, const hmm_training& settings,
+                         vector<arma::Mat<double>>& observations, vector<arma::Row<size_t>>& labels) {
         // Find dimension of the data.
-        const size_t dimensionality = m_observations[0].n_rows;
+        const size_t dimensionality = observations[0].n_rows;
         
-        if (gaussians == 0) {
-            (cerr << "Number of gaussians for each GMM must be specified "
-             << "when type = 'gmm'!" << endl);
-        }
+        check_gaussians(settings.gaussians, "gmm");
         
-        if (gaussians < 0) {
-            (cerr << "Invalid number of gaussians (" << gaussians << "); must "
-             << "be greater than or equal to 1." << endl);
+        if(!settings.use_labels) {
+            throw std::runtime_error("Unlabeled training of GMM HMMs is almost certainly not going to produce good results! Training terminated.");
         }
         
-        if(hmm != nullptr) {
-            *hmm = HMM<GMM>(size_t(states), GMM(size_t(gaussians), dimensionality), tolerance);
-            
-            std::vector<GMM>& e = hmm->Emission();
+        *hmm = HMM<GMM>(size_t(settings.states), GMM(size_t(settings.gaussians), dimensionality), settings.tolerance);
+        
+        std::vector<GMM>& e = hmm->Emission();
+        
+        for (size_t i = 0; i < e.size(); ++i)
+        {
+            // Random weights.
+            e[i].Weights().randu();
+            e[i].Weights() /= arma::accu(e[i].Weights());
             
-            for (size_t i = 0; i < e.size(); ++i)
+            // Random means and covariances.
+            for (int g = 0; g < settings.gaussians; ++g)
             {
-                // Random weights.
-                e[i].Weights().randu();
-                e[i].Weights() /= arma::accu(e[i].Weights());
+                const size_t dimensionality = e[i].Component(g).Mean().n_rows;
+                e[i].Component(g).Mean().randu();
                 
-                // Random means and covariances.
-                for (int g = 0; g < gaussians; ++g)
-                {
-                    const size_t dimensionality = e[i].Component(g).Mean().n_rows;
-                    e[i].Component(g).Mean().randu();
-                    
-                    // Generate random covariance.
-                    arma::mat r = arma::randu<arma::mat>(dimensionality,
-                                                         dimensionality);
-                    e[i].Component(g).Covariance(r * r.t());
-                }
+                // Generate random covariance.
+                arma::mat r = arma::randu<arma::mat>(dimensionality,
+                                                     dimensionality);
+                e[i].Component(g).Covariance(r * r.t());
             }
         }
         
-        if((err=check_observations(m_observations,hmm->Emission()[0].Dimensionality()))) {
-            return err;
-        };
-        
-        if(use_labels) {
-            if((err=check_labels(m_labels, m_observations, hmm->Transition().n_cols))) {
-                return err;
-            }
-            hmm->Train(m_observations, m_labels);
-        } else {
-            (cwarn << "Unlabeled training of GMM HMMs is almost certainly not going to produce good results! Training terminated. " << endl);
-            //hmm->Train(m_observations);
-        }
-        return err;
+        check_observations(observations, hmm->Emission()[0].Dimensionality());
+        check_labels(labels, observations, settings.states);
+        hmm->Train(observations, labels);
     }
     
-    t_jit_err init_hmm(HMM<DiagonalGMM>* hmm) {
-        t_jit_err err = JIT_ERR_NONE;
+    static void init_hmm(HMM<DiagonalGMM>* hmm, const hmm_training& settings,
+                         vector<arma::Mat<double>>& observations, vector<arma::Row<size_t>>& labels) {
+        const size_t dimensionality = observations[0].n_rows;
         
-        const size_t dimensionality = m_observations[0].n_rows;
+        check_gaussians(settings.gaussians, "diag_gmm");
         
-        if (gaussians == 0){
-            (cerr << "Number of gaussians for each GMM must be specified " << "when type = 'diag_gmm'!" << endl);
-        }
-        if (gaussians < 0)  {
-            (cerr << "Invalid number of gaussians (" << gaussians << "); must "  << "be greater than or equal to 1." << endl);
+        if(!settings.use_labels) {
+            throw std::runtime_error("Unlabeled training of Diagonal GMM HMMs is almost certainly not going to produce good results! Training terminated.");
         }
         
-        if(hmm != nullptr) {
-            *hmm = HMM<DiagonalGMM>(size_t(states), DiagonalGMM(size_t(gaussians), dimensionality), tolerance);
-            
-            std::vector<DiagonalGMM>& e = hmm->Emission();
+        *hmm = HMM<DiagonalGMM>(size_t(settings.states), DiagonalGMM(size_t(settings.gaussians), dimensionality), settings.tolerance);
+        
+        std::vector<DiagonalGMM>& e = hmm->Emission();
+        
+        for (size_t i = 0; i < e.size(); ++i) {
+            // Random weights.
+            e[i].Weights().randu();
+            e[i].Weights() /= arma::accu(e[i].Weights());
             
-            for (size_t i = 0; i < e.size(); ++i) {
-                // Random weights.
-                e[i].Weights().randu();
-                e[i].Weights() /= arma::accu(e[i].Weights());
+            // Random means and covariances.
+            for (int g = 0; g < settings.gaussians; ++g) {
+                const size_t dimensionality = e[i].Component(g).Mean().n_rows;
+                e[i].Component(g).Mean().randu();
                 
-                // Random means and covariances.
-                for (int g = 0; g < gaussians; ++g) {
-                    const size_t dimensionality = e[i].Component(g).Mean().n_rows;
-                    e[i].Component(g).Mean().randu();
-                    
-                    // Generate random diagonal covariance.
-                    arma::vec r = arma::randu<arma::vec>(dimensionality);
-                    e[i].Component(g).Covariance(r);
-                }
+                // Generate random diagonal covariance.
+                arma::vec r = arma::randu<arma::vec>(dimensionality);
+                e[i].Component(g).Covariance(r);
             }
         }
         
-        if((err=check_observations(m_observations,hmm->Emission()[0].Dimensionality()))) {
-            return err;
-        };
-        
-        if(use_labels) {
-            if((err=check_labels(m_labels, m_observations, hmm->Transition().n_cols))) {
-                return err;
-            }
-            hmm->Train(m_observations, m_labels);
-        } else {
-            (cwarn << "Unlabeled training of Diagonal GMM HMMs is almost certainly not going to produce good results! Training terminated. " << endl);
-            //hmm->Train(m_observations);
-        }
-        return err;
+        check_observations(observations, hmm->Emission()[0].Dimensionality());
+        check_labels(labels, observations, settings.states);
+        hmm->Train(observations, labels);
     }
     
     
@@ -629,48 +586,53 @@ public:
     
 private:
     
-    t_jit_err check_observations(vector<arma::Mat<double>>& obs, const size_t s ) {
-        t_jit_err err = JIT_ERR_NONE;//
+    static void check_gaussians(const int gaussians, const string& type) {
+        if (gaussians <= 0) {
+            std::ostringstream oss;
+            oss << "Invalid number of gaussians (" << gaussians << ") for type '" << type << "'; must "
+            << "be greater than or equal to 1.";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    
+    static void check_observations(vector<arma::Mat<double>>& obs, const size_t s ) {
         for(size_t i=0;i<obs.size();i++) {
             if(obs[i].n_rows != s) {
-                
-                cerr << "Dimensionality of training sequence " << i << " (" << obs[i].n_rows << ") is not equal to the dimensionality of " << "the HMM (" << s << ")!"
-                << endl;
-                return JIT_ERR_GENERIC;
+                std::ostringstream oss;
+                oss << "Dimensionality of training sequence " << i << " (" << obs[i].n_rows << ") is not equal to the dimensionality of " << "the HMM (" << s << ")!";
+                throw std::runtime_error(oss.str());
             }
         }
-        return err;
     }
     
-    t_jit_err check_labels(vector<arma::Row<size_t>>& labels,  vector<arma::Mat<double>>& obs, const size_t ) {
-        t_jit_err err = JIT_ERR_NONE;//
+    static void check_labels(vector<arma::Row<size_t>>& labels,  vector<arma::Mat<double>>& obs, const int states) {
+        std::ostringstream oss;
         // are vectors same size
         if(labels.size() != obs.size()) {
-            cerr << "Label sequence does not have the same number of points as observation sequence!" << endl;
-            return JIT_ERR_GENERIC;
+            throw std::runtime_error("Label sequence does not have the same number of points as observation sequence!");
         }
         
         //do labels and observations have same number of entries
         for(size_t i=0;i<obs.size();i++) {
             if(obs[i].n_cols != labels[i].n_cols) {
-                cerr << "Label sequence " <<  i << " does not have"
+                oss << "Label sequence " <<  i << " does not have"
                 << " the same number of points (" << labels[i].n_cols << ") as observation sequence "
-                << obs[i].n_cols << "!" << endl;
-                return JIT_ERR_GENERIC;
+                << obs[i].n_cols << "!";
+                throw std::runtime_error(oss.str());
             }
             //do labels match hidden states of hmm
             for (size_t j = 0; j < labels[i].n_cols; j++) {
                 if (labels[i][j] > states) {
-                    cerr << "HMM has " << states << " hidden "
+                    oss << "HMM has " << states << " hidden "
                     << "states, but labels contain " << labels[i][j]
                     << " (should be between 0 and "
-                    << states << ")!" << endl;
-                    return JIT_ERR_GENERIC;
+                    << states << ")!";
+                    throw std::runtime_error(oss.str());
                 }
             }
         }
-        return err;
     }
+    
     vector<arma::Mat<double>> m_observations;
     vector<arma::Row<size_t>> m_labels;
 };
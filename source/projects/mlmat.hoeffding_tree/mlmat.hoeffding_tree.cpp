@@ -106,7 +106,7 @@ public:
     
     message<> clear { this, "clear", "clear model.",
         MIN_FUNCTION {
-            m_model.model.reset();
+            m_model.clear();
             m_data.reset();
             m_labels.reset();
             return {};
@@ -124,6 +124,7 @@ public:
             DatasetInfo dataset_info;
             int num_passes = passes;
             arma::mat out_data;
+            std::shared_ptr<model_version> next;
             
             const string strategy = numeric_split_strategy.get().c_str();
             
@@ -145,23 +146,30 @@ public:
             
             //1. if model is null or type is different must remake
             
-            scaler_fit(m_model, *m_data);
-            out_data = scaler_transform(m_model, *m_data, out_data);
+            if(batch_mode || !m_model.snapshot()->model) {  //need to check underlying data in same format.
+                next = std::make_shared<model_version>();
+            } else {
+                // keeps training a copy, matrix_calc goes on using the published tree meanwhile
+                next = std::make_shared<model_version>(*m_model.snapshot());
+            }
+            
+            scaler_fit(*next, *m_data);
+            out_data = scaler_transform(*next, *m_data, out_data);
             
 
-            if(batch_mode || (m_model.model == nullptr)) {  //need to check underlying data in same format.
+            if(batch_mode || !next->model) {
             
                 if(!info_gain && (strategy == "domingos")) {
-                    m_model.model = std::make_unique<HoeffdingTreeModel>(HoeffdingTreeModel::GINI_HOEFFDING);
+                    next->model = std::make_unique<HoeffdingTreeModel>(HoeffdingTreeModel::GINI_HOEFFDING);
                 }
                 else if (info_gain && (strategy == "binary")) {
-                     m_model.model = std::make_unique<HoeffdingTreeModel>(HoeffdingTreeModel::GINI_BINARY);
+                     next->model = std::make_unique<HoeffdingTreeModel>(HoeffdingTreeModel::GINI_BINARY);
                 }
                 else if (info_gain && (strategy == "domingos")) {
-                    m_model.model = std::make_unique<HoeffdingTreeModel>(HoeffdingTreeModel::INFO_HOEFFDING);
+                    next->model = std::make_unique<HoeffdingTreeModel>(HoeffdingTreeModel::INFO_HOEFFDING);
                 }
                 else {
-                    m_model.model = std::make_unique<HoeffdingTreeModel>(HoeffdingTreeModel::INFO_BINARY);
+                    next->model = std::make_unique<HoeffdingTreeModel>(HoeffdingTreeModel::INFO_BINARY);
                 }
             
                 numClasses = arma::max(arma::max(*m_labels)) + 1;
@@ -172,24 +180,25 @@ public:
                     dataset_info.Type(i) = data::Datatype::numeric;
                 }
                 // this will reset the model and build a new one. if batch_mode is true will also train using 1 pass
-                m_model.model->BuildModel(out_data, dataset_info, *m_labels, numClasses, batch_mode, confidence, max_samples, check_interval, min_samples, bins, observations_before_binning);
+                next->model->BuildModel(out_data, dataset_info, *m_labels, numClasses, batch_mode, confidence, max_samples, check_interval, min_samples, bins, observations_before_binning);
                 num_passes--;
                 
                 //if batch_mode is not true need to do initial training N number of passes
                 if(!batch_mode) {
                     for(auto p = 0;p < num_passes;p++) {
-                        m_model.model->Train(out_data, *m_labels, false);
+                        next->model->Train(out_data, *m_labels, false);
                     }
                 }
             } else {
                 
                 for(auto p = 0;p < num_passes;p++) {
-                    m_model.model->Train(out_data, *m_labels, false);
+                    next->model->Train(out_data, *m_labels, false);
                 }
                 
             }
             
-            m_model.model->Classify(out_data, predictions);
+            next->model->Classify(out_data, predictions);
+            publish_model(next);
     
             for (size_t i = 0; i < m_data->n_cols; ++i) {
                 if (predictions[i] == (*m_labels)[i]) {
@@ -228,6 +237,7 @@ public:
 
             // force type
             jit_mop_single_type(mop, _jit_sym_float64);
+            jit_mop_input_all_types(mop, 1);
         
             auto in2 = object_method(mop,_jit_sym_getinput,2);
             auto in3 = object_method(mop,_jit_sym_getinput,3);
@@ -271,6 +281,7 @@ public:
         arma::mat query;
         arma::Row<size_t> predictions;
         arma::rowvec probabilities;
+        auto current = m_model.snapshot();
 
         auto in_matrix = (t_object*)object_method(inputs, _jit_sym_getindex, 0);
         auto in_data = (t_object*)object_method(inputs, _jit_sym_getindex, 1);
@@ -288,10 +299,10 @@ public:
         object_method(in_matrix, _jit_sym_getinfo, &in_matrix_info);
         
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_matrix_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
 
         
-        query = jit_to_arma(mode, in_matrix64, query);
+        query = jit_to_arma(mode, in_query_matrix, query);
     
 
         try {
@@ -306,10 +317,15 @@ public:
             goto out;
         }
         
+        if(!current->model) {
+            cerr << "no model has been trained" << endl;
+            goto out;
+        }
+        
         try {
             arma::mat scaled_query;
-            scaled_query = scaler_transform(m_model, query, scaled_query);
-            m_model.model->Classify(scaled_query, predictions, probabilities);
+            scaled_query = scaler_transform(*current, query, scaled_query);
+            current->model->Classify(scaled_query, predictions, probabilities);
         } catch (const std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
@@ -335,7 +351,6 @@ public:
         out_probabilities = arma_to_jit(mode, probabilities, out_probabilities, out_probabilities_info);
 
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         object_method(in_matrix,_jit_sym_lock,in_matrix_savelock);
         object_method(in_data,_jit_sym_lock,in_data_savelock);
         object_method(in_labels,_jit_sym_lock,in_labels_savelock);
@@ -359,11 +374,13 @@ private:
         path p {f, path::filetype::any};
 
         if(p) {
+            auto next = std::make_shared<model_version>();
             try {
-                mlpack::data::Load(string(p), "hoeffding_tree", m_model, true);
+                mlpack::data::Load(string(p), "hoeffding_tree", *next, true);
             } catch (const std::runtime_error& s) {
                 std::throw_with_nested(std::runtime_error("Error reading model file to disk."));
             }
+            m_model.publish(std::move(next));
         }
     }
 
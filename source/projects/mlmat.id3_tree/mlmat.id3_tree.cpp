@@ -99,6 +99,7 @@ public:
             arma::Row<size_t> predictions;
             arma::mat probabilities;
             arma::mat out_data;
+            auto next = std::make_shared<model_version>();
             
             size_t correct = 0;
             t_atom a[1];
@@ -122,13 +123,13 @@ public:
             
             numClasses = arma::max(arma::max(*m_labels)) + 1;
             
-            m_model.model = std::make_unique<DecisionTreeModel>();
+            next->model = std::make_unique<DecisionTreeModel>();
             
-            scaler_fit(m_model, *m_data);
-            out_data = scaler_transform(m_model, *m_data, out_data);
+            scaler_fit(*next, *m_data);
+            out_data = scaler_transform(*next, *m_data, out_data);
             
             try {
-                m_model.model->tree = DecisionTree<>(out_data, *m_labels, numClasses, minimum_leaf_size, minimum_gain_split, maximum_depth);
+                next->model->tree = DecisionTree<>(out_data, *m_labels, numClasses, minimum_leaf_size, minimum_gain_split, maximum_depth);
             } catch (std::invalid_argument& s) {
                 (cerr << s.what() << endl);
                 goto out;
@@ -136,7 +137,8 @@ public:
             
            
             
-            m_model.model->tree.Classify(out_data, predictions, probabilities);
+            next->model->tree.Classify(out_data, predictions, probabilities);
+            publish_model(std::move(next));
             
             for (size_t i = 0; i < m_data->n_cols; ++i) {
                 if (predictions[i] == (*m_labels)[i]) {
@@ -159,7 +161,7 @@ public:
     
     message<> clear { this, "clear", "clear model.",
         MIN_FUNCTION {
-            m_model.model.reset();
+            m_model.clear();
             m_data.reset();
             m_labels.reset();
             return {};
@@ -191,6 +193,7 @@ public:
             
             // force type
             jit_mop_single_type(mop, _jit_sym_float64);
+            jit_mop_input_all_types(mop, 1);
             
             auto in2 = object_method(mop,_jit_sym_getinput,2);
             auto in3 = object_method(mop,_jit_sym_getinput,3);
@@ -219,10 +222,8 @@ public:
         t_jit_matrix_info in_matrix_info;
         object_method(matrix, _jit_sym_getinfo, &in_matrix_info);
         
-        t_object* in_matrix_long = convert_to_long(static_cast<t_object*>(matrix), in_matrix_info);
         m_labels = std::make_unique<arma::Row<size_t>>();
-        *m_labels = jit_to_arma(mode, in_matrix_long, *m_labels);
-        if(matrix != in_matrix_long) { jit_object_free(in_matrix_long); }
+        *m_labels = jit_to_arma(mode, matrix, *m_labels);
         return err;
     }
     
@@ -242,6 +243,7 @@ public:
         arma::mat query;
         arma::Row<size_t> predictions;
         arma::mat probabilities;
+        auto current = m_model.snapshot();
         
         auto in_matrix = (t_object*)object_method(inputs, _jit_sym_getindex, 0);
         auto in_data = (t_object*)object_method(inputs, _jit_sym_getindex, 1);
@@ -258,9 +260,9 @@ public:
         
         object_method(in_matrix, _jit_sym_getinfo, &in_matrix_info);
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_matrix_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
         
-        if(!m_model.model) {
+        if(!current->model) {
             (cerr << "no model trained." << endl);
             goto out;
         }
@@ -272,7 +274,7 @@ public:
             goto out;
         }
         
-        query = jit_to_arma(mode, in_matrix64, query);
+        query = jit_to_arma(mode, in_query_matrix, query);
         
         
         if(!m_data) {
@@ -287,8 +289,8 @@ public:
         
         try {
             arma::mat scaled_query;
-            scaled_query = scaler_transform(m_model, query, scaled_query);
-            m_model.model->tree.Classify(std::move(scaled_query), predictions, probabilities);
+            scaled_query = scaler_transform(*current, query, scaled_query);
+            current->model->tree.Classify(std::move(scaled_query), predictions, probabilities);
         } catch (const std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
@@ -337,7 +339,6 @@ public:
         out_probabilities = arma_to_jit(mode, probabilities, out_probabilities, out_probabilities_info);
         
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         object_method(in_matrix,_jit_sym_lock,in_matrix_savelock);
         object_method(in_data,_jit_sym_lock,in_data_savelock);
         object_method(in_labels,_jit_sym_lock,in_labels_savelock);
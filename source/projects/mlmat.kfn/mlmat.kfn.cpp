@@ -9,6 +9,8 @@
 
 
 #include "mlmat.hpp"
+#include "core/neighbor_search.hpp"
+#include "core/reference_file.hpp"
 #include <mlpack/methods/neighbor_search/neighbor_search.hpp>
 #include <mlpack/methods/neighbor_search/unmap.hpp>
 #include <mlpack/core/util/timers.hpp>
@@ -21,7 +23,7 @@ using namespace c74::max;
 using namespace mlpack;
 using namespace mlpack::util;
 
-typedef NSModel<FurthestNS> KFNModel;
+typedef mlmat::kfn_index KFNModel;
 // C function declarations
 void max_mlmat_kfn_jit_matrix(max_jit_wrapper *x, t_symbol *s, short argc,t_atom *argv);
 void mlmat_kfn_assist(void* x, void* b, long m, long a, char* s) ;
@@ -31,7 +33,7 @@ t_jit_err mlmat_matrix_calc(t_object* x, t_object* inputs, t_object* outputs);
 class mlmat_kfn : public mlmat_object_writable<mlmat_kfn, KFNModel>
 {
 public:
-    MIN_DESCRIPTION     {"K-farthest neighbor search. An implementation of k-farthest-neighbor search using single-tree and dual-tree algorithms. Given a set of reference points and query points, this can find the k furthest neighbors in the reference set of each query point using trees; trees that are built can be saved for future use."};
+    MIN_DESCRIPTION     {"K-farthest neighbor search. An implementation of k-farthest-neighbor search using single-tree and dual-tree algorithms, or approximately with DrusillaSelect or QDAFN. Given a set of reference points and query points, this can find the k furthest neighbors in the reference set of each query point using trees; trees that are built can be saved for future use."};
     MIN_TAGS            {"ML"};
     MIN_AUTHOR          {"Todd Ingalls"};
     MIN_RELATED         {"mlmat.knn"};
@@ -75,9 +77,37 @@ public:
     
     attribute<min::symbol> algorithm { this, "algorithm", "dual_tree",
         description {
-            "Type of neighbor search"
+            "Type of neighbor search. drusilla (DrusillaSelect) and qdafn (query dependent approximate furthest neighbor) keep num_tables * num_projections candidates picked from the reference set instead of a tree and answer approximate queries from those alone, which is far faster for a large set. neighbors can be no more than the number of candidates."
         },
-        range {"naive", "single_tree", "dual_tree", "greedy"}
+        range {"naive", "single_tree", "dual_tree", "greedy", "drusilla", "qdafn"}
+    };
+    
+    attribute<int> num_tables { this, "num_tables", 5,
+        description {
+            "Number of projections (DrusillaSelect) or hash tables (QDAFN) candidates are picked from, used when algorithm is drusilla or qdafn."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
+    };
+    
+    attribute<int> num_projections { this, "num_projections", 5,
+        description {
+            "Number of candidates picked from each table, used when algorithm is drusilla or qdafn."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
     };
     
     attribute<int> leaf_size { this, "leaf_size", 20,
@@ -100,6 +130,20 @@ public:
         range {0., 1.}
     };
     
+    attribute<int> threads { this, "threads", 1,
+        description {
+            "Number of threads a query matrix is split across. With algorithm dual_tree each thread searches its part single tree, which finds the same neighbors, since dual tree search writes to the tree."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
+    };
+    
     attribute<bool> random_basis { this, "random_basis", false,
         description {
             "Before tree-building, project the data onto a random orthogonal basis."
@@ -112,21 +156,93 @@ public:
         }
     };
     
+    attribute<int> cache { this, "cache", 0,
+        description {
+            "Number of recent query matrices whose neighbors and distances are kept. A query that matches one of them cell for cell, with the same reference set and attributes, gets the kept outputs again without being searched. 0 turns it off."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 0) {
+                value = 0;
+            }
+            return {value};
+        }}
+    };
+    
+    message<> cache_hits { this, "cache_hits", "Outputs how many frames the cache answered and how many it had to search via dump outlet.",
+        MIN_FUNCTION {
+            report_cache();
+            return {};
+        }
+    };
+    
     message<> clear { this, "clear", "clear model.",
         MIN_FUNCTION {
-            m_model.model.reset();
+            m_trainer.cancel();
+            m_model.clear();
             return {};
         }
         
     };
     
+    message<> write_mapped { this, "write_mapped", "Write the reference set to a file that read maps instead of loading, as in write_mapped corpus.mlmat. Reading one is near instant: the tree is built in the background and queries are answered by brute force until it is done.",
+        MIN_FUNCTION {
+            adopt_trained_model();
+            auto current = m_model.snapshot();
+            std::string path;
+            
+            if(!current->reference) {
+                (cerr << "no reference set sent to this object or read from a mapped file" << endl);
+                return {};
+            }
+            if(!save_file_path(args, path)) {
+                return {};
+            }
+            mlmat::reference_file_settings settings;
+            settings.params = search_params();
+            if(current->scaler) {
+                settings.scaler = std::make_unique<mlpack::data::ScalingModel>(*current->scaler);
+            }
+            settings.dim0 = current->dim0;
+            settings.dimcount = current->dimcount;
+            settings.autoscale = current->autoscale;
+            const arma::mat& reference = *current->reference;
+            try {
+                mlmat::write_reference_file(path, settings, reference.n_rows, reference.n_cols,
+                    [&reference](const size_t first, const size_t count, arma::mat& out) {
+                        out = reference.cols(first, first + count - 1);
+                    });
+            } catch (const std::runtime_error& s) {
+                cerr << s.what() << endl;
+            }
+            return {};
+        }
+    };
+    
 
     t_jit_err matrix_calc(t_object* x, t_object* inputs, t_object* outputs) {
         t_jit_err err = JIT_ERR_NONE;
         t_jit_matrix_info in_query_info, out_neighbors_info, out_distances_info;
-        arma::mat query;
-        arma::Mat<size_t> resulting_neighbors;
-        arma::mat resulting_distances;
+        arma::mat& query = m_scratch.query;
+        arma::Mat<size_t>& resulting_neighbors = m_scratch.indices;
+        arma::mat& resulting_distances = m_scratch.distances;
+        
+        m_scratch.begin_frame();
+        adopt_trained_model();
+        const uint64_t key = cache_key(cache, neighbors.get(), epsilon.get(), algorithm.get(), tree_type.get(),
+                                     num_tables.get(), num_projections.get(), percentage.get());
+        
+        // the reference set can be replaced while this frame runs, the snapshot keeps this one alive
+        auto current = m_model.snapshot();
+        // a set read from a mapped file is searched by brute force until its tree is built
+        const arma::mat* reference = current->model ? nullptr : current->reference.get();
+        const size_t references = current->model ? current->model->size() : reference ? size_t(reference->n_cols) : 0;
+        const size_t dimensions = current->model ? current->model->dimensions() : reference ? size_t(reference->n_rows) : 0;
+        
+        if(!current->model && current->reference && !training()) {
+            tree_starter.set();
+        }
         
         auto in_matrix = object_method(inputs, _jit_sym_getindex, 0);
         auto out_neighbors = object_method(outputs, _jit_sym_getindex, 0);
@@ -138,9 +254,13 @@ public:
         
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
 
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
+        
+        if(cached_outputs(key, in_query_matrix, outputs, 2)) {
+            goto out;
+        }
         
-        if(m_model.model == nullptr || m_model.model->Dataset().is_empty()) {
+        if(references == 0) {
             (cerr << "no reference set exists" << endl);
             goto out;
         }
@@ -150,7 +270,7 @@ public:
             goto out;
         }
         
-        object_method(in_matrix64, _jit_sym_getinfo, &in_query_info);
+        object_method(in_query_matrix, _jit_sym_getinfo, &in_query_info);
         
         try {
             check_mode(in_query_info, mode, "kfn");
@@ -159,32 +279,33 @@ public:
             goto out;
         }
         
-        query = jit_to_arma(mode, static_cast<t_object*>(in_matrix64), query);
+        query = jit_to_arma_view(mode, static_cast<t_object*>(in_query_matrix), query);
         
-        try {
-            CheckSameDimensionality(query, m_model.model->Dataset(), "kfn");
-        } catch (const std::invalid_argument& s) {
-            cerr << s.what() << endl;
+        if(query.n_rows != dimensions) {
+            (cerr << "kfn: query has " << query.n_rows << " dimensions, reference set has " << dimensions << endl);
             goto out;
         }
         
-        if(neighbors > m_model.model->Dataset().n_cols) {
-             (cerr << "number of neighbors requested(" << neighbors << ") exceeds entries in reference set (" << m_model.model->Dataset().n_cols << ")" << endl);
+        if(neighbors > references) {
+             (cerr << "number of neighbors requested(" << neighbors << ") exceeds entries in reference set (" << references << ")" << endl);
              goto out;
         }
         
         try {
-            Timers u = Timers();
             arma::mat scaled_query;
-            scaled_query = scaler_transform(m_model, query, scaled_query);
-            m_model.model->Search(u, std::move(scaled_query), neighbors, resulting_neighbors, resulting_distances);
+            scaled_query = scaler_transform(*current, query, scaled_query);
+            if(current->model) {
+                mlmat::search_neighbors(*current->model, std::move(scaled_query), neighbors, query_params(), resulting_neighbors, resulting_distances);
+            } else {
+                mlmat::search_reference<FurthestNS>(*reference, std::move(scaled_query), neighbors, query_params(), resulting_neighbors, resulting_distances);
+            }
         } catch (const std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
         }
 
         
-        out_neighbors_info.planecount = m_model.dimcount;
+        out_neighbors_info.planecount = current->dimcount;
         out_distances_info.planecount = 1;
         out_neighbors_info.type = _jit_sym_long;
         out_distances_info.type = _jit_sym_float64;
@@ -226,11 +347,12 @@ public:
         }
         
         
-        out_neighbors = arma_to_jit(mode, resulting_neighbors, static_cast<t_object*>(out_neighbors), out_neighbors_info, true, m_model.dim0);
+        out_neighbors = arma_to_jit(mode, resulting_neighbors, static_cast<t_object*>(out_neighbors), out_neighbors_info, true, current->dim0);
         out_distances = arma_to_jit(mode, resulting_distances, static_cast<t_object*>(out_distances), out_distances_info);
+        cache_outputs(key, in_query_matrix, outputs, 2);
 
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
+        m_scratch.end_frame();
         
         object_method(in_matrix,_jit_sym_lock,query_savelock);
         object_method(out_neighbors,_jit_sym_lock,out_neighbors_savelock);
@@ -244,12 +366,11 @@ public:
         t_jit_err err = JIT_ERR_NONE;
         arma::mat dat;
         arma::mat out_data;
-        Timers u = Timers();
-        NeighborSearchMode search_mode = DUAL_TREE_MODE;
-        KFNModel::TreeTypes tree = KFNModel::KD_TREE;
-        const string algorithm_string = algorithm.get().c_str();
-        const string tree_type_string = tree_type.get().c_str();
-        double adjusted_epsilon = 1 - percentage;
+        mlmat::neighbor_search_params params = search_params();
+        auto next = std::make_shared<model_version>();
+        
+        // a tree being built for a mapped file would be turned down anyway
+        m_trainer.cancel();
         
         long savelock = (long) object_method(matrix, _jit_sym_lock, 1);
         object_method(matrix, _jit_sym_getinfo, &minfo);
@@ -260,10 +381,10 @@ public:
             goto out;
         }
 
-        m_model.dimcount = minfo.dimcount;
+        next->dimcount = minfo.dimcount;
          
          if(minfo.dimcount == 2) {
-             m_model.dim0 = minfo.dim[0];
+             next->dim0 = minfo.dim[0];
          }
 
          try {
@@ -274,64 +395,28 @@ public:
          }
            
     
-        dat = jit_to_arma(mode, matrix, dat);
-        
-        m_model.model = std::make_unique<KFNModel>();
-        
-        if (algorithm_string == "naive")
-          search_mode = NAIVE_MODE;
-        else if (algorithm_string == "single_tree")
-          search_mode = SINGLE_TREE_MODE;
-        else if (algorithm_string == "dual_tree")
-          search_mode = DUAL_TREE_MODE;
-        else if (algorithm_string == "greedy")
-          search_mode = GREEDY_SINGLE_TREE_MODE;
-        
-        //maybe use hash table instead
-        if (tree_type_string == "kd")
-          tree = KFNModel::KD_TREE;
-        else if (tree_type_string == "cover")
-          tree = KFNModel::COVER_TREE;
-        else if (tree_type_string == "r")
-          tree = KFNModel::R_TREE;
-        else if (tree_type_string == "r-star")
-          tree = KFNModel::R_STAR_TREE;
-        else if (tree_type_string == "ball")
-          tree = KFNModel::BALL_TREE;
-        else if (tree_type_string == "x")
-          tree = KFNModel::X_TREE;
-        else if (tree_type_string == "hilbert-r")
-          tree = KFNModel::HILBERT_R_TREE;
-        else if (tree_type_string == "r-plus")
-          tree = KFNModel::R_PLUS_TREE;
-        else if (tree_type_string == "r-plus-plus")
-          tree = KFNModel::R_PLUS_PLUS_TREE;
-        else if (tree_type_string == "spill")
-          tree = KFNModel::SPILL_TREE;
-        else if (tree_type_string == "vp")
-          tree = KFNModel::VP_TREE;
-        else if (tree_type_string == "rp")
-          tree = KFNModel::RP_TREE;
-        else if (tree_type_string == "max-rp")
-          tree = KFNModel::MAX_RP_TREE;
-        else if (tree_type_string == "ub")
-          tree = KFNModel::UB_TREE;
-        else if (tree_type_string == "oct")
-          tree = KFNModel::OCTREE;
-        
-        m_model.model->TreeType() = tree;
-        m_model.model->RandomBasis() = random_basis;
-        m_model.model->LeafSize() = leaf_size;
+        dat = jit_to_arma_view(mode, matrix, dat);
+        
+        next->model = std::make_unique<KFNModel>();
 
         if (seed != 0)
           mlpack::RandomSeed((size_t) seed);
         else
           mlpack::RandomSeed((size_t) std::time(NULL));
         
-        scaler_fit(m_model, dat);
-        out_data = scaler_transform(m_model, dat, out_data);
+        scaler_fit(*next, dat);
+        out_data = scaler_transform(*next, dat, out_data);
+        // the tree reorders its copy, write_mapped writes this one
+        next->reference = std::make_shared<const arma::mat>(out_data);
 
-        m_model.model->BuildModel(u, std::move(dat), search_mode, adjusted_epsilon);
+        try {
+            mlmat::build_neighbor_model(*next->model, params, std::move(out_data));
+        } catch (const std::invalid_argument& s) {
+            cerr << s.what() << endl;
+            err = JIT_ERR_INVALID_INPUT;
+            goto out;
+        }
+        publish_model(std::move(next));
         m_mode_changed = false;
     out:
 
@@ -340,8 +425,125 @@ public:
     }
     
     
+    // reads a file written by write_mapped. its points are used from the mapping, the tree is built in the background
+    bool read_mapped_model(const std::string& path) {
+        if(!mlmat::is_reference_file(path)) {
+            return false;
+        }
+        mlmat::reference_file_settings settings;
+        auto points = mlmat::read_reference_file(path, settings);
+        auto next = std::make_shared<model_version>();
+        next->scaler = std::move(settings.scaler);
+        next->dim0 = settings.dim0;
+        next->dimcount = settings.dimcount;
+        next->autoscale = settings.autoscale;
+        next->reference = points;
+        
+        m_trainer.cancel();
+        std::lock_guard<std::mutex> lock(m_publish_mutex);
+        m_mapped_params = settings.params;
+        m_model.publish(next);
+        build_mapped_tree(next);
+        return true;
+    }
+    
+    // the tree built for a mapped file keeps the mapped reference set, anything else was sent since
+    bool accept_trained_model(model_version& next, const model_version& current) {
+        if(&current != m_building_from.get()) {
+            return false;
+        }
+        next.dim0 = current.dim0;
+        next.dimcount = current.dimcount;
+        next.reference = current.reference;
+        return true;
+    }
+    
+    // a tree can only be written once it is built
+    std::shared_ptr<model_version> version_to_write() {
+        std::lock_guard<std::mutex> lock(m_publish_mutex);
+        auto current = m_model.snapshot();
+        
+        if(current->model || !current->reference) {
+            return current;
+        }
+        auto next = std::make_shared<model_version>(*current);
+        next->model = std::make_unique<KFNModel>();
+        try {
+            mlmat::build_neighbor_model(*next->model, m_mapped_params, arma::mat(*current->reference));
+        } catch (const std::invalid_argument& s) {
+            throw std::runtime_error(s.what());
+        }
+        m_trainer.cancel();
+        m_model.publish(next);
+        return next;
+    }
+    
 private:
     
+    mlmat::neighbor_search_params search_params() {
+        mlmat::neighbor_search_params params;
+        params.algorithm = algorithm.get().c_str();
+        params.tree_type = tree_type.get().c_str();
+        params.leaf_size = leaf_size;
+        params.random_basis = random_basis;
+        params.epsilon = 1 - percentage;
+        params.num_tables = num_tables;
+        params.num_projections = num_projections;
+        return params;
+    }
+    
+    // starts the tree for a set read from a mapped file on the main thread when matrix_calc finds it unbuilt
+    // with nothing running, which happens when read could not start it because other training was still going
+    queue<> tree_starter { this,
+        MIN_FUNCTION {
+            std::lock_guard<std::mutex> lock(m_publish_mutex);
+            auto current = m_model.snapshot();
+            if(!current->model && current->reference && !training() && m_building_from != current) {
+                build_mapped_tree(current);
+            }
+            return {};
+        }
+    };
+    
+    // builds the tree over a reference set read from a mapped file on the training worker. called
+    // on the main thread with m_publish_mutex held, which also guards m_building_from
+    void build_mapped_tree(const std::shared_ptr<model_version>& current) {
+        const bool started = train_in_background([current, params = m_mapped_params, build_seed = int(seed)](mlmat_training_status& status) {
+            if (build_seed != 0) {
+              mlpack::RandomSeed((size_t) build_seed);
+            } else {
+              mlpack::RandomSeed((size_t) std::time(NULL));
+            }
+            auto trained = std::make_unique<mlmat_trained_model<KFNModel>>();
+            status.progress(0, 1);
+            if(current->scaler) {
+                trained->scaler = std::make_unique<mlpack::data::ScalingModel>(*current->scaler);
+            }
+            trained->model = std::make_unique<KFNModel>();
+            // the tree needs its own copy to reorder
+            mlmat::build_neighbor_model(*trained->model, params, arma::mat(*current->reference));
+            status.progress(1, 1);
+            return trained;
+        });
+        
+        if(started) {
+            m_building_from = current;
+        }
+    }
+    
+    // what the last tree for a mapped file was started from, and the settings written with the file
+    std::shared_ptr<const model_version> m_building_from { nullptr };
+    mlmat::neighbor_search_params m_mapped_params;
+    
+    // matrix_calc settings for the search, m_workers is only used from there
+    mlmat::neighbor_query_params query_params() {
+        mlmat::neighbor_query_params params;
+        m_workers.resize(threads);
+        params.workers = &m_workers;
+        return params;
+    }
+    
+    mlmat::worker_pool m_workers;
                 
     void load_model_file(const atoms& args) {
         atoms f{};
@@ -353,11 +555,16 @@ private:
         path p {f, path::filetype::any};
 
         if(p) {
+            if(read_mapped_model(string(p))) {
+                return;
+            }
+            auto next = std::make_shared<model_version>();
             try {
-                mlpack::data::Load(string(p), "kfn_model", m_model, true);
+                mlpack::data::Load(string(p), "kfn_model", *next, true);
             } catch (const std::runtime_error& s) {
                 std::throw_with_nested(std::runtime_error("Error reading model file to disk."));
             }
+            m_model.publish(std::move(next));
         }
     }
     
@@ -369,6 +576,7 @@ private:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
        
         auto ref_input = jit_object_method(mop,_jit_sym_getinput,2);
    
@@ -5,14 +5,7 @@
 
 
 #include "mlmat.hpp"
-#include <mlpack/methods/kmeans.hpp>
-#include <mlpack/methods/kmeans/allow_empty_clusters.hpp>
-#include <mlpack/methods/kmeans/kill_empty_clusters.hpp>
-#include <mlpack/methods/kmeans/refined_start.hpp>
-#include <mlpack/methods/kmeans/elkan_kmeans.hpp>
-#include <mlpack/methods/kmeans/hamerly_kmeans.hpp>
-#include <mlpack/methods/kmeans/pelleg_moore_kmeans.hpp>
-#include <mlpack/methods/kmeans/dual_tree_kmeans.hpp>
+#include "core/kmeans.hpp"
 
 using namespace c74::min;
 using namespace c74::max;
@@ -68,7 +61,52 @@ public:
     };
     
     attribute<bool> refined_start { this, "refined_start", false,
-        description {"Use refined start sampling to partition data."}
+        description {"Use refined start sampling to partition data. Same as init refined, which it overrides."}
+    };
+    
+    attribute<c74::min::symbol> init { this, "init", "sample",
+        description {
+            "How the starting centroids are picked. sample picks points at random, refined clusters samples of the data (see samplings and percentage), kmeans++ picks them one at a time, each with a probability proportional to its squared distance to the ones picked before, and kmeans|| picks many at a time in a few passes over the data (see init_rounds and oversampling) and reduces them with kmeans++. kmeans++ and kmeans|| need fewer iterations than sample, kmeans|| is the faster of the two with many clusters."
+        },
+        range{"sample", "refined", "kmeans++", "kmeans||"}
+    };
+    
+    attribute<int> init_rounds { this, "init_rounds", 5,
+        description {"Number of passes over the data kmeans|| makes to pick candidate centroids (use when init is kmeans||)."},
+        setter { MIN_FUNCTION {
+            int value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
+    };
+    
+    attribute<double> oversampling { this, "oversampling", 2.,
+        description {"Candidate centroids kmeans|| picks per pass, as a multiple of clusters (use when init is kmeans||)."},
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value <= 0.) {
+                value = 2.;
+            }
+            return {value};
+        }}
+    };
+    
+    attribute<int> threads { this, "threads", 1,
+        description {
+            "Number of threads the points are split across in the naive Lloyd iteration and the distance passes of kmeans++ and kmeans||. The other algorithms stay on one thread."
+        },
+        setter { MIN_FUNCTION {
+            int value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
     };
     
     attribute<int> samplings { this, "samplings", 100,
@@ -86,93 +124,122 @@ public:
             "Random seed if random basis being used. 0 indicates no seed."
         }
     };
-
-    // Given the type of initial partition policy, figure out the empty cluster
-    // policy and run k-means.
-    template<typename InitialPartitionPolicy>
-    void FindEmptyClusterPolicy(const InitialPartitionPolicy& ipp,
-                                arma::Mat<double>& dataset,
-                                arma::Row<size_t>& assignments,
-                                arma::Mat<double>& centroids,
-                                const bool initialAssignmentGuess,
-                                const bool initialCentroidGuess) {
-        if (allow_empty_clusters) {
-            FindLloydStepType<InitialPartitionPolicy, AllowEmptyClusters>(ipp, dataset, assignments, centroids, initialAssignmentGuess, initialCentroidGuess);
-        }
-        else {
-            FindLloydStepType<InitialPartitionPolicy, KillEmptyClusters>(ipp, dataset, assignments, centroids, initialAssignmentGuess, initialCentroidGuess);
-        }
-    }
-
-    // Given the initial partitionining policy and empty cluster policy, figure out
-    // the Lloyd iteration step type and run k-means.
-    template<typename InitialPartitionPolicy, typename EmptyClusterPolicy>
-    void FindLloydStepType(const InitialPartitionPolicy& ipp,
-                           arma::Mat<double>& dataset,
-                           arma::Row<size_t>& assignments,
-                           arma::Mat<double>& centroids,
-                           const bool initialAssignmentGuess,
-                           const bool initialCentroidGuess) {
-        const string algorithm_string = algorithm.get().c_str();
-        
-        if (algorithm_string == "elkan") {
-            RunKMeans<InitialPartitionPolicy, EmptyClusterPolicy, ElkanKMeans>(ipp, dataset, assignments, centroids, initialAssignmentGuess, initialCentroidGuess);
-        }
-        else if (algorithm_string == "hamerly") {
-            RunKMeans<InitialPartitionPolicy, EmptyClusterPolicy, HamerlyKMeans>(ipp, dataset, assignments, centroids, initialAssignmentGuess, initialCentroidGuess);
+    
+    attribute<bool> minibatch { this, "minibatch", false,
+        description {"Treat every matrix as a mini-batch of a stream instead of clustering it from scratch. Its points are assigned to centroids kept between matrices, which then move towards them, each at a rate of 1 over the number of points it has been given. The work per matrix only depends on its size. The first centroids are picked from the first matrix, or sent to the right inlet. algorithm, max_iterations and the reuse and refined start attributes are not used."}
+    };
+    
+    attribute<double> decay { this, "decay", 1.,
+        description {"Used with minibatch. The point counts of the centroids are scaled by this before every matrix, so below 1 the centroids keep following a stream whose clusters move instead of settling."},
+        range {0., 1.}
+    };
+    
+    attribute<bool> predict { this, "predict", false,
+        description {"Only assign the points of each matrix to the nearest of the centroids kept by fit or loaded by read, instead of clustering it."}
+    };
+    
+    message<> fit { this, "fit", "Keep the centroids the last matrix was clustered into for predict and write.",
+        MIN_FUNCTION {
+            auto next = std::make_shared<mlmat::kmeans_model>();
+            {
+                std::lock_guard<std::mutex> lock(m_last_mutex);
+                next->centroids = m_last_centroids;
+            }
+            if(next->centroids.n_cols == 0) {
+                cerr << "no matrix has been clustered yet" << endl;
+                return {};
+            }
+            std::atomic_store(&m_fit, std::shared_ptr<const mlmat::kmeans_model>(std::move(next)));
+            return {};
         }
-        else if (algorithm_string == "pelleg-moore") {
-            RunKMeans<InitialPartitionPolicy, EmptyClusterPolicy, PellegMooreKMeans>(ipp, dataset, assignments, centroids, initialAssignmentGuess, initialCentroidGuess);
+    };
+    
+    message<> clear { this, "clear", "Forget the centroids fit for predict.",
+        MIN_FUNCTION {
+            std::atomic_store(&m_fit, std::shared_ptr<const mlmat::kmeans_model>());
+            return {};
         }
-        else if (algorithm_string == "dualtree") {
-            RunKMeans<InitialPartitionPolicy, EmptyClusterPolicy, DefaultDualTreeKMeans>(ipp, dataset, assignments, centroids, initialAssignmentGuess, initialCentroidGuess);
+    };
+    
+    message<> write { this, "write", "Save the centroids fit for predict to a file.",
+        MIN_FUNCTION {
+            auto current = std::atomic_load(&m_fit);
+            
+            if(!current) {
+                cerr << "no centroids have been fit to save" << endl;
+                return {};
+            }
+            try {
+                save_object_file(args, *current, std::string(classname()));
+            } catch (const std::runtime_error& s) {
+                cerr << s.what() << endl;
+            }
+            return {};
         }
-        else if (algorithm_string == "dualtree-covertree") {
-            RunKMeans<InitialPartitionPolicy, EmptyClusterPolicy, CoverTreeDualTreeKMeans>(ipp, dataset, assignments, centroids, initialAssignmentGuess, initialCentroidGuess);
+    };
+    
+    message<> read { this, "read", "Load centroids for predict from a file.",
+        MIN_FUNCTION {
+            std::string filepath;
+            
+            if(load_file_path(args, filepath)) {
+                auto next = std::make_shared<mlmat::kmeans_model>();
+                try {
+                    load_object_file(filepath, std::string(classname()), *next);
+                    std::atomic_store(&m_fit, std::shared_ptr<const mlmat::kmeans_model>(std::move(next)));
+                } catch (const std::runtime_error& s) {
+                    cerr << s.what() << endl;
+                }
+            }
+            return {};
         }
-        else if (algorithm_string == "naive") {
-            RunKMeans<InitialPartitionPolicy, EmptyClusterPolicy, NaiveKMeans>(ipp, dataset, assignments, centroids, initialAssignmentGuess, initialCentroidGuess);
+    };
+    
+    message<> timings { this, "timings", "Outputs the milliseconds the last clustering took to pick its starting centroids and to iterate from them via dump outlet.",
+        MIN_FUNCTION {
+            c74::max::t_atom a[2];
+            c74::max::atom_setfloat(a, m_timings.seeding * 1000.);
+            c74::max::atom_setfloat(a+1, m_timings.iterations * 1000.);
+            c74::max::outlet_anything(m_dumpoutlet, c74::max::gensym("timings"), 2, a);
+            return {};
         }
-    }
+    };
     
-    template<typename InitialPartitionPolicy,
-             typename EmptyClusterPolicy,
-             template<class, class> class LloydStepType>
-    void RunKMeans(const InitialPartitionPolicy& ipp,
-                   arma::Mat<double>& dataset,
-                   arma::Row<size_t>& assignments,
-                   arma::Mat<double>& centroids,
-                   const bool initialAssignmentGuess,
-                   const bool initialCentroidGuess) {
-        
-        
-        if (seed != 0) {
-           mlpack::RandomSeed((size_t) seed);
-        } else {
-            mlpack::RandomSeed((size_t) std::time(NULL));
+    message<> reset { this, "reset", "Forget the centroids kept with minibatch, the next matrix picks new ones.",
+        MIN_FUNCTION {
+            m_minibatch.reset(seed);
+            return {};
         }
+    };
 
-        
-        KMeans<EuclideanDistance,
-            InitialPartitionPolicy,
-            EmptyClusterPolicy,
-            LloydStepType> kmeans(max_iterations, EuclideanDistance(), ipp);
-
-        
-        kmeans.Cluster(dataset, clusters, assignments, centroids, initialAssignmentGuess, initialCentroidGuess);
+    mlmat::kmeans_params cluster_params() {
+        mlmat::kmeans_params p;
+        p.algorithm = algorithm.get().c_str();
+        p.max_iterations = max_iterations;
+        p.allow_empty_clusters = allow_empty_clusters;
+        p.refined_start = refined_start;
+        p.samplings = samplings;
+        p.percentage = percentage;
+        p.seed = seed;
+        p.init = init.get().c_str();
+        p.init_rounds = init_rounds;
+        p.oversampling = oversampling;
+        m_workers.resize(threads);
+        p.workers = &m_workers;
+        return p;
     }
 
 
     t_jit_err matrix_calc(t_object* x, t_object* inputs, t_object* outputs) {
         t_jit_err err = JIT_ERR_NONE;
-        arma::Mat<double> dat;
-        arma::Row<size_t> assignments;
-        arma::Mat<double> centroids;
-        KMeans<> kmeans;
+        arma::Mat<double>& dat = m_scratch.query;
+        arma::Row<size_t>& assignments = m_scratch.labels;
+        arma::Mat<double>& centroids = m_scratch.results;
         t_jit_matrix_info in_query_info, in_centroids_info, out_assignments_info, out_centroids_info;
         bool initial_assignment_guess;
         bool initial_centroid_guess;
 
+        m_scratch.begin_frame();
 
         auto in_matrix = (t_object*)object_method(inputs, _jit_sym_getindex, 0);
         auto in_centroids = (t_object*)object_method(inputs, _jit_sym_getindex, 1);
@@ -188,8 +255,8 @@ public:
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
         object_method(in_centroids, _jit_sym_getinfo, &in_centroids_info);
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
-        t_object* in_centroids64 = convert_to_float64(static_cast<t_object*>(in_centroids), in_centroids_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
+        t_object* in_centroids_matrix = static_cast<t_object*>(in_centroids);
         
         try {
             check_mode(in_query_info, mode, "kmeans");
@@ -199,11 +266,11 @@ public:
         }
       
        
-        dat = jit_to_arma(mode, in_matrix64, dat);
+        dat = jit_to_arma(mode, in_query_matrix, dat);
         
 
         if(m_received_centroids) {
-            centroids = jit_to_arma(mode, in_centroids64, centroids);
+            centroids = jit_to_arma(mode, in_centroids_matrix, centroids);
             
             if(centroids.n_rows != dat.n_rows) {
                 (cerr << "incorrect number of elements in centroids. expecting " << dat.n_rows << " but got " << centroids.n_rows << ". ignoring." << endl);
@@ -219,15 +286,47 @@ public:
         }
         
 
+        if(predict) {
+            // read and clear can swap the centroids while this frame runs, the snapshot keeps these alive
+            auto current = std::atomic_load(&m_fit);
+            
+            if(!current) {
+                (cerr << "no centroids have been fit. send a matrix with predict 0 or read a model" << endl);
+                goto out;
+            }
+            if(current->centroids.n_rows != dat.n_rows) {
+                (cerr << "incorrect number of elements in points. expecting " << current->centroids.n_rows << " but got " << dat.n_rows << endl);
+                goto out;
+            }
+            mlmat::kmeans_assign(current->centroids, dat, assignments, m_cross, m_norms);
+            centroids = current->centroids;
+            goto output;
+        }
+        
+        if(minibatch) {
+            if(m_minibatch.centroids().n_cols == 0) {
+                m_minibatch.reset(seed);
+            }
+            if(m_received_centroids) {
+                m_minibatch.start_from(centroids);
+            }
+            m_minibatch.update(dat, clusters, decay, assignments);
+            centroids = m_minibatch.centroids();
+            keep_last(centroids);
+            goto output;
+        }
+
         if(m_previous_centroids) {
-            if(!reuse_centroids || m_previous_centroids->n_cols != clusters) {
+            if(!reuse_centroids || m_previous_centroids->n_cols != clusters || m_previous_centroids->n_rows != dat.n_rows) {
                 m_previous_centroids.reset();
             }
         }
      
         
         if(m_previous_assignments) {
-            if(!reuse_assignments || m_previous_assignments->n_cols != clusters ) {
+            // one assignment per point, kept while the points and clusters still fit them
+            if(!reuse_assignments || m_previous_assignments->n_cols != dat.n_cols ||
+               arma::any(*m_previous_assignments >= size_t(clusters))) {
                 m_previous_assignments.reset();
             }
         }
@@ -237,35 +336,42 @@ public:
         initial_centroid_guess = reuse_centroids && m_previous_centroids;
 
         if(initial_assignment_guess) {
-            assignments = arma::Row<size_t>(*m_previous_assignments);
+            assignments = *m_previous_assignments;
         }
         
         if(initial_centroid_guess) {
-            centroids = arma::Mat<double>(*m_previous_centroids);
+            centroids = *m_previous_centroids;
         }
         
-        if(refined_start) {
-            try {
-                FindEmptyClusterPolicy<RefinedStart>(RefinedStart(samplings, percentage), dat, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
-            } catch (const std::out_of_range& s) {
-                cerr << "Not enough samples for refined start. Try increasing percentage attribute." << endl;
-                goto out;
-            }
-        } else {
-            FindEmptyClusterPolicy<SampleInitialization>(SampleInitialization(), dat, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+        try {
+            mlmat::kmeans_cluster(cluster_params(), dat, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess, &m_timings);
+        } catch (const std::out_of_range& s) {
+            cerr << "Not enough samples for refined start. Try increasing percentage attribute." << endl;
+            goto out;
+        } catch (const std::invalid_argument& s) {
+            cerr << s.what() << endl;
+            goto out;
         }
+        keep_last(centroids);
            
         
         if(reuse_centroids) {
-            m_previous_centroids = std::make_unique<arma::Mat<double>>(centroids);
+            if(m_previous_centroids) {
+                *m_previous_centroids = centroids;
+            } else {
+                m_previous_centroids = std::make_unique<arma::Mat<double>>(centroids);
+            }
         }
         
         if(reuse_assignments) {
-            m_previous_assignments = std::make_unique<arma::Row<size_t>>(assignments);
+            if(m_previous_assignments) {
+                *m_previous_assignments = assignments;
+            } else {
+                m_previous_assignments = std::make_unique<arma::Row<size_t>>(assignments);
+            }
         }
         
-
-    
+    output:
         out_assignments_info = in_query_info;
         out_assignments_info.type = _jit_sym_long;
         out_assignments_info.planecount = 1;
@@ -279,8 +385,7 @@ public:
         out_centroids = arma_to_jit(mode, centroids, out_centroids,out_centroids_info);
 
     out:
-        if(in_centroids != in_centroids64) { jit_object_free(in_centroids64); }
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
+        m_scratch.end_frame();
         m_received_centroids = false;
         
         object_method(in_matrix,_jit_sym_lock,query_savelock);
@@ -307,6 +412,7 @@ private:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
         
         jit_class_addadornment(c, mop);
         
@@ -342,6 +448,26 @@ private:
     std::unique_ptr<arma::Mat<double>> m_previous_centroids;
     std::unique_ptr<arma::Row<size_t>> m_previous_assignments;
     bool m_received_centroids = false;
+    // the centroids predict assigns to and write saves. swapped whole with atomic_load/atomic_store
+    // since fit, read and clear come from the main thread
+    std::shared_ptr<const mlmat::kmeans_model> m_fit;
+    // what the last matrix was clustered into, for fit. the copy reuses its memory while the size stays
+    arma::mat m_last_centroids;
+    std::mutex m_last_mutex;
+    
+    void keep_last(const arma::mat& centroids) {
+        std::lock_guard<std::mutex> lock(m_last_mutex);
+        m_last_centroids = centroids;
+    }
+    
+    // the centroids kept between matrices with minibatch
+    mlmat::kmeans_minibatch m_minibatch;
+    // predict's scratch
+    arma::mat m_cross;
+    arma::rowvec m_norms;
+    // cluster_params settings for the seeding, m_workers is only used from matrix_calc
+    mlmat::worker_pool m_workers;
+    mlmat::kmeans_timings m_timings;
 };
 
 
@@ -8,6 +8,8 @@
 
 
 #include "mlmat.hpp"
+#include "core/neighbor_search.hpp"
+#include "core/reference_file.hpp"
 
 #include <mlpack/methods/neighbor_search/neighbor_search.hpp>
 #include <mlpack/methods/neighbor_search/unmap.hpp>
@@ -17,6 +19,8 @@
 
 
 
+#include <cfloat>
+#include <climits>
 #include <string>
 
 using namespace c74;
@@ -26,7 +30,7 @@ using namespace mlpack;
 using namespace mlpack::util;
 using namespace mlpack::data;
 
-typedef NSModel<NearestNeighborSort> KNNModel;
+typedef mlmat::knn_index KNNModel;
 // C function declarations
 void max_mlmat_jit_matrix(max_jit_wrapper *x, t_symbol *s, short argc,t_atom *argv);
 void mlmat_assist(void* x, void* b, long m, long a, char* s) ;
@@ -74,9 +78,92 @@ public:
     
     attribute<min::symbol> tree_type { this, "tree_type", "kd",
         description {
-            "Type of tree to use"
+            "Type of tree to use, or hnsw for an approximate graph that scales to large sets with many dimensions."
         },
-        range {"kd", "vp", "rp", "max-rp", "ub", "cover", "r", "r-star", "x", "ball", "hilbert-r", "r-plus", "r-plus-plus", "spill", "oct"}
+        range {"kd", "vp", "rp", "max-rp", "ub", "cover", "r", "r-star", "x", "ball", "hilbert-r", "r-plus", "r-plus-plus", "spill", "oct", "hnsw"}
+    };
+    
+    attribute<int> M { this, "M", 16,
+        description {
+            "Links per point on each layer of the hnsw graph, twice that on the bottom layer. More links give better recall for more memory and slower building. Used when the graph is built."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 2) {
+                value = 2;
+            }
+            return {value};
+        }}
+    };
+    
+    attribute<int> ef_construction { this, "ef_construction", 200,
+        description {
+            "Candidates looked at while linking a point into the hnsw graph. Higher builds a better graph more slowly. Used when the graph is built."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
+    };
+    
+    attribute<int> ef_search { this, "ef_search", 50,
+        description {
+            "Candidates looked at for each query of the hnsw graph, at least the number of neighbors. Higher gives better recall and slower queries. Can be changed at any time."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
+    };
+    
+    attribute<min::symbol> storage { this, "storage", "float64",
+        description {
+            "How the hnsw graph keeps the reference set. float32 takes half the memory of float64 and pq (product quantization) a few bytes per point, for lower recall. The trees always keep float64. Used when the graph is built."
+        },
+        range {"float64", "float32", "pq"}
+    };
+    
+    attribute<int> pq_bytes { this, "pq_bytes", 8,
+        description {
+            "Bytes per point with pq storage, each one encoding a slice of the dimensions. More bytes give better recall. At most the number of dimensions. Used when the graph is built."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
+    };
+    
+    attribute<bool> rerank { this, "rerank", false,
+        description {
+            "With pq storage, also keep a float32 copy of the reference set and use it to put the neighbors found in order and give their distances. Used when the graph is built."
+        }
+    };
+    
+    attribute<double> radius { this, "radius", 0.,
+        description {
+            "When above 0, find every reference point within this distance of each query point instead of the k nearest, nearest first. The results of all query points follow each other in the neighbors and distances outputs, and the offsets outlet, right of dumpout, outputs where each query point's results start, with one more entry than there are query points. A range tree of the same tree_type and leaf_size (kd for hnsw and spill) is built with the reference set when radius is above 0 then, otherwise the set is searched by brute force."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 0.) {
+                value = 0.;
+            }
+            return {value};
+        }}
     };
     
     attribute<min::symbol> algorithm { this, "algorithm", "dual_tree",
@@ -121,6 +208,26 @@ public:
         range {0., 1.}
     };
     
+    attribute<int> threads { this, "threads", 1,
+        description {
+            "Number of threads a query matrix is split across. With algorithm dual_tree each thread searches its part single tree, which finds the same neighbors, since dual tree search writes to the tree. The hnsw graph is always shared."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
+    };
+    
+    attribute<bool> coherent { this, "coherent", false,
+        description {
+            "Start the search for each query point of the hnsw graph from the neighbors it had in the previous frame instead of the top of the graph. Much faster when the query moves little from frame to frame, as with sensor and video features. Used when the number of query points stays the same, the trees ignore it."
+        }
+    };
+    
     attribute<bool> random_basis { this, "random_basis", false,
         description {
             "Before tree-building, project the data onto a random orthogonal basis."
@@ -129,25 +236,193 @@ public:
     
     attribute<int> seed { this, "seed", 0,
         description {
-            "Random seed if random basis being used. 0 indicates no seed."
+            "Random seed for the random basis and the layers of the hnsw graph. 0 indicates no seed."
+        }
+    };
+    
+    attribute<int> append_buffer { this, "append_buffer", 1024,
+        description {
+            "Number of appended reference points that are searched by brute force before the tree is rebuilt with them in the background."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 1) {
+                value = 1;
+            }
+            return {value};
+        }}
+    };
+    
+    attribute<int> cache { this, "cache", 0,
+        description {
+            "Number of recent query matrices whose neighbors and distances are kept. A query that matches one of them cell for cell, with the same reference set and attributes, gets the kept outputs again without being searched. Appending points or sending a new reference set empties it. 0 turns it off."
+        },
+        setter { MIN_FUNCTION {
+            double value = args[0];
+            
+            if (value < 0) {
+                value = 0;
+            }
+            return {value};
+        }}
+    };
+    
+    message<> cache_hits { this, "cache_hits", "Outputs how many frames the cache answered and how many it had to search via dump outlet.",
+        MIN_FUNCTION {
+            report_cache();
+            return {};
         }
     };
     
     message<> clear { this, "clear", "clear model.",
         MIN_FUNCTION {
-            m_model.model.reset();
+            m_trainer.cancel();
+            m_model.clear();
             return {};
         }
         
     };
     
+    message<> recall { this, "recall", "Outputs recall of the neighbors search via dump outlet, the fraction of neighbors found that are as close as the true ones. Measured with a number of points from the reference set as queries (50 by default) against brute force, so it takes a while for large sets.",
+        MIN_FUNCTION {
+            auto current = m_model.snapshot();
+            const long samples = args.empty() ? 50 : long(args[0]);
+            c74::max::t_atom a[1];
+            
+            if(!current->model) {
+                (cerr << "no reference set exists" << endl);
+                return {};
+            }
+            if(samples < 1) {
+                (cerr << "recall needs at least one sample" << endl);
+                return {};
+            }
+            const arma::uvec picked = arma::randi<arma::uvec>(samples, arma::distr_param(0, int(current->model->size()) - 1));
+            arma::mat sample(current->model->dimensions(), samples);
+            arma::mat point;
+            for(long i = 0; i < samples; i++) {
+                current->model->points(picked(i), 1, point);
+                sample.col(i) = point;
+            }
+            mlmat::neighbor_query_params params;
+            params.ef_search = ef_search;
+            const double value = mlmat::neighbor_recall(*current->model, sample, neighbors, params);
+            
+            c74::max::atom_setfloat(a, value);
+            c74::max::outlet_anything(m_dumpoutlet, c74::max::gensym("recall"), 1, a);
+            return {};
+        }
+    };
+    
+    message<> write_mapped { this, "write_mapped", "Write the reference set to a file that read maps instead of loading, as in write_mapped corpus.mlmat. Reading one is near instant: the tree or graph is built in the background and queries are answered by brute force until it is done.",
+        MIN_FUNCTION {
+            adopt_trained_model();
+            auto current = m_model.snapshot();
+            auto appended = std::atomic_load(&current->appended);
+            std::string path;
+            
+            if(!current->model) {
+                (cerr << "no reference set exists" << endl);
+                return {};
+            }
+            if(!current->reference && !current->model->graph) {
+                (cerr << "can only write a reference set sent to this object, a tree read from a file has to be sent again" << endl);
+                return {};
+            }
+            if(!save_file_path(args, path)) {
+                return {};
+            }
+            mlmat::reference_file_settings settings;
+            settings.params = current->model->params;
+            if(current->scaler) {
+                settings.scaler = std::make_unique<ScalingModel>(*current->scaler);
+            }
+            settings.dim0 = current->dim0;
+            settings.dimcount = current->dimcount;
+            settings.autoscale = current->autoscale;
+            
+            // in input order, with the appended points after the set they were appended to
+            const KNNModel& model = *current->model;
+            const size_t built = model.size();
+            const size_t count = built + (appended ? appended->n_cols : 0);
+            try {
+                mlmat::write_reference_file(path, settings, model.dimensions(), count,
+                    [&current, &model, &appended, built](const size_t first, const size_t n, arma::mat& out) {
+                        if(first >= built) {
+                            out = appended->cols(first - built, first - built + n - 1);
+                            return;
+                        }
+                        const size_t from_set = std::min(n, built - first);
+                        if(current->reference) {
+                            out = current->reference->cols(first, first + from_set - 1);
+                        } else {
+                            model.points(first, from_set, out);
+                        }
+                        if(from_set < n) {
+                            out = arma::join_rows(out, appended->cols(0, n - from_set - 1));
+                        }
+                    });
+            } catch (const std::runtime_error& s) {
+                cerr << s.what() << endl;
+            }
+            return {};
+        }
+    };
+    
+    message<> coherence { this, "coherence", "Outputs the fraction of query points the graph searched from their neighbors in the previous frame instead of from its top while coherent is on, for the last frame and since the object was created, via dump outlet. A frame after the graph or the number of query points changed searches all of them from the top.",
+        MIN_FUNCTION {
+            c74::max::t_atom a[2];
+            const size_t queries = m_coherent_queries;
+            c74::max::atom_setfloat(a, m_last_hit_rate);
+            c74::max::atom_setfloat(a+1, queries ? double(m_coherent_hits) / double(queries) : 0.);
+            c74::max::outlet_anything(m_dumpoutlet, c74::max::gensym("coherence"), 2, a);
+            return {};
+        }
+    };
+    
+    message<> append { this, "append", "Add the points of a matrix to the reference set without rebuilding the tree, as in append jit_matrix u123. They are found by queries right away.",
+        MIN_FUNCTION {
+            if(args.empty()) {
+                (cerr << "append needs a matrix name" << endl);
+                return {};
+            }
+            min::symbol name = args[args.size() - 1];
+            t_object* matrix = static_cast<t_object*>(jit_object_findregistered(name));
+            
+            if(!matrix || !jit_object_method(matrix, _jit_sym_class_jit_matrix)) {
+                (cerr << "no matrix named " << name.c_str() << endl);
+                return {};
+            }
+            append_reference_matrix(matrix);
+            return {};
+        }
+    };
+    
 
     t_jit_err matrix_calc(t_object* x, t_object* inputs, t_object* outputs) {
         t_jit_err err = JIT_ERR_NONE;
-        t_jit_matrix_info in_query_info, out_neighbors_info, out_distances_info;
-        arma::mat query;
-        arma::Mat<size_t> resulting_neighbors;
-        arma::mat resulting_distances;
+        t_jit_matrix_info in_query_info, out_neighbors_info, out_distances_info, out_offsets_info;
+        // only searching a radius writes the offsets
+        bool offsets_written = false;
+        arma::mat& query = m_scratch.query;
+        arma::Mat<size_t>& resulting_neighbors = m_scratch.indices;
+        arma::mat& resulting_distances = m_scratch.distances;
+        
+        m_scratch.begin_frame();
+        adopt_trained_model();
+        const uint64_t key = cache_key(cache, neighbors.get(), epsilon.get(), radius.get(), ef_search.get(), rerank.get(),
+                                     coherent.get(), algorithm.get(), tree_type.get(), storage.get());
+        
+        // the reference set can be replaced while this frame runs, the snapshot keeps this one alive
+        auto current = m_model.snapshot();
+        auto appended = std::atomic_load(&current->appended);
+        
+        // a set read from a mapped file is searched by brute force until its tree is built
+        if(current->model && !current->model->built() && !training()) {
+            rebuild_starter.set();
+        }
+        const size_t references = current->model ? current->model->size() + (appended ? appended->n_cols : 0) : 0;
         
         auto in_matrix = object_method(inputs, _jit_sym_getindex, 0);
         auto out_neighbors = object_method(outputs, _jit_sym_getindex, 0);
@@ -159,9 +434,15 @@ public:
         
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
+        if(radius > 0. ? cached_outputs(key, static_cast<t_object*>(in_matrix), range_outputs(out_neighbors, out_distances))
+                       : cached_outputs(key, static_cast<t_object*>(in_matrix), outputs, 2)) {
+            offsets_written = radius > 0.;
+            goto out;
+        }
+        
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
 
-        if(m_model.model == nullptr || m_model.model->Dataset().is_empty()) {
+        if(!current->model || current->model->size() == 0) {
             (cerr << "no reference set exists" << endl);
             goto out;
         }
@@ -171,7 +452,7 @@ public:
             goto out;
         }
         
-        object_method(in_matrix64, _jit_sym_getinfo, &in_query_info);
+        object_method(in_query_matrix, _jit_sym_getinfo, &in_query_info);
         
         try {
             check_mode(in_query_info, mode, "knn");
@@ -180,32 +461,78 @@ public:
             goto out;
         }
         
-        query = jit_to_arma(mode, static_cast<t_object*>(in_matrix64), query);
+        query = jit_to_arma_view(mode, static_cast<t_object*>(in_query_matrix), query);
         
 
-        try {
-            CheckSameDimensionality(query, m_model.model->Dataset(), "knn");
-        } catch (const std::invalid_argument& s) {
-            cerr << s.what() << endl;
+        if(query.n_rows != current->model->dimensions()) {
+            (cerr << "knn: query has " << query.n_rows << " dimensions, reference set has " << current->model->dimensions() << endl);
+            goto out;
+        }
+        
+        if(radius > 0.) {
+            const arma::mat none;
+            arma::Row<size_t>& range_neighbors = m_scratch.labels;
+            arma::Row<double>& range_distances = m_scratch.values;
+            try {
+                arma::mat scaled_query;
+                scaled_query = scaler_transform(*current, query, scaled_query);
+                mlmat::search_range(*current->model, current->reference.get(), appended ? *appended : none, std::move(scaled_query), radius,
+                                    query_params(), m_offsets, range_neighbors, range_distances);
+            } catch (const std::invalid_argument& s) {
+                cerr << s.what() << endl;
+                goto out;
+            }
+            // a jitter matrix has at least one cell, the offsets say it holds nothing
+            if(range_neighbors.is_empty()) {
+                range_neighbors.set_size(1);
+                range_neighbors(0) = SIZE_MAX;
+                range_distances.set_size(1);
+                range_distances(0) = DBL_MAX;
+            }
+            out_neighbors = arma_to_jit(2, range_neighbors, static_cast<t_object*>(out_neighbors), out_neighbors_info);
+            out_distances = arma_to_jit(2, range_distances, static_cast<t_object*>(out_distances), out_distances_info);
+            arma_to_jit(2, m_offsets, m_offsets_matrix, out_offsets_info);
+            cache_outputs(key, static_cast<t_object*>(in_matrix), range_outputs(out_neighbors, out_distances));
+            offsets_written = true;
             goto out;
         }
         
-        if(neighbors > m_model.model->Dataset().n_cols) {
-             (cerr << "number of neighbors requested(" << neighbors << ") exceeds entries in reference set (" << m_model.model->Dataset().n_cols << ")" << endl);
+        if(neighbors > references) {
+             (cerr << "number of neighbors requested(" << neighbors << ") exceeds entries in reference set (" << references << ")" << endl);
              goto out;
         }
         
         try {
-            Timers u = Timers();
             arma::mat scaled_query;
-            scaled_query = scaler_transform(m_model, query, scaled_query);
-            m_model.model->Search(u, std::move(scaled_query), neighbors, resulting_neighbors, resulting_distances);
+            scaled_query = scaler_transform(*current, query, scaled_query);
+            mlmat::neighbor_query_params params = query_params();
+            // last frame's neighbors only mean something for the same graph and the same query points
+            const bool warm = coherent && current->model->graph && m_previous_version.lock() == current && m_previous.n_cols == query.n_cols;
+            size_t hits = 0;
+            
+            if(warm) {
+                params.previous = &m_previous;
+            }
+            if(appended) {
+                hits = mlmat::search_neighbors(*current->model, *appended, std::move(scaled_query), neighbors, params, resulting_neighbors, resulting_distances);
+            } else {
+                hits = mlmat::search_neighbors(*current->model, std::move(scaled_query), neighbors, params, resulting_neighbors, resulting_distances);
+            }
+            if(coherent && current->model->graph) {
+                m_coherent_hits += hits;
+                m_coherent_queries += query.n_cols;
+                m_last_hit_rate = double(hits) / double(query.n_cols);
+            }
+            if(coherent) {
+                m_previous = resulting_neighbors;
+                m_previous_version = current;
+            }
         } catch (const std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
         }
         
-        out_neighbors_info.planecount = mode == 0 ? m_model.dimcount : 1;
+        out_neighbors_info.planecount = mode == 0 ? current->dimcount : 1;
         out_distances_info.planecount = 1;
         out_neighbors_info.type = _jit_sym_long;
         out_distances_info.type = _jit_sym_float64;
@@ -247,29 +574,42 @@ public:
         }
         
         // for mode 1 or 2 is coords should be false i think
-        out_neighbors = arma_to_jit(mode, resulting_neighbors, static_cast<t_object*>(out_neighbors), out_neighbors_info, true, m_model.dim0);
+        out_neighbors = arma_to_jit(mode, resulting_neighbors, static_cast<t_object*>(out_neighbors), out_neighbors_info, true, current->dim0);
         out_distances = arma_to_jit(mode, resulting_distances, static_cast<t_object*>(out_distances), out_distances_info);
+        cache_outputs(key, static_cast<t_object*>(in_matrix), outputs, 2);
 
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
+        m_scratch.end_frame();
         
         object_method(in_matrix,_jit_sym_lock,query_savelock);
         object_method(out_neighbors,_jit_sym_lock,out_neighbors_savelock);
         object_method(out_distances,_jit_sym_lock,out_distances_savelock);
 
+        // the offsets outlet is right of the mop outlets, so they go out before the neighbors
+        if(offsets_written) {
+            t_atom a;
+            atom_setsym(&a, static_cast<t_symbol*>(jit_attr_getsym(m_offsets_matrix, _jit_sym_name)));
+            outlet_anything(m_offsets_outlet, _jit_sym_jit_matrix, 1, &a);
+        }
         return err;
     }
 
+    ~mlmat_knn() {
+        if(m_offsets_matrix) {
+            jit_object_free(m_offsets_matrix);
+        }
+    }
+
     t_jit_err process_reference_set_matrix(t_object *matrix) {
         t_jit_matrix_info minfo;
         t_jit_err err = JIT_ERR_NONE;
         arma::mat dat;
         arma::mat out_data;
-        Timers u = Timers();
-        NeighborSearchMode search_mode = DUAL_TREE_MODE;
-        KNNModel::TreeTypes tree = KNNModel::KD_TREE;
-        const string algorithm_string = algorithm.get().c_str();
-        const string tree_type_string = tree_type.get().c_str();
+        mlmat::neighbor_search_params params = search_params();
+        auto next = std::make_shared<model_version>();
+        
+        // a rebuild of the tree this replaces would be turned down anyway
+        m_trainer.cancel();
         
         long savelock = (long) object_method(matrix, _jit_sym_lock, 1);
         object_method(matrix, _jit_sym_getinfo, &minfo);
@@ -280,10 +620,10 @@ public:
             goto out;
         }
         
-        m_model.dimcount = minfo.dimcount;
+        next->dimcount = minfo.dimcount;
         
         if(minfo.dimcount == 2) {
-            m_model.dim0 = minfo.dim[0];
+            next->dim0 = minfo.dim[0];
         }
 
         try {
@@ -293,66 +633,26 @@ public:
             goto out;
         }
                 
-        dat = jit_to_arma(mode, matrix, dat);
-
-        m_model.model = std::make_unique<KNNModel>();
-        
-        if (algorithm_string == "naive")
-          search_mode = NAIVE_MODE;
-        else if (algorithm_string == "single_tree")
-          search_mode = SINGLE_TREE_MODE;
-        else if (algorithm_string == "dual_tree")
-          search_mode = DUAL_TREE_MODE;
-        else if (algorithm_string == "greedy")
-          search_mode = GREEDY_SINGLE_TREE_MODE;
-        
-        if (tree_type_string == "kd")
-          tree = KNNModel::KD_TREE;
-        else if (tree_type_string == "cover")
-          tree = KNNModel::COVER_TREE;
-        else if (tree_type_string == "r")
-          tree = KNNModel::R_TREE;
-        else if (tree_type_string == "r-star")
-          tree = KNNModel::R_STAR_TREE;
-        else if (tree_type_string == "ball")
-          tree = KNNModel::BALL_TREE;
-        else if (tree_type_string == "x")
-          tree = KNNModel::X_TREE;
-        else if (tree_type_string == "hilbert-r")
-          tree = KNNModel::HILBERT_R_TREE;
-        else if (tree_type_string == "r-plus")
-          tree = KNNModel::R_PLUS_TREE;
-        else if (tree_type_string == "r-plus-plus")
-          tree = KNNModel::R_PLUS_PLUS_TREE;
-        else if (tree_type_string == "spill")
-          tree = KNNModel::SPILL_TREE;
-        else if (tree_type_string == "vp")
-          tree = KNNModel::VP_TREE;
-        else if (tree_type_string == "rp")
-          tree = KNNModel::RP_TREE;
-        else if (tree_type_string == "max-rp")
-          tree = KNNModel::MAX_RP_TREE;
-        else if (tree_type_string == "ub")
-          tree = KNNModel::UB_TREE;
-        else if (tree_type_string == "oct")
-          tree = KNNModel::OCTREE;
-        
-        m_model.model->TreeType() = tree;
-        m_model.model->RandomBasis() = random_basis;
-        m_model.model->LeafSize() = leaf_size;
-        m_model.model->Tau() = tau;
-        m_model.model->Rho() = rho;
+        dat = jit_to_arma_view(mode, matrix, dat);
+
+        next->model = std::make_unique<KNNModel>();
 
         if (seed != 0) {
           mlpack::RandomSeed((size_t) seed);
         } else {
           mlpack::RandomSeed((size_t) std::time(NULL));
         }
+        params.seed = mlpack::RandInt(INT_MAX);
         
-        scaler_fit(m_model, dat);
-        out_data = scaler_transform(m_model, dat, out_data);
+        scaler_fit(*next, dat);
+        out_data = scaler_transform(*next, dat, out_data);
+        // the graph keeps its points in input order itself
+        if(params.tree_type != "hnsw") {
+            next->reference = std::make_shared<const arma::mat>(out_data);
+        }
         
-        m_model.model->BuildModel(u, std::move(out_data), search_mode, epsilon);
+        mlmat::build_neighbor_model(*next->model, params, std::move(out_data));
+        publish_model(std::move(next));
         m_mode_changed = false;
     out:
         
@@ -360,8 +660,284 @@ public:
         return err;
     }
     
+    // adds points to the published reference set. they are searched by brute force until
+    // append_buffer of them have piled up, then the tree is rebuilt in the background
+    t_jit_err append_reference_matrix(t_object *matrix) {
+        t_jit_matrix_info minfo;
+        t_jit_err err = JIT_ERR_NONE;
+        arma::mat dat;
+        arma::mat scaled;
+        std::shared_ptr<model_version> current;
+        std::shared_ptr<const arma::mat> appended;
+        
+        if(!m_model.snapshot()->model) {
+            // nothing to append to yet
+            return process_reference_set_matrix(matrix);
+        }
+        
+        long savelock = (long) object_method(matrix, _jit_sym_lock, 1);
+        object_method(matrix, _jit_sym_getinfo, &minfo);
+        
+        if(m_mode_changed) {
+            (cerr << "mode has changed must resubmit reference set" << endl);
+            err = JIT_ERR_INVALID_INPUT;
+            goto out;
+        }
+        
+        try {
+            check_mode(minfo, mode, "knn");
+        } catch (const std::invalid_argument& s) {
+            cerr << s.what() << endl;
+            err = JIT_ERR_INVALID_INPUT;
+            goto out;
+        }
+        
+        dat = jit_to_arma_view(mode, matrix, dat);
+        
+        {
+            std::lock_guard<std::mutex> lock(m_publish_mutex);
+            current = m_model.snapshot();
+            
+            if(!current->reference && !current->model->graph) {
+                (cerr << "can only append to a reference set sent to this object, a tree read from a file has to be sent again" << endl);
+                err = JIT_ERR_INVALID_INPUT;
+                goto out;
+            }
+            
+            if(dat.n_rows != current->model->dimensions()) {
+                (cerr << "appended points have " << dat.n_rows << " dimensions, reference set has " << current->model->dimensions() << endl);
+                err = JIT_ERR_INVALID_INPUT;
+                goto out;
+            }
+            
+            try {
+                scaled = scaler_transform(*current, dat, scaled);
+            } catch (const std::runtime_error& s) {
+                cerr << s.what() << endl;
+                err = JIT_ERR_INVALID_INPUT;
+                goto out;
+            }
+            
+            appended = std::atomic_load(&current->appended);
+            appended = std::make_shared<const arma::mat>(appended ? arma::join_rows(*appended, scaled) : scaled);
+            std::atomic_store(&current->appended, appended);
+            m_model.changed();
+            
+            if(appended->n_cols >= size_t(append_buffer) && !training()) {
+                start_rebuild(current, appended, search_params());
+            }
+        }
+    out:
+        
+        object_method(matrix, _jit_sym_lock, savelock);
+        return err;
+    }
+    
+    // the rebuilt tree keeps the published version's indices, points appended while it is built stay appended
+    bool accept_trained_model(model_version& next, const model_version& current) {
+        auto rebuild = std::move(m_rebuild);
+        if(!rebuild || !rebuild->done || &current != rebuild->from.get()) {
+            // the tree it started from was replaced
+            return false;
+        }
+        auto appended = std::atomic_load(&current.appended);
+        next.dim0 = current.dim0;
+        next.dimcount = current.dimcount;
+        next.reference = rebuild->reference;
+        
+        if(appended && appended->n_cols > rebuild->folded) {
+            next.appended = std::make_shared<const arma::mat>(appended->cols(rebuild->folded, appended->n_cols - 1));
+        }
+        return true;
+    }
+    
+    // reads a file written by write_mapped. its points are used from the mapping and searched by brute
+    // force while the tree or graph is built in the background
+    bool read_mapped_model(const std::string& path) {
+        if(!mlmat::is_reference_file(path)) {
+            return false;
+        }
+        mlmat::reference_file_settings settings;
+        auto points = mlmat::read_reference_file(path, settings);
+        auto next = std::make_shared<model_version>();
+        next->scaler = std::move(settings.scaler);
+        next->dim0 = settings.dim0;
+        next->dimcount = settings.dimcount;
+        next->autoscale = settings.autoscale;
+        next->reference = points;
+        next->model = std::make_unique<KNNModel>();
+        next->model->flat = points;
+        next->model->params = settings.params;
+        
+        m_trainer.cancel();
+        std::lock_guard<std::mutex> lock(m_publish_mutex);
+        m_model.publish(next);
+        start_rebuild(next, std::make_shared<const arma::mat>(points->n_rows, 0), settings.params);
+        return true;
+    }
+    
+    // appended points are not saved, so they are folded into the tree first
+    std::shared_ptr<model_version> version_to_write() {
+        std::lock_guard<std::mutex> lock(m_publish_mutex);
+        auto current = m_model.snapshot();
+        auto appended = std::atomic_load(&current->appended);
+        
+        if(!current->model || (current->model->built() && ((!current->reference && !current->model->graph) || !appended))) {
+            return current;
+        }
+        // a set read from a mapped file that is not built yet is built here, with the settings it was written with
+        const arma::mat none(current->model->dimensions(), 0);
+        const mlmat::neighbor_search_params params = current->model->built() ? search_params() : current->model->params;
+        auto next = std::make_shared<model_version>();
+        next->dim0 = current->dim0;
+        next->dimcount = current->dimcount;
+        if(current->scaler) {
+            next->scaler = std::make_unique<ScalingModel>(*current->scaler);
+        }
+        next->model = rebuild_tree(*current, appended ? *appended : none, params, next->reference);
+        m_trainer.cancel();
+        publish_model(next);
+        return next;
+    }
+    
     
 private:
+    
+    // what a background rebuild started from, and what it hands over when done
+    struct rebuild_state {
+        std::shared_ptr<const model_version> from { nullptr };
+        size_t folded = 0;
+        // set by the job, read once it has been taken from the trainer
+        bool done = false;
+        std::shared_ptr<const arma::mat> reference { nullptr };
+    };
+    
+    mlmat::neighbor_search_params search_params() {
+        mlmat::neighbor_search_params params;
+        params.algorithm = algorithm.get().c_str();
+        params.tree_type = tree_type.get().c_str();
+        params.leaf_size = leaf_size;
+        params.tau = tau;
+        params.rho = rho;
+        params.random_basis = random_basis;
+        params.epsilon = epsilon;
+        params.m = M;
+        params.ef_construction = ef_construction;
+        params.storage = storage.get().c_str();
+        params.pq_bytes = pq_bytes;
+        params.rerank = rerank;
+        params.range = radius > 0.;
+        return params;
+    }
+    
+    // a tree over the reference set of current with appended added at the end, so indices stay the same.
+    // a graph takes the points in where they are instead
+    static std::unique_ptr<KNNModel> rebuild_tree(const model_version& current, const arma::mat& appended,
+                                                  const mlmat::neighbor_search_params& params,
+                                                  std::shared_ptr<const arma::mat>& reference) {
+        if(current.model->graph) {
+            auto model = std::make_unique<KNNModel>(*current.model);
+            model->graph->add(arma::mat(appended));
+            model->range.reset();
+            if(params.range) {
+                arma::mat all;
+                model->points(0, model->size(), all);
+                mlmat::build_range_model(*model, params, std::move(all));
+            }
+            reference = nullptr;
+            return model;
+        }
+        if(appended.n_cols == 0) {
+            // nothing to add, a mapped reference set stays mapped
+            reference = params.tree_type == "hnsw" ? nullptr : current.reference;
+            auto model = std::make_unique<KNNModel>();
+            mlmat::build_neighbor_model(*model, params, arma::mat(*current.reference));
+            return model;
+        }
+        arma::mat all = arma::join_rows(*current.reference, appended);
+        reference = params.tree_type == "hnsw" ? nullptr : std::make_shared<const arma::mat>(all);
+        auto model = std::make_unique<KNNModel>();
+        mlmat::build_neighbor_model(*model, params, std::move(all));
+        return model;
+    }
+    
+    // starts building a set read from a mapped file on the main thread when matrix_calc finds it unbuilt
+    // with nothing running, which happens when read could not start it because other training was still going
+    queue<> rebuild_starter { this,
+        MIN_FUNCTION {
+            std::lock_guard<std::mutex> lock(m_publish_mutex);
+            auto current = m_model.snapshot();
+            if(current->model && !current->model->built() && !training() && (!m_rebuild || m_rebuild->from != current)) {
+                start_rebuild(current, std::make_shared<const arma::mat>(current->model->dimensions(), 0), current->model->params);
+            }
+            return {};
+        }
+    };
+    
+    // called with m_publish_mutex held, which also guards m_rebuild. params.seed is kept unless it is 0
+    void start_rebuild(const std::shared_ptr<model_version>& current, const std::shared_ptr<const arma::mat>& appended,
+                       const mlmat::neighbor_search_params& params) {
+        auto rebuild = std::make_shared<rebuild_state>();
+        rebuild->from = current;
+        rebuild->folded = appended->n_cols;
+        
+        const bool started = train_in_background([current, appended, rebuild, params, rebuild_seed = int(seed)](mlmat_training_status& status) mutable {
+            if (rebuild_seed != 0) {
+              mlpack::RandomSeed((size_t) rebuild_seed);
+            } else {
+              mlpack::RandomSeed((size_t) std::time(NULL));
+            }
+            if(params.seed == 0) {
+                params.seed = mlpack::RandInt(INT_MAX);
+            }
+            auto trained = std::make_unique<mlmat_trained_model<KNNModel>>();
+            status.progress(0, 1);
+            if(current->scaler) {
+                trained->scaler = std::make_unique<ScalingModel>(*current->scaler);
+            }
+            std::shared_ptr<const arma::mat> reference;
+            trained->model = rebuild_tree(*current, *appended, params, reference);
+            rebuild->reference = reference;
+            rebuild->done = true;
+            status.progress(1, 1);
+            return trained;
+        });
+        
+        if(started) {
+            m_rebuild = rebuild;
+        }
+    }
+    
+    // matrix_calc settings for the search, m_workers is only used from there
+    mlmat::neighbor_query_params query_params() {
+        mlmat::neighbor_query_params params;
+        params.ef_search = ef_search;
+        m_workers.resize(threads);
+        params.workers = &m_workers;
+        return params;
+    }
+    
+    std::shared_ptr<rebuild_state> m_rebuild { nullptr };
+    // the neighbors and distances outputs and the offsets matrix, which the cache keeps together
+    const std::vector<t_object*>& range_outputs(void* out_neighbors, void* out_distances) {
+        m_range_outputs.assign({ static_cast<t_object*>(out_neighbors), static_cast<t_object*>(out_distances), m_offsets_matrix });
+        return m_range_outputs;
+    }
+    
+    // where each query point's results start in the outputs when searching a radius
+    arma::Row<size_t> m_offsets;
+    // what the offsets outlet outputs. it is not a mop output, so the outlets before it keep their places
+    t_object* m_offsets_matrix { nullptr };
+    void* m_offsets_outlet { nullptr };
+    std::vector<t_object*> m_range_outputs;
+    mlmat::worker_pool m_workers;
+    // what matrix_calc found last frame in coherent mode, and for which version
+    arma::Mat<size_t> m_previous;
+    std::weak_ptr<model_version> m_previous_version;
+    // query points of the frames searched coherent, and how many of them started from last frame's neighbors
+    std::atomic<size_t> m_coherent_hits { 0 };
+    std::atomic<size_t> m_coherent_queries { 0 };
+    std::atomic<double> m_last_hit_rate { 0. };
 
     message<> jitclass_setup {this, "jitclass_setup", MIN_FUNCTION {
         t_class* c = args[0];
@@ -370,6 +946,7 @@ private:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
         
 
         auto ref_input = jit_object_method(mop,_jit_sym_getinput,2);
@@ -384,6 +961,35 @@ private:
     }};
     
 
+    // what max_jit_mop_setup_simple does, with the offsets outlet made first so it is right of dumpout
+    message<> mop_setup {this, "mop_setup", MIN_FUNCTION {
+        t_jit_err err = JIT_ERR_NONE;
+        t_object* x = maxob_from_jitob(min::object_base::maxobj());
+        t_jit_matrix_info info;
+
+        // outlets are made right to left
+        m_offsets_outlet = outlet_new(x, nullptr);
+        max_jit_obex_dumpout_set(x, outlet_new(x, nullptr));
+        err = max_jit_mop_setup(x);
+        if(err != JIT_ERR_NONE) {
+            jit_error_code(x, err);
+        }
+        err = max_jit_mop_inputs(x);
+        if(err != JIT_ERR_NONE) {
+            jit_error_code(x, err);
+        }
+        err = max_jit_mop_outputs(x);
+        if(err != JIT_ERR_NONE) {
+            jit_error_code(x, err);
+        }
+
+        jit_matrix_info_default(&info);
+        info.type = _jit_sym_long;
+        m_offsets_matrix = static_cast<t_object*>(jit_object_new(_jit_sym_jit_matrix, &info));
+        m_offsets_matrix = static_cast<t_object*>(jit_object_register(m_offsets_matrix, jit_symbol_unique()));
+        return {};
+    }};
+    
     message<> maxclass_setup {this, "maxclass_setup", MIN_FUNCTION {
         t_class* c = args[0];
         
@@ -466,6 +1072,10 @@ void mlmat_assist(void* x, void* b, long io, long index, char* s) {
                     sprintf(s, "(matrix) distances");
                     break;
 
+                case 3:
+                    sprintf(s, "(matrix) offsets, where the results of each query point start when radius is above 0");
+                    break;
+
                 default:
                     sprintf(s, "dumpout");
                     break;
@@ -33,6 +33,7 @@ public:
             arma::mat probabilities;
             t_atom a[1];
             arma::vec params;
+            auto next = std::make_shared<model_version>();
             if(!m_responses) {
                 (cerr << "no responses have been input" << endl);
                 goto out;
@@ -55,11 +56,11 @@ public:
                 goto out;
             }
     
-            m_model.model = std::make_unique<LinearRegression>(std::move(*m_regressors), std::move(*m_responses), lambda);
-            
+            next->model = std::make_unique<LinearRegression>(std::move(*m_regressors), std::move(*m_responses), lambda);
+            publish_model(next);
  
             //ComputeError
-            atom_setfloat(a,m_model.model->ComputeError(*m_regressors, *m_responses));
+            atom_setfloat(a,next->model->ComputeError(*m_regressors, *m_responses));
             outlet_anything(m_dumpoutlet, gensym("error"), 1, a);
         out:
             return {};
@@ -68,12 +69,13 @@ public:
     
     message<> getparameters {this, "getparameters", "Outputs the parameters (the b vector) via dump outlet.",
         MIN_FUNCTION {
-            if(!m_model.model) {
+            auto current = m_model.snapshot();
+            if(!current->model) {
                 (cerr << "No model has been trained." << endl);
             } else {
                try {
                    
-                   const arma::vec params = m_model.model->Parameters();
+                   const arma::vec params = current->model->Parameters();
 
                    t_atom a[params.n_elem];
                    for(auto i=0;i<params.n_elem;i++) {
@@ -93,7 +95,7 @@ public:
     
     message<> clear { this, "clear", "clear model.",
         MIN_FUNCTION {
-            m_model.model.reset();
+            m_model.clear();
             m_responses.reset();
             m_regressors.reset();
             return {};
@@ -122,6 +124,7 @@ public:
 
             // force type
             jit_mop_single_type(mop, _jit_sym_float64);
+            jit_mop_input_all_types(mop, 1);
         
            
             auto in2 = object_method(mop,_jit_sym_getinput,2);
@@ -165,6 +168,7 @@ public:
         t_jit_matrix_info in_matrix_info, out_predictions_info;
         arma::mat query;
         arma::Row<double> predictions;
+        auto current = m_model.snapshot();
 
         auto in_matrix = object_method(inputs, _jit_sym_getindex, 0);
         auto out_predictions = object_method(outputs, _jit_sym_getindex, 0);
@@ -174,11 +178,11 @@ public:
 
         object_method(in_matrix, _jit_sym_getinfo, &in_matrix_info);
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_matrix_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
 
         
 
-        if(!m_model.model) {
+        if(!current->model) {
             (cerr << "no model trained." << endl);
             goto out;
         }
@@ -190,14 +194,14 @@ public:
             goto out;
         }
         
-        query = jit_to_arma(mode, in_matrix64, query);
+        query = jit_to_arma(mode, in_query_matrix, query);
 
         if(m_mode_changed) {
             cerr << "mode has changed must resubmit reference set" << endl;
             goto out;
         }
         
-        if(!m_model.model) {
+        if(!current->model) {
             (cerr << "no linear regression model has been trained" << endl);
             goto out;
         }
@@ -212,7 +216,7 @@ public:
 
 
         try {
-            m_model.model->Predict(query, predictions);
+            current->model->Predict(query, predictions);
         } catch (const std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
@@ -232,7 +236,6 @@ public:
         out_predictions = arma_to_jit(mode, predictions, static_cast<t_object*>(out_predictions), out_predictions_info);
 
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         object_method(in_matrix,_jit_sym_lock,in_matrix_savelock);
         object_method(out_predictions,_jit_sym_lock,out_predictions_savelock);
         return err;
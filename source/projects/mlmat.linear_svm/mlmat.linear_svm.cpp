@@ -95,10 +95,6 @@ public:
     
     message<> train {this, "train", "Train model",
         MIN_FUNCTION {
-            size_t numClasses = 0;
-            arma::Row<size_t> labels;
-            arma::mat out_data;
-            
             if(!m_labels) {
                 (cerr << "no labels have been input" << endl);
                 goto out;
@@ -114,41 +110,62 @@ public:
                 goto out;
             }
             
-            if (seed == 0) {
-              mlpack::RandomSeed(time(NULL));
-            } else {
-              mlpack::RandomSeed((size_t) seed);
-            }
-            
-            m_model.model = std::make_unique<LinearSVMModel>();
-            
-            data::NormalizeLabels(*m_labels, labels, m_model.model->mappings);
-            
-            numClasses = (num_classes == 0) ? m_model.model->mappings.n_elem : num_classes;
-            m_model.model->svm.Lambda() = lambda;
-            m_model.model->svm.Delta() = delta;
-            m_model.model->svm.NumClasses() = numClasses;
-            m_model.model->svm.FitIntercept() = no_intercept;
-            
-            scaler_fit(m_model, *m_data);
-            out_data = scaler_transform(m_model, *m_data, out_data);
-            
-            if(optimizer.get() == "lbfgs") {
-                ens::L_BFGS lbfgsOpt;
-                lbfgsOpt.MaxIterations() = max_iterations;
-                lbfgsOpt.MinGradientNorm() = tolerance;
-                //(cout << "Training model with L-BFGS optimizer." << endl);
-                // This will train the model.
-                m_model.model->svm.Train(std::move(out_data), labels, numClasses, lbfgsOpt);
-            } else if (optimizer.get() == "psgd") {
-                const size_t maxIt = epochs * m_labels->n_cols;
-                ens::ConstantStep decayPolicy(step_size);
-                // can OPENMP cause problems with MAX?
-                //(cout << "Training model with P-SGD optimizer." << endl);
-                ens::ParallelSGD<ens::ConstantStep> psgdOpt(maxIt, std::ceil((float) m_data->n_cols), tolerance, shuffle, decayPolicy);
-                // This will train the model.
-                m_model.model->svm.Train(std::move(out_data), labels, numClasses, psgdOpt);
-            }
+            // the job works on copies, so the data and attributes can change while it runs
+            train_in_background([training = *m_data,
+                                 input_labels = *m_labels,
+                                 scaling = scaler_settings(),
+                                 random_seed = int(seed),
+                                 classes = int(num_classes),
+                                 l = double(lambda),
+                                 d = double(delta),
+                                 intercept = bool(no_intercept),
+                                 optimizer_type = string(optimizer.get().c_str()),
+                                 iterations = int(max_iterations),
+                                 tol = double(tolerance),
+                                 step = double(step_size),
+                                 shuffle_points = bool(shuffle),
+                                 passes = int(epochs)](mlmat_training_status& status) mutable {
+                auto trained = std::make_unique<mlmat_trained_model<LinearSVMModel>>();
+                auto& model = trained->model;
+                arma::Row<size_t> labels;
+                arma::mat scaled_data;
+                mlmat_training_callback callback(status);
+                
+                // seeded here as the generator belongs to the thread
+                if (random_seed == 0) {
+                  mlpack::RandomSeed(time(NULL));
+                } else {
+                  mlpack::RandomSeed((size_t) random_seed);
+                }
+                
+                model = std::make_unique<LinearSVMModel>();
+                
+                data::NormalizeLabels(input_labels, labels, model->mappings);
+                
+                const size_t numClasses = (classes == 0) ? model->mappings.n_elem : classes;
+                model->svm.Lambda() = l;
+                model->svm.Delta() = d;
+                model->svm.NumClasses() = numClasses;
+                model->svm.FitIntercept() = intercept;
+                
+                arma::mat& out_data = scaling.fit_transform(trained->scaler, training, scaled_data);
+                
+                if(optimizer_type == "lbfgs") {
+                    ens::L_BFGS lbfgsOpt;
+                    lbfgsOpt.MaxIterations() = iterations;
+                    lbfgsOpt.MinGradientNorm() = tol;
+                    // This will train the model.
+                    model->svm.Train(out_data, labels, numClasses, lbfgsOpt, callback);
+                } else if (optimizer_type == "psgd") {
+                    const size_t maxIt = passes * input_labels.n_cols;
+                    ens::ConstantStep decayPolicy(step);
+                    // can OPENMP cause problems with MAX?
+                    ens::ParallelSGD<ens::ConstantStep> psgdOpt(maxIt, std::ceil((float) out_data.n_cols), tol, shuffle_points, decayPolicy);
+                    // This will train the model.
+                    model->svm.Train(out_data, labels, numClasses, psgdOpt, callback);
+                }
+                return trained;
+            });
             
         out:
             return {};
@@ -157,7 +174,8 @@ public:
     
     message<> clear { this, "clear", "clear model.",
         MIN_FUNCTION {
-            m_model.model.reset();
+            m_trainer.cancel();
+            m_model.clear();
             m_data.reset();
             m_labels.reset();
             return {};
@@ -186,9 +204,12 @@ public:
         
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
+        
+        adopt_trained_model();
+        auto current = m_model.snapshot();
         
-        if(!m_model.model) {
+        if(!current->model) {
             (cerr << "no model trained." << endl);
             goto out;
         }
@@ -200,16 +221,16 @@ public:
             goto out;
         }
         
-        numClasses = m_model.model->svm.NumClasses();
+        numClasses = current->model->svm.NumClasses();
         
         // Set the dimensionality according to fitz intercept.
         if (no_intercept) {
-            training_dimensionality = m_model.model->svm.Parameters().n_rows - 1;
+            training_dimensionality = current->model->svm.Parameters().n_rows - 1;
         } else {
-            training_dimensionality = m_model.model->svm.Parameters().n_rows;
+            training_dimensionality = current->model->svm.Parameters().n_rows;
         }
 
-        query = jit_to_arma(mode, in_matrix64, query);
+        query = jit_to_arma(mode, in_query_matrix, query);
         
         try {
             CheckSameDimensionality(query, training_dimensionality, "linear svm");
@@ -220,8 +241,8 @@ public:
         
         try {
             arma::mat scaled_query;
-            scaled_query = scaler_transform(m_model, query, scaled_query);
-            m_model.model->svm.Classify(std::move(scaled_query), predicted_labels, scores);
+            scaled_query = scaler_transform(*current, query, scaled_query);
+            current->model->svm.Classify(std::move(scaled_query), predicted_labels, scores);
         } catch (const std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
@@ -230,7 +251,7 @@ public:
         
         
         //map normalized labels back to original labels.
-        data::RevertLabels(predicted_labels, m_model.model->mappings, predictions);
+        data::RevertLabels(predicted_labels, current->model->mappings, predictions);
         out_predictions_info = in_query_info;
         out_predictions_info.planecount = 1;
         
@@ -241,7 +262,6 @@ public:
         out_scores = arma_to_jit(mode, scores, static_cast<t_object*>(out_scores), out_scores_info);
     
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         object_method(in_matrix,_jit_sym_lock,in_matrix_savelock);
         object_method(out_predictions,_jit_sym_lock,out_predictions_savelock);
         object_method(out_scores,_jit_sym_lock,out_scores_savelock);
@@ -277,6 +297,7 @@ public:
 
             // force type
             jit_mop_single_type(mop, _jit_sym_float64);
+            jit_mop_input_all_types(mop, 1);
         
             void* in2 = object_method(mop,_jit_sym_getinput,2);
             void* in3 = object_method(mop,_jit_sym_getinput,3);
@@ -45,10 +45,11 @@ public:
     t_jit_err matrix_calc(t_object* x, t_object* inputs, t_object* outputs) {
         t_jit_err err = JIT_ERR_NONE;
         t_jit_matrix_info in_query_info,in_data_info, out_info;
-        arma::Col<arma::uword> query;
-        arma::mat resulting;
-        t_object* in_matrix_long = nullptr;
+        arma::Col<arma::uword>& query = m_scratch.lookup;
+        arma::mat& resulting = m_scratch.results;
        
+        m_scratch.begin_frame();
+        
         auto in_matrix = object_method(inputs, _jit_sym_getindex, 0);
         auto data_matrix = object_method(inputs, _jit_sym_getindex, 1);
         auto out_results = object_method(outputs, _jit_sym_getindex, 0);
@@ -85,9 +86,7 @@ public:
             goto out;
         }
     
-        in_matrix_long  = convert_to_long(static_cast<t_object*>(in_matrix), in_query_info);
-        
-        query = jit_to_arma_limit(mode, static_cast<t_object*>(in_matrix_long), query, in_data_info.dim[0], in_data_info.dim[1]);
+        query = jit_to_arma_limit(mode, static_cast<t_object*>(in_matrix), query, in_data_info.dim[0], in_data_info.dim[1]);
 
         query.clamp(0, (m_data->n_cols-1));//this is extra safeguard. could remove
 
@@ -123,8 +122,8 @@ public:
         
 
     out:
+        m_scratch.end_frame();
         
-        if(in_matrix != in_matrix_long) { jit_object_free(in_matrix_long); }
         object_method(in_matrix,_jit_sym_lock,query_savelock);
         object_method(data_matrix,_jit_sym_lock,data_matrix_savelock);
         object_method(out_results,_jit_sym_lock,out_results_savelock);
@@ -141,6 +140,7 @@ private:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
         jit_mop_input_nolink(mop, 2);
         jit_mop_output_nolink(mop, 1);
         
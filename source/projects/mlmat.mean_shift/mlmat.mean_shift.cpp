@@ -58,7 +58,7 @@ public:
         
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
         
-        t_object *in_matrix64 = convert_to_float64(in_matrix, in_query_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
         
         try {
             check_mode(in_query_info, mode, "mean shift");
@@ -67,7 +67,7 @@ public:
             goto out;
         }
     
-        dat = jit_to_arma(mode, in_matrix64, dat);
+        dat = jit_to_arma(mode, in_query_matrix, dat);
  
         mean_shift.Cluster(dat, assignments, centroids, force_convergence);
         
@@ -84,7 +84,6 @@ public:
         out_centroids = arma_to_jit(mode, centroids, out_centroids,out_centroids_info);
 
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         
         object_method(in_matrix,_jit_sym_lock,query_savelock);
         object_method(out_assignments,_jit_sym_lock,out_assignments_savelock);
@@ -104,6 +103,7 @@ private:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
         
         //unlink dimesions between left and right i/o
         //keep planecounts same for now.
@@ -87,79 +87,83 @@ public:
                 return {};
             }
             
-            
-            arma::Mat<double> labels(*m_labels);
-            arma::mat out_data;
-            
-            
-            
-            m_model.model = std::make_unique<FFN<>>();
+            // the job works on copies, so the data and attributes can change while it runs
+            train_in_background([training = *m_training,
+                                 labels = arma::Mat<double>(*m_labels),
+                                 scaling = scaler_settings(),
+                                 layers = int(hidden_layers),
+                                 neurons = int(hidden_neurons),
+                                 layer_type = string(activation.get().c_str()),
+                                 optimizer_type = string(optimizer.get().c_str()),
+                                 step = double(step_size),
+                                 batch = double(batch_size),
+                                 iterations = int(max_iterations),
+                                 tol = double(tolerance)](mlmat_training_status& status) mutable {
+                auto trained = std::make_unique<mlmat_trained_model<FFN<>>>();
+                auto& model = trained->model;
+                mlmat_training_callback callback(status);
+                arma::mat scaled_data;
                 
-            m_model.model->Add<Linear>(m_training->n_rows);
-            
-            for(auto i = 0;i<hidden_layers;i++) {
-                add_layer(activation.get());
-                m_model.model->Add<Linear>(hidden_neurons.get());
-                //(std::cout << "hidden layer: " << hidden_neurons.get() << " inputs " << hidden_neurons.get() << " outputs" << std::endl);
-            }
+                model = std::make_unique<FFN<>>();
+                model->Add<Linear>(training.n_rows);
                 
-            m_model.model->Add<LinearType<arma::mat, NoRegularizer>>(hidden_neurons.get());
-            m_model.model->Add<LogSoftMaxType<>>();
-            //removing will test when labels inpput
-            //double diff = m_labels_min - 1.0;
-            //labels = labels - diff;
-            
-            scaler_fit(m_model, *m_training);
-            out_data = scaler_transform(m_model, *m_training, out_data);
-            
-            
-            //std::cout << labels << std::endl;
-            
-            if(optimizer.get() == "rmsprop") {
-                // this is default
-                m_model.model->Train(out_data, labels);
-            } else if(optimizer.get() == "sgd") {
-                ens::StandardSGD opt(step_size, batch_size, max_iterations, tolerance);
-                m_model.model->Train(out_data, labels, opt);
-            } else if(optimizer.get() == "lbfgs") {
-                ens::L_BFGS opt;
-                opt.MaxIterations() = max_iterations;
-                opt.MinGradientNorm() = tolerance;
-                m_model.model->Train(out_data, labels, opt);
-            } else if(optimizer.get() == "adam") {
-                ens::Adam opt(step_size, batch_size, 0.9, 0.999, 1e-8, max_iterations,
-                tolerance);
-                m_model.model->Train(out_data, labels, opt);
-            } else {
-                ///ERROR?
-            }
+                for(auto i = 0;i<layers;i++) {
+                    add_layer(*model, layer_type);
+                    model->Add<Linear>(neurons);
+                }
+                
+                model->Add<LinearType<arma::mat, NoRegularizer>>(neurons);
+                model->Add<LogSoftMaxType<>>();
+                //removing will test when labels inpput
+                //double diff = m_labels_min - 1.0;
+                //labels = labels - diff;
+                
+                arma::mat& out_data = scaling.fit_transform(trained->scaler, training, scaled_data);
+                
+                if(optimizer_type == "rmsprop") {
+                    // this is default
+                    model->Train(out_data, labels, callback);
+                } else if(optimizer_type == "sgd") {
+                    ens::StandardSGD opt(step, batch, iterations, tol);
+                    model->Train(out_data, labels, opt, callback);
+                } else if(optimizer_type == "lbfgs") {
+                    ens::L_BFGS opt;
+                    opt.MaxIterations() = iterations;
+                    opt.MinGradientNorm() = tol;
+                    model->Train(out_data, labels, opt, callback);
+                } else if(optimizer_type == "adam") {
+                    ens::Adam opt(step, batch, 0.9, 0.999, 1e-8, iterations, tol);
+                    model->Train(out_data, labels, opt, callback);
+                } else {
+                    ///ERROR?
+                }
+                return trained;
+            });
             return {};
         }
     };
         
         
-    void add_layer(const c74::min::symbol& layer_type) {
-        const string layer_string = layer_type.c_str();
-        
+    static void add_layer(FFN<>& model, const string& layer_string) {
         if(layer_string == "sigmoid") {
-            m_model.model->Add<mlpack::SigmoidType<>>();
+            model.Add<mlpack::SigmoidType<>>();
 
         } else if(layer_string == "gaussian") {
-            m_model.model->Add<GaussianType<>>();
+            model.Add<GaussianType<>>();
 
         } else if(layer_string == "relu") {
-            m_model.model->Add<ReLUType<>>();
+            model.Add<ReLUType<>>();
 
         } else if(layer_string == "tanh") {
-            m_model.model->Add<TanHType<>>();
+            model.Add<TanHType<>>();
 
         } else if(layer_string == "soft_plus") {
-            m_model.model->Add<SoftPlusType<>>();
+            model.Add<SoftPlusType<>>();
 
         } else if(layer_string == "linear") {
-            m_model.model->Add<LinearType<arma::mat, NoRegularizer>>();
+            model.Add<LinearType<arma::mat, NoRegularizer>>();
         } else if(layer_string == "identity") {
-            m_model.model->Add<IdentityType<>>();
+            model.Add<IdentityType<>>();
         }
 
     }
@@ -168,7 +172,8 @@ public:
         MIN_FUNCTION {
             m_labels.reset();
             m_training.reset();
-            m_model.model.reset();
+            m_trainer.cancel();
+            m_model.clear();
             
             return {};
         }
@@ -179,10 +184,14 @@ public:
         // ignore last two inputs as they have already been processed
         t_jit_err err = JIT_ERR_NONE;
         t_jit_matrix_info in_matrix_info, out_info, out_predictions_info;
-        arma::mat query;
-        arma::mat likelihoods;
-        arma::Row<double> predictions;
-        arma::Row<size_t> labels;
+        arma::mat& query = m_scratch.query;
+        arma::mat& likelihoods = m_scratch.results;
+        arma::Row<double>& predictions = m_scratch.values;
+        arma::Row<size_t>& labels = m_scratch.labels;
+
+        m_scratch.begin_frame();
+        adopt_trained_model();
+        auto current = m_model.snapshot();
 
         auto in_matrix = object_method(inputs, _jit_sym_getindex, 0);
         auto out_predictions_matrix = object_method(outputs, _jit_sym_getindex, 0);
@@ -193,9 +202,9 @@ public:
         object_method(in_matrix, _jit_sym_getinfo, &in_matrix_info);
         
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_matrix_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
                 
-        if(!m_model.model ) {
+        if(!current->model ) {
             (cerr << "no mlp model has been trained" << endl);
             goto out;
         }
@@ -208,10 +217,10 @@ public:
         }
             
 
-        query = jit_to_arma(mode, static_cast<t_object*>(in_matrix64), query);
+        query = jit_to_arma(mode, static_cast<t_object*>(in_query_matrix), query);
         
         try {
-            size_t p = m_model.model->InputDimensions()[0];
+            size_t p = current->model->InputDimensions()[0];
             mlpack::util::CheckSameDimensionality(query, p, "mlp classifier", "query");
         } catch (std::invalid_argument& s) {
             cerr << s.what() << endl;
@@ -219,9 +228,7 @@ public:
         }
         
         try {
-            arma::mat scaled_query;
-            scaled_query = scaler_transform(m_model, query, scaled_query);
-            m_model.model->Predict(std::move(scaled_query), likelihoods);
+            current->model->Predict(scaler_transform(*current, query, m_scratch.scaled_query), likelihoods);
         } catch (const std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
@@ -273,7 +280,7 @@ public:
         out_likelihoods_matrix = arma_to_jit(mode, likelihoods, static_cast<t_object*>(out_likelihoods_matrix), out_info);
 
    out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
+        m_scratch.end_frame();
         object_method(in_matrix,_jit_sym_lock,in_matrix_savelock);
         object_method(out_predictions_matrix,_jit_sym_lock,out_predictions_savelock);
         object_method(out_likelihoods_matrix,_jit_sym_lock,out_likelihoods_savelock);
@@ -377,6 +384,7 @@ private:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
     
         void* in2 = object_method(mop,_jit_sym_getinput,2);
         void* in3 = object_method(mop,_jit_sym_getinput,3);
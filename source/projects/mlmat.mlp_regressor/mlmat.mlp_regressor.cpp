@@ -71,7 +71,8 @@ public:
         MIN_FUNCTION {
             m_target.reset();
             m_training.reset();
-            m_model.model.reset();
+            m_trainer.cancel();
+            m_model.clear();
             return {};
         }
     };
@@ -79,87 +80,88 @@ public:
 
     message<> train { this, "train", "train model.",
         MIN_FUNCTION {
-            // range for random initialization
-            m_model.model = std::make_unique<FFN<MeanSquaredError,RandomInitialization>>();
-            arma::mat out_data;
-        
-            m_model.model->Add<Linear>(hidden_neurons.get());
-            
-            for(auto i = 0;i<hidden_layers-1;i++) {
-                add_layer(activation.get());
-                m_model.model->Add<Linear>(m_training->n_rows);
+            if(!m_target) {
+                (cerr << "unable to run training. no valid target data." << endl);
+                return {};
+            }
+            if(!m_training) {
+                (cerr << "unable to run training. no valid training data." << endl);
+                return {};
             }
-
-            m_model.model->Add<Linear>( hidden_neurons.get());
-            m_model.model->Add<Identity>();
-            
-            scaler_fit(m_model, *m_training);
-            out_data = scaler_transform(m_model, *m_training, out_data);
             
-            if(optimizer.get() == "rmsprop") {
-                // this is default
-                try {
-                    m_model.model->Train(out_data, *m_target);
-                } catch (std::exception& s)  {
-                    cerr << s.what() << endl;
-                    goto out;
+            // the job works on copies, so the data and attributes can change while it runs
+            train_in_background([training = *m_training,
+                                 target = *m_target,
+                                 scaling = scaler_settings(),
+                                 layers = int(hidden_layers),
+                                 neurons = int(hidden_neurons),
+                                 layer_type = string(activation.get().c_str()),
+                                 optimizer_type = string(optimizer.get().c_str()),
+                                 step = double(step_size),
+                                 batch = double(batch_size),
+                                 iterations = int(max_iterations),
+                                 tol = double(tolerance)](mlmat_training_status& status) mutable {
+                auto trained = std::make_unique<mlmat_trained_model<FFN<MeanSquaredError,RandomInitialization>>>();
+                auto& model = trained->model;
+                mlmat_training_callback callback(status);
+                arma::mat scaled_data;
+                
+                // range for random initialization
+                model = std::make_unique<FFN<MeanSquaredError,RandomInitialization>>();
+                model->Add<Linear>(neurons);
+                
+                for(auto i = 0;i<layers-1;i++) {
+                    add_layer(*model, layer_type);
+                    model->Add<Linear>(training.n_rows);
                 }
-            } else if(optimizer.get() == "sgd") {
-                ens::StandardSGD opt(step_size, batch_size, max_iterations, tolerance);
-                try {
-                    m_model.model->Train(out_data, *m_target, opt);
-                } catch (std::exception& s)  {
-                    cerr << s.what() << endl;
-                    goto out;
+                
+                model->Add<Linear>(neurons);
+                model->Add<Identity>();
+                
+                arma::mat& out_data = scaling.fit_transform(trained->scaler, training, scaled_data);
+                
+                if(optimizer_type == "rmsprop") {
+                    // this is default
+                    model->Train(out_data, target, callback);
+                } else if(optimizer_type == "sgd") {
+                    ens::StandardSGD opt(step, batch, iterations, tol);
+                    model->Train(out_data, target, opt, callback);
+                } else if(optimizer_type == "lbfgs") {
+                    ens::L_BFGS opt;
+                    opt.MaxIterations() = iterations;
+                    opt.MinGradientNorm() = tol;
+                    model->Train(out_data, target, opt, callback);
+                } else if(optimizer_type == "adam") {
+                    ens::Adam opt(step, batch, 0.9, 0.999, 1e-8, iterations, tol);
+                    model->Train(out_data, target, opt, callback);
+                } else {
+                    ///ERROR?
                 }
-            } else if(optimizer.get() == "lbfgs") {
-                ens::L_BFGS opt;
-                opt.MaxIterations() = max_iterations;
-                opt.MinGradientNorm() = tolerance;
-                try {
-                    m_model.model->Train(out_data, *m_target, opt);
-                } catch (std::exception& s)  {
-                    cerr << s.what() << endl;
-                    goto out;
-                }
-            } else if(optimizer.get() == "adam") {
-                ens::Adam opt(step_size, batch_size, 0.9, 0.999, 1e-8, max_iterations,
-                tolerance);
-                try {
-                    m_model.model->Train(out_data, *m_target, opt);
-                } catch (std::exception& s)  {
-                    cerr << s.what() << endl;
-                    goto out;
-                }
-            } else {
-                ///ERROR?
-            }
-        out:
+                return trained;
+            });
             return {};
         }
     };
 
 
-    void add_layer(const c74::min::symbol& layer_type) {
-        const string layer_string = layer_type.c_str();
-        
+    static void add_layer(FFN<MeanSquaredError,RandomInitialization>& model, const string& layer_string) {
         if(layer_string == "sigmoid") {
-            m_model.model->Add<SigmoidType<>>();
+            model.Add<SigmoidType<>>();
 
         } else if(layer_string == "gaussian") {
-            m_model.model->Add<GaussianType<>>();
+            model.Add<GaussianType<>>();
 
         } else if(layer_string == "relu") {
-            m_model.model->Add<ReLUType<>>();
+            model.Add<ReLUType<>>();
 
         } else if(layer_string == "tanh") {
-            m_model.model->Add<TanHType<>>();
+            model.Add<TanHType<>>();
 
         } else if(layer_string == "soft_plus") {
-            m_model.model->Add<SoftPlusType<>>();
+            model.Add<SoftPlusType<>>();
 
         } else if(layer_string == "identity") {
-            m_model.model->Add<IdentityType<>>();
+            model.Add<IdentityType<>>();
         }
 
     }
@@ -168,8 +170,12 @@ public:
         // ignore last two inputs as they have already been processed
         t_jit_err err = JIT_ERR_NONE;
         t_jit_matrix_info in_matrix_info, out_info;
-        arma::mat query;
-        arma::mat predictions;
+        arma::mat& query = m_scratch.query;
+        arma::mat& predictions = m_scratch.results;
+
+        m_scratch.begin_frame();
+        adopt_trained_model();
+        auto current = m_model.snapshot();
 
         auto in_matrix = object_method(inputs, _jit_sym_getindex, 0);
         auto out_results_matrix = object_method(outputs, _jit_sym_getindex, 0);
@@ -178,7 +184,7 @@ public:
 
         object_method(in_matrix, _jit_sym_getinfo, &in_matrix_info);
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_matrix_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
 
             
         try {
@@ -189,16 +195,16 @@ public:
         }
         
         
-        if(!m_model.model ) {
+        if(!current->model ) {
             (cerr << "no mlp model has been trained" << endl);
             goto out;
         }
         
 
-        query = jit_to_arma(mode, static_cast<t_object*>(in_matrix64), query);
+        query = jit_to_arma(mode, static_cast<t_object*>(in_query_matrix), query);
         
         try {
-            size_t p = m_model.model->InputDimensions()[0];
+            size_t p = current->model->InputDimensions()[0];
             cout << p << endl;
             mlpack::util::CheckSameDimensionality(query, p, "mlp regressor", "query");
         } catch (std::invalid_argument& s) {
@@ -212,9 +218,7 @@ public:
         }
         
         try {
-            arma::mat scaled_query;
-            scaled_query = scaler_transform(m_model, query, scaled_query);
-            m_model.model->Predict(std::move(scaled_query), predictions);
+            current->model->Predict(scaler_transform(*current, query, m_scratch.scaled_query), predictions);
         } catch (const std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
@@ -226,7 +230,7 @@ public:
         out_results_matrix = arma_to_jit(mode, predictions, static_cast<t_object*>(out_results_matrix), out_info);
         
    out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
+        m_scratch.end_frame();
         object_method(in_matrix,_jit_sym_lock,in_matrix_savelock);
         object_method(out_results_matrix,_jit_sym_lock,out_results_savelock);
 
@@ -302,6 +306,7 @@ private:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
         
         void* in2 = object_method(mop,_jit_sym_getinput,2);
         void* in3 = object_method(mop,_jit_sym_getinput,3);
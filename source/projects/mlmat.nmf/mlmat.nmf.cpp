@@ -44,6 +44,7 @@ public:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
         
         auto output1 = object_method(mop,_jit_sym_getoutput,1);
         jit_attr_setlong(output1,_jit_sym_dimlink,0);
@@ -83,7 +84,7 @@ public:
         auto H_savelock = object_method(H_matrix, _jit_sym_lock, 1);
 
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
         
         NMFALSFactorizer nmf;
         arma::mat W, H;
@@ -98,7 +99,7 @@ public:
             goto out;
         }
         
-        query = jit_to_arma(mode, static_cast<t_object*>(in_matrix64), query);
+        query = jit_to_arma(mode, static_cast<t_object*>(in_query_matrix), query);
 
         if (seed != 0)
           mlpack::RandomSeed((size_t) seed);
@@ -169,7 +170,6 @@ public:
         H_matrix = arma_to_jit(mode, H, static_cast<t_object*>(H_matrix), H_info );
 
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         
         object_method(in_matrix,_jit_sym_lock,in_savelock);
         object_method(W_matrix,_jit_sym_lock,W_savelock);
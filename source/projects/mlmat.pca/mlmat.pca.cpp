@@ -63,6 +63,7 @@ public:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
         
         auto output1 = object_method(mop,_jit_sym_getoutput,1);
         jit_attr_setlong(output1,_jit_sym_dimlink,0);
@@ -122,7 +123,7 @@ public:
         const string decomp = decomposition_method.get().c_str() ;
         
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
         
         
         try {
@@ -155,7 +156,7 @@ public:
             goto out;
         }
         
-        query = jit_to_arma(mode, static_cast<t_object*>(in_matrix64), query);
+        query = jit_to_arma(mode, static_cast<t_object*>(in_query_matrix), query);
         
         if (seed != 0)
           mlpack::RandomSeed((size_t) seed);
@@ -200,7 +201,6 @@ public:
         eigvec_matrix = arma_to_jit(mode, eigvec, static_cast<t_object*>(eigvec_matrix), eigvec_info );
 
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         
         object_method(in_matrix,_jit_sym_lock,in_savelock);
         object_method(out_matrix,_jit_sym_lock,out_savelock);
@@ -57,6 +57,7 @@ public:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
         
         auto output1 = object_method(mop,_jit_sym_getoutput,1);
         jit_attr_setlong(output1,_jit_sym_dimlink,0);
@@ -96,7 +97,7 @@ public:
         auto W_savelock = object_method(W_matrix, _jit_sym_lock, 1);
 
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
         
         
         try {
@@ -105,7 +106,6 @@ public:
             cerr << s.what() << endl;
             ///
             ///clean up stuff
-            if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
             
             object_method(in_matrix,_jit_sym_lock,in_savelock);
             object_method(Y_matrix,_jit_sym_lock,Y_savelock);
@@ -114,7 +114,7 @@ public:
             //goto out;
         }
         
-        query = jit_to_arma(mode, static_cast<t_object*>(in_matrix64), query);
+        query = jit_to_arma(mode, static_cast<t_object*>(in_query_matrix), query);
         
         //std::cout << query << std::endl;
         
@@ -208,7 +208,6 @@ public:
         W_matrix = arma_to_jit(mode, matW, static_cast<t_object*>(W_matrix), W_info );
         
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         
         object_method(in_matrix,_jit_sym_lock,in_savelock);
         object_method(Y_matrix,_jit_sym_lock,Y_savelock);
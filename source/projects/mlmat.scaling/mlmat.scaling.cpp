@@ -160,7 +160,7 @@ public:
         auto out_matrix_savelock = object_method(out_matrix, _jit_sym_lock, 1);
         
         object_method(in_matrix, _jit_sym_getinfo, &in_matrix_info);
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_matrix_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
         
         if(!m_model) {
             (cerr << "no reference data input for scaling" << endl);
@@ -179,7 +179,7 @@ public:
             goto out;
         }
          
-        dat = jit_to_arma(mode, in_matrix64, dat);
+        dat = jit_to_arma(mode, in_query_matrix, dat);
         
         if(inverse) {
             m_model->InverseTransform(dat, output);
@@ -190,7 +190,6 @@ public:
         out_matrix = arma_to_jit(mode, output, out_matrix, in_matrix_info);
          
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         object_method(in_matrix,_jit_sym_lock,in_matrix_savelock);
         object_method(out_matrix,_jit_sym_lock,out_matrix_savelock);
         return err;
@@ -232,23 +231,10 @@ public:
            
         dat = jit_to_arma(mode, matrix, dat);
                
-        m_model = std::make_unique<ScalingModel>(min, max, epsilon);
+        m_model = mlmat::make_scaler(scalertype_string, min, max, epsilon);
     
-        if(scalertype_string == "standard") {
-            m_model->ScalerType() = ScalingModel::STANDARD_SCALER;
-        } else if(scalertype_string == "min_max") {
-           m_model->ScalerType() = ScalingModel::MIN_MAX_SCALER;
-        } else if(scalertype_string == "normalization") {
-            m_model->ScalerType() = ScalingModel::MEAN_NORMALIZATION;
-        } else if(scalertype_string == "abs") {
-            m_model->ScalerType() = ScalingModel::MAX_ABS_SCALER;
-        } else if(scalertype_string == "pca_whitening") {
-            m_model->ScalerType() = ScalingModel::PCA_WHITENING;
-        } else if(scalertype_string == "zca_whitening") {
-            m_model->ScalerType() = ScalingModel::PCA_WHITENING;
-        } else {
+        if(!m_model) {
             (cerr << "scaler attribute not valid" << endl);
-            m_model.reset(nullptr);
             goto out;
         }
         
@@ -281,6 +267,7 @@ private:
         
         // force type
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
         jit_mop_input_nolink(mop, 2);
         jit_mop_output_nolink(mop, 1);
         jit_mop_output_nolink(mop, 2);
@@ -6,6 +6,7 @@
 /// TODO: in mode 1 and 2 needs to output 3d matrix
 
 #include "mlmat.hpp"
+#include "core/som.hpp"
 #include <mlpack/methods/neighbor_search/neighbor_search.hpp>
 #include <mlpack/methods/neighbor_search/unmap.hpp>
 #include <mlpack/methods/neighbor_search/ns_model.hpp>
@@ -17,171 +18,7 @@ using namespace mlpack;
 
 typedef NeighborSearch<NearestNeighborSort, mlpack::SquaredEuclideanDistance> SomKNN;
 
-class SOM {
-public:
-    enum initialization {uniform, gaussian, sample};
-    SOM() {};
-    
-    SOM(long cols, long rows, long weights, long epochs, long neighborhood, double rate=.01, initialization init = uniform) {
-        m_num_iterations = epochs;
-        m_learning_rate = rate;
-        m_initialization = init;
-        m_cols = cols;
-        m_rows = rows;
-        //will have to redo sample anyway
-        if((m_initialization == uniform) || (m_initialization == sample)) {
-            m_nodes = std::make_unique<arma::Mat<double>>(weights, cols*rows, arma::fill::randu);
-        } else if(m_initialization == gaussian) {
-            m_nodes = std::make_unique<arma::Mat<double>>(weights, cols*rows, arma::fill::randn);
-        }
-        m_map_radius = std::max(cols, rows) / 2;
-
-        if(neighborhood != 0) {
-            m_map_radius = MIN(neighborhood, m_map_radius);
-        }
-
-        m_time_constant = m_num_iterations/log(m_map_radius);
-    }
-    
-    
-    void run_epochs(arma::Mat<double>& data) {
-        long n = m_num_iterations;
-
-        long iter_count = 0;
-        double rate = m_learning_rate;
-    
-        if(m_first_run && (m_initialization == sample)) {
-            for(auto i=0;i<m_nodes->n_cols;i++) {
-                int elem = mlpack::RandInt(data.n_cols);
-                m_nodes->col(i) = data.col(elem);
-            }
-            m_first_run = false;
-        }
-        
-        while(n--) {
-            arma::Col<double> data_elem;
-            m_neighborhood_radius = m_map_radius * exp(-(double)iter_count/m_time_constant);
-            double width_sq = m_neighborhood_radius * m_neighborhood_radius;
-            iter_count++;
-            
-            for(auto k=0;k<data.n_cols;k++) {
-                m_bmu = find_bmu(data.col(k));
-                
-                
-                for(auto i=0;i<m_nodes->n_cols;i++) {
-                    long dx = (m_bmu % m_rows) - (i % m_rows);
-                    long dy = (m_bmu / m_rows) - (i / m_rows);
-                    double dist_sq = double((dx*dx)+(dy*dy));//squared distance
-                    
-                    if(dist_sq < width_sq) {
-                        data_elem = data.col(k);
-                        m_influence = exp(-(dist_sq)/(2*width_sq));
-                        adjust_weights(i, data_elem, rate, m_influence);
-                    }
-                }
-            }
-            rate = m_learning_rate * exp(-(double)iter_count/m_num_iterations);
-           
-        }
-    }
-    
-    
-    
-    void run_batch_knn(arma::Mat<double>& data) {
-        long n = m_num_iterations;
-        long iter_count = 0;
-        
-        if(m_first_run && (m_initialization == sample)) {
-            for(auto i=0;i<m_nodes->n_cols;i++) {
-                int elem = mlpack::RandInt(data.n_cols);
-                m_nodes->col(i) = data.col(elem);
-            }
-            m_first_run = false;
-        }
-        
-        while(n--) {
-            arma::Mat<double> numerator(m_nodes->n_rows, m_nodes->n_cols, arma::fill::zeros);
-            std::vector<double> denominator(m_nodes->n_cols, 0.0);
-            m_neighborhood_radius = m_map_radius * exp(-(double)iter_count/m_time_constant);
-            double width_sq = m_neighborhood_radius * m_neighborhood_radius;
-            iter_count++;
-            
-            for(auto k=0;k<data.n_cols;k++) {
-                m_bmu = find_bmu(data.col(k));
-            
-                for(auto i=0;i<m_nodes->n_cols;i++) {
-                    long dx = (m_bmu % m_rows) - (i % m_rows);
-                    long dy = (m_bmu / m_rows) - (i / m_rows);
-                    double dist_sq = double((dx*dx)+(dy*dy));//squared distance
-                    double nh = exp(-(dist_sq)/(2*width_sq)); //neighborhood scaling
-                    numerator.col(i) += data.col(k) * nh;
-                    denominator[i] += nh;
-                }
-            }
-            
-            for(auto j=0;j<m_nodes->n_cols;j++) {
-                m_nodes->col(j) = numerator.col(j)/denominator[j];
-            }
-        }
-    }
-    
-    double get_euclidean_squared(const arma::Col<double>& target, const arma::Col<double>& weights) {
-        return arma::accu(arma::square(target - weights));
-    }
-    
-    void adjust_weights(long weight_index, arma::Col<double>& target, const double learning_rate, const double influence) {
-        arma::Col<double> adjust = (target - m_nodes->col(weight_index)) * (learning_rate * influence );
-        m_nodes->col(weight_index) += adjust;
-    }
-    
- 
-    
-    template<typename Archive>
-    void serialize(Archive& ar, const uint32_t /* version */)
-    {
-        ar(CEREAL_NVP(m_nodes));
-    }
-    
-    void set_epochs(long i) {
-        m_num_iterations = i;
-    }
-    
-    std::unique_ptr<arma::Mat<double>> m_nodes { nullptr };
-    
-private:
-    size_t find_bmu(const arma::Col<double> &vec) {
-        size_t winner = 0;
-        double lowest_distance = std::numeric_limits<double>::max();
-        double dist;
-        for(auto i=0;i<m_nodes->n_cols;i++) {
-            dist = get_euclidean_squared(vec, m_nodes->col(i));
-           
-            if(dist < lowest_distance) {
-                lowest_distance = dist;
-                winner = i;
-            }
-        }
-        return winner;
-    }
-    
-   
-    long        m_bmu;
-    double      m_map_radius;
-    double      m_time_constant;
-    long        m_num_iterations;
-    long        m_rows;
-    long        m_cols;
-    double      m_neighborhood_radius;
-    double      m_influence;
-    double      m_learning_rate;
-    initialization m_initialization;
-    bool m_first_run = true;
-};
-
-
-
-
-
+using mlmat::SOM;
 
 // C function declarations
 void max_mlmat_jit_matrix(max_jit_wrapper *x, t_symbol *s, short argc,t_atom *argv);
@@ -253,8 +90,8 @@ public:
     message<> write {this, "write",
         MIN_FUNCTION {
            try {
-               m_model.autoscale = autoscale;
-               save_model_file(args, m_model, "som");
+               adopt_trained_model();
+               save_model_file(args, *m_model.snapshot(), "som");
            } catch (const std::runtime_error& s) {
                (cout << s.what() << endl);
            }
@@ -265,7 +102,7 @@ public:
     message<> read {this, "read",
         MIN_FUNCTION {
             load_model_file(args);
-            autoscale = m_model.autoscale;
+            autoscale = m_model.snapshot()->autoscale;
             m_mode_changed = false;
             return {};
         }
@@ -281,18 +118,21 @@ public:
        path p {f, path::filetype::any};
 
        if(p) {
+           auto next = std::make_shared<model_version>();
            try {
-               mlpack::data::Load(string(p), "som", m_model, true);
+               mlpack::data::Load(string(p), "som", *next, true);
            } catch (const std::runtime_error& s) {
                std::throw_with_nested(std::runtime_error("Error reading model file to disk."));
            }
+           m_model.publish(std::move(next));
        }
     }
     
     message<> clear { this, "clear", "clear internal map",
         MIN_FUNCTION {
-            if(m_model.model) {
-                m_model.model = nullptr;
+            m_trainer.cancel();
+            if(m_model.snapshot()->model) {
+                m_model.clear();
                 m_data.reset();
             }
             return {};
@@ -327,8 +167,6 @@ public:
     // respond to the bang message to do something
     message<> train { this, "train", "train.",
         MIN_FUNCTION {
-            void *o,*p;
-            t_atom a;
             long num_epochs = epochs;
             if(args.size() > 0) {
                 long iters = args[0];
@@ -340,85 +178,108 @@ public:
             if(!m_data) {
                 (cerr << "no data to train on." << endl);
             } else {
-                if (seed == 0) {
-                  mlpack::RandomSeed(time(NULL));
-                } else {
-                  mlpack::RandomSeed((size_t) seed);
-                }
+                som_training settings;
+                settings.cols = cols;
+                settings.rows = rows;
+                settings.epochs = num_epochs;
+                settings.neighborhood = neighborhood;
+                settings.learning_rate = learning_rate;
+                settings.seed = seed;
+                settings.batch = batch_process;
                 
-                arma::Mat<double> dat(m_data->n_rows, cols*rows );
-                arma::Mat<double> scaled_data;
-                arma::Mat<double> rescaled_data;
-
-                
-                SOM::initialization init_type;
                 if(initialization.get() == "uniform") {
-                    init_type = SOM::uniform;
+                    settings.init = SOM::uniform;
                 } else if(initialization.get() == "gaussian") {
-                    init_type = SOM::gaussian;
+                    settings.init = SOM::gaussian;
                 } else if(initialization.get() == "sample") {
-                    init_type = SOM::sample;
+                    settings.init = SOM::sample;
                 }
                 
+                // published maps are never changed, so the job can hold on to the current one and train a copy of it
+                std::shared_ptr<const SOM> previous;
+                auto current = m_model.snapshot();
+                if(!autoclear && current->model) {
+                    previous = std::shared_ptr<const SOM>(current, current->model.get());
+                }
                 
-                if(autoclear) {
-                    m_model.model = std::make_unique<SOM>(cols, rows, m_data->n_rows, num_epochs, neighborhood, learning_rate, init_type);
-                } else {
-                    if(!m_model.model) {
-                        m_model.model = std::make_unique<SOM>(cols, rows, m_data->n_rows, num_epochs, neighborhood, learning_rate, init_type);
+                train_in_background([data = *m_data, previous, settings, scaling = scaler_settings()](mlmat_training_status& status) mutable {
+                    if (settings.seed == 0) {
+                      mlpack::RandomSeed(time(NULL));
                     } else {
-                        m_model.model->set_epochs(num_epochs);
+                      mlpack::RandomSeed((size_t) settings.seed);
                     }
-                }
-                
-                scaler_fit(m_model, *m_data);
-                
-                scaled_data = scaler_transform(m_model, *m_data, scaled_data);
-                
-                if(batch_process) {
-                    m_model.model->run_batch_knn(scaled_data);
-                } else {
-                    m_model.model->run_epochs(scaled_data);
-                }
-
-                for(auto i=0;i<m_model.model->m_nodes->n_cols;i++) {
-                    dat.col(i) = m_model.model->m_nodes->col(i);
-                }
-
-                t_object* mob = maxob_from_jitob(maxobj());
-                t_object *mop = static_cast<t_object*>(max_jit_obex_adornment_get(mob , _jit_sym_jit_mop));
-                t_linklist * op =  static_cast<t_linklist*>(object_method(mop,_jit_sym_getoutputlist));
-                t_object* genmatrix = static_cast<t_object*>(linklist_getindex(op, 0));
-                genmatrix = static_cast<t_object*>(object_method(genmatrix, _jit_sym_getmatrix));
-
-                auto genmatrix_savelock = object_method(genmatrix, _jit_sym_lock, 1);
-    
-                rescaled_data = scaler_inverse_transform(m_model, dat, rescaled_data);
-                
-                t_jit_matrix_info minfo;
-                minfo.type = _jit_sym_float64;
-                
-                minfo.flags = 0;
-                minfo.planecount = rescaled_data.n_rows;
-                minfo.dimcount = 2;
-                minfo.dim[0] = cols;
-                minfo.dim[1] = rows;
-                
-                genmatrix = arma_to_jit(mode, rescaled_data, genmatrix, minfo);
-                
-                if ((p=object_method((t_object*)mop,_jit_sym_getoutput,1)) && (o=max_jit_mop_io_getoutlet(p)))
-                {
-                    atom_setsym(&a,object_attr_getsym(p,_jit_sym_matrixname));
-                    outlet_anything(o,_jit_sym_jit_matrix,1,&a);
-                }
-                object_method(genmatrix,_jit_sym_lock,genmatrix_savelock);
+                    auto trained = std::make_unique<mlmat_trained_model<SOM>>();
+                    
+                    if(previous) {
+                        trained->model = std::make_unique<SOM>(*previous);
+                        trained->model->set_epochs(settings.epochs);
+                    } else {
+                        trained->model = std::make_unique<SOM>(settings.cols, settings.rows, data.n_rows, settings.epochs, settings.neighborhood, settings.learning_rate, settings.init);
+                    }
+                    
+                    arma::Mat<double> scaled_data;
+                    arma::Mat<double>& out_data = scaling.fit_transform(trained->scaler, data, scaled_data);
+                    
+                    auto on_epoch = [&status](long epoch, long epochs) {
+                        status.progress(epoch, epochs);
+                        return !status.cancelled();
+                    };
+                    
+                    if(settings.batch) {
+                        trained->model->run_batch_knn(out_data, on_epoch);
+                    } else {
+                        trained->model->run_epochs(out_data, on_epoch);
+                    }
+                    return trained;
+                });
             }
             return {};
         }
     };
     
+    // outputs the new map once training is done
+    void model_published() {
+        void *o,*p;
+        t_atom a;
+        arma::Mat<double> rescaled_data;
+        
+        auto current = m_model.snapshot();
+        
+        if(!current->model || !current->model->m_nodes) {
+            return;
+        }
+        
+        arma::Mat<double>& dat = *current->model->m_nodes;
+
+        t_object* mob = maxob_from_jitob(maxobj());
+        t_object *mop = static_cast<t_object*>(max_jit_obex_adornment_get(mob , _jit_sym_jit_mop));
+        t_linklist * op =  static_cast<t_linklist*>(object_method(mop,_jit_sym_getoutputlist));
+        t_object* genmatrix = static_cast<t_object*>(linklist_getindex(op, 0));
+        genmatrix = static_cast<t_object*>(object_method(genmatrix, _jit_sym_getmatrix));
+
+        auto genmatrix_savelock = object_method(genmatrix, _jit_sym_lock, 1);
+
+        rescaled_data = scaler_inverse_transform(*current, dat, rescaled_data);
+        
+        t_jit_matrix_info minfo;
+        minfo.type = _jit_sym_float64;
+        
+        minfo.flags = 0;
+        minfo.planecount = rescaled_data.n_rows;
+        minfo.dimcount = 2;
+        minfo.dim[0] = cols;
+        minfo.dim[1] = rows;
+        
+        genmatrix = arma_to_jit(mode, rescaled_data, genmatrix, minfo);
+        
+        if ((p=object_method((t_object*)mop,_jit_sym_getoutput,1)) && (o=max_jit_mop_io_getoutlet(p)))
+        {
+            atom_setsym(&a,object_attr_getsym(p,_jit_sym_matrixname));
+            outlet_anything(o,_jit_sym_jit_matrix,1,&a);
+        }
+        object_method(genmatrix,_jit_sym_lock,genmatrix_savelock);
+    }
 
-    
     message<> jitclass_setup {this, "jitclass_setup",
         MIN_FUNCTION {
             t_class* c = args[0];
@@ -427,6 +288,7 @@ public:
             
             // force type
             jit_mop_single_type(mop, _jit_sym_float64);
+            jit_mop_input_all_types(mop, 1);
     
             
             auto output1 = object_method(mop,_jit_sym_getoutput,1);
@@ -466,7 +328,7 @@ public:
         //need to check if rows are same
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
         
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
 
 
         try {
@@ -476,16 +338,16 @@ public:
             goto out;
         }
         
-        dat = jit_to_arma(mode, static_cast<t_object*>(in_matrix64), dat);
+        dat = jit_to_arma(mode, static_cast<t_object*>(in_query_matrix), dat);
         
         m_data = std::make_unique<arma::Mat<double>>(std::move(dat));
 
-        if(autotrain && !batch_process) {
+        // a frame that arrives while the map is still training is only kept as the next data set
+        if(autotrain && !batch_process && !training()) {
             train();
         }
         
      out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         
         object_method(in_matrix,_jit_sym_lock,in_savelock);
         object_method(out_matrix,_jit_sym_lock,out_savelock);
@@ -494,6 +356,19 @@ public:
         
         
     std::unique_ptr<arma::Mat<double>> m_data { nullptr };
+
+private:
+    // the attributes training depends on, copied when training starts
+    struct som_training {
+        long cols;
+        long rows;
+        long epochs;
+        long neighborhood;
+        double learning_rate;
+        int seed;
+        bool batch;
+        SOM::initialization init = SOM::uniform;
+    };
 };
 
 MIN_EXTERNAL(mlmat_som);
@@ -75,8 +75,8 @@ public:
     message<> write {this, "write",
         MIN_FUNCTION {
            try {
-               m_model.autoscale = autoscale;
-               save_model_file(args, m_model, "sparse_autoencoder");
+               adopt_trained_model();
+               save_model_file(args, *m_model.snapshot(), "sparse_autoencoder");
            } catch (const std::runtime_error& s) {
                (cout << s.what() << endl);
            }
@@ -87,7 +87,7 @@ public:
     message<> read {this, "read",
         MIN_FUNCTION {
             load_model_file(args);
-            autoscale = m_model.autoscale;
+            autoscale = m_model.snapshot()->autoscale;
             m_mode_changed = false;
             return {};
         }
@@ -103,21 +103,33 @@ public:
        path p {f, path::filetype::any};
 
        if(p) {
+           auto next = std::make_shared<model_version>();
            try {
-               mlpack::data::Load(string(p), "sparse_autoencoder", m_model, true);
+               mlpack::data::Load(string(p), "sparse_autoencoder", *next, true);
            } catch (const std::runtime_error& s) {
                std::throw_with_nested(std::runtime_error("Error reading model file to disk."));
            }
+           m_model.publish(std::move(next));
        }
     }
     
     message<> train { this, "train", "train model.",
         MIN_FUNCTION {
             if(m_training) {
-                arma::mat out_data;
-                scaler_fit(m_model, *m_training);
-                out_data = scaler_transform(m_model, *m_training, out_data);
-                m_model.model = std::make_unique<SparseAutoencoderExt>(out_data, out_data.n_rows, hidden_size, lambda, beta, rho);
+                // the job works on a copy, so new training data can arrive while it runs
+                train_in_background([training = *m_training,
+                                     scaling = scaler_settings(),
+                                     hidden = size_t(hidden_size),
+                                     l = double(lambda),
+                                     b = double(beta),
+                                     r = double(rho)](mlmat_training_status& status) mutable {
+                    auto trained = std::make_unique<mlmat_trained_model<SparseAutoencoderExt>>();
+                    arma::mat scaled_data;
+                    arma::mat& out_data = scaling.fit_transform(trained->scaler, training, scaled_data);
+                    trained->model = std::make_unique<SparseAutoencoderExt>(out_data, out_data.n_rows, hidden, l, b, r,
+                                                                            ens::L_BFGS(), mlmat_training_callback(status));
+                    return trained;
+                });
         
                 if(autoclear) {
                     m_training.reset();
@@ -132,7 +144,8 @@ public:
     message<> clear { this, "clear", "clear data and model",
         MIN_FUNCTION {
             m_training.reset();
-            m_model.model.reset();
+            m_trainer.cancel();
+            m_model.clear();
             return {};
         }
     };
@@ -160,6 +173,7 @@ public:
             
             // force type
             jit_mop_single_type(mop, _jit_sym_float64);
+            jit_mop_input_all_types(mop, 1);
             
             jit_class_addadornment(c, mop);
             
@@ -188,6 +202,7 @@ public:
         
         void *o,*p;
         t_atom a;
+        auto current = m_model.snapshot();
 
         
         auto* mob = maxob_from_jitob(maxobj());
@@ -200,7 +215,7 @@ public:
         
         object_method(matrix, _jit_sym_getinfo, &in_info);
         
-        if(!m_model.model) {
+        if(!current->model) {
             (cerr << "no Autoencoder model has been trained" << endl);
             goto out;
         }
@@ -223,15 +238,15 @@ public:
         features = jit_to_arma(mode, matrix, features);
         
         try {
-            mlpack::util::CheckSameDimensionality(features, m_model.model->HiddenSize(), "sparse autoencoder", "features");
+            mlpack::util::CheckSameDimensionality(features, current->model->HiddenSize(), "sparse autoencoder", "features");
         } catch (std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
         }
     
         try {
-            m_model.model->Predict(features, data);
-            scaled_data = scaler_inverse_transform(m_model,data, scaled_data);
+            current->model->Predict(features, data);
+            scaled_data = scaler_inverse_transform(*current,data, scaled_data);
         } catch (const std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
@@ -297,9 +312,12 @@ public:
         auto in_matrix_savelock = object_method(in_matrix, _jit_sym_lock, 1);
         auto out_features_savelock = object_method(out_features, _jit_sym_lock, 1);
         
+        adopt_trained_model();
+        auto current = m_model.snapshot();
+        
         object_method(in_matrix, _jit_sym_getinfo, &in_query_info);
         //std::cout << "query_matrix" << std::endl;
-        t_object* query_matrix = convert_to_float64(static_cast<t_object*>(in_matrix), in_query_info);
+        t_object* query_matrix = static_cast<t_object*>(in_matrix);
 
         try {
             check_mode(in_query_info, mode, "sparse autoencoder");
@@ -308,7 +326,7 @@ public:
             goto out;
         }
         
-        if(!m_model.model) {
+        if(!current->model) {
             (cerr << "no Autoencoder model has been trained" << endl);
             goto out;
         }
@@ -316,7 +334,7 @@ public:
         query = jit_to_arma(mode, static_cast<t_object*>(query_matrix), query);
         
         try {
-            mlpack::util::CheckSameDimensionality(query, m_model.model->VisibleSize(), "sparse autoencoder", "query");
+            mlpack::util::CheckSameDimensionality(query, current->model->VisibleSize(), "sparse autoencoder", "query");
         } catch (std::invalid_argument& s) {
             cerr << s.what() << endl;
             goto out;
@@ -324,8 +342,8 @@ public:
         
         try {
             arma::mat scaled_query;
-            scaled_query = scaler_transform(m_model, query, scaled_query);
-            m_model.model->GetNewFeatures(scaled_query, features);
+            scaled_query = scaler_transform(*current, query, scaled_query);
+            current->model->GetNewFeatures(scaled_query, features);
 
         } catch (const std::invalid_argument& s) {
             cerr << s.what() << endl;
@@ -78,9 +78,9 @@ public:
         auto out_test_matrix_savelock = object_method(out_test_matrix, _jit_sym_lock, 1);
 
         object_method(in_matrix, _jit_sym_getinfo, &in_matrix_info);
-        t_object* in_matrix64 = convert_to_float64(static_cast<t_object*>(in_matrix), in_matrix_info);
+        t_object* in_query_matrix = static_cast<t_object*>(in_matrix);
         
-        input_data = jit_to_arma(mode, in_matrix64, input_data);
+        input_data = jit_to_arma(mode, in_query_matrix, input_data);
         
         if(use_labels && !m_labels_received) {
             (cerr << "Have not received labels matrix." << endl);
@@ -157,7 +157,6 @@ public:
 
          
     out:
-        if(in_matrix != in_matrix64) { jit_object_free(in_matrix64); }
         object_method(in_matrix,_jit_sym_lock,in_matrix_savelock);
         object_method(out_train_matrix,_jit_sym_lock,out_train_matrix_savelock);
         object_method(out_test_matrix,_jit_sym_lock,out_test_matrix_savelock);
@@ -180,6 +179,7 @@ private:
         t_object* mop = static_cast<t_object*>(jit_object_new(_jit_sym_jit_mop, 2, 4));
         
         jit_mop_single_type(mop, _jit_sym_float64);
+        jit_mop_input_all_types(mop, 1);
         jit_mop_input_nolink(mop, 2);
         auto in2 = object_method(mop,_jit_sym_getinput,2);
         
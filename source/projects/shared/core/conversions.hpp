@@ -0,0 +1,437 @@
+/// @file conversions.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include <mlpack/prereqs.hpp>
+
+#include "matrix_desc.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+namespace mlmat {
+
+// dims past dimcount count as 1 so 1d and 2d matrices can go through the same loops
+inline long dim_or_one(const matrix_desc& desc, const long i) {
+    return i < desc.dimcount ? desc.dim[i] : 1;
+}
+
+// char cells hold 0-255 but are 0.-1. once converted to a float type,
+// float cells are truncated to long the same way jitter's frommatrix does
+template <typename T, typename S>
+inline T cell_cast(const S v) {
+    if constexpr (std::is_same_v<S, unsigned char> && std::is_floating_point_v<T>) {
+        return static_cast<T>(v) / static_cast<T>(255);
+    } else if constexpr (std::is_floating_point_v<S> && std::is_integral_v<T>) {
+        return static_cast<T>(static_cast<int32_t>(v));
+    } else {
+        return static_cast<T>(v);
+    }
+}
+
+
+// converts a run of cells that follow each other in memory. same type runs are a memcpy,
+// otherwise a plain loop over non aliasing pointers which the compiler vectorizes.
+// used for whole rows in mode 0, where packed cells already have arma's
+// planecount x cells column-major layout, and for whole columns in mode 1
+template <typename D, typename S>
+inline void convert_run(D* __restrict dst, const S* __restrict src, const size_t n) {
+    if constexpr (std::is_same_v<D, S>) {
+        std::memcpy(dst, src, n * sizeof(S));
+    } else {
+        for(size_t i=0;i<n;i++) {
+            dst[i] = cell_cast<D>(src[i]);
+        }
+    }
+}
+
+
+// writes the transpose of a rows x cols block. cells within a src row are contiguous and
+// rows are src_stride bytes apart, the result has cols rows dst_stride bytes apart.
+// walks the block in tiles so both the strided reads and the writes stay in cache
+template <typename D, typename S>
+void transpose(const unsigned char *src, const long src_stride,
+               unsigned char *dst, const long dst_stride,
+               const long rows, const long cols) {
+    constexpr long tile = 32;
+    for(long r0=0;r0<rows;r0+=tile) {
+        const long r1 = std::min(rows, r0 + tile);
+        for(long c0=0;c0<cols;c0+=tile) {
+            const long c1 = std::min(cols, c0 + tile);
+            for(long c=c0;c<c1;c++) {
+                D *d = reinterpret_cast<D*>(dst + (c*dst_stride));
+                const unsigned char *sc = src + (c*sizeof(S));
+                for(long r=r0;r<r1;r++) {
+                    d[r] = cell_cast<D>(*reinterpret_cast<const S*>(sc + (r*src_stride)));
+                }
+            }
+        }
+    }
+}
+
+
+// true if the cells of a 1 plane matrix follow each other with no padding,
+// which is the same column-major layout arma uses with n_rows = dim[0]
+inline bool matrix_is_packed(const matrix_desc& desc, const size_t elemsize) {
+    if(desc.planecount != 1 || desc.dimcount > 2) {
+        return false;
+    }
+    if(desc.dimstride[0] != (long)elemsize) {
+        return false;
+    }
+    return (desc.dimcount == 1) || (desc.dimstride[1] == (long)(desc.dim[0] * elemsize));
+}
+
+
+//feel like this template is a little hacky with the coords stuff but keeps other things cleaner
+template <typename M, typename A>
+void fill_matrix(const matrix_desc& desc, const A& arma, int mode, bool is_coords = false, long x = 0) {
+    unsigned char *dataptr = desc.data;
+    const size_t stepsize = sizeof(M);
+    const long dim0 = dim_or_one(desc, 0);
+    const long dim1 = dim_or_one(desc, 1);
+    const long dim2 = dim_or_one(desc, 2);
+    unsigned char *p = nullptr;
+    unsigned char *p2 = nullptr;
+    unsigned char *p1 = nullptr;
+    long aelem = 0;
+
+    if(!dataptr) {
+        return;
+    }
+
+    switch (mode) {
+        case 0:
+            //if 2 planes and is suppose to contain 2d coords, do the conversion
+            if(is_coords && ((desc.dimcount == 2) || (desc.dimcount == 1))) {
+                M pos = 0;
+                for(auto jslice=0;jslice<dim2;jslice++) {
+                    p = dataptr + (jslice*desc.dimstride[2]);
+                    for(auto jcol=0;jcol<dim1;jcol++) {
+                        p2 = p + (jcol*desc.dimstride[1]);
+                        for(auto jrow=0;jrow<dim0;jrow++) {
+                            p1 = p2 + (jrow*desc.dimstride[0]);
+                            pos = arma(aelem++);
+                            *(M*)p1 = (M)((long)pos % x);
+                            p1 += stepsize;
+                            *(M*)p1 = (M)((long)pos / x);
+                        }
+                    }
+                }
+
+            } else if(is_coords && (desc.dimcount == 3)) {
+                M pos = 0;
+                for(auto jslice=0;jslice<dim2;jslice++) {
+                    aelem = 0;
+                    p = dataptr + (jslice*desc.dimstride[2]);
+                    for(auto jcol=0;jcol<dim1;jcol++) {
+                        p2 = p + (jcol*desc.dimstride[1]);
+                        for(auto jrow=0;jrow<dim0;jrow++) {
+                            p1 = p2 + (jrow*desc.dimstride[0]);
+                            pos = arma(jslice, aelem++);
+                            *(M*)p1 = (M)((long)pos % x);
+                            p1 += stepsize;
+                            *(M*)p1 = (M)((long)pos / x);
+                        }
+                    }
+                }
+
+            } else {
+                const size_t cells_per_row = dim0 * desc.planecount;
+                const bool packed_cells = desc.dimstride[0] == (long)(desc.planecount * stepsize);
+                for(auto jslice=0;jslice<dim2;jslice++) {
+                    aelem = 0;
+                    p = dataptr + (jslice*desc.dimstride[2]);
+                    for(auto jcol=0;jcol<dim1;jcol++) {
+                        p2 = p +   (jcol*desc.dimstride[1]);
+                        if(packed_cells && (aelem + cells_per_row) <= arma.n_elem) {
+                            convert_run(reinterpret_cast<M*>(p2), arma.memptr() + aelem, cells_per_row);
+                            aelem += cells_per_row;
+                            continue;
+                        }
+                        for(auto jrow=0;jrow<dim0;jrow++) {
+                            p1 = p2 + (jrow*desc.dimstride[0]);
+                            for(auto jplane=0;jplane<desc.planecount;jplane++) {
+                                *(M*)p1 = arma(aelem++);
+                                p1 += stepsize;
+                            }
+                        }
+                    }
+                }
+            }
+            break;
+
+        case 1:
+            for(auto jcol=0;jcol<dim1;jcol++) {
+                p = dataptr + (jcol*desc.dimstride[1]);
+                if((aelem + dim0) <= (long)arma.n_elem) {
+                    convert_run(reinterpret_cast<M*>(p), arma.memptr() + aelem, dim0);
+                    aelem += dim0;
+                    continue;
+                }
+                for(auto jrow=0;jrow<dim0;jrow++) {
+                    *(M*)p = arma(aelem++);
+                    p += stepsize;
+                }
+            }
+            break;
+
+        case 2:
+            if(desc.dimstride[0] == (long)stepsize && (long)arma.n_cols == dim0 && (long)arma.n_rows == dim1) {
+                typedef typename A::elem_type eT;
+                transpose<M, eT>(reinterpret_cast<const unsigned char*>(arma.memptr()), arma.n_rows*sizeof(eT),
+                                 dataptr, desc.dimstride[1], arma.n_cols, arma.n_rows);
+                break;
+            }
+            for(auto jrow=0;jrow<dim0;jrow++) {
+                p1 = dataptr + (jrow*desc.dimstride[0]);
+                for(auto jcol=0;jcol<dim1;jcol++) {
+                    p = p1;
+                    *(M*)p = arma(aelem++);
+                    p1 += desc.dimstride[1];
+                }
+            }
+            break;
+
+        default:
+            (std::cerr << "could not create matrix" << std::endl);
+            break;
+    }
+}
+
+
+/*
+ reads the cells of a matrix stored as S into an arma matrix of eT,
+ converting the type in the same pass as the layout change
+ mode 0: each cell is a column, each plane a row
+ mode 1: dim[0] are the rows, dim[1] the columns
+ mode 2: dim[0] are the columns, dim[1] the rows
+ */
+template <typename S, typename eT>
+void read_matrix(const int mode,
+                 const matrix_desc& desc,
+                 arma::Mat<eT>& arma_matrix) {
+    const unsigned char *dataptr = desc.data;
+    const unsigned char *p = nullptr;
+    const S *s = nullptr;
+    const long dim0 = dim_or_one(desc, 0);
+    const long dim1 = dim_or_one(desc, 1);
+
+    switch(mode) {
+        case 0: {
+            arma_matrix.set_size(desc.planecount, dim0*dim1);
+            eT *a = arma_matrix.memptr();
+            const size_t cells_per_row = dim0 * desc.planecount;
+            const bool packed_cells = desc.dimstride[0] == (long)(desc.planecount * sizeof(S));
+            for(auto jcol=0;jcol<dim1;jcol++) {
+                p = dataptr + (jcol*desc.dimstride[1]);
+                if(packed_cells) {
+                    convert_run(a, reinterpret_cast<const S*>(p), cells_per_row);
+                    a += cells_per_row;
+                    continue;
+                }
+                for(auto jrow=0;jrow<dim0;jrow++) {
+                    s = reinterpret_cast<const S*>(p + (jrow*desc.dimstride[0]));
+                    for(auto jplane=0;jplane<desc.planecount;jplane++) {
+                        *a++ = cell_cast<eT>(s[jplane]);
+                    }
+                }
+            }
+        }
+            break;
+
+        case 1:
+            arma_matrix.set_size(dim0, dim1);
+            for(auto jcol=0;jcol<dim1;jcol++) {
+                s = reinterpret_cast<const S*>(dataptr + (jcol*desc.dimstride[1]));
+                convert_run(arma_matrix.colptr(jcol), s, dim0);
+            }
+            break;
+
+        case 2:
+            // Will catch earlier if not a 1d or 2d matrix and not 1 plane
+            arma_matrix.set_size(dim1, dim0);
+            transpose<eT, S>(dataptr, desc.dimstride[1],
+                             reinterpret_cast<unsigned char*>(arma_matrix.memptr()), dim1*sizeof(eT),
+                             dim1, dim0);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+// reads all cells (and in mode 0 all planes) in order into an arma row or column
+template <typename S, typename V>
+void read_vector(const int mode,
+                 const matrix_desc& desc,
+                 V& arma_vec) {
+    typedef typename V::elem_type eT;
+    const unsigned char *p = nullptr;
+    const S *s = nullptr;
+    const long planecount = mode == 0 ? desc.planecount : 1;
+    const long dim0 = dim_or_one(desc, 0);
+    const long dim1 = dim_or_one(desc, 1);
+
+    arma_vec.set_size(dim0*dim1*planecount);
+    eT *a = arma_vec.memptr();
+    const size_t cells_per_row = dim0 * planecount;
+    const bool packed_cells = desc.dimstride[0] == (long)(planecount * sizeof(S));
+
+    for(auto jcol=0;jcol<dim1;jcol++) {
+        p = desc.data + (jcol*desc.dimstride[1]);
+        if(packed_cells) {
+            convert_run(a, reinterpret_cast<const S*>(p), cells_per_row);
+            a += cells_per_row;
+            continue;
+        }
+        for(auto jrow=0;jrow<dim0;jrow++) {
+            s = reinterpret_cast<const S*>(p + (jrow*desc.dimstride[0]));
+            for(auto jplane=0;jplane<planecount;jplane++) {
+                *a++ = cell_cast<eT>(s[jplane]);
+            }
+        }
+    }
+}
+
+
+// reads cells as long, clamped to the range of the matrix being looked up into.
+// in mode 0 a 2 plane matrix holds x/y coords which are turned into a single index
+template <typename S>
+void read_matrix_limit(const int mode,
+                       const matrix_desc& desc,
+                       arma::Col<arma::uword>& arma_col,
+                       int32_t max_x,
+                       int32_t max_y) {
+    const unsigned char *dataptr = desc.data;
+    const S *s = nullptr;
+    const long dim0 = dim_or_one(desc, 0);
+    const long dim1 = dim_or_one(desc, 1);
+    long acol = 0;
+
+    arma_col.set_size(dim0*dim1);
+
+    switch(mode) {
+        case 0:
+            if(desc.planecount == 1) {
+                int32_t m = (max_x * max_y)-1;
+                for(auto jcol=0;jcol<dim1;jcol++) {
+                    for(auto jrow=0;jrow<dim0;jrow++) {
+                        s = reinterpret_cast<const S*>(dataptr + (jcol*desc.dimstride[1]) + (jrow*desc.dimstride[0]));
+                        int32_t d = cell_cast<int32_t>(*s);
+                        arma_col(acol++) = std::clamp(d, 0, m);
+                    }
+                }
+            } else if (desc.planecount == 2) {
+                for(auto jcol=0;jcol<dim1;jcol++) {
+                    for(auto jrow=0;jrow<dim0;jrow++) {
+                        s = reinterpret_cast<const S*>(dataptr + (jcol*desc.dimstride[1]) + (jrow*desc.dimstride[0]));
+                        int32_t xpos = std::clamp(cell_cast<int32_t>(s[0]), 0, max_x-1);
+                        int32_t ypos = std::clamp(cell_cast<int32_t>(s[1]), 0, max_y-1);
+
+                        ypos *= max_x;//
+                        arma_col(acol++) =  xpos + ypos;
+                    }
+                }
+            } else {
+                //ERROR
+            }
+            break;
+
+        case 1:
+            for(auto jcol=0;jcol<dim1;jcol++) {
+                s = reinterpret_cast<const S*>(dataptr + (jcol*desc.dimstride[1]));
+                for(auto jrow=0;jrow<dim0;jrow++) {
+                    arma_col(acol++) = std::clamp(cell_cast<int32_t>(s[jrow]), 0, (max_y)-1);
+                }
+            }
+            break;
+
+        case 2:
+            //TODO: compare doing same as in mode 1 and then
+            //transposing the arma mat
+            // Will catch earlier if not a 1d or 2d matrix and not 1 plane
+            for(auto jcol=0;jcol<dim1;jcol++) {
+                s = reinterpret_cast<const S*>(dataptr + (jcol*desc.dimstride[1]));
+                for(auto jrow=0;jrow<dim0;jrow++) {
+                    arma_col(acol++) = std::clamp(cell_cast<int32_t>(s[jrow]), 0, (max_x)-1);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/*
+ entry points used by the hosts. these dispatch on the cell type of the descriptor
+ */
+
+template <typename eT>
+arma::Mat<eT>& to_arma(const int mode, const matrix_desc& desc, arma::Mat<eT>& arma_matrix) {
+    type_dispatch(desc.type, [&](auto tag) {
+        read_matrix<std::remove_pointer_t<decltype(tag)>>(mode, desc, arma_matrix);
+    });
+    return arma_matrix;
+}
+
+template <typename eT>
+arma::Row<eT>& to_arma(const int mode, const matrix_desc& desc, arma::Row<eT>& arma_row) {
+    type_dispatch(desc.type, [&](auto tag) {
+        read_vector<std::remove_pointer_t<decltype(tag)>>(mode, desc, arma_row);
+    });
+    return arma_row;
+}
+
+template <typename eT>
+arma::Col<eT>& to_arma(const int mode, const matrix_desc& desc, arma::Col<eT>& arma_col) {
+    type_dispatch(desc.type, [&](auto tag) {
+        read_vector<std::remove_pointer_t<decltype(tag)>>(mode, desc, arma_col);
+    });
+    return arma_col;
+}
+
+/*
+ same as to_arma but in mode 1 a packed float64 matrix is not copied. arma_matrix
+ is pointed at the data instead, so it is only valid as long as the data is
+ and must be treated as read only. anything else falls back to a copy.
+ */
+inline arma::mat& to_arma_view(const int mode, const matrix_desc& desc, arma::mat& arma_matrix) {
+    if(mode == 1 && desc.data && desc.type == cell_type::float64 && matrix_is_packed(desc, sizeof(double))) {
+        //move assignment takes over the auxiliary memory without copying it
+        arma_matrix = arma::mat(reinterpret_cast<double*>(desc.data), dim_or_one(desc, 0), dim_or_one(desc, 1), false, false);
+        return arma_matrix;
+    }
+    //a buffer still aliasing earlier data would be written through in place
+    if(arma_matrix.mem_state == 1) {
+        arma_matrix.reset();
+    }
+    return to_arma(mode, desc, arma_matrix);
+}
+
+inline arma::Col<arma::uword>& to_arma_limit(const int mode, const matrix_desc& desc,
+                                             arma::Col<arma::uword>& arma_col,
+                                             int32_t max_x, int32_t max_y) {
+    type_dispatch(desc.type, [&](auto tag) {
+        read_matrix_limit<std::remove_pointer_t<decltype(tag)>>(mode, desc, arma_col, max_x, max_y);
+    });
+    return arma_col;
+}
+
+// writes arma into the cells desc points at, converting to the type of desc
+template <typename A>
+void from_arma(const int mode, const A& arma, const matrix_desc& desc, const bool is_coords = false, const long x = 0) {
+    type_dispatch(desc.type, [&](auto tag) {
+        fill_matrix<std::remove_pointer_t<decltype(tag)>>(desc, arma, mode, is_coords, x);
+    });
+}
+
+}
@@ -0,0 +1,302 @@
+/// @file gmm.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved. Also based on examples provided with the mlpack library. Please see source/mlpack for license details
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#include "gmm.hpp"
+
+#include <mlpack/methods/kmeans.hpp>
+#include <mlpack/methods/kmeans/refined_start.hpp>
+#include <mlpack/methods/gmm/positive_definite_constraint.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace mlmat {
+
+// columns whitened at once within a shard
+static const size_t score_block = 1024;
+
+void gmm_score(const mlpack::GMM& gmm,
+               const arma::mat& query,
+               arma::Row<double>& probabilities,
+               arma::Row<double>& log_probabilities) {
+    probabilities.set_size(query.n_cols);
+    log_probabilities.set_size(query.n_cols);
+
+    for (size_t i = 0; i < query.n_cols; i++) {
+        log_probabilities[i] = gmm.LogProbability(query.unsafe_col(i));
+        probabilities[i] = std::exp(log_probabilities[i]);
+    }
+}
+
+void gmm_classify(const mlpack::GMM& gmm, const arma::mat& query, arma::Row<size_t>& labels) {
+    gmm.Classify(query, labels);
+}
+
+bool gmm_scorer::prepare_component(const size_t g, const arma::vec& mean, const arma::mat& covariance, const double weight) {
+    arma::mat lower;
+    if(!arma::chol(lower, covariance, "lower")) {
+        return false;
+    }
+    component& c = m_components[g];
+    // |L^-1 (x - m)|^2 is the mahalanobis distance of x and its log determinant is 2 sum log diag(L)
+    c.whitening = arma::inv(arma::trimatl(lower));
+    c.whitened_mean = c.whitening * mean;
+    c.offset = std::log(weight) - .5 * (double(mean.n_elem) * std::log(2. * arma::datum::pi)) - arma::accu(arma::log(lower.diag()));
+    return true;
+}
+
+bool gmm_scorer::prepare(const mlpack::GMM& gmm) {
+    m_components.resize(gmm.Gaussians());
+    for(size_t g = 0; g < gmm.Gaussians(); g++) {
+        if(!prepare_component(g, gmm.Component(g).Mean(), gmm.Component(g).Covariance(), gmm.Weights()[g])) {
+            clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool gmm_scorer::prepare(const std::vector<arma::vec>& means, const std::vector<arma::mat>& covariances, const arma::vec& weights) {
+    m_components.resize(means.size());
+    for(size_t g = 0; g < means.size(); g++) {
+        if(!prepare_component(g, means[g], covariances[g], weights[g])) {
+            clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void gmm_scorer::score(const arma::mat& query,
+                       arma::mat& log_likelihoods,
+                       arma::Row<double>& probabilities,
+                       arma::Row<double>& log_probabilities,
+                       worker_pool* workers) {
+    const size_t threads = workers ? workers->size() : 1;
+    const size_t shards = std::max<size_t>(1, std::min<size_t>(threads, query.n_cols / 64));
+
+    log_likelihoods.set_size(m_components.size(), query.n_cols);
+    probabilities.set_size(query.n_cols);
+    log_probabilities.set_size(query.n_cols);
+    m_whitened.resize(shards);
+
+    auto shard = [&](const size_t s) {
+        const size_t begin = query.n_cols * s / shards;
+        const size_t end = query.n_cols * (s + 1) / shards;
+        arma::mat& whitened = m_whitened[s];
+
+        for(size_t first = begin; first < end; first += score_block) {
+            const size_t count = std::min(score_block, end - first);
+            const arma::mat points(const_cast<double*>(query.colptr(first)), query.n_rows, count, false, true);
+            for(size_t g = 0; g < m_components.size(); g++) {
+                const component& c = m_components[g];
+                whitened = c.whitening * points;
+                for(size_t i = 0; i < count; i++) {
+                    const double* z = whitened.colptr(i);
+                    double distance = 0.;
+                    for(size_t row = 0; row < whitened.n_rows; row++) {
+                        const double d = z[row] - c.whitened_mean[row];
+                        distance += d * d;
+                    }
+                    log_likelihoods(g, first + i) = c.offset - .5 * distance;
+                }
+            }
+            for(size_t i = first; i < first + count; i++) {
+                const double* l = log_likelihoods.colptr(i);
+                const double top = *std::max_element(l, l + log_likelihoods.n_rows);
+                if(!std::isfinite(top)) {
+                    log_probabilities[i] = top;
+                } else {
+                    double sum = 0.;
+                    for(size_t g = 0; g < log_likelihoods.n_rows; g++) {
+                        sum += std::exp(l[g] - top);
+                    }
+                    log_probabilities[i] = top + std::log(sum);
+                }
+                probabilities[i] = std::exp(log_probabilities[i]);
+            }
+        }
+    };
+    if(shards > 1) {
+        workers->run(shards, shard);
+    } else {
+        shard(0);
+    }
+}
+
+void gmm_classify(const arma::mat& log_likelihoods, arma::Row<size_t>& labels) {
+    labels.set_size(log_likelihoods.n_cols);
+    for(size_t i = 0; i < log_likelihoods.n_cols; i++) {
+        const double* l = log_likelihoods.colptr(i);
+        labels[i] = size_t(std::max_element(l, l + log_likelihoods.n_rows) - l);
+    }
+}
+
+namespace {
+
+// one EM run, what gmm_train does per trial
+struct gmm_trial {
+    std::vector<arma::vec> means;
+    std::vector<arma::mat> covariances;
+    arma::vec weights;
+    double likelihood = -std::numeric_limits<double>::infinity();
+};
+
+// well mixed seeds from one, so neighbouring trials do not get neighbouring streams
+uint64_t trial_seed(const uint64_t seed, const size_t trial) {
+    uint64_t z = seed + (trial + 1) * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+void constrain(const gmm_train_params& params, arma::mat& covariance) {
+    if(params.diagonal_covariance) {
+        covariance = arma::diagmat(covariance);
+    }
+    if(params.diagonal_covariance || params.force_positive) {
+        mlpack::PositiveDefiniteConstraint::ApplyConstraint(covariance);
+    }
+}
+
+// the weights, means and covariances of the k-means clusters of data, as EMFit starts
+void initial_clustering(const gmm_train_params& params, const arma::mat& data, gmm_trial& trial) {
+    const size_t gaussians = params.gaussians;
+    arma::Row<size_t> assignments;
+
+    if(params.refined_start) {
+        mlpack::KMeans<mlpack::SquaredEuclideanDistance, mlpack::RefinedStart> k(params.kmeans_max_iterations, mlpack::SquaredEuclideanDistance(), mlpack::RefinedStart(params.samplings, params.percentage));
+        k.Cluster(data, gaussians, assignments);
+    } else {
+        mlpack::KMeans<> k(params.kmeans_max_iterations);
+        k.Cluster(data, gaussians, assignments);
+    }
+
+    trial.means.assign(gaussians, arma::vec(data.n_rows, arma::fill::zeros));
+    trial.covariances.assign(gaussians, arma::mat(data.n_rows, data.n_rows, arma::fill::zeros));
+    trial.weights.zeros(gaussians);
+    for(size_t i = 0; i < data.n_cols; i++) {
+        trial.means[assignments[i]] += data.col(i);
+        trial.weights[assignments[i]] += 1.;
+    }
+    for(size_t g = 0; g < gaussians; g++) {
+        if(trial.weights[g] > 0.) {
+            trial.means[g] /= trial.weights[g];
+        }
+    }
+    for(size_t i = 0; i < data.n_cols; i++) {
+        const arma::vec diff = data.col(i) - trial.means[assignments[i]];
+        trial.covariances[assignments[i]] += diff * diff.t();
+    }
+    for(size_t g = 0; g < gaussians; g++) {
+        if(trial.weights[g] > 1.) {
+            trial.covariances[g] /= trial.weights[g];
+        }
+        constrain(params, trial.covariances[g]);
+    }
+    trial.weights /= double(data.n_cols);
+}
+
+// scores data under the trial, leaving the weighted component log likelihoods in log_likelihoods, and returns the log likelihood of all of it
+double expectation(const gmm_trial& trial, const arma::mat& data, gmm_scorer& scorer, worker_pool* workers,
+                   arma::mat& log_likelihoods, arma::Row<double>& probabilities, arma::Row<double>& log_probabilities) {
+    if(!scorer.prepare(trial.means, trial.covariances, trial.weights)) {
+        throw std::runtime_error("a covariance is not positive definite");
+    }
+    scorer.score(data, log_likelihoods, probabilities, log_probabilities, workers);
+    return arma::accu(log_probabilities);
+}
+
+// moves each component to the points weighted by how likely they are to be from it, a component per part on workers
+void maximization(const gmm_train_params& params, const arma::mat& data, const arma::mat& log_likelihoods,
+                  const arma::Row<double>& log_probabilities, worker_pool* workers, gmm_trial& trial) {
+    auto component = [&](const size_t g) {
+        const arma::rowvec responsibilities = arma::exp(log_likelihoods.row(g) - log_probabilities);
+        const double total = arma::accu(responsibilities);
+        trial.weights[g] = total / double(data.n_cols);
+        // a component nothing is likely to be from keeps its mean and covariance
+        if(!(total > 0.)) {
+            return;
+        }
+        trial.means[g] = data * responsibilities.t() / total;
+        arma::mat diff = data.each_col() - trial.means[g];
+        const arma::mat weighted = diff.each_row() % responsibilities;
+        trial.covariances[g] = weighted * diff.t() / total;
+        constrain(params, trial.covariances[g]);
+    };
+    if(workers && workers->size() > 1) {
+        workers->run(params.gaussians, component);
+    } else {
+        for(size_t g = 0; g < params.gaussians; g++) {
+            component(g);
+        }
+    }
+}
+
+// one EMFit::Estimate run from the k-means start, seeded with seed, its inner steps on workers
+void run_trial(const gmm_train_params& params, const arma::mat& data, const uint64_t seed, worker_pool* workers, gmm_trial& trial) {
+    // mlpack and armadillo keep their generators per thread
+    mlpack::RandomSeed((size_t) seed);
+    initial_clustering(params, data, trial);
+
+    gmm_scorer scorer;
+    arma::mat log_likelihoods;
+    arma::Row<double> probabilities, log_probabilities;
+    double likelihood = expectation(trial, data, scorer, workers, log_likelihoods, probabilities, log_probabilities);
+    double previous = -std::numeric_limits<double>::max();
+    size_t iteration = 1;
+    while(std::abs(likelihood - previous) > params.tolerance && iteration != params.max_iterations) {
+        maximization(params, data, log_likelihoods, log_probabilities, workers, trial);
+        previous = likelihood;
+        likelihood = expectation(trial, data, scorer, workers, log_likelihoods, probabilities, log_probabilities);
+        iteration++;
+    }
+    trial.likelihood = likelihood;
+}
+
+}
+
+double gmm_train(const gmm_train_params& params, const arma::mat& data, mlpack::GMM& model) {
+    const size_t trials = std::max<size_t>(1, params.trials);
+    const size_t threads = std::max<size_t>(1, params.threads);
+    const uint64_t seed = params.seed != 0 ? uint64_t(params.seed) : uint64_t(std::time(NULL));
+
+    // trials side by side, each with an equal share of what is left for its steps
+    const size_t side_by_side = std::min(trials, threads);
+    worker_pool trial_workers(side_by_side);
+    std::vector<std::unique_ptr<worker_pool>> step_workers(side_by_side);
+    for(auto& w : step_workers) {
+        w = std::make_unique<worker_pool>(threads / side_by_side);
+    }
+
+    std::vector<gmm_trial> results(trials);
+    trial_workers.run(side_by_side, [&](const size_t lane) {
+        for(size_t t = lane; t < trials; t += side_by_side) {
+            run_trial(params, data, trial_seed(seed, t), step_workers[lane].get(), results[t]);
+        }
+    });
+
+    size_t best = 0;
+    for(size_t t = 1; t < trials; t++) {
+        if(results[t].likelihood > results[best].likelihood) {
+            best = t;
+        }
+    }
+    const gmm_trial& kept = results[best];
+    for(size_t g = 0; g < params.gaussians; g++) {
+        model.Component(g).Mean() = kept.means[g];
+        model.Component(g).Covariance(kept.covariances[g]);
+    }
+    model.Weights() = kept.weights;
+    return kept.likelihood;
+}
+
+}
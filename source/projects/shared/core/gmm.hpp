@@ -0,0 +1,110 @@
+/// @file gmm.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved. Also based on examples provided with the mlpack library. Please see source/mlpack for license details
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include <mlpack/prereqs.hpp>
+#include <mlpack/methods/gmm.hpp>
+
+#include "worker_pool.hpp"
+
+#include <vector>
+
+namespace mlmat {
+
+// probability and log probability of each column of query under the model, one density evaluation per column
+void gmm_score(const mlpack::GMM& gmm,
+               const arma::mat& query,
+               arma::Row<double>& probabilities,
+               arma::Row<double>& log_probabilities);
+
+// most likely component of each column of query
+void gmm_classify(const mlpack::GMM& gmm, const arma::mat& query, arma::Row<size_t>& labels);
+
+/*
+ scores whole query matrices against a GMM. prepare keeps the inverse of the lower cholesky
+ factor of each covariance, its mean run through that and its log determinant, so score
+ whitens each component's block of columns with one matrix product and gets every log
+ density from the sums of squares, without going back to the model. the mixture is the log
+ sum of the weighted component densities, and the probabilities are their exponents
+ */
+class gmm_scorer {
+public:
+    // false, leaving the scorer empty, if a covariance has no cholesky factor
+    bool prepare(const mlpack::GMM& gmm);
+
+    // same from the parts of a model, a mean and covariance per component
+    bool prepare(const std::vector<arma::vec>& means, const std::vector<arma::mat>& covariances, const arma::vec& weights);
+
+    void clear() {
+        m_components.clear();
+    }
+
+    bool ready() const {
+        return !m_components.empty();
+    }
+
+    /*
+     log of each component's weight times its density at each column of query, a row per
+     component, and the log and plain density of the mixture from those. the columns are
+     split into a contiguous shard per thread of workers when it is set
+     */
+    void score(const arma::mat& query,
+               arma::mat& log_likelihoods,
+               arma::Row<double>& probabilities,
+               arma::Row<double>& log_probabilities,
+               worker_pool* workers = nullptr);
+
+private:
+    bool prepare_component(const size_t g, const arma::vec& mean, const arma::mat& covariance, const double weight);
+
+    struct component {
+        arma::mat whitening;
+        arma::vec whitened_mean;
+        // log weight - (dimensions log 2 pi + log determinant) / 2
+        double offset;
+    };
+
+    std::vector<component> m_components;
+    // whitened columns, one per shard, kept so frames of the same size do not allocate
+    std::vector<arma::mat> m_whitened;
+};
+
+// most likely component of each column of log_likelihoods from gmm_scorer::score
+void gmm_classify(const arma::mat& log_likelihoods, arma::Row<size_t>& labels);
+
+// settings for gmm_train, named the same as the object attributes
+struct gmm_train_params {
+    size_t gaussians = 10;
+    size_t trials = 1;
+    // 0 runs until the log likelihood changes by less than tolerance
+    size_t max_iterations = 250;
+    size_t kmeans_max_iterations = 1000;
+    size_t samplings = 100;
+    double tolerance = 1e-5;
+    double percentage = .02;
+    bool refined_start = false;
+    bool diagonal_covariance = true;
+    // keeps the covariances positive definite after each step, which diagonal_covariance always does.
+    // false leaves full covariances as they come out of each step
+    bool force_positive = true;
+    // each trial seeds its own random numbers from this, so a trial gives the same model on any
+    // thread. 0 picks a different seed every time
+    int seed = 0;
+    size_t threads = 1;
+};
+
+/*
+ fits model to the columns of data with EM (expectation maximization), starting each of
+ params.trials runs from a k-means clustering, and keeps the one with the highest log
+ likelihood, which is returned. the trials run side by side on up to params.threads threads,
+ and the threads left over from that split the expectation step (scored with gmm_scorer) and
+ the per component maximization step of each trial. model has to have params.gaussians
+ components of the dimensions of data.
+ throws std::runtime_error if a covariance stops being positive definite
+ */
+double gmm_train(const gmm_train_params& params, const arma::mat& data, mlpack::GMM& model);
+
+}
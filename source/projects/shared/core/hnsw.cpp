@@ -0,0 +1,515 @@
+/// @file hnsw.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#include "hnsw.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+namespace mlmat {
+
+// buffers for one search or insert, kept per thread so queries do not go to the heap once they have grown
+struct hnsw_index::scratch {
+    // a point has been visited when its mark is the current tag
+    std::vector<uint32_t> marks;
+    uint32_t tag = 0;
+    // closest first (min heap) and furthest first (max heap)
+    std::vector<candidate> candidates;
+    std::vector<candidate> results;
+    std::vector<candidate> sorted;
+    std::vector<uint32_t> chosen;
+    std::vector<uint32_t> linked;
+    // decoded points and the distances from a query to the codebook
+    std::vector<double> a;
+    std::vector<double> b;
+    std::vector<double> table;
+
+    void begin(const size_t points) {
+        if(marks.size() < points) {
+            marks.resize(points, 0);
+        }
+        if(++tag == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            tag = 1;
+        }
+    }
+
+    // true the first time a point is seen since begin
+    bool visit(const uint32_t point) {
+        if(marks[point] == tag) {
+            return false;
+        }
+        marks[point] = tag;
+        return true;
+    }
+};
+
+hnsw_index::scratch& hnsw_index::thread_scratch() {
+    static thread_local scratch s;
+    return s;
+}
+
+// at most this many points are used to train the codebook
+static const size_t codebook_sample = 65536;
+
+hnsw_index::hnsw_index(size_t m, size_t ef_construction, size_t seed, storage kept, size_t pq_bytes, bool rerank) :
+    m_m(std::max<size_t>(m, 2)),
+    m_ef_construction(std::max<size_t>(ef_construction, 1)),
+    m_seed(seed),
+    m_level_mult(1. / std::log(double(m_m))),
+    m_rng(seed),
+    m_kept(kept),
+    m_pq_bytes(std::max<size_t>(pq_bytes, 1)),
+    m_rerank(rerank && kept == storage::pq) {}
+
+// the rerank copy is nearer the points than their codes, so everything but the graph search itself reads that
+static hnsw_index::storage stored_as(const hnsw_index::storage storage, const bool rerank) {
+    return storage == hnsw_index::storage::pq && rerank ? hnsw_index::storage::float32 : storage;
+}
+
+double hnsw_index::distance(const double* a, const uint32_t point) const {
+    double sum = 0.;
+    switch(stored_as(m_storage, m_rerank)) {
+        case storage::float64: {
+            const double* b = m_data.colptr(point);
+            for(size_t i = 0; i < m_dims; i++) {
+                const double d = a[i] - b[i];
+                sum += d * d;
+            }
+            break;
+        }
+        case storage::float32: {
+            const float* b = m_data32.colptr(point);
+            for(size_t i = 0; i < m_dims; i++) {
+                const double d = a[i] - double(b[i]);
+                sum += d * d;
+            }
+            break;
+        }
+        case storage::pq: {
+            const uint8_t* code = &m_codes[size_t(point) * m_pq_bytes];
+            for(size_t s = 0; s < m_pq_bytes; s++) {
+                const double* c = m_codebook.colptr(code[s]);
+                for(size_t i = m_subspaces[s]; i < m_subspaces[s + 1]; i++) {
+                    const double d = a[i] - c[i];
+                    sum += d * d;
+                }
+            }
+            break;
+        }
+    }
+    return sum;
+}
+
+const double* hnsw_index::vector_of(const uint32_t point, std::vector<double>& buffer) const {
+    if(m_storage == storage::float64) {
+        return m_data.colptr(point);
+    }
+    buffer.resize(m_dims);
+    if(stored_as(m_storage, m_rerank) == storage::float32) {
+        const float* b = m_data32.colptr(point);
+        std::copy(b, b + m_dims, buffer.begin());
+    } else {
+        const uint8_t* code = &m_codes[size_t(point) * m_pq_bytes];
+        for(size_t s = 0; s < m_pq_bytes; s++) {
+            const double* c = m_codebook.colptr(code[s]);
+            std::copy(c + m_subspaces[s], c + m_subspaces[s + 1], buffer.begin() + m_subspaces[s]);
+        }
+    }
+    return buffer.data();
+}
+
+int hnsw_index::random_level() {
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    return int(-std::log(1. - uniform(m_rng)) * m_level_mult);
+}
+
+// greedy walk from the entry point down to to_level, one step at a time to the closest link
+template<typename Distance>
+uint32_t hnsw_index::descend(Distance&& distance, const int to_level, double& d) const {
+    uint32_t current = m_entry;
+    d = distance(current);
+    for(int level = m_max_level; level > to_level; level--) {
+        bool moved = true;
+        while(moved) {
+            moved = false;
+            const uint32_t* l = links(current, level);
+            for(uint32_t i = 1; i <= l[0]; i++) {
+                const double dl = distance(l[i]);
+                if(dl < d) {
+                    d = dl;
+                    current = l[i];
+                    moved = true;
+                }
+            }
+        }
+    }
+    return current;
+}
+
+// best first search of one layer from the entry points in s.results. leaves the ef closest found there as a max heap
+template<typename Distance>
+void hnsw_index::search_layer(Distance&& distance, const size_t ef, const int level, scratch& s) const {
+    auto closer = std::greater<candidate>();
+    s.begin(size());
+    s.candidates.clear();
+    size_t entries = 0;
+    for(auto& r : s.results) {
+        if(s.visit(r.second)) {
+            s.candidates.push_back(r);
+            s.results[entries++] = r;
+        }
+    }
+    s.results.resize(entries);
+    std::make_heap(s.candidates.begin(), s.candidates.end(), closer);
+    std::make_heap(s.results.begin(), s.results.end());
+
+    while(!s.candidates.empty()) {
+        const candidate c = s.candidates.front();
+        if(c.first > s.results.front().first && s.results.size() >= ef) {
+            break;
+        }
+        std::pop_heap(s.candidates.begin(), s.candidates.end(), closer);
+        s.candidates.pop_back();
+
+        const uint32_t* l = links(c.second, level);
+        for(uint32_t i = 1; i <= l[0]; i++) {
+            if(!s.visit(l[i])) {
+                continue;
+            }
+            const double d = distance(l[i]);
+            if(s.results.size() < ef || d < s.results.front().first) {
+                s.candidates.emplace_back(d, l[i]);
+                std::push_heap(s.candidates.begin(), s.candidates.end(), closer);
+                s.results.emplace_back(d, l[i]);
+                std::push_heap(s.results.begin(), s.results.end());
+                if(s.results.size() > ef) {
+                    std::pop_heap(s.results.begin(), s.results.end());
+                    s.results.pop_back();
+                }
+            }
+        }
+    }
+}
+
+// keeps a candidate only if it is closer to the point being linked than to everything kept so far, which spreads the links out
+void hnsw_index::select_neighbors(std::vector<candidate>& sorted, const size_t m, std::vector<uint32_t>& chosen, scratch& s) const {
+    std::sort(sorted.begin(), sorted.end());
+    chosen.clear();
+    for(auto& c : sorted) {
+        if(chosen.size() >= m) {
+            break;
+        }
+        const double* v = vector_of(c.second, s.a);
+        bool keep = true;
+        for(auto other : chosen) {
+            if(distance(v, other) < c.first) {
+                keep = false;
+                break;
+            }
+        }
+        if(keep) {
+            chosen.push_back(c.second);
+        }
+    }
+}
+
+// links from to to, pruning the links of from when it has too many
+void hnsw_index::connect(const uint32_t from, const uint32_t to, const int level, scratch& s) {
+    const size_t most = level == 0 ? 2 * m_m : m_m;
+    uint32_t* l = links(from, level);
+    if(l[0] < most) {
+        l[++l[0]] = to;
+        return;
+    }
+    const double* f = vector_of(from, s.b);
+    s.sorted.clear();
+    s.sorted.emplace_back(distance(f, to), to);
+    for(uint32_t i = 1; i <= l[0]; i++) {
+        s.sorted.emplace_back(distance(f, l[i]), l[i]);
+    }
+    select_neighbors(s.sorted, most, s.chosen, s);
+    l[0] = uint32_t(s.chosen.size());
+    std::copy(s.chosen.begin(), s.chosen.end(), l + 1);
+}
+
+// q is the point as it was added, which is what it is linked by
+void hnsw_index::insert(const uint32_t point, const double* q, scratch& s) {
+    const int level = random_level();
+    auto to_q = [this, q](const uint32_t p) { return distance(q, p); };
+    m_levels[point] = level;
+    m_upper[point].assign(size_t(level) * (m_m + 1), 0);
+
+    if(m_max_level < 0) {
+        m_entry = point;
+        m_max_level = level;
+        return;
+    }
+
+    double d = 0.;
+    const uint32_t entry = descend(to_q, level, d);
+    s.results.assign(1, candidate(d, entry));
+
+    for(int l = std::min(level, m_max_level); l >= 0; l--) {
+        search_layer(to_q, m_ef_construction, l, s);
+        s.sorted.assign(s.results.begin(), s.results.end());
+        select_neighbors(s.sorted, m_m, s.chosen, s);
+
+        // connect prunes through s.chosen too
+        s.linked.assign(s.chosen.begin(), s.chosen.end());
+        uint32_t* own = links(point, l);
+        own[0] = uint32_t(s.linked.size());
+        std::copy(s.linked.begin(), s.linked.end(), own + 1);
+        for(auto other : s.linked) {
+            connect(other, point, l, s);
+        }
+    }
+
+    if(level > m_max_level) {
+        m_entry = point;
+        m_max_level = level;
+    }
+}
+
+// k-means per subspace over a sample of points, at most 256 centroids so a code fits a byte
+void hnsw_index::train_codebook(const arma::mat& points) {
+    arma::mat sample;
+    if(points.n_cols > codebook_sample) {
+        std::uniform_int_distribution<size_t> pick(0, points.n_cols - 1);
+        arma::uvec picked(codebook_sample);
+        for(auto& p : picked) {
+            p = pick(m_rng);
+        }
+        sample = points.cols(picked);
+    } else {
+        sample = points;
+    }
+    const size_t centroids = std::min<size_t>(256, sample.n_cols);
+
+    m_pq_bytes = std::min(m_pq_bytes, m_dims);
+    m_subspaces.resize(m_pq_bytes + 1);
+    for(size_t s = 0; s <= m_pq_bytes; s++) {
+        m_subspaces[s] = s * m_dims / m_pq_bytes;
+    }
+
+    m_codebook.set_size(m_dims, centroids);
+    for(size_t s = 0; s < m_pq_bytes; s++) {
+        const arma::mat rows = sample.rows(m_subspaces[s], m_subspaces[s + 1] - 1);
+        arma::mat means;
+        if(!arma::kmeans(means, rows, centroids, arma::random_subset, 15, false)) {
+            means = rows.cols(0, centroids - 1);
+        }
+        m_codebook.rows(m_subspaces[s], m_subspaces[s + 1] - 1) = means;
+    }
+}
+
+// keeps the columns of points from first on the way m_kept says, after the ones already kept
+void hnsw_index::encode(const arma::mat& points, const size_t first) {
+    if(m_kept == storage::float32 || m_rerank) {
+        const arma::fmat converted = arma::conv_to<arma::fmat>::from(points);
+        m_data32 = first == 0 ? converted : arma::fmat(arma::join_rows(m_data32, converted));
+    }
+    if(m_kept == storage::pq) {
+        m_codes.resize((first + points.n_cols) * m_pq_bytes);
+        for(size_t i = 0; i < points.n_cols; i++) {
+            const double* p = points.colptr(i);
+            uint8_t* code = &m_codes[(first + i) * m_pq_bytes];
+            for(size_t s = 0; s < m_pq_bytes; s++) {
+                double best = DBL_MAX;
+                for(size_t c = 0; c < m_codebook.n_cols; c++) {
+                    const double* centroid = m_codebook.colptr(c);
+                    double sum = 0.;
+                    for(size_t r = m_subspaces[s]; r < m_subspaces[s + 1]; r++) {
+                        const double d = p[r] - centroid[r];
+                        sum += d * d;
+                    }
+                    if(sum < best) {
+                        best = sum;
+                        code[s] = uint8_t(c);
+                    }
+                }
+            }
+        }
+    }
+    m_count = first + points.n_cols;
+}
+
+// the first points were linked as float64, from here on they are kept as m_kept says
+void hnsw_index::compress() {
+    if(m_kept == storage::pq) {
+        train_codebook(m_data);
+    }
+    encode(m_data, 0);
+    m_data.reset();
+    m_storage = m_kept;
+}
+
+void hnsw_index::add(arma::mat&& points) {
+    if(points.n_cols == 0) {
+        return;
+    }
+    const size_t first = size();
+    if(first + points.n_cols >= size_t(std::numeric_limits<uint32_t>::max())) {
+        throw std::invalid_argument("hnsw: too many points");
+    }
+    if(first > 0 && points.n_rows != m_dims) {
+        throw std::invalid_argument("hnsw: points have a different number of dimensions than the graph");
+    }
+    scratch& s = thread_scratch();
+    const size_t count = first + points.n_cols;
+    m_levels.resize(count, 0);
+    m_level0.resize(count * (2 * m_m + 1), 0);
+    m_upper.resize(count);
+
+    if(first == 0) {
+        m_dims = points.n_rows;
+        m_data = std::move(points);
+        m_count = count;
+        m_storage = storage::float64;
+        for(size_t i = 0; i < count; i++) {
+            insert(uint32_t(i), m_data.colptr(i), s);
+        }
+        if(m_kept != storage::float64) {
+            compress();
+        }
+    } else if(m_storage == storage::float64) {
+        m_data = arma::join_rows(m_data, points);
+        m_count = count;
+        for(size_t i = first; i < count; i++) {
+            insert(uint32_t(i), m_data.colptr(i), s);
+        }
+    } else {
+        // kept first, so the new points can be compared with each other while they are linked
+        encode(points, first);
+        for(size_t i = first; i < count; i++) {
+            insert(uint32_t(i), points.colptr(i - first), s);
+        }
+    }
+}
+
+void hnsw_index::points(const size_t first, const size_t count, arma::mat& out) const {
+    if(m_storage == storage::float64) {
+        out = m_data.cols(first, first + count - 1);
+        return;
+    }
+    scratch& s = thread_scratch();
+    out.set_size(m_dims, count);
+    for(size_t i = 0; i < count; i++) {
+        const double* v = vector_of(uint32_t(first + i), s.a);
+        std::copy(v, v + m_dims, out.colptr(i));
+    }
+}
+
+size_t hnsw_index::point_bytes() const {
+    return m_data.n_elem * sizeof(double) + m_data32.n_elem * sizeof(float) +
+        m_codebook.n_elem * sizeof(double) + m_codes.size();
+}
+
+void hnsw_index::search(const arma::mat& query, const size_t k, const size_t ef,
+                        arma::Mat<size_t>& neighbors, arma::mat& distances) const {
+    search_from(query, k, ef, nullptr, neighbors, distances);
+}
+
+size_t hnsw_index::search(const arma::mat& query, const size_t k, const size_t ef, const arma::Mat<size_t>& previous,
+                          arma::Mat<size_t>& neighbors, arma::mat& distances) const {
+    return search_from(query, k, ef, &previous, neighbors, distances);
+}
+
+size_t hnsw_index::search_from(const arma::mat& query, const size_t k, const size_t ef, const arma::Mat<size_t>* previous,
+                               arma::Mat<size_t>& neighbors, arma::mat& distances) const {
+    const size_t found = std::min(k, size());
+    scratch& s = thread_scratch();
+    size_t hits = 0;
+
+    neighbors.set_size(found, query.n_cols);
+    distances.set_size(found, query.n_cols);
+    if(found == 0) {
+        return 0;
+    }
+    if(query.n_rows != m_dims) {
+        throw std::invalid_argument("hnsw: query has a different number of dimensions than the graph");
+    }
+
+    for(size_t i = 0; i < query.n_cols; i++) {
+        const double* q = query.colptr(i);
+        const size_t centroids = m_codebook.n_cols;
+
+        if(m_storage == storage::pq) {
+            // distances from each subspace of q to each centroid, a code is then m_pq_bytes lookups
+            s.table.resize(m_pq_bytes * centroids);
+            for(size_t c = 0; c < centroids; c++) {
+                const double* centroid = m_codebook.colptr(c);
+                for(size_t sub = 0; sub < m_pq_bytes; sub++) {
+                    double sum = 0.;
+                    for(size_t r = m_subspaces[sub]; r < m_subspaces[sub + 1]; r++) {
+                        const double d = q[r] - centroid[r];
+                        sum += d * d;
+                    }
+                    s.table[sub * centroids + c] = sum;
+                }
+            }
+        }
+        auto to_q = [this, q, &s, centroids](const uint32_t p) {
+            if(m_storage != storage::pq) {
+                return distance(q, p);
+            }
+            const uint8_t* code = &m_codes[size_t(p) * m_pq_bytes];
+            double sum = 0.;
+            for(size_t sub = 0; sub < m_pq_bytes; sub++) {
+                sum += s.table[sub * centroids + code[sub]];
+            }
+            return sum;
+        };
+
+        s.results.clear();
+        if(previous && i < previous->n_cols) {
+            // starting with the results full of good candidates, the search stops as soon as nothing around them is closer
+            for(size_t j = 0; j < previous->n_rows; j++) {
+                const size_t p = (*previous)(j, i);
+                if(p < size()) {
+                    s.results.emplace_back(to_q(uint32_t(p)), uint32_t(p));
+                }
+            }
+        }
+        const size_t seeds = s.results.size();
+        if(seeds == 0) {
+            double d = 0.;
+            const uint32_t entry = descend(to_q, 0, d);
+            s.results.assign(1, candidate(d, entry));
+        }
+        // seeds are close already, a few candidates past k are enough to follow them
+        search_layer(to_q, seeds > 0 ? std::min(std::max(ef, found), 2 * found) : std::max(ef, found), 0, s);
+
+        if(m_rerank) {
+            for(auto& r : s.results) {
+                r.first = distance(q, r.second);
+            }
+            std::sort(s.results.begin(), s.results.end());
+        } else {
+            std::sort_heap(s.results.begin(), s.results.end());
+        }
+        for(size_t j = 0; j < found; j++) {
+            // only short when the graph came apart, marked not found the way mlpack does
+            if(j < s.results.size()) {
+                neighbors(j, i) = s.results[j].second;
+                distances(j, i) = std::sqrt(s.results[j].first);
+            } else {
+                neighbors(j, i) = SIZE_MAX;
+                distances(j, i) = DBL_MAX;
+            }
+        }
+
+        // started from its previous neighbors, without descending from the top of the graph
+        hits += seeds > 0 ? 1 : 0;
+    }
+    return hits;
+}
+
+}
@@ -0,0 +1,175 @@
+/// @file hnsw.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+/// Malkov, Yashunin. Efficient and robust approximate nearest neighbor search using Hierarchical Navigable Small World graphs. https://arxiv.org/abs/1603.09320
+/// Jegou, Douze, Schmid. Product quantization for nearest neighbor search. https://hal.inria.fr/inria-00514462
+
+#pragma once
+
+#include <mlpack/prereqs.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace mlmat {
+
+/*
+ hierarchical navigable small world graph for approximate nearest neighbors under
+ euclidean distance. points keep the order they were added in, so the indices found
+ are their column numbers. searching is const and can be done from several threads
+ at once, adding is not.
+
+ the points can be kept as float64, float32 or product quantization codes of
+ pq_bytes bytes each. the first points added are linked as they are and compressed
+ afterwards. compressed points are compared to a query through a table of its
+ distances to the codebook, made once per query. with rerank a float32 copy is kept
+ as well and the candidates found are put in order by their distance to that.
+ */
+class hnsw_index {
+public:
+    enum class storage { float64, float32, pq };
+
+    hnsw_index() {}
+
+    // m links per point on each layer (twice that on the bottom one), ef_construction candidates looked at while linking
+    hnsw_index(size_t m, size_t ef_construction, size_t seed,
+               storage kept = storage::float64, size_t pq_bytes = 8, bool rerank = false);
+
+    // links the columns of points in after the ones already in the graph. the codebook is
+    // trained on the first points added
+    void add(arma::mat&& points);
+
+    // k approximate nearest neighbors of each column of query, looking at ef candidates (at least k)
+    void search(const arma::mat& query, const size_t k, const size_t ef,
+                arma::Mat<size_t>& neighbors, arma::mat& distances) const;
+
+    // same, but each column starts from the neighbors previous holds for it instead of the top of the graph,
+    // and looks at no more than 2k candidates from there. returns how many columns did, a column whose previous
+    // neighbors are all gone from the graph starts from the top
+    size_t search(const arma::mat& query, const size_t k, const size_t ef, const arma::Mat<size_t>& previous,
+                  arma::Mat<size_t>& neighbors, arma::mat& distances) const;
+
+    // count points from first as float64, decoded if they are compressed
+    void points(const size_t first, const size_t count, arma::mat& out) const;
+
+    size_t size() const {
+        return m_count;
+    }
+
+    size_t dimensions() const {
+        return m_dims;
+    }
+
+    // memory the points take, without the links
+    size_t point_bytes() const;
+
+    // version 0 kept float64 points only
+    template<typename Archive>
+    void serialize(Archive& ar, const uint32_t version)
+    {
+        ar(CEREAL_NVP(m_m));
+        ar(CEREAL_NVP(m_ef_construction));
+        ar(CEREAL_NVP(m_seed));
+        ar(CEREAL_NVP(m_data));
+        ar(CEREAL_NVP(m_levels));
+        ar(CEREAL_NVP(m_level0));
+        ar(CEREAL_NVP(m_upper));
+        ar(CEREAL_NVP(m_entry));
+        ar(CEREAL_NVP(m_max_level));
+
+        if(version > 0) {
+            ar(CEREAL_NVP(m_storage));
+            ar(CEREAL_NVP(m_count));
+            ar(CEREAL_NVP(m_dims));
+            ar(CEREAL_NVP(m_data32));
+            ar(CEREAL_NVP(m_pq_bytes));
+            ar(CEREAL_NVP(m_rerank));
+            ar(CEREAL_NVP(m_subspaces));
+            ar(CEREAL_NVP(m_codebook));
+            ar(CEREAL_NVP(m_codes));
+        } else if(cereal::is_loading<Archive>()) {
+            m_storage = storage::float64;
+            m_count = m_data.n_cols;
+            m_dims = m_data.n_rows;
+        }
+
+        if(cereal::is_loading<Archive>()) {
+            m_kept = m_storage;
+            m_level_mult = 1. / std::log(double(m_m));
+            m_rng.seed(m_seed + size());
+        }
+    }
+
+private:
+    // squared distance and point
+    typedef std::pair<double, uint32_t> candidate;
+    struct scratch;
+    static scratch& thread_scratch();
+
+    // links of point on level, the count first
+    uint32_t* links(const uint32_t point, const int level) {
+        return level == 0 ? &m_level0[point * (2 * m_m + 1)] : &m_upper[point][(level - 1) * (m_m + 1)];
+    }
+    const uint32_t* links(const uint32_t point, const int level) const {
+        return level == 0 ? &m_level0[point * (2 * m_m + 1)] : &m_upper[point][(level - 1) * (m_m + 1)];
+    }
+
+    size_t search_from(const arma::mat& query, const size_t k, const size_t ef, const arma::Mat<size_t>* previous,
+                       arma::Mat<size_t>& neighbors, arma::mat& distances) const;
+    template<typename Distance>
+    uint32_t descend(Distance&& distance, const int to_level, double& d) const;
+    template<typename Distance>
+    void search_layer(Distance&& distance, const size_t ef, const int level, scratch& s) const;
+    void select_neighbors(std::vector<candidate>& sorted, const size_t m, std::vector<uint32_t>& chosen, scratch& s) const;
+    void connect(const uint32_t from, const uint32_t to, const int level, scratch& s);
+    void insert(const uint32_t point, const double* q, scratch& s);
+    int random_level();
+
+    // squared distance from a to point however it is kept, decoding codes as it goes
+    double distance(const double* a, const uint32_t point) const;
+    // point as float64, in buffer unless the points are float64
+    const double* vector_of(const uint32_t point, std::vector<double>& buffer) const;
+    void compress();
+    void train_codebook(const arma::mat& points);
+    void encode(const arma::mat& points, const size_t first);
+
+    size_t m_m = 16;
+    size_t m_ef_construction = 200;
+    size_t m_seed = 0;
+    double m_level_mult = 1. / std::log(16.);
+    // float64 points, and all points while the first ones are linked
+    arma::mat m_data;
+    std::vector<int> m_levels;
+    // 2m + 1 per point
+    std::vector<uint32_t> m_level0;
+    // m + 1 per point and level above the bottom one
+    std::vector<std::vector<uint32_t>> m_upper;
+    uint32_t m_entry = 0;
+    // -1 while the graph is empty
+    int m_max_level = -1;
+    std::mt19937_64 m_rng;
+
+    // how the points are kept now, and how they are kept once the first ones are linked
+    storage m_storage = storage::float64;
+    storage m_kept = storage::float64;
+    size_t m_count = 0;
+    size_t m_dims = 0;
+    // float32 points, or the rerank copy of pq points
+    arma::fmat m_data32;
+    size_t m_pq_bytes = 8;
+    bool m_rerank = false;
+    // first row of each subspace, then one past the last row
+    std::vector<size_t> m_subspaces;
+    // a column per centroid, holding that centroid of every subspace in the subspace's rows
+    arma::mat m_codebook;
+    // m_pq_bytes per point
+    std::vector<uint8_t> m_codes;
+};
+
+}
+
+CEREAL_CLASS_VERSION(mlmat::hnsw_index, 1);
@@ -0,0 +1,574 @@
+/// @file kmeans.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved. Also based on examples provided with the mlpack library. Please see source/mlpack for license details
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#include "kmeans.hpp"
+
+#include <mlpack/methods/kmeans.hpp>
+#include <mlpack/methods/kmeans/allow_empty_clusters.hpp>
+#include <mlpack/methods/kmeans/kill_empty_clusters.hpp>
+#include <mlpack/methods/kmeans/refined_start.hpp>
+#include <mlpack/methods/kmeans/elkan_kmeans.hpp>
+#include <mlpack/methods/kmeans/hamerly_kmeans.hpp>
+#include <mlpack/methods/kmeans/pelleg_moore_kmeans.hpp>
+#include <mlpack/methods/kmeans/dual_tree_kmeans.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace mlmat {
+
+using namespace mlpack;
+
+namespace {
+
+// runs policy and adds the seconds it took to seconds. mlpack only looks for the non-const
+// form of Cluster and some policies only have a const one, so this has both
+template<typename Policy>
+class timed_partition {
+public:
+    timed_partition(const Policy& policy, double* seconds)
+    : m_policy(policy)
+    , m_seconds(seconds) {}
+
+    void Cluster(const arma::mat& data, const size_t clusters, arma::mat& centroids) const {
+        const auto start = std::chrono::steady_clock::now();
+        m_policy.Cluster(data, clusters, centroids);
+        *m_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void Cluster(const arma::mat& data, const size_t clusters, arma::mat& centroids) {
+        static_cast<const timed_partition&>(*this).Cluster(data, clusters, centroids);
+    }
+
+private:
+    mutable Policy m_policy;
+    double* m_seconds;
+};
+
+// kmeans_plusplus as an mlpack initial partition policy
+class plusplus_initialization {
+public:
+    plusplus_initialization(const size_t rounds, const double oversampling, worker_pool* workers)
+    : m_rounds(rounds)
+    , m_oversampling(oversampling)
+    , m_workers(workers) {}
+
+    void Cluster(const arma::mat& data, const size_t clusters, arma::mat& centroids) const {
+        kmeans_plusplus(data, clusters, m_rounds, m_oversampling, m_workers, centroids);
+    }
+
+private:
+    size_t m_rounds;
+    double m_oversampling;
+    worker_pool* m_workers;
+};
+
+// the products of a block of points with the candidates are kept to about this many cells
+const size_t pass_cells = 1 << 20;
+
+/*
+ lowers nearest[i] to the squared distance from column i of data to the columns of candidates
+ from first on where one of those is closer, and sets owner[i] to it. norms are the squared
+ norms of the columns of data. the columns are split into blocks run on workers
+ */
+void nearest_pass(const arma::mat& data, const arma::rowvec& norms, const arma::mat& candidates, const size_t first,
+                  arma::vec& nearest, arma::Col<size_t>& owner, worker_pool* workers) {
+    const arma::mat fresh = candidates.cols(first, candidates.n_cols - 1);
+    const arma::rowvec fresh_norms = arma::sum(arma::square(fresh), 0);
+    const size_t block = std::min<size_t>(4096, std::max<size_t>(64, pass_cells / fresh.n_cols));
+    const size_t blocks = (data.n_cols + block - 1) / block;
+
+    auto part = [&](const size_t b) {
+        const size_t begin = b * block;
+        const size_t end = std::min<size_t>(data.n_cols, begin + block);
+        const arma::mat points(const_cast<double*>(data.colptr(begin)), data.n_rows, end - begin, false, true);
+        // |x - c|^2 = |c|^2 - 2 c.x + |x|^2, clamped as rounding can take it below 0
+        const arma::mat cross = fresh.t() * points;
+        for(size_t i = 0; i < points.n_cols; i++) {
+            const double* dots = cross.colptr(i);
+            const double norm = norms[begin + i];
+            double best = nearest[begin + i];
+            size_t best_owner = owner[begin + i];
+            for(size_t c = 0; c < fresh.n_cols; c++) {
+                const double distance = std::max(0., fresh_norms[c] - 2. * dots[c] + norm);
+                if(distance < best) {
+                    best = distance;
+                    best_owner = first + c;
+                }
+            }
+            nearest[begin + i] = best;
+            owner[begin + i] = best_owner;
+        }
+    };
+    if(workers && workers->size() > 1 && blocks > 1) {
+        workers->run(blocks, part);
+    } else {
+        for(size_t b = 0; b < blocks; b++) {
+            part(b);
+        }
+    }
+}
+
+// a column picked with a probability proportional to its weight times nearest, or evenly if those are all 0
+size_t d2_pick(const arma::vec& nearest, const arma::vec* weights) {
+    const double total = weights ? arma::dot(*weights, nearest) : arma::accu(nearest);
+    if(!(total > 0.) || !std::isfinite(total)) {
+        return (size_t) mlpack::RandInt((int) nearest.n_elem);
+    }
+    const double target = mlpack::Random() * total;
+    double sum = 0.;
+    for(size_t i = 0; i < nearest.n_elem; i++) {
+        sum += weights ? (*weights)[i] * nearest[i] : nearest[i];
+        if(sum > target) {
+            return i;
+        }
+    }
+    // rounding can leave target just above the last sum
+    for(size_t i = nearest.n_elem; i-- > 0;) {
+        if(nearest[i] > 0. && (!weights || (*weights)[i] > 0.)) {
+            return i;
+        }
+    }
+    return nearest.n_elem - 1;
+}
+
+// adds d2 picks from data to candidates until there are clusters of them
+void plusplus_fill(const arma::mat& data, const arma::rowvec& norms, const arma::vec* weights, const size_t clusters,
+                   arma::vec& nearest, arma::Col<size_t>& owner, worker_pool* workers, arma::mat& candidates) {
+    while(candidates.n_cols < clusters) {
+        const size_t first = candidates.n_cols;
+        candidates.insert_cols(first, data.col(d2_pick(nearest, weights)));
+        nearest_pass(data, norms, candidates, first, nearest, owner, workers);
+    }
+}
+
+// euclidean distance that also carries the pool parallel_lloyd splits its points across
+struct pooled_distance : public EuclideanDistance {
+    worker_pool* workers = nullptr;
+};
+
+/*
+ the naive lloyd step as an mlpack LloydStepType, with the points split into one contiguous
+ shard per thread of distance.workers. each shard finds the nearest centroids of blocks of its
+ points with one matrix product per block (|x - c|^2 = |c|^2 - 2 c.x + |x|^2, |x|^2 being the
+ same for every centroid) and sums them into centroid sums and counts of its own, which are
+ added up in shard order once all are done, so a run gives the same centroids for a thread count
+ */
+template<typename DistanceType, typename MatType>
+class parallel_lloyd {
+public:
+    parallel_lloyd(const MatType& dataset, DistanceType& distance)
+    : m_dataset(dataset)
+    , m_distance(distance) {}
+
+    double Iterate(const arma::mat& centroids, arma::mat& new_centroids, arma::Col<size_t>& counts) {
+        worker_pool* workers = m_distance.workers;
+        const size_t threads = workers ? workers->size() : 1;
+        const size_t shards = std::max<size_t>(1, std::min<size_t>(threads, m_dataset.n_cols / 64));
+        const size_t block = std::min<size_t>(4096, std::max<size_t>(64, pass_cells / centroids.n_cols));
+        const arma::rowvec centroid_norms = arma::sum(arma::square(centroids), 0);
+
+        m_sums.resize(shards);
+        m_counts.resize(shards);
+        m_cross.resize(shards);
+
+        auto shard = [&](const size_t s) {
+            const size_t begin = m_dataset.n_cols * s / shards;
+            const size_t end = m_dataset.n_cols * (s + 1) / shards;
+            arma::mat& sums = m_sums[s];
+            arma::Col<size_t>& shard_counts = m_counts[s];
+            arma::mat& cross = m_cross[s];
+
+            sums.zeros(m_dataset.n_rows, centroids.n_cols);
+            shard_counts.zeros(centroids.n_cols);
+            for(size_t first = begin; first < end; first += block) {
+                const arma::mat points(const_cast<double*>(m_dataset.colptr(first)), m_dataset.n_rows, std::min(block, end - first), false, true);
+                cross = centroids.t() * points;
+                for(size_t i = 0; i < points.n_cols; i++) {
+                    const double* dots = cross.colptr(i);
+                    size_t best = 0;
+                    double best_distance = centroid_norms[0] - 2. * dots[0];
+                    for(size_t c = 1; c < centroids.n_cols; c++) {
+                        const double distance = centroid_norms[c] - 2. * dots[c];
+                        if(distance < best_distance) {
+                            best_distance = distance;
+                            best = c;
+                        }
+                    }
+                    shard_counts[best]++;
+                    double* sum = sums.colptr(best);
+                    const double* point = points.colptr(i);
+                    for(size_t row = 0; row < points.n_rows; row++) {
+                        sum[row] += point[row];
+                    }
+                }
+            }
+        };
+        if(shards > 1) {
+            workers->run(shards, shard);
+        } else {
+            shard(0);
+        }
+
+        new_centroids = m_sums[0];
+        counts = m_counts[0];
+        for(size_t s = 1; s < shards; s++) {
+            new_centroids += m_sums[s];
+            counts += m_counts[s];
+        }
+        // same as mlpack's NaiveKMeans, empty clusters are left to the empty cluster policy
+        for(size_t c = 0; c < centroids.n_cols; c++) {
+            if(counts[c] == 0) {
+                new_centroids.col(c).fill(DBL_MAX);
+            } else {
+                new_centroids.col(c) /= (double) counts[c];
+            }
+        }
+        m_distance_calculations += centroids.n_cols * m_dataset.n_cols + centroids.n_cols;
+
+        double norm = 0.;
+        for(size_t c = 0; c < centroids.n_cols; c++) {
+            norm += std::pow(m_distance.Evaluate(centroids.col(c), new_centroids.col(c)), 2.);
+        }
+        return std::sqrt(norm);
+    }
+
+    size_t DistanceCalculations() const {
+        return m_distance_calculations;
+    }
+
+private:
+    const MatType& m_dataset;
+    DistanceType& m_distance;
+    size_t m_distance_calculations = 0;
+    // a set per shard, kept between iterations
+    std::vector<arma::mat> m_sums;
+    std::vector<arma::Col<size_t>> m_counts;
+    std::vector<arma::mat> m_cross;
+};
+
+template<typename InitialPartitionPolicy,
+         typename EmptyClusterPolicy,
+         template<class, class> class LloydStepType>
+void run_kmeans(const kmeans_params& params,
+                const InitialPartitionPolicy& ipp,
+                const arma::mat& dataset,
+                const size_t clusters,
+                arma::Row<size_t>& assignments,
+                arma::mat& centroids,
+                const bool initial_assignment_guess,
+                const bool initial_centroid_guess) {
+    if (params.seed != 0) {
+       mlpack::RandomSeed((size_t) params.seed);
+    } else {
+        mlpack::RandomSeed((size_t) std::time(NULL));
+    }
+
+    KMeans<EuclideanDistance,
+        InitialPartitionPolicy,
+        EmptyClusterPolicy,
+        LloydStepType> kmeans(params.max_iterations, EuclideanDistance(), ipp);
+
+    kmeans.Cluster(dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+}
+
+// run_kmeans with parallel_lloyd. the assignments are worked out here too, on the workers, as
+// mlpack's go through the points one distance at a time
+template<typename InitialPartitionPolicy, typename EmptyClusterPolicy>
+void run_parallel_kmeans(const kmeans_params& params,
+                         const InitialPartitionPolicy& ipp,
+                         const arma::mat& dataset,
+                         const size_t clusters,
+                         arma::Row<size_t>& assignments,
+                         arma::mat& centroids,
+                         const bool initial_assignment_guess,
+                         const bool initial_centroid_guess) {
+    if (params.seed != 0) {
+       mlpack::RandomSeed((size_t) params.seed);
+    } else {
+        mlpack::RandomSeed((size_t) std::time(NULL));
+    }
+
+    pooled_distance distance;
+    distance.workers = params.workers;
+    KMeans<pooled_distance,
+        InitialPartitionPolicy,
+        EmptyClusterPolicy,
+        parallel_lloyd> kmeans(params.max_iterations, distance, ipp);
+
+    // mlpack checks its guesses in Cluster(), these are read before it gets them
+    if(initial_assignment_guess) {
+        if(assignments.n_elem != dataset.n_cols) {
+            throw std::invalid_argument("initial assignments have " + std::to_string(assignments.n_elem) +
+                                        " points, the dataset has " + std::to_string(dataset.n_cols));
+        }
+        if(arma::any(assignments >= clusters)) {
+            throw std::invalid_argument("initial assignments name clusters beyond " + std::to_string(clusters));
+        }
+    } else if(initial_centroid_guess && (centroids.n_rows != dataset.n_rows || centroids.n_cols != clusters)) {
+        throw std::invalid_argument("initial centroids are " + std::to_string(centroids.n_rows) + "x" +
+                                    std::to_string(centroids.n_cols) + ", expected " +
+                                    std::to_string(dataset.n_rows) + "x" + std::to_string(clusters));
+    }
+
+    if(initial_assignment_guess) {
+        // the means of the points assigned to each cluster
+        arma::vec counts(clusters, arma::fill::zeros);
+        centroids.zeros(dataset.n_rows, clusters);
+        for(size_t i = 0; i < dataset.n_cols; i++) {
+            centroids.col(assignments[i]) += dataset.col(i);
+            counts[assignments[i]] += 1.;
+        }
+        for(size_t c = 0; c < clusters; c++) {
+            if(counts[c] > 0.) {
+                centroids.col(c) /= counts[c];
+            }
+        }
+    }
+    kmeans.Cluster(dataset, clusters, centroids, initial_assignment_guess || initial_centroid_guess);
+
+    const arma::rowvec norms = arma::sum(arma::square(dataset), 0);
+    arma::vec nearest(dataset.n_cols);
+    nearest.fill(std::numeric_limits<double>::infinity());
+    arma::Col<size_t> owner(dataset.n_cols, arma::fill::zeros);
+    nearest_pass(dataset, norms, centroids, 0, nearest, owner, params.workers);
+    assignments = owner.t();
+}
+
+// Given the initial partitionining policy and empty cluster policy, figure out
+// the Lloyd iteration step type and run k-means.
+template<typename InitialPartitionPolicy, typename EmptyClusterPolicy>
+void find_lloyd_step_type(const kmeans_params& params,
+                          const InitialPartitionPolicy& ipp,
+                          const arma::mat& dataset,
+                          const size_t clusters,
+                          arma::Row<size_t>& assignments,
+                          arma::mat& centroids,
+                          const bool initial_assignment_guess,
+                          const bool initial_centroid_guess) {
+    if (params.algorithm == "elkan") {
+        run_kmeans<InitialPartitionPolicy, EmptyClusterPolicy, ElkanKMeans>(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    }
+    else if (params.algorithm == "hamerly") {
+        run_kmeans<InitialPartitionPolicy, EmptyClusterPolicy, HamerlyKMeans>(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    }
+    else if (params.algorithm == "pelleg-moore") {
+        run_kmeans<InitialPartitionPolicy, EmptyClusterPolicy, PellegMooreKMeans>(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    }
+    else if (params.algorithm == "dualtree") {
+        run_kmeans<InitialPartitionPolicy, EmptyClusterPolicy, DefaultDualTreeKMeans>(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    }
+    else if (params.algorithm == "dualtree-covertree") {
+        run_kmeans<InitialPartitionPolicy, EmptyClusterPolicy, CoverTreeDualTreeKMeans>(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    }
+    else if (params.algorithm == "naive") {
+        run_parallel_kmeans<InitialPartitionPolicy, EmptyClusterPolicy>(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    }
+}
+
+// Given the type of initial partition policy, figure out the empty cluster
+// policy and run k-means.
+template<typename InitialPartitionPolicy>
+void find_empty_cluster_policy(const kmeans_params& params,
+                               const InitialPartitionPolicy& ipp,
+                               const arma::mat& dataset,
+                               const size_t clusters,
+                               arma::Row<size_t>& assignments,
+                               arma::mat& centroids,
+                               const bool initial_assignment_guess,
+                               const bool initial_centroid_guess) {
+    if (params.allow_empty_clusters) {
+        find_lloyd_step_type<InitialPartitionPolicy, AllowEmptyClusters>(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    }
+    else {
+        find_lloyd_step_type<InitialPartitionPolicy, KillEmptyClusters>(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    }
+}
+
+}
+
+void kmeans_cluster(const kmeans_params& params,
+                    const arma::mat& dataset,
+                    const size_t clusters,
+                    arma::Row<size_t>& assignments,
+                    arma::mat& centroids,
+                    const bool initial_assignment_guess,
+                    const bool initial_centroid_guess,
+                    kmeans_timings* timings) {
+    double seeding = 0.;
+    const auto start = std::chrono::steady_clock::now();
+
+    if(params.refined_start || params.init == "refined") {
+        timed_partition<RefinedStart> ipp(RefinedStart(params.samplings, params.percentage), &seeding);
+        find_empty_cluster_policy(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    } else if(params.init == "kmeans++") {
+        timed_partition<plusplus_initialization> ipp(plusplus_initialization(0, 0., params.workers), &seeding);
+        find_empty_cluster_policy(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    } else if(params.init == "kmeans||") {
+        timed_partition<plusplus_initialization> ipp(plusplus_initialization((size_t) std::max(1, params.init_rounds), params.oversampling, params.workers), &seeding);
+        find_empty_cluster_policy(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    } else {
+        timed_partition<SampleInitialization> ipp(SampleInitialization(), &seeding);
+        find_empty_cluster_policy(params, ipp, dataset, clusters, assignments, centroids, initial_assignment_guess, initial_centroid_guess);
+    }
+
+    if(timings) {
+        const double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        timings->seeding = seeding;
+        timings->iterations = std::max(0., total - seeding);
+    }
+}
+
+void kmeans_plusplus(const arma::mat& dataset, const size_t clusters, const size_t rounds, const double oversampling,
+                     worker_pool* workers, arma::mat& centroids) {
+    if(clusters == 0 || clusters > dataset.n_cols) {
+        throw std::invalid_argument("kmeans++ needs at least as many points as clusters");
+    }
+    const arma::rowvec norms = arma::sum(arma::square(dataset), 0);
+    arma::vec nearest(dataset.n_cols);
+    nearest.fill(std::numeric_limits<double>::infinity());
+    arma::Col<size_t> owner(dataset.n_cols, arma::fill::zeros);
+
+    arma::mat candidates = dataset.col((size_t) mlpack::RandInt((int) dataset.n_cols));
+    nearest_pass(dataset, norms, candidates, 0, nearest, owner, workers);
+
+    if(rounds == 0) {
+        plusplus_fill(dataset, norms, nullptr, clusters, nearest, owner, workers, candidates);
+        centroids = std::move(candidates);
+        return;
+    }
+
+    // each round keeps every point on its own with probability oversampling * clusters * nearest / the sum of nearest
+    const double picks = std::max(1., oversampling * (double) clusters);
+    std::vector<arma::uword> picked;
+    for(size_t round = 0; round < rounds; round++) {
+        const double total = arma::accu(nearest);
+        if(!(total > 0.)) {
+            break;
+        }
+        picked.clear();
+        for(size_t i = 0; i < dataset.n_cols; i++) {
+            if(mlpack::Random() * total < picks * nearest[i]) {
+                picked.push_back(i);
+            }
+        }
+        if(picked.empty()) {
+            continue;
+        }
+        const size_t first = candidates.n_cols;
+        candidates = arma::join_rows(candidates, dataset.cols(arma::uvec(picked)));
+        nearest_pass(dataset, norms, candidates, first, nearest, owner, workers);
+    }
+
+    if(candidates.n_cols <= clusters) {
+        plusplus_fill(dataset, norms, nullptr, clusters, nearest, owner, workers, candidates);
+        centroids = std::move(candidates);
+        return;
+    }
+
+    // weighs each candidate by the points nearest to it and reduces them to clusters with weighted kmeans++
+    arma::vec weights(candidates.n_cols, arma::fill::zeros);
+    for(size_t i = 0; i < dataset.n_cols; i++) {
+        weights[owner[i]] += 1.;
+    }
+    const arma::rowvec candidate_norms = arma::sum(arma::square(candidates), 0);
+    arma::vec candidate_nearest(candidates.n_cols);
+    candidate_nearest.fill(1.);
+    arma::Col<size_t> candidate_owner(candidates.n_cols, arma::fill::zeros);
+    arma::mat chosen = candidates.col(d2_pick(candidate_nearest, &weights));
+    candidate_nearest.fill(std::numeric_limits<double>::infinity());
+    nearest_pass(candidates, candidate_norms, chosen, 0, candidate_nearest, candidate_owner, workers);
+    plusplus_fill(candidates, candidate_norms, &weights, clusters, candidate_nearest, candidate_owner, workers, chosen);
+    centroids = std::move(chosen);
+}
+
+void kmeans_minibatch::reset(const int seed) {
+    m_centroids.reset();
+    m_counts.reset();
+    m_clusters = 0;
+    m_seed = seed;
+}
+
+void kmeans_minibatch::start_from(const arma::mat& centroids) {
+    m_centroids = centroids;
+    m_counts.ones(centroids.n_cols);
+    m_clusters = centroids.n_cols;
+}
+
+void kmeans_assign(const arma::mat& centroids, const arma::mat& points, arma::Row<size_t>& assignments,
+                   arma::mat& cross, arma::rowvec& norms) {
+    // |x - c|^2 = |c|^2 - 2 c.x + |x|^2, and |x|^2 is the same for every centroid
+    norms = arma::sum(arma::square(centroids), 0);
+    cross = centroids.t() * points;
+    assignments.set_size(points.n_cols);
+    for(size_t i = 0; i < points.n_cols; i++) {
+        const double* dots = cross.colptr(i);
+        size_t best = 0;
+        double best_distance = norms[0] - 2. * dots[0];
+        for(size_t c = 1; c < centroids.n_cols; c++) {
+            const double distance = norms[c] - 2. * dots[c];
+            if(distance < best_distance) {
+                best_distance = distance;
+                best = c;
+            }
+        }
+        assignments[i] = best;
+    }
+}
+
+void kmeans_minibatch::update(const arma::mat& batch, const size_t clusters, const double decay, arma::Row<size_t>& assignments) {
+    size_t first = 0;
+
+    if(clusters != m_clusters || (m_centroids.n_cols > 0 && m_centroids.n_rows != batch.n_rows)) {
+        reset(m_seed);
+        m_clusters = clusters;
+    }
+    assignments.set_size(batch.n_cols);
+    if(batch.n_cols == 0) {
+        return;
+    }
+    if(m_centroids.n_cols == 0 && batch.n_cols >= clusters) {
+        if(m_seed != 0) {
+            mlpack::RandomSeed((size_t) m_seed);
+        }
+        m_centroids = batch.cols(arma::randperm(batch.n_cols, clusters));
+        m_counts.ones(clusters);
+    } else if(m_centroids.n_cols == 0) {
+        m_centroids.set_size(batch.n_rows, 0);
+    }
+    // until there are enough centroids every point that comes in is one
+    for(; first < batch.n_cols && m_centroids.n_cols < clusters; first++) {
+        m_centroids.insert_cols(m_centroids.n_cols, batch.col(first));
+        m_counts.resize(m_centroids.n_cols);
+        m_counts[m_centroids.n_cols - 1] = 1.;
+        assignments[first] = m_centroids.n_cols - 1;
+    }
+    if(first == batch.n_cols) {
+        return;
+    }
+
+    m_counts *= decay;
+    arma::Row<size_t> rest(assignments.memptr() + first, batch.n_cols - first, false, true);
+    const arma::mat points(const_cast<double*>(batch.colptr(first)), batch.n_rows, batch.n_cols - first, false, true);
+    kmeans_assign(m_centroids, points, rest, m_cross, m_centroid_norms);
+    for(size_t i = 0; i < points.n_cols; i++) {
+        const size_t c = rest[i];
+        m_counts[c] += 1.;
+        const double rate = 1. / m_counts[c];
+        double* centroid = m_centroids.colptr(c);
+        const double* point = points.colptr(i);
+        for(size_t row = 0; row < points.n_rows; row++) {
+            centroid[row] += rate * (point[row] - centroid[row]);
+        }
+    }
+}
+
+}
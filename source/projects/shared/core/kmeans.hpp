@@ -0,0 +1,124 @@
+/// @file kmeans.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved. Also based on examples provided with the mlpack library. Please see source/mlpack for license details
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include <mlpack/prereqs.hpp>
+
+#include "worker_pool.hpp"
+
+#include <string>
+
+namespace mlmat {
+
+// settings for a k-means run, named the same as the object attributes
+struct kmeans_params {
+    std::string algorithm = "naive";
+    int max_iterations = 1000;
+    bool allow_empty_clusters = false;
+    bool refined_start = false;
+    int samplings = 100;
+    double percentage = .02;
+    int seed = 0;
+    // sample, refined, kmeans++ or kmeans||. refined_start picks refined whatever this is
+    std::string init = "sample";
+    // kmeans|| rounds, and the points it picks per round as a multiple of the clusters
+    int init_rounds = 5;
+    double oversampling = 2.;
+    // splits the naive lloyd step and the distance passes of kmeans++ and kmeans|| across its threads when set
+    worker_pool* workers = nullptr;
+};
+
+// seconds a k-means run took to pick its starting centroids and to iterate from them
+struct kmeans_timings {
+    double seeding = 0.;
+    double iterations = 0.;
+};
+
+/*
+ clusters the columns of dataset. assignments and centroids are used as the
+ starting point when the matching guess flag is set.
+ throws std::out_of_range if there are not enough samples for a refined start
+ */
+void kmeans_cluster(const kmeans_params& params,
+                    const arma::mat& dataset,
+                    const size_t clusters,
+                    arma::Row<size_t>& assignments,
+                    arma::mat& centroids,
+                    const bool initial_assignment_guess,
+                    const bool initial_centroid_guess,
+                    kmeans_timings* timings = nullptr);
+
+/*
+ k-means++ (Arthur, Vassilvitskii) starting centroids, each picked with a probability
+ proportional to its squared distance to the ones picked before. with rounds above 0
+ this is k-means|| (Bahmani et al., Scalable k-means++) instead, which picks about
+ oversampling * clusters points per round in rounds passes over dataset, weighs each by
+ the points closest to it and picks the centroids from those with k-means++. the passes
+ that update the distances are split across the threads of workers when it is set
+ */
+void kmeans_plusplus(const arma::mat& dataset, const size_t clusters, const size_t rounds, const double oversampling,
+                     worker_pool* workers, arma::mat& centroids);
+
+// what mlmat.kmeans fits and then assigns points to, saved with write
+struct kmeans_model {
+    // a column each
+    arma::mat centroids;
+
+    template<typename Archive>
+    void serialize(Archive& ar, const uint32_t /* version */)
+    {
+        ar(CEREAL_NVP(centroids));
+    }
+};
+
+// the nearest of the columns of centroids, which can not be empty, for each column of points, from one matrix product.
+// cross and norms are scratch, kept by the caller so points of the same size do not allocate
+void kmeans_assign(const arma::mat& centroids, const arma::mat& points, arma::Row<size_t>& assignments,
+                   arma::mat& cross, arma::rowvec& norms);
+
+/*
+ mini-batch k-means (Sculley, Web-scale k-means clustering) over a stream of batches.
+ each batch is assigned to the centroids as they were when it came in, then every
+ centroid moves towards each of its points in turn with a learning rate of 1 over the
+ number of points it has been given. the work per batch only depends on its size and
+ nothing but the centroids and their counts is kept. decay below 1 scales the counts
+ down before every batch, so the rates stop shrinking and the centroids follow a
+ stream that changes.
+ */
+class kmeans_minibatch {
+public:
+    // forgets the centroids. the next batches pick new ones, seeded with seed unless it is 0
+    void reset(const int seed = 0);
+
+    // starts from centroids (a column each) as if each had been given one point
+    void start_from(const arma::mat& centroids);
+
+    // assigns the columns of batch to the nearest of clusters centroids and moves those. the
+    // centroids are picked at random from the first batch with enough columns, or are the first
+    // points seen until there are clusters of them. a change of clusters or dimensions starts over
+    void update(const arma::mat& batch, const size_t clusters, const double decay, arma::Row<size_t>& assignments);
+
+    // fewer than clusters columns until that many points have been seen
+    const arma::mat& centroids() const {
+        return m_centroids;
+    }
+
+    // points each centroid has been given, scaled by decay
+    const arma::vec& counts() const {
+        return m_counts;
+    }
+
+private:
+    arma::mat m_centroids;
+    arma::vec m_counts;
+    size_t m_clusters = 0;
+    int m_seed = 0;
+    // kept between batches so a batch of the same size does not allocate
+    arma::mat m_cross;
+    arma::rowvec m_centroid_norms;
+};
+
+}
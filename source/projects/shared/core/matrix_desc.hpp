@@ -0,0 +1,80 @@
+/// @file matrix_desc.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace mlmat {
+
+constexpr long max_dimcount = 32;
+
+enum class cell_type { char8, long32, float32, float64, unknown };
+
+/*
+ plain description of a block of cells laid out the way jitter lays out a matrix.
+ dimstride is in bytes, planes of a cell follow each other. the core never
+ allocates through this, it only reads and writes what data points at.
+ */
+struct matrix_desc {
+    cell_type type = cell_type::float64;
+    long planecount = 1;
+    long dimcount = 1;
+    long dim[max_dimcount] = {};
+    long dimstride[max_dimcount] = {};
+    unsigned char* data = nullptr;
+};
+
+inline size_t cell_size(const cell_type type) {
+    switch(type) {
+        case cell_type::char8: return sizeof(unsigned char);
+        case cell_type::long32: return sizeof(int32_t);
+        case cell_type::float32: return sizeof(float);
+        case cell_type::float64: return sizeof(double);
+        default: return 0;
+    }
+}
+
+// sets packed strides for the current type, planecount and dims
+inline void set_packed_strides(matrix_desc& desc) {
+    long stride = desc.planecount * cell_size(desc.type);
+    for(long i=0;i<desc.dimcount;i++) {
+        desc.dimstride[i] = stride;
+        stride *= desc.dim[i];
+    }
+}
+
+// calls f with a null pointer to the c type the cells are stored as.
+// returns false if the type is not one of char, long, float32 or float64
+template <typename F>
+inline bool type_dispatch(const cell_type type, F&& f) {
+    switch(type) {
+        case cell_type::char8: f(static_cast<unsigned char*>(nullptr)); return true;
+        case cell_type::long32: f(static_cast<int32_t*>(nullptr)); return true;
+        case cell_type::float32: f(static_cast<float*>(nullptr)); return true;
+        case cell_type::float64: f(static_cast<double*>(nullptr)); return true;
+        default: return false;
+    }
+}
+
+// does test that matrix is suitable for mode
+inline void check_mode(const long planecount,
+                       const int mode,
+                       const std::string& callerDescription) {
+    if(mode > 0) {
+        if(planecount > 1) {
+            std::ostringstream oss;
+            oss << callerDescription << ": number of planes (" << planecount << ") in matrix "
+            << "is not valid in mode "  << mode << ". Expecting 1 plane!";
+            throw std::invalid_argument(oss.str());
+        }
+    }
+}
+
+}
@@ -0,0 +1,580 @@
+/// @file neighbor_search.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved. Also based on examples provided with the mlpack library. Please see source/mlpack for license details
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#include "neighbor_search.hpp"
+
+#include <mlpack/core/util/timers.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mlmat {
+
+template<typename ModelType>
+void build_neighbor_model(ModelType& model, const neighbor_search_params& params, arma::mat&& reference) {
+    mlpack::util::Timers u = mlpack::util::Timers();
+    mlpack::NeighborSearchMode search_mode = mlpack::DUAL_TREE_MODE;
+    typename ModelType::TreeTypes tree = ModelType::KD_TREE;
+
+    if (params.algorithm == "naive")
+      search_mode = mlpack::NAIVE_MODE;
+    else if (params.algorithm == "single_tree")
+      search_mode = mlpack::SINGLE_TREE_MODE;
+    else if (params.algorithm == "dual_tree")
+      search_mode = mlpack::DUAL_TREE_MODE;
+    else if (params.algorithm == "greedy")
+      search_mode = mlpack::GREEDY_SINGLE_TREE_MODE;
+
+    //maybe use hash table instead
+    if (params.tree_type == "kd")
+      tree = ModelType::KD_TREE;
+    else if (params.tree_type == "cover")
+      tree = ModelType::COVER_TREE;
+    else if (params.tree_type == "r")
+      tree = ModelType::R_TREE;
+    else if (params.tree_type == "r-star")
+      tree = ModelType::R_STAR_TREE;
+    else if (params.tree_type == "ball")
+      tree = ModelType::BALL_TREE;
+    else if (params.tree_type == "x")
+      tree = ModelType::X_TREE;
+    else if (params.tree_type == "hilbert-r")
+      tree = ModelType::HILBERT_R_TREE;
+    else if (params.tree_type == "r-plus")
+      tree = ModelType::R_PLUS_TREE;
+    else if (params.tree_type == "r-plus-plus")
+      tree = ModelType::R_PLUS_PLUS_TREE;
+    else if (params.tree_type == "spill")
+      tree = ModelType::SPILL_TREE;
+    else if (params.tree_type == "vp")
+      tree = ModelType::VP_TREE;
+    else if (params.tree_type == "rp")
+      tree = ModelType::RP_TREE;
+    else if (params.tree_type == "max-rp")
+      tree = ModelType::MAX_RP_TREE;
+    else if (params.tree_type == "ub")
+      tree = ModelType::UB_TREE;
+    else if (params.tree_type == "oct")
+      tree = ModelType::OCTREE;
+
+    model.TreeType() = tree;
+    model.RandomBasis() = params.random_basis;
+    model.LeafSize() = params.leaf_size;
+    model.Tau() = params.tau;
+    model.Rho() = params.rho;
+
+    model.BuildModel(u, std::move(reference), search_mode, params.epsilon);
+}
+
+template<typename ModelType>
+void search_neighbors(ModelType& model, arma::mat&& query, const size_t k,
+                      arma::Mat<size_t>& neighbors, arma::mat& distances) {
+    mlpack::util::Timers u = mlpack::util::Timers();
+    model.Search(u, std::move(query), k, neighbors, distances);
+}
+
+// a thread gets at least this many query columns, fewer are not worth handing over
+static const size_t min_block_columns = 64;
+// reference columns neighbor_recall and a brute force range search of the graph hold at once
+static const size_t recall_chunk_columns = 65536;
+
+// how many blocks n_queries columns are split into, 1 without workers
+static size_t block_count(worker_pool* workers, const size_t n_queries) {
+    return workers ? std::min(workers->size() * 4, (n_queries + min_block_columns - 1) / min_block_columns) : 1;
+}
+
+// searches blocks of query columns on the threads of workers and puts what search finds for each back in
+// query order. search gets a block and the column it starts at, fills neighbors and distances for it with
+// the same rows for every block and returns how many of its columns started coherent, which are added up
+template<typename Search>
+static size_t search_blocks(worker_pool* workers, arma::mat&& query, Search&& search,
+                            arma::Mat<size_t>& neighbors, arma::mat& distances) {
+    const size_t n_queries = query.n_cols;
+    const size_t blocks = block_count(workers, n_queries);
+
+    if(blocks < 2) {
+        return search(std::move(query), 0, neighbors, distances);
+    }
+    const size_t per_block = (n_queries + blocks - 1) / blocks;
+    std::vector<arma::Mat<size_t>> block_neighbors(blocks);
+    std::vector<arma::mat> block_distances(blocks);
+    std::vector<size_t> block_hits(blocks, 0);
+
+    workers->run(blocks, [&](size_t b) {
+        const size_t first = b * per_block;
+        if(first >= n_queries) {
+            return;
+        }
+        const size_t last = std::min(n_queries, first + per_block) - 1;
+        block_hits[b] = search(arma::mat(query.cols(first, last)), first, block_neighbors[b], block_distances[b]);
+    });
+
+    neighbors.set_size(block_neighbors[0].n_rows, n_queries);
+    distances.set_size(block_distances[0].n_rows, n_queries);
+    for(size_t b = 0; b < blocks && b * per_block < n_queries; b++) {
+        const size_t first = b * per_block;
+        const size_t last = first + block_neighbors[b].n_cols - 1;
+        neighbors.cols(first, last) = block_neighbors[b];
+        distances.cols(first, last) = block_distances[b];
+    }
+    return std::accumulate(block_hits.begin(), block_hits.end(), size_t(0));
+}
+
+// searches appended by brute force and merges it with what search_index finds in the first reference_count points
+template<typename SortPolicy, typename SearchIndex>
+static size_t search_with_appended(const size_t reference_count, const arma::mat& appended, arma::mat&& query, const size_t k,
+                                 SearchIndex&& search_index, arma::Mat<size_t>& neighbors, arma::mat& distances) {
+    const size_t first_appended = reference_count;
+    const size_t tree_k = std::min(k, first_appended);
+    const size_t n_queries = query.n_cols;
+
+    // brute force over the appended points before the tree search takes the query over
+    arma::mat appended_distances(appended.n_cols, n_queries);
+    for(size_t i = 0; i < n_queries; i++) {
+        appended_distances.col(i) = arma::sqrt(arma::sum(arma::square(appended.each_col() - query.col(i)), 0)).t();
+    }
+
+    arma::Mat<size_t> tree_neighbors;
+    arma::mat tree_distances;
+    size_t hits = 0;
+    if(tree_k > 0) {
+        hits = search_index(std::move(query), tree_k, tree_neighbors, tree_distances);
+    }
+
+    const size_t out_k = std::min(k, first_appended + appended.n_cols);
+    std::vector<std::pair<double, size_t>> candidates;
+    candidates.reserve(tree_k + appended.n_cols);
+    auto better = [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+        return SortPolicy::IsBetter(a.first, b.first);
+    };
+
+    neighbors.set_size(out_k, n_queries);
+    distances.set_size(out_k, n_queries);
+    for(size_t i = 0; i < n_queries; i++) {
+        candidates.clear();
+        for(size_t j = 0; j < tree_k; j++) {
+            candidates.emplace_back(tree_distances(j, i), tree_neighbors(j, i));
+        }
+        for(size_t j = 0; j < appended.n_cols; j++) {
+            candidates.emplace_back(appended_distances(j, i), first_appended + j);
+        }
+        std::partial_sort(candidates.begin(), candidates.begin() + out_k, candidates.end(), better);
+        for(size_t j = 0; j < out_k; j++) {
+            distances(j, i) = candidates[j].first;
+            neighbors(j, i) = candidates[j].second;
+        }
+    }
+    return hits;
+}
+
+/*
+ only dual tree search writes to the tree, it keeps bounds in it while it runs. while a query is split
+ across workers a dual tree model is searched single tree instead, which finds the same neighbors and
+ only reads the tree, and is put back when this goes, also when the search throws. the counters mlpack
+ keeps while searching are written from every thread, nothing here reads them
+ */
+template<typename SortPolicy>
+class single_tree_while_split {
+public:
+    single_tree_while_split(mlpack::NSModel<SortPolicy>* model, worker_pool* workers, const size_t n_queries) :
+        m_model(model && model->SearchMode() == mlpack::DUAL_TREE_MODE && block_count(workers, n_queries) > 1 ? model : nullptr) {
+        if(m_model) {
+            m_model->SearchMode() = mlpack::SINGLE_TREE_MODE;
+        }
+    }
+
+    ~single_tree_while_split() {
+        if(m_model) {
+            m_model->SearchMode() = mlpack::DUAL_TREE_MODE;
+        }
+    }
+
+    single_tree_while_split(const single_tree_while_split&) = delete;
+    single_tree_while_split& operator=(const single_tree_while_split&) = delete;
+
+private:
+    mlpack::NSModel<SortPolicy>* m_model;
+};
+
+template<typename SortPolicy>
+void search_neighbors(mlpack::NSModel<SortPolicy>& model, arma::mat&& query, const size_t k, const neighbor_query_params& query_params,
+                      arma::Mat<size_t>& neighbors, arma::mat& distances) {
+    single_tree_while_split<SortPolicy> single_tree(&model, query_params.workers, query.n_cols);
+    search_blocks(query_params.workers, std::move(query),
+        [&model, k](arma::mat&& q, const size_t, arma::Mat<size_t>& n, arma::mat& d) {
+            search_neighbors(model, std::move(q), k, n, d);
+            return size_t(0);
+        }, neighbors, distances);
+}
+
+template<typename SortPolicy>
+void search_neighbors(mlpack::NSModel<SortPolicy>& model, const arma::mat& appended, arma::mat&& query, const size_t k,
+                      arma::Mat<size_t>& neighbors, arma::mat& distances) {
+    if(appended.n_cols == 0) {
+        search_neighbors(model, std::move(query), k, neighbors, distances);
+        return;
+    }
+    search_with_appended<SortPolicy>(model.Dataset().n_cols, appended, std::move(query), k,
+        [&model](arma::mat&& q, const size_t tree_k, arma::Mat<size_t>& n, arma::mat& d) {
+            search_neighbors(model, std::move(q), tree_k, n, d);
+            return size_t(0);
+        }, neighbors, distances);
+}
+
+template<typename SortPolicy>
+void search_reference(const arma::mat& reference, arma::mat&& query, const size_t k, const neighbor_query_params& query_params,
+                      arma::Mat<size_t>& neighbors, arma::mat& distances) {
+    const size_t found = std::min(k, size_t(reference.n_cols));
+    auto better = [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+        return SortPolicy::IsBetter(a.first, b.first);
+    };
+    search_blocks(query_params.workers, std::move(query),
+        [&reference, found, &better](arma::mat&& q, const size_t, arma::Mat<size_t>& n, arma::mat& d) {
+            // one query column at a time, the set can be far too big for a matrix of all the distances
+            std::vector<std::pair<double, size_t>> candidates(reference.n_cols);
+            n.set_size(found, q.n_cols);
+            d.set_size(found, q.n_cols);
+            for(size_t i = 0; i < q.n_cols; i++) {
+                const double* p = q.colptr(i);
+                for(size_t j = 0; j < reference.n_cols; j++) {
+                    const double* r = reference.colptr(j);
+                    double sum = 0.;
+                    for(size_t row = 0; row < reference.n_rows; row++) {
+                        const double diff = p[row] - r[row];
+                        sum += diff * diff;
+                    }
+                    candidates[j] = std::make_pair(std::sqrt(sum), j);
+                }
+                std::partial_sort(candidates.begin(), candidates.begin() + found, candidates.end(), better);
+                for(size_t j = 0; j < found; j++) {
+                    d(j, i) = candidates[j].first;
+                    n(j, i) = candidates[j].second;
+                }
+            }
+            return size_t(0);
+        }, neighbors, distances);
+}
+
+void build_neighbor_model(knn_index& model, const neighbor_search_params& params, arma::mat&& reference) {
+    model.tree.reset();
+    model.graph.reset();
+    model.flat.reset();
+    model.range.reset();
+    model.params = params;
+    if(params.range) {
+        build_range_model(model, params, arma::mat(reference));
+    }
+    if(params.tree_type == "hnsw") {
+        const hnsw_index::storage storage = params.storage == "float32" ? hnsw_index::storage::float32 :
+            params.storage == "pq" ? hnsw_index::storage::pq : hnsw_index::storage::float64;
+        model.graph = std::make_unique<hnsw_index>(params.m, params.ef_construction, params.seed,
+                                                   storage, params.pq_bytes, params.rerank);
+        model.graph->add(std::move(reference));
+    } else {
+        model.tree = std::make_unique<knn_model>();
+        build_neighbor_model(*model.tree, params, std::move(reference));
+    }
+}
+
+void build_range_model(knn_index& model, const neighbor_search_params& params, arma::mat&& reference) {
+    mlpack::util::Timers u = mlpack::util::Timers();
+    range_model::TreeTypes tree = range_model::KD_TREE;
+
+    // the range trees are the neighbor trees without spill
+    if (params.tree_type == "cover")
+      tree = range_model::COVER_TREE;
+    else if (params.tree_type == "r")
+      tree = range_model::R_TREE;
+    else if (params.tree_type == "r-star")
+      tree = range_model::R_STAR_TREE;
+    else if (params.tree_type == "ball")
+      tree = range_model::BALL_TREE;
+    else if (params.tree_type == "x")
+      tree = range_model::X_TREE;
+    else if (params.tree_type == "hilbert-r")
+      tree = range_model::HILBERT_R_TREE;
+    else if (params.tree_type == "r-plus")
+      tree = range_model::R_PLUS_TREE;
+    else if (params.tree_type == "r-plus-plus")
+      tree = range_model::R_PLUS_PLUS_TREE;
+    else if (params.tree_type == "vp")
+      tree = range_model::VP_TREE;
+    else if (params.tree_type == "rp")
+      tree = range_model::RP_TREE;
+    else if (params.tree_type == "max-rp")
+      tree = range_model::MAX_RP_TREE;
+    else if (params.tree_type == "ub")
+      tree = range_model::UB_TREE;
+    else if (params.tree_type == "oct")
+      tree = range_model::OCTREE;
+
+    model.range = std::make_unique<range_model>(tree, params.random_basis);
+    model.range->BuildModel(u, std::move(reference), params.leaf_size, params.algorithm == "naive",
+                            params.algorithm == "single_tree" || params.algorithm == "greedy");
+}
+
+// adds the columns of points within radius of each column of query to found, numbered from first
+static void brute_force_range(const arma::mat& points, const size_t first, const arma::mat& query, const double radius,
+                              std::vector<std::vector<std::pair<double, size_t>>>& found) {
+    const double squared = radius * radius;
+    for(size_t i = 0; i < query.n_cols; i++) {
+        const double* q = query.colptr(i);
+        for(size_t j = 0; j < points.n_cols; j++) {
+            const double* p = points.colptr(j);
+            double sum = 0.;
+            for(size_t row = 0; row < points.n_rows; row++) {
+                const double diff = q[row] - p[row];
+                sum += diff * diff;
+            }
+            if(sum <= squared) {
+                found[i].emplace_back(std::sqrt(sum), first + j);
+            }
+        }
+    }
+}
+
+void search_range(knn_index& model, const arma::mat* reference, const arma::mat& appended, arma::mat&& query, const double radius,
+                  const neighbor_query_params& query_params,
+                  arma::Row<size_t>& offsets, arma::Row<size_t>& neighbors, arma::Row<double>& distances) {
+    const size_t n_queries = query.n_cols;
+    worker_pool* workers = query_params.workers;
+    const size_t blocks = block_count(workers, n_queries);
+    const size_t per_block = (n_queries + blocks - 1) / blocks;
+    std::vector<std::vector<std::pair<double, size_t>>> found(n_queries);
+
+    if(!model.range && !model.graph && !model.flat && !reference) {
+        throw std::invalid_argument("range search needs the reference set sent again with radius above 0");
+    }
+
+    auto search = [&](size_t b) {
+        const size_t first = b * per_block;
+        if(first >= n_queries) {
+            return;
+        }
+        const size_t last = std::min(n_queries, first + per_block) - 1;
+        const arma::mat block = query.cols(first, last);
+        std::vector<std::vector<std::pair<double, size_t>>> block_found(block.n_cols);
+
+        if(model.range) {
+            mlpack::util::Timers u = mlpack::util::Timers();
+            std::vector<std::vector<size_t>> range_neighbors;
+            std::vector<std::vector<double>> range_distances;
+            model.range->Search(u, arma::mat(block), mlpack::Range(0., radius), range_neighbors, range_distances);
+            for(size_t i = 0; i < block.n_cols; i++) {
+                for(size_t j = 0; j < range_neighbors[i].size(); j++) {
+                    block_found[i].emplace_back(range_distances[i][j], range_neighbors[i][j]);
+                }
+            }
+        } else if(model.graph) {
+            arma::mat chunk;
+            for(size_t from = 0; from < model.size(); from += recall_chunk_columns) {
+                model.points(from, std::min(recall_chunk_columns, model.size() - from), chunk);
+                brute_force_range(chunk, from, block, radius, block_found);
+            }
+        } else {
+            brute_force_range(model.flat ? *model.flat : *reference, 0, block, radius, block_found);
+        }
+        if(appended.n_cols > 0) {
+            brute_force_range(appended, model.size(), block, radius, block_found);
+        }
+        for(size_t i = 0; i < block.n_cols; i++) {
+            std::sort(block_found[i].begin(), block_found[i].end());
+            found[first + i] = std::move(block_found[i]);
+        }
+    };
+    if(blocks < 2) {
+        search(0);
+    } else if(model.range && !model.range->Naive() && !model.range->SingleMode()) {
+        // the range tree keeps counters while searching like the neighbor trees do, and a dual tree search
+        // writes to it. split across workers it is searched single tree, which finds the same points
+        model.range->SingleMode() = true;
+        try {
+            workers->run(blocks, search);
+        } catch (...) {
+            model.range->SingleMode() = false;
+            throw;
+        }
+        model.range->SingleMode() = false;
+    } else {
+        workers->run(blocks, search);
+    }
+
+    size_t total = 0;
+    offsets.set_size(n_queries + 1);
+    for(size_t i = 0; i < n_queries; i++) {
+        offsets(i) = total;
+        total += found[i].size();
+    }
+    offsets(n_queries) = total;
+    neighbors.set_size(total);
+    distances.set_size(total);
+    for(size_t i = 0; i < n_queries; i++) {
+        for(size_t j = 0; j < found[i].size(); j++) {
+            neighbors(offsets(i) + j) = found[i][j].second;
+            distances(offsets(i) + j) = found[i][j].first;
+        }
+    }
+}
+
+// searches one block on the calling thread. previous is what was found for the same columns last time, if anything
+static size_t search_block(knn_index& model, arma::mat&& query, const size_t k, const size_t ef_search,
+                           const arma::Mat<size_t>& previous, arma::Mat<size_t>& neighbors, arma::mat& distances) {
+    if(model.graph) {
+        if(previous.n_cols > 0) {
+            return model.graph->search(query, k, ef_search, previous, neighbors, distances);
+        }
+        model.graph->search(query, k, ef_search, neighbors, distances);
+    } else if(model.tree) {
+        search_neighbors(*model.tree, std::move(query), k, neighbors, distances);
+    } else {
+        search_reference<mlpack::NearestNeighborSort>(*model.flat, std::move(query), k, neighbor_query_params(), neighbors, distances);
+    }
+    return 0;
+}
+
+// the previous neighbors of the columns of a block that starts at first. columns are contiguous, so this
+// uses the memory of query_params.previous instead of copying it, and is only read
+static arma::Mat<size_t> previous_block(const neighbor_query_params& query_params, const size_t first, const size_t columns) {
+    const arma::Mat<size_t>* previous = query_params.previous;
+    if(!previous || previous->n_rows == 0 || first >= previous->n_cols) {
+        return arma::Mat<size_t>();
+    }
+    const size_t n_cols = std::min<size_t>(previous->n_cols - first, columns);
+    return arma::Mat<size_t>(const_cast<size_t*>(previous->colptr(first)), previous->n_rows, n_cols, false, true);
+}
+
+size_t search_neighbors(knn_index& model, arma::mat&& query, const size_t k, const neighbor_query_params& query_params,
+                        arma::Mat<size_t>& neighbors, arma::mat& distances) {
+    const size_t ef_search = query_params.ef_search;
+    // the graph and a flat set are only read while searching
+    single_tree_while_split<mlpack::NearestNeighborSort> single_tree(model.tree.get(), query_params.workers, query.n_cols);
+    return search_blocks(query_params.workers, std::move(query),
+        [&model, &query_params, k, ef_search](arma::mat&& q, const size_t first, arma::Mat<size_t>& n, arma::mat& d) {
+            const arma::Mat<size_t> previous = previous_block(query_params, first, q.n_cols);
+            return search_block(model, std::move(q), k, ef_search, previous, n, d);
+        }, neighbors, distances);
+}
+
+size_t search_neighbors(knn_index& model, const arma::mat& appended, arma::mat&& query, const size_t k, const neighbor_query_params& query_params,
+                        arma::Mat<size_t>& neighbors, arma::mat& distances) {
+    if(appended.n_cols == 0) {
+        return search_neighbors(model, std::move(query), k, query_params, neighbors, distances);
+    }
+    const size_t ef_search = query_params.ef_search;
+    single_tree_while_split<mlpack::NearestNeighborSort> single_tree(model.tree.get(), query_params.workers, query.n_cols);
+    return search_blocks(query_params.workers, std::move(query),
+        [&model, &appended, &query_params, k, ef_search](arma::mat&& q, const size_t first, arma::Mat<size_t>& n, arma::mat& d) {
+            const arma::Mat<size_t> previous = previous_block(query_params, first, q.n_cols);
+            return search_with_appended<mlpack::NearestNeighborSort>(model.size(), appended, std::move(q), k,
+                [&model, &previous, ef_search](arma::mat&& block, const size_t tree_k, arma::Mat<size_t>& bn, arma::mat& bd) {
+                    return search_block(model, std::move(block), tree_k, ef_search, previous, bn, bd);
+                }, n, d);
+        }, neighbors, distances);
+}
+
+void build_neighbor_model(kfn_index& model, const neighbor_search_params& params, arma::mat&& reference) {
+    model.tree.reset();
+    model.drusilla.reset();
+    model.qdafn.reset();
+    model.params = params;
+    model.count = reference.n_cols;
+    model.dims = reference.n_rows;
+    if(params.algorithm == "drusilla") {
+        model.drusilla = std::make_unique<drusilla_model>(reference, params.num_tables, params.num_projections);
+    } else if(params.algorithm == "qdafn") {
+        if(size_t(params.num_projections) > reference.n_cols) {
+            throw std::invalid_argument("qdafn: num_projections (" + std::to_string(params.num_projections) +
+                                        ") exceeds entries in reference set (" + std::to_string(reference.n_cols) + ")");
+        }
+        model.qdafn = std::make_unique<qdafn_model>(reference, params.num_tables, params.num_projections);
+    } else {
+        model.tree = std::make_unique<kfn_model>();
+        build_neighbor_model(*model.tree, params, std::move(reference));
+    }
+}
+
+void search_neighbors(kfn_index& model, arma::mat&& query, const size_t k, const neighbor_query_params& query_params,
+                      arma::Mat<size_t>& neighbors, arma::mat& distances) {
+    // checked here, not on the workers
+    const size_t candidates = size_t(model.params.num_tables) * size_t(model.params.num_projections);
+    if(!model.tree && k > candidates) {
+        throw std::invalid_argument("number of neighbors requested(" + std::to_string(k) + ") exceeds the " +
+                                    std::to_string(candidates) + " candidates of " + model.params.algorithm);
+    }
+    // drusilla and qdafn only read their candidates while searching
+    single_tree_while_split<mlpack::FurthestNeighborSort> single_tree(model.tree.get(), query_params.workers, query.n_cols);
+    search_blocks(query_params.workers, std::move(query),
+        [&model, k](arma::mat&& q, const size_t, arma::Mat<size_t>& n, arma::mat& d) {
+            if(model.drusilla) {
+                model.drusilla->Search(q, k, n, d);
+            } else if(model.qdafn) {
+                model.qdafn->Search(q, k, n, d);
+            } else {
+                search_neighbors(*model.tree, std::move(q), k, n, d);
+            }
+            return size_t(0);
+        }, neighbors, distances);
+}
+
+double neighbor_recall(knn_index& model, const arma::mat& query, const size_t k, const neighbor_query_params& query_params) {
+    const size_t found = std::min(k, model.size());
+    arma::Mat<size_t> neighbors;
+    arma::mat distances;
+    // the found closest so far for each query column, in no order
+    arma::mat exact;
+    arma::mat chunk;
+    arma::rowvec d;
+    std::vector<double> merged;
+    size_t hits = 0;
+
+    if(found == 0 || query.n_cols == 0) {
+        return 1.;
+    }
+    search_neighbors(model, arma::mat(query), found, query_params, neighbors, distances);
+
+    // a chunk of the reference set at a time, a compressed graph is only decoded that far
+    exact.set_size(found, query.n_cols);
+    exact.fill(DBL_MAX);
+    for(size_t first = 0; first < model.size(); first += recall_chunk_columns) {
+        model.points(first, std::min(recall_chunk_columns, model.size() - first), chunk);
+        for(size_t i = 0; i < query.n_cols; i++) {
+            d = arma::sqrt(arma::sum(arma::square(chunk.each_col() - query.col(i)), 0));
+            merged.assign(exact.colptr(i), exact.colptr(i) + found);
+            merged.insert(merged.end(), d.begin(), d.end());
+            std::nth_element(merged.begin(), merged.begin() + (found - 1), merged.end());
+            std::copy(merged.begin(), merged.begin() + found, exact.colptr(i));
+        }
+    }
+
+    for(size_t i = 0; i < query.n_cols; i++) {
+        // compared by distance, the trees number their reordered dataset differently and ties can go either way
+        const double furthest = exact.col(i).max() * (1. + 1e-9);
+        for(size_t j = 0; j < found; j++) {
+            if(distances(j, i) <= furthest) {
+                hits++;
+            }
+        }
+    }
+    return double(hits) / double(found * query.n_cols);
+}
+
+template void build_neighbor_model(knn_model&, const neighbor_search_params&, arma::mat&&);
+template void build_neighbor_model(kfn_model&, const neighbor_search_params&, arma::mat&&);
+template void search_neighbors(knn_model&, arma::mat&&, const size_t, arma::Mat<size_t>&, arma::mat&);
+template void search_neighbors(kfn_model&, arma::mat&&, const size_t, arma::Mat<size_t>&, arma::mat&);
+template void search_neighbors(knn_model&, arma::mat&&, const size_t, const neighbor_query_params&, arma::Mat<size_t>&, arma::mat&);
+template void search_neighbors(kfn_model&, arma::mat&&, const size_t, const neighbor_query_params&, arma::Mat<size_t>&, arma::mat&);
+template void search_neighbors(knn_model&, const arma::mat&, arma::mat&&, const size_t, arma::Mat<size_t>&, arma::mat&);
+template void search_neighbors(kfn_model&, const arma::mat&, arma::mat&&, const size_t, arma::Mat<size_t>&, arma::mat&);
+template void search_reference<mlpack::NearestNeighborSort>(const arma::mat&, arma::mat&&, const size_t, const neighbor_query_params&, arma::Mat<size_t>&, arma::mat&);
+template void search_reference<mlpack::FurthestNeighborSort>(const arma::mat&, arma::mat&&, const size_t, const neighbor_query_params&, arma::Mat<size_t>&, arma::mat&);
+
+}
@@ -0,0 +1,307 @@
+/// @file neighbor_search.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved. Also based on examples provided with the mlpack library. Please see source/mlpack for license details
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include <mlpack/prereqs.hpp>
+#include <mlpack/methods/neighbor_search/neighbor_search.hpp>
+#include <mlpack/methods/neighbor_search/ns_model.hpp>
+#include <mlpack/methods/range_search/rs_model.hpp>
+#include <mlpack/methods/approx_kfn/drusilla_select.hpp>
+#include <mlpack/methods/approx_kfn/qdafn.hpp>
+#include <cereal/types/memory.hpp>
+#include <cereal/types/string.hpp>
+
+#include "hnsw.hpp"
+#include "worker_pool.hpp"
+
+#include <memory>
+#include <string>
+
+namespace mlmat {
+
+typedef mlpack::NSModel<mlpack::NearestNeighborSort> knn_model;
+typedef mlpack::NSModel<mlpack::FurthestNeighborSort> kfn_model;
+typedef mlpack::RSModel range_model;
+typedef mlpack::DrusillaSelect<arma::mat> drusilla_model;
+typedef mlpack::QDAFN<arma::mat> qdafn_model;
+
+// settings for building a reference tree, named the same as the object attributes
+struct neighbor_search_params {
+    std::string algorithm = "dual_tree";
+    std::string tree_type = "kd";
+    int leaf_size = 20;
+    double tau = 0.;
+    double rho = 0.7;
+    bool random_basis = false;
+    double epsilon = 0.;
+    // only for the hnsw graph
+    int m = 16;
+    int ef_construction = 200;
+    size_t seed = 0;
+    // float64, float32 or pq, how the graph keeps the reference set
+    std::string storage = "float64";
+    int pq_bytes = 8;
+    bool rerank = false;
+    // build a range tree as well, of the same type and leaf size (kd for hnsw and spill)
+    bool range = false;
+    // only for drusilla and qdafn, the approximate furthest neighbor algorithms
+    int num_tables = 5;
+    int num_projections = 5;
+
+    // version 0 had no range, version 1 no num_tables and num_projections
+    template<typename Archive>
+    void serialize(Archive& ar, const uint32_t version)
+    {
+        ar(CEREAL_NVP(algorithm));
+        ar(CEREAL_NVP(tree_type));
+        ar(CEREAL_NVP(leaf_size));
+        ar(CEREAL_NVP(tau));
+        ar(CEREAL_NVP(rho));
+        ar(CEREAL_NVP(random_basis));
+        ar(CEREAL_NVP(epsilon));
+        ar(CEREAL_NVP(m));
+        ar(CEREAL_NVP(ef_construction));
+        ar(CEREAL_NVP(seed));
+        ar(CEREAL_NVP(storage));
+        ar(CEREAL_NVP(pq_bytes));
+        ar(CEREAL_NVP(rerank));
+        if(version > 0) {
+            ar(CEREAL_NVP(range));
+        }
+        if(version > 1) {
+            ar(CEREAL_NVP(num_tables));
+            ar(CEREAL_NVP(num_projections));
+        }
+    }
+};
+
+// settings for a search, ef_search named the same as the object attribute
+struct neighbor_query_params {
+    // candidates the graph looks at, the trees ignore it
+    size_t ef_search = 50;
+    // splits the query columns across its threads when set. dual tree search keeps bounds in the
+    // tree while it runs, so a tree built for dual_tree is searched single tree while it is split
+    worker_pool* workers = nullptr;
+    // the neighbors found for the same query columns last frame. the graph starts each column from them
+    // instead of its top layer, the trees ignore it
+    const arma::Mat<size_t>* previous = nullptr;
+};
+
+/*
+ what mlmat.knn searches, one of the mlpack trees or an hnsw graph when tree_type is hnsw.
+ the graph keeps the reference set in input order, most trees reorder theirs
+ */
+class knn_index {
+public:
+    knn_index() {}
+
+    // copies the tree or graph too, so a copy can be added to without touching the original
+    knn_index(const knn_index& other) :
+        tree(other.tree ? std::make_unique<knn_model>(*other.tree) : nullptr),
+        graph(other.graph ? std::make_unique<hnsw_index>(*other.graph) : nullptr),
+        flat(other.flat),
+        range(other.range ? std::make_unique<range_model>(*other.range) : nullptr),
+        params(other.params) {}
+
+    // a set with nothing built over it yet, flat, only until one is
+    bool built() const {
+        return tree || graph;
+    }
+
+    size_t size() const {
+        return graph ? graph->size() : tree ? tree->Dataset().n_cols : flat->n_cols;
+    }
+
+    size_t dimensions() const {
+        return graph ? graph->dimensions() : tree ? tree->Dataset().n_rows : flat->n_rows;
+    }
+
+    // count reference points from first, in the order the tree or graph keeps them
+    void points(const size_t first, const size_t count, arma::mat& out) const {
+        if(graph) {
+            graph->points(first, count, out);
+        } else {
+            out = (tree ? tree->Dataset() : *flat).cols(first, first + count - 1);
+        }
+    }
+
+    // version 0 is a file written before there was a graph, which held the tree on its own in the same place.
+    // version 1 did not keep the settings, version 2 had no range tree
+    template<typename Archive>
+    void serialize(Archive& ar, const uint32_t version)
+    {
+        if(version == 0) {
+            tree = std::make_unique<knn_model>();
+            graph.reset();
+            tree->serialize(ar, version);
+            return;
+        }
+        ar(CEREAL_NVP(tree));
+        ar(CEREAL_NVP(graph));
+        if(version > 1) {
+            ar(CEREAL_NVP(params));
+        } else if(cereal::is_loading<Archive>() && graph) {
+            params.tree_type = "hnsw";
+        }
+        if(version > 2) {
+            ar(CEREAL_NVP(range));
+        }
+    }
+
+    std::unique_ptr<knn_model> tree { nullptr };
+    std::unique_ptr<hnsw_index> graph { nullptr };
+    // searched by brute force when there is neither, never saved
+    std::shared_ptr<const arma::mat> flat { nullptr };
+    // over the same points in input order, when params.range
+    std::unique_ptr<range_model> range { nullptr };
+    // what it was built with, or is to be built with when flat
+    neighbor_search_params params;
+};
+
+/*
+ what mlmat.kfn searches, one of the mlpack trees or, when algorithm is drusilla or qdafn,
+ the candidates picked from the reference set that those answer approximate queries from.
+ neither keeps the rest of the set, the neighbors they find are columns of it in input order
+ */
+class kfn_index {
+public:
+    kfn_index() {}
+
+    kfn_index(const kfn_index& other) :
+        tree(other.tree ? std::make_unique<kfn_model>(*other.tree) : nullptr),
+        drusilla(other.drusilla ? std::make_unique<drusilla_model>(*other.drusilla) : nullptr),
+        qdafn(other.qdafn ? std::make_unique<qdafn_model>(*other.qdafn) : nullptr),
+        count(other.count),
+        dims(other.dims),
+        params(other.params) {}
+
+    size_t size() const {
+        return tree ? tree->Dataset().n_cols : count;
+    }
+
+    size_t dimensions() const {
+        return tree ? tree->Dataset().n_rows : dims;
+    }
+
+    // version 0 is a file written when mlmat.kfn only had the tree, which was in the same place
+    template<typename Archive>
+    void serialize(Archive& ar, const uint32_t version)
+    {
+        if(version == 0) {
+            tree = std::make_unique<kfn_model>();
+            drusilla.reset();
+            qdafn.reset();
+            tree->serialize(ar, version);
+            return;
+        }
+        ar(CEREAL_NVP(tree));
+        serialize_engine(ar, drusilla);
+        serialize_engine(ar, qdafn);
+        ar(CEREAL_NVP(count));
+        ar(CEREAL_NVP(dims));
+        ar(CEREAL_NVP(params));
+    }
+
+    std::unique_ptr<kfn_model> tree { nullptr };
+    std::unique_ptr<drusilla_model> drusilla { nullptr };
+    std::unique_ptr<qdafn_model> qdafn { nullptr };
+    // size and dimensions of the set drusilla or qdafn were built over
+    size_t count = 0;
+    size_t dims = 0;
+    neighbor_search_params params;
+
+private:
+    // neither engine can be made without its table sizes, so cereal can't make one for a unique_ptr
+    template<typename Archive, typename Engine>
+    static void serialize_engine(Archive& ar, std::unique_ptr<Engine>& engine) {
+        bool kept = bool(engine);
+        ar(CEREAL_NVP(kept));
+        if(cereal::is_loading<Archive>()) {
+            engine = kept ? std::make_unique<Engine>(1, 1) : nullptr;
+        }
+        if(kept) {
+            ar(cereal::make_nvp("engine", *engine));
+        }
+    }
+};
+
+// builds the model over reference, which is taken over (and reordered by most trees)
+template<typename ModelType>
+void build_neighbor_model(ModelType& model, const neighbor_search_params& params, arma::mat&& reference);
+
+// k nearest (or furthest) neighbors of each column of query
+template<typename ModelType>
+void search_neighbors(ModelType& model, arma::mat&& query, const size_t k,
+                      arma::Mat<size_t>& neighbors, arma::mat& distances);
+
+// same as above, split across the threads of query_params.workers. results are in query order either way
+template<typename SortPolicy>
+void search_neighbors(mlpack::NSModel<SortPolicy>& model, arma::mat&& query, const size_t k, const neighbor_query_params& query_params,
+                      arma::Mat<size_t>& neighbors, arma::mat& distances);
+
+// same as above, with points appended after the tree was built searched by brute force and merged
+// into what the tree finds. appended points are numbered after the tree's reference set
+template<typename SortPolicy>
+void search_neighbors(mlpack::NSModel<SortPolicy>& model, const arma::mat& appended, arma::mat&& query, const size_t k,
+                      arma::Mat<size_t>& neighbors, arma::mat& distances);
+
+// k nearest (or furthest) neighbors of each column of query by brute force over reference, for a set
+// nothing has been built over yet. split across the threads of query_params.workers
+template<typename SortPolicy>
+void search_reference(const arma::mat& reference, arma::mat&& query, const size_t k, const neighbor_query_params& query_params,
+                      arma::Mat<size_t>& neighbors, arma::mat& distances);
+
+// builds a tree, or a graph when params.tree_type is hnsw
+void build_neighbor_model(knn_index& model, const neighbor_search_params& params, arma::mat&& reference);
+
+// builds the range tree of model over reference, which has to be its points in input order
+void build_range_model(knn_index& model, const neighbor_search_params& params, arma::mat&& reference);
+
+// every point within radius of each column of query, nearest first. query i's are neighbors and distances
+// from offsets(i) to offsets(i + 1) - 1. uses the range tree, or brute force over the graph, a flat set or
+// reference (the set in input order, used for a tree without a range tree). appended points are numbered
+// after the set and searched by brute force. throws std::invalid_argument when there is nothing to search
+void search_range(knn_index& model, const arma::mat* reference, const arma::mat& appended, arma::mat&& query, const double radius,
+                  const neighbor_query_params& query_params,
+                  arma::Row<size_t>& offsets, arma::Row<size_t>& neighbors, arma::Row<double>& distances);
+
+// both return how many query columns the graph searched from their previous neighbors instead of its top,
+// 0 without query_params.previous
+size_t search_neighbors(knn_index& model, arma::mat&& query, const size_t k, const neighbor_query_params& query_params,
+                        arma::Mat<size_t>& neighbors, arma::mat& distances);
+
+size_t search_neighbors(knn_index& model, const arma::mat& appended, arma::mat&& query, const size_t k, const neighbor_query_params& query_params,
+                        arma::Mat<size_t>& neighbors, arma::mat& distances);
+
+// builds a tree, or picks the candidates of drusilla or qdafn when params.algorithm is one of them.
+// throws std::invalid_argument when the set is too small for num_tables * num_projections candidates
+void build_neighbor_model(kfn_index& model, const neighbor_search_params& params, arma::mat&& reference);
+
+// k furthest neighbors of each column of query, split across the threads of query_params.workers.
+// drusilla and qdafn throw std::invalid_argument for more than they have candidates
+void search_neighbors(kfn_index& model, arma::mat&& query, const size_t k, const neighbor_query_params& query_params,
+                      arma::Mat<size_t>& neighbors, arma::mat& distances);
+
+// fraction of the k neighbors found for each column of query that are as close as the true k nearest,
+// which are found by brute force over the reference set
+double neighbor_recall(knn_index& model, const arma::mat& query, const size_t k, const neighbor_query_params& query_params);
+
+extern template void build_neighbor_model(knn_model&, const neighbor_search_params&, arma::mat&&);
+extern template void build_neighbor_model(kfn_model&, const neighbor_search_params&, arma::mat&&);
+extern template void search_neighbors(knn_model&, arma::mat&&, const size_t, arma::Mat<size_t>&, arma::mat&);
+extern template void search_neighbors(kfn_model&, arma::mat&&, const size_t, arma::Mat<size_t>&, arma::mat&);
+extern template void search_neighbors(knn_model&, arma::mat&&, const size_t, const neighbor_query_params&, arma::Mat<size_t>&, arma::mat&);
+extern template void search_neighbors(kfn_model&, arma::mat&&, const size_t, const neighbor_query_params&, arma::Mat<size_t>&, arma::mat&);
+extern template void search_neighbors(knn_model&, const arma::mat&, arma::mat&&, const size_t, arma::Mat<size_t>&, arma::mat&);
+extern template void search_neighbors(kfn_model&, const arma::mat&, arma::mat&&, const size_t, arma::Mat<size_t>&, arma::mat&);
+extern template void search_reference<mlpack::NearestNeighborSort>(const arma::mat&, arma::mat&&, const size_t, const neighbor_query_params&, arma::Mat<size_t>&, arma::mat&);
+extern template void search_reference<mlpack::FurthestNeighborSort>(const arma::mat&, arma::mat&&, const size_t, const neighbor_query_params&, arma::Mat<size_t>&, arma::mat&);
+
+}
+
+CEREAL_CLASS_VERSION(mlmat::neighbor_search_params, 2);
+CEREAL_CLASS_VERSION(mlmat::knn_index, 3);
+CEREAL_CLASS_VERSION(mlmat::kfn_index, 1);
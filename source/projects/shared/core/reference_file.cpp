@@ -0,0 +1,231 @@
+/// @file reference_file.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#include "reference_file.hpp"
+
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/string.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mlmat {
+
+static const char reference_magic[8] = { 'm', 'l', 'm', 'a', 't', 'r', 'e', 'f' };
+static const uint32_t reference_version = 1;
+// written as is, so it reads back differently on the other byte order
+static const uint32_t reference_byte_order = 0x01020304;
+// the points start on a multiple of this, a page everywhere mlmat runs
+static const uint64_t reference_alignment = 65536;
+// columns asked for at once while writing
+static const size_t reference_chunk_columns = 65536;
+
+struct reference_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t settings_offset;
+    uint64_t settings_bytes;
+    uint64_t points_offset;
+};
+
+// a whole file mapped copy on write, unmapped when this goes away
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path) {
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(m_file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("can't open " + path);
+        }
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+            close();
+            throw std::runtime_error(path + " is empty");
+        }
+        m_size = size_t(size.QuadPart);
+        m_mapping = CreateFileMappingA(m_file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        m_data = m_mapping ? static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0)) : nullptr;
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if(fd < 0) {
+            throw std::runtime_error("can't open " + path);
+        }
+        if(fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error(path + " is empty");
+        }
+        m_size = size_t(st.st_size);
+        void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        // the mapping keeps the file open
+        ::close(fd);
+        m_data = data == MAP_FAILED ? nullptr : static_cast<char*>(data);
+#endif
+        if(!m_data) {
+            close();
+            throw std::runtime_error("can't map " + path);
+        }
+    }
+
+    ~mapped_file() {
+        close();
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    char* data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+private:
+    void close() {
+#ifdef _WIN32
+        if(m_data) {
+            UnmapViewOfFile(m_data);
+        }
+        if(m_mapping) {
+            CloseHandle(m_mapping);
+        }
+        if(m_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_file);
+        }
+        m_mapping = NULL;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if(m_data) {
+            munmap(m_data, m_size);
+        }
+#endif
+        m_data = nullptr;
+    }
+
+    char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = NULL;
+#endif
+};
+
+// the mapping and the matrix over it, freed together
+struct mapped_reference {
+    explicit mapped_reference(const std::string& path) : file(path) {}
+    mapped_file file;
+    // made over the mapping in place, assigning one would copy it
+    std::unique_ptr<const arma::mat> points { nullptr };
+};
+
+void write_reference_file(const std::string& path, const reference_file_settings& settings,
+                          const size_t rows, const size_t cols, const reference_points& points) {
+    std::ostringstream packed;
+    {
+        cereal::BinaryOutputArchive ar(packed);
+        ar(settings);
+    }
+    const std::string blob = packed.str();
+
+    reference_header header;
+    std::memcpy(header.magic, reference_magic, sizeof(header.magic));
+    header.version = reference_version;
+    header.byte_order = reference_byte_order;
+    header.rows = rows;
+    header.cols = cols;
+    header.settings_offset = sizeof(reference_header);
+    header.settings_bytes = blob.size();
+    header.points_offset = (header.settings_offset + header.settings_bytes + reference_alignment - 1) / reference_alignment * reference_alignment;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if(!out) {
+        throw std::runtime_error("can't write " + path);
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(blob.data(), std::streamsize(blob.size()));
+    const std::vector<char> padding(size_t(header.points_offset - header.settings_offset - header.settings_bytes), 0);
+    out.write(padding.data(), std::streamsize(padding.size()));
+
+    arma::mat chunk;
+    for(size_t first = 0; first < cols; first += reference_chunk_columns) {
+        const size_t count = std::min(reference_chunk_columns, cols - first);
+        points(first, count, chunk);
+        if(chunk.n_rows != rows || chunk.n_cols != count) {
+            throw std::runtime_error("reference set changed while " + path + " was written");
+        }
+        out.write(reinterpret_cast<const char*>(chunk.memptr()), std::streamsize(chunk.n_elem * sizeof(double)));
+    }
+    if(!out.flush()) {
+        throw std::runtime_error("can't write " + path);
+    }
+}
+
+bool is_reference_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(reference_magic)] = { 0 };
+    in.read(magic, sizeof(magic));
+    return in && std::memcmp(magic, reference_magic, sizeof(magic)) == 0;
+}
+
+std::shared_ptr<const arma::mat> read_reference_file(const std::string& path, reference_file_settings& settings) {
+    auto mapped = std::make_shared<mapped_reference>(path);
+    const char* data = mapped->file.data();
+    const size_t size = mapped->file.size();
+    reference_header header;
+
+    if(size < sizeof(header)) {
+        throw std::runtime_error(path + " is not a reference file");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if(std::memcmp(header.magic, reference_magic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error(path + " is not a reference file");
+    }
+    if(header.byte_order != reference_byte_order) {
+        throw std::runtime_error(path + " was written on a machine with another byte order");
+    }
+    if(header.version > reference_version) {
+        throw std::runtime_error(path + " was written by a newer version of mlmat");
+    }
+    if(header.settings_offset + header.settings_bytes > size || header.points_offset % sizeof(double) != 0 ||
+       header.points_offset > size || (size - header.points_offset) / sizeof(double) / std::max<uint64_t>(header.rows, 1) < header.cols) {
+        throw std::runtime_error(path + " is cut short");
+    }
+    if(header.rows == 0 || header.cols == 0) {
+        throw std::runtime_error(path + " holds no points");
+    }
+
+    std::istringstream packed(std::string(data + header.settings_offset, size_t(header.settings_bytes)));
+    {
+        cereal::BinaryInputArchive ar(packed);
+        ar(settings);
+    }
+
+    // over the file's pages, nothing is read until they are touched
+    double* points = reinterpret_cast<double*>(mapped->file.data() + header.points_offset);
+    mapped->points = std::make_unique<const arma::mat>(points, arma::uword(header.rows), arma::uword(header.cols), false, true);
+    return std::shared_ptr<const arma::mat>(mapped, mapped->points.get());
+}
+
+}
@@ -0,0 +1,60 @@
+/// @file reference_file.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include "neighbor_search.hpp"
+
+#include <mlpack/prereqs.hpp>
+#include <mlpack/methods/preprocess/scaling_model.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace mlmat {
+
+// what is written with a reference set, everything needed to build the tree again and scale queries
+struct reference_file_settings {
+    neighbor_search_params params;
+    std::unique_ptr<mlpack::data::ScalingModel> scaler { nullptr };
+    long dim0 = 0;
+    long dimcount = 1;
+    bool autoscale = false;
+
+    template<typename Archive>
+    void serialize(Archive& ar, const uint32_t /* version */)
+    {
+        ar(CEREAL_NVP(params));
+        ar(CEREAL_NVP(scaler));
+        ar(CEREAL_NVP(dim0));
+        ar(CEREAL_NVP(dimcount));
+        ar(CEREAL_NVP(autoscale));
+    }
+};
+
+// fills out with count points from first
+typedef std::function<void(const size_t first, const size_t count, arma::mat& out)> reference_points;
+
+/*
+ mlmat.knn and mlmat.kfn reference sets without a tree. the file is a header, the settings
+ and then the points as float64 columns in input order, starting on a page boundary so
+ they can be used straight from a mapping of the file. reading one only maps it, the
+ pages are read in by whatever touches them first. files are read on the byte order
+ they were written on.
+ */
+
+// writes rows x cols points, asking for them a chunk at a time. throws std::runtime_error
+void write_reference_file(const std::string& path, const reference_file_settings& settings,
+                          const size_t rows, const size_t cols, const reference_points& points);
+
+// true if path starts like a file write_reference_file wrote
+bool is_reference_file(const std::string& path);
+
+// maps path and returns its points, which keep the mapping alive. the memory is copy on write,
+// so the file is never changed. throws std::runtime_error
+std::shared_ptr<const arma::mat> read_reference_file(const std::string& path, reference_file_settings& settings);
+
+}
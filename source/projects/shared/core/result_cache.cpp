@@ -0,0 +1,178 @@
+/// @file result_cache.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#include "result_cache.hpp"
+
+#include <cstring>
+
+namespace mlmat {
+
+static const uint64_t hash_multiplier = 0x9e3779b97f4a7c15ull;
+
+static inline uint64_t hash_finish(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint64_t hash_word(const uint64_t h, const uint64_t w) {
+    const uint64_t x = (h ^ w) * hash_multiplier;
+    return (x << 31) | (x >> 33);
+}
+
+uint64_t hash_bytes(const void* data, const size_t size, const uint64_t seed) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ (size * hash_multiplier);
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t w;
+        std::memcpy(&w, p + i, sizeof(w));
+        h = hash_word(h, w);
+    }
+    if(i < size) {
+        uint64_t w = 0;
+        std::memcpy(&w, p + i, size - i);
+        h = hash_word(h, w);
+    }
+    return hash_finish(h);
+}
+
+// bytes in a dim[0] row, the cells of a row are always next to each other
+static size_t row_bytes(const matrix_desc& desc) {
+    return size_t(desc.dimcount > 0 ? desc.dim[0] : 1) * desc.planecount * cell_size(desc.type);
+}
+
+// calls f with the start of each dim[0] row of a and the same row of b, which has the same dims
+template<typename F>
+static void for_each_row(const matrix_desc& a, const matrix_desc& b, F&& f) {
+    long rows = 1;
+    for(long i = 1; i < a.dimcount; i++) {
+        rows *= a.dim[i];
+    }
+    long index[max_dimcount] = {};
+    for(long r = 0; r < rows; r++) {
+        size_t offset_a = 0;
+        size_t offset_b = 0;
+        for(long i = 1; i < a.dimcount; i++) {
+            offset_a += size_t(index[i]) * a.dimstride[i];
+            offset_b += size_t(index[i]) * b.dimstride[i];
+        }
+        f(a.data + offset_a, b.data + offset_b);
+        for(long i = 1; i < a.dimcount && ++index[i] == a.dim[i]; i++) {
+            index[i] = 0;
+        }
+    }
+}
+
+static bool same_layout(const matrix_desc& a, const matrix_desc& b) {
+    if(a.type != b.type || a.planecount != b.planecount || a.dimcount != b.dimcount) {
+        return false;
+    }
+    for(long i = 0; i < a.dimcount; i++) {
+        if(a.dim[i] != b.dim[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void keep(const matrix_desc& from, cached_matrix& to) {
+    to.layout = from;
+    set_packed_strides(to.layout);
+    to.layout.data = nullptr;
+    long cells = 1;
+    for(long i = 0; i < from.dimcount; i++) {
+        cells *= from.dim[i];
+    }
+    to.cells.resize(size_t(cells) * from.planecount * cell_size(from.type));
+    matrix_desc packed = to.layout;
+    packed.data = to.cells.data();
+    copy_cells(from, packed);
+}
+
+uint64_t hash_cells(const matrix_desc& desc, const uint64_t seed) {
+    const size_t bytes = row_bytes(desc);
+    uint64_t h = seed;
+    for_each_row(desc, desc, [&](const unsigned char* row, const unsigned char*) {
+        h = hash_bytes(row, bytes, h);
+    });
+    return h;
+}
+
+void copy_cells(const matrix_desc& from, const matrix_desc& to) {
+    const size_t bytes = row_bytes(from);
+    for_each_row(from, to, [bytes](const unsigned char* a, unsigned char* b) {
+        std::memcpy(b, a, bytes);
+    });
+}
+
+void result_cache::resize(const size_t capacity) {
+    if(capacity != m_entries.size()) {
+        m_entries.clear();
+        m_entries.shrink_to_fit();
+        m_entries.resize(capacity);
+    }
+}
+
+const std::vector<cached_matrix>* result_cache::find(const matrix_desc& input, const uint64_t hash, const uint64_t key) {
+    if(m_entries.empty()) {
+        return nullptr;
+    }
+    const size_t bytes = row_bytes(input);
+
+    for(auto& e : m_entries) {
+        if(!e.used || e.hash != hash || e.key != key || !same_layout(input, e.input.layout)) {
+            continue;
+        }
+        matrix_desc kept = e.input.layout;
+        kept.data = e.input.cells.data();
+        bool same = true;
+        for_each_row(input, kept, [&](const unsigned char* a, const unsigned char* b) {
+            same = same && std::memcmp(a, b, bytes) == 0;
+        });
+        if(same) {
+            e.last_used = ++m_clock;
+            m_hits++;
+            return &e.outputs;
+        }
+    }
+    m_misses++;
+    return nullptr;
+}
+
+void result_cache::store(const matrix_desc& input, const uint64_t hash, const uint64_t key, const std::vector<matrix_desc>& outputs) {
+    if(m_entries.empty()) {
+        return;
+    }
+    entry* oldest = &m_entries[0];
+    for(auto& e : m_entries) {
+        if(!e.used) {
+            oldest = &e;
+            break;
+        }
+        if(e.last_used < oldest->last_used) {
+            oldest = &e;
+        }
+    }
+    entry& e = *oldest;
+    e.used = true;
+    e.hash = hash;
+    e.key = key;
+    e.last_used = ++m_clock;
+    keep(input, e.input);
+    e.outputs.resize(outputs.size());
+    for(size_t i = 0; i < outputs.size(); i++) {
+        keep(outputs[i], e.outputs[i]);
+    }
+}
+
+void result_cache::clear() {
+    for(auto& e : m_entries) {
+        e.used = false;
+    }
+}
+
+}
@@ -0,0 +1,82 @@
+/// @file result_cache.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include "matrix_desc.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mlmat {
+
+// 64 bit hash of size bytes, fast and not meant to stand up to inputs picked to collide
+uint64_t hash_bytes(const void* data, const size_t size, const uint64_t seed = 0);
+
+// the cells of desc with its padding left out. data is null, strides are packed
+struct cached_matrix {
+    matrix_desc layout;
+    std::vector<unsigned char> cells;
+};
+
+/*
+ what an object put out for the last few distinct inputs it was sent, for patches that
+ send the same matrix over and over. an input is looked up by a hash of its cells and
+ checked against a copy of them, so a hit is always the same input. the caller makes
+ the hash with hash_cells once and passes it to find and to the store after a miss. key stands for
+ everything else the outputs depend on (the model version, the attributes) and has to
+ match too. the least recently used entry is replaced, keeping its buffers, so a full
+ cache does not allocate for inputs and outputs of the sizes it already holds.
+ */
+class result_cache {
+public:
+    // keeps up to capacity entries. 0 turns the cache off and frees them
+    void resize(const size_t capacity);
+
+    size_t capacity() const {
+        return m_entries.size();
+    }
+
+    // the outputs stored for input, whose hash_cells is hash, under key. null if there are none.
+    // counts a hit or a miss
+    const std::vector<cached_matrix>* find(const matrix_desc& input, const uint64_t hash, const uint64_t key);
+
+    // keeps copies of input, whose hash_cells is hash, and outputs under key
+    void store(const matrix_desc& input, const uint64_t hash, const uint64_t key, const std::vector<matrix_desc>& outputs);
+
+    void clear();
+
+    size_t hits() const {
+        return m_hits;
+    }
+
+    size_t misses() const {
+        return m_misses;
+    }
+
+private:
+    struct entry {
+        bool used = false;
+        uint64_t hash = 0;
+        uint64_t key = 0;
+        size_t last_used = 0;
+        cached_matrix input;
+        std::vector<cached_matrix> outputs;
+    };
+
+    std::vector<entry> m_entries;
+    size_t m_clock = 0;
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+};
+
+// hashes the cells of desc row by row, leaving out padding
+uint64_t hash_cells(const matrix_desc& desc, const uint64_t seed = 0);
+
+// copies the cells of from into to, which has to have the same type, planecount and dims
+void copy_cells(const matrix_desc& from, const matrix_desc& to);
+
+}
@@ -0,0 +1,52 @@
+/// @file scaler.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#include "scaler.hpp"
+
+namespace mlmat {
+
+using mlpack::data::ScalingModel;
+
+std::unique_ptr<ScalingModel> make_scaler(const std::string& type,
+                                          const int min,
+                                          const int max,
+                                          const double epsilon) {
+    auto s = std::make_unique<ScalingModel>(min, max, epsilon);
+
+    if(type == "standard") {
+        s->ScalerType() = ScalingModel::STANDARD_SCALER;
+    } else if(type == "min_max") {
+        s->ScalerType() = ScalingModel::MIN_MAX_SCALER;
+    } else if(type == "normalization") {
+        s->ScalerType() = ScalingModel::MEAN_NORMALIZATION;
+    } else if(type == "abs") {
+        s->ScalerType() = ScalingModel::MAX_ABS_SCALER;
+    } else if(type == "pca_whitening") {
+        s->ScalerType() = ScalingModel::PCA_WHITENING;
+    } else if(type == "zca_whitening") {
+        s->ScalerType() = ScalingModel::ZCA_WHITENING;
+    } else {
+        return nullptr;
+    }
+    return s;
+}
+
+arma::mat& scaler_transform(ScalingModel* scaler, arma::mat& input, arma::mat& output) {
+    if(!scaler) {
+        return input;
+    }
+    scaler->Transform(input, output);
+    return output;
+}
+
+arma::mat& scaler_inverse_transform(ScalingModel* scaler, arma::mat& input, arma::mat& output) {
+    if(!scaler) {
+        return input;
+    }
+    scaler->InverseTransform(input, output);
+    return output;
+}
+
+}
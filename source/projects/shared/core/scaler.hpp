@@ -0,0 +1,28 @@
+/// @file scaler.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include <mlpack/prereqs.hpp>
+#include <mlpack/methods/preprocess/scaling_model.hpp>
+
+#include <memory>
+#include <string>
+
+namespace mlmat {
+
+// makes an unfitted scaler from its name ("standard", "min_max", "normalization",
+// "abs", "pca_whitening", "zca_whitening"). returns nullptr for any other name
+std::unique_ptr<mlpack::data::ScalingModel> make_scaler(const std::string& type,
+                                                        const int min,
+                                                        const int max,
+                                                        const double epsilon);
+
+// returns output holding the scaled input, or input itself when there is no scaler
+arma::mat& scaler_transform(mlpack::data::ScalingModel* scaler, arma::mat& input, arma::mat& output);
+
+arma::mat& scaler_inverse_transform(mlpack::data::ScalingModel* scaler, arma::mat& input, arma::mat& output);
+
+}
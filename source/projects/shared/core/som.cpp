@@ -0,0 +1,166 @@
+/// @file som.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#include "som.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace mlmat {
+
+SOM::SOM(long cols, long rows, long weights, long epochs, long neighborhood, double rate, initialization init) {
+    m_num_iterations = epochs;
+    m_learning_rate = rate;
+    m_initialization = init;
+    m_cols = cols;
+    m_rows = rows;
+    //will have to redo sample anyway
+    if((m_initialization == uniform) || (m_initialization == sample)) {
+        m_nodes = std::make_unique<arma::Mat<double>>(weights, cols*rows, arma::fill::randu);
+    } else if(m_initialization == gaussian) {
+        m_nodes = std::make_unique<arma::Mat<double>>(weights, cols*rows, arma::fill::randn);
+    }
+    m_map_radius = std::max(cols, rows) / 2;
+
+    if(neighborhood != 0) {
+        m_map_radius = std::min<double>(neighborhood, m_map_radius);
+    }
+
+    m_time_constant = m_num_iterations/log(m_map_radius);
+}
+
+
+SOM::SOM(const SOM& other) :
+    m_bmu(other.m_bmu),
+    m_map_radius(other.m_map_radius),
+    m_time_constant(other.m_time_constant),
+    m_num_iterations(other.m_num_iterations),
+    m_rows(other.m_rows),
+    m_cols(other.m_cols),
+    m_neighborhood_radius(other.m_neighborhood_radius),
+    m_influence(other.m_influence),
+    m_learning_rate(other.m_learning_rate),
+    m_initialization(other.m_initialization),
+    m_first_run(other.m_first_run) {
+    if(other.m_nodes) {
+        m_nodes = std::make_unique<arma::Mat<double>>(*other.m_nodes);
+    }
+}
+
+
+void SOM::run_epochs(arma::Mat<double>& data, const epoch_callback& on_epoch) {
+    long n = m_num_iterations;
+
+    long iter_count = 0;
+    double rate = m_learning_rate;
+
+    if(m_first_run && (m_initialization == sample)) {
+        for(auto i=0;i<m_nodes->n_cols;i++) {
+            int elem = mlpack::RandInt(data.n_cols);
+            m_nodes->col(i) = data.col(elem);
+        }
+        m_first_run = false;
+    }
+
+    while(n--) {
+        arma::Col<double> data_elem;
+        m_neighborhood_radius = m_map_radius * exp(-(double)iter_count/m_time_constant);
+        double width_sq = m_neighborhood_radius * m_neighborhood_radius;
+        iter_count++;
+
+        for(auto k=0;k<data.n_cols;k++) {
+            m_bmu = find_bmu(data.col(k));
+
+
+            for(auto i=0;i<m_nodes->n_cols;i++) {
+                long dx = (m_bmu % m_rows) - (i % m_rows);
+                long dy = (m_bmu / m_rows) - (i / m_rows);
+                double dist_sq = double((dx*dx)+(dy*dy));//squared distance
+
+                if(dist_sq < width_sq) {
+                    data_elem = data.col(k);
+                    m_influence = exp(-(dist_sq)/(2*width_sq));
+                    adjust_weights(i, data_elem, rate, m_influence);
+                }
+            }
+        }
+        rate = m_learning_rate * exp(-(double)iter_count/m_num_iterations);
+
+        if(on_epoch && !on_epoch(iter_count, m_num_iterations)) {
+            break;
+        }
+    }
+}
+
+
+void SOM::run_batch_knn(arma::Mat<double>& data, const epoch_callback& on_epoch) {
+    long n = m_num_iterations;
+    long iter_count = 0;
+
+    if(m_first_run && (m_initialization == sample)) {
+        for(auto i=0;i<m_nodes->n_cols;i++) {
+            int elem = mlpack::RandInt(data.n_cols);
+            m_nodes->col(i) = data.col(elem);
+        }
+        m_first_run = false;
+    }
+
+    while(n--) {
+        arma::Mat<double> numerator(m_nodes->n_rows, m_nodes->n_cols, arma::fill::zeros);
+        std::vector<double> denominator(m_nodes->n_cols, 0.0);
+        m_neighborhood_radius = m_map_radius * exp(-(double)iter_count/m_time_constant);
+        double width_sq = m_neighborhood_radius * m_neighborhood_radius;
+        iter_count++;
+
+        for(auto k=0;k<data.n_cols;k++) {
+            m_bmu = find_bmu(data.col(k));
+
+            for(auto i=0;i<m_nodes->n_cols;i++) {
+                long dx = (m_bmu % m_rows) - (i % m_rows);
+                long dy = (m_bmu / m_rows) - (i / m_rows);
+                double dist_sq = double((dx*dx)+(dy*dy));//squared distance
+                double nh = exp(-(dist_sq)/(2*width_sq)); //neighborhood scaling
+                numerator.col(i) += data.col(k) * nh;
+                denominator[i] += nh;
+            }
+        }
+
+        for(auto j=0;j<m_nodes->n_cols;j++) {
+            m_nodes->col(j) = numerator.col(j)/denominator[j];
+        }
+
+        if(on_epoch && !on_epoch(iter_count, m_num_iterations)) {
+            break;
+        }
+    }
+}
+
+double SOM::get_euclidean_squared(const arma::Col<double>& target, const arma::Col<double>& weights) {
+    return arma::accu(arma::square(target - weights));
+}
+
+void SOM::adjust_weights(long weight_index, arma::Col<double>& target, const double learning_rate, const double influence) {
+    arma::Col<double> adjust = (target - m_nodes->col(weight_index)) * (learning_rate * influence );
+    m_nodes->col(weight_index) += adjust;
+}
+
+
+size_t SOM::find_bmu(const arma::Col<double> &vec) {
+    size_t winner = 0;
+    double lowest_distance = std::numeric_limits<double>::max();
+    double dist;
+    for(auto i=0;i<m_nodes->n_cols;i++) {
+        dist = get_euclidean_squared(vec, m_nodes->col(i));
+
+        if(dist < lowest_distance) {
+            lowest_distance = dist;
+            winner = i;
+        }
+    }
+    return winner;
+}
+
+}
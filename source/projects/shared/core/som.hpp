@@ -0,0 +1,65 @@
+/// @file som.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+/// http://www.ai-junkie.com/ann/som/som4.html
+
+#pragma once
+
+#include <mlpack/prereqs.hpp>
+
+#include <functional>
+#include <memory>
+
+namespace mlmat {
+
+class SOM {
+public:
+    enum initialization {uniform, gaussian, sample};
+    SOM() {};
+
+    // called after each epoch with the epochs done and the total, returning false stops training early
+    typedef std::function<bool(long, long)> epoch_callback;
+
+    SOM(long cols, long rows, long weights, long epochs, long neighborhood, double rate=.01, initialization init = uniform);
+
+    // copies the map too, so a copy can go on training without touching the original
+    SOM(const SOM& other);
+
+    void run_epochs(arma::Mat<double>& data, const epoch_callback& on_epoch = nullptr);
+
+    void run_batch_knn(arma::Mat<double>& data, const epoch_callback& on_epoch = nullptr);
+
+    double get_euclidean_squared(const arma::Col<double>& target, const arma::Col<double>& weights);
+
+    void adjust_weights(long weight_index, arma::Col<double>& target, const double learning_rate, const double influence);
+
+    template<typename Archive>
+    void serialize(Archive& ar, const uint32_t /* version */)
+    {
+        ar(CEREAL_NVP(m_nodes));
+    }
+
+    void set_epochs(long i) {
+        m_num_iterations = i;
+    }
+
+    std::unique_ptr<arma::Mat<double>> m_nodes { nullptr };
+
+private:
+    size_t find_bmu(const arma::Col<double> &vec);
+
+    long        m_bmu;
+    double      m_map_radius;
+    double      m_time_constant;
+    long        m_num_iterations;
+    long        m_rows;
+    long        m_cols;
+    double      m_neighborhood_radius;
+    double      m_influence;
+    double      m_learning_rate;
+    initialization m_initialization;
+    bool m_first_run = true;
+};
+
+}
@@ -0,0 +1,187 @@
+/// @file stft.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#include "stft.hpp"
+
+#include <cmath>
+#include <complex>
+
+namespace mlmat {
+
+window_type window_from_string(const std::string& name) {
+    if(name == "triangle") {
+        return window_type::triangle;
+    } else if(name == "hanning") {
+        return window_type::hanning;
+    } else if(name == "hamming") {
+        return window_type::hamming;
+    } else if(name == "blackman") {
+        return window_type::blackman;
+    }
+    return window_type::square;
+}
+
+void make_window(const window_type type, const size_t n, std::vector<float>& w) {
+    const double two_pi = 2.0 * arma::datum::pi;
+    const size_t n_2 = n / 2;
+
+    w.assign(n, 0.0f);
+
+    switch(type) {
+        case window_type::triangle:
+            //ramps up over the first half and back down from the middle, last point stays 0
+            for(size_t i=0;i<n_2;i++) {
+                w[i] = float(i) / n_2;
+            }
+            for(size_t i=0;i<n_2 && (n_2-1+i)<n;i++) {
+                w[n_2-1+i] = 1.0f - (float(i) / n_2);
+            }
+            break;
+        case window_type::hanning:
+            for(size_t i=0;i<n;i++) {
+                w[i] = 0.5 * (1.0 - std::cos(two_pi * i / n));
+            }
+            break;
+        case window_type::hamming:
+            for(size_t i=0;i<n;i++) {
+                w[i] = 0.54 - (0.46 * std::cos(two_pi * i / n));
+            }
+            break;
+        case window_type::blackman:
+            for(size_t i=0;i<n;i++) {
+                w[i] = 0.42 - (0.5 * std::cos(two_pi * i / n)) + (0.08 * std::cos(2.0 * two_pi * i / n));
+            }
+            break;
+        default:
+            w.assign(n, 1.0f);
+            break;
+    }
+}
+
+size_t stft::frames(const stft_params& params, const size_t sample_count) const {
+    const size_t step = std::max<size_t>(1, params.fftsize / params.overlap);
+    return (sample_count + step - 1) / step;
+}
+
+size_t stft::bins(const stft_params& params) const {
+    return params.full_spectrum ? params.fftsize : params.fftsize / 2;
+}
+
+namespace {
+
+template <typename T>
+void write_frame(const matrix_desc& out, const size_t frame, const size_t bin, const float a, const float b) {
+    T* p = reinterpret_cast<T*>(out.data + (frame*out.dimstride[0]) + (bin*out.dimstride[1]));
+    p[0] = a;
+    p[1] = b;
+}
+
+template <typename T>
+std::complex<float> read_frame(const matrix_desc& in, const size_t frame, const size_t bin, const bool polar) {
+    const T* p = reinterpret_cast<const T*>(in.data + (frame*in.dimstride[0]) + (bin*in.dimstride[1]));
+    if(polar) {
+        return std::complex<float>(p[0] * std::cos(p[1]), p[0] * std::sin(p[1]));
+    }
+    return std::complex<float>(p[0], p[1]);
+}
+
+}
+
+void stft::run(const stft_params& params,
+               const float* samples,
+               const size_t sample_count,
+               const size_t channel_count,
+               const size_t channel,
+               const matrix_desc& out) {
+    const size_t fftsize = params.fftsize;
+    const size_t fftsize_2 = fftsize / 2;
+    const size_t step = std::max<size_t>(1, fftsize / params.overlap);
+    const size_t num_frames = std::min<size_t>(frames(params, sample_count), out.dim[0]);
+
+    if(m_window.size() != fftsize || m_window_type != params.window) {
+        make_window(params.window, fftsize, m_window);
+        m_window_type = params.window;
+    }
+    m_frame.set_size(fftsize);
+
+    for(size_t f=0;f<num_frames;f++) {
+        const size_t i = f * step;
+        //get next N samples, zero padding past the end
+        for(size_t j=0;j<fftsize;j++) {
+            m_frame[j] = (i+j) < sample_count ? samples[(i+j)*channel_count + channel] * m_window[j] : 0.0f;
+        }
+
+        m_spectrum = arma::fft(m_frame);
+        //the dc bin is real, vDSP packs nyquist into its imaginary part which is dropped
+        m_spectrum[0].imag(0.0f);
+
+        for(size_t k=0;k<fftsize_2;k++) {
+            float a, b;
+            if(params.polar) {
+                a = std::abs(m_spectrum[k]);
+                b = std::arg(m_spectrum[k]);
+            } else {
+                a = m_spectrum[k].real();
+                b = m_spectrum[k].imag();
+            }
+
+            if(out.type == cell_type::float64) {
+                write_frame<double>(out, f, k, a, b);
+                if(params.full_spectrum) {
+                    write_frame<double>(out, f, fftsize - 1 - k, a, b);
+                }
+            } else {
+                write_frame<float>(out, f, k, a, b);
+                if(params.full_spectrum) {
+                    write_frame<float>(out, f, fftsize - 1 - k, a, b);
+                }
+            }
+        }
+    }
+}
+
+size_t istft::sample_count(const stft_params& params, const size_t frame_count) const {
+    return frame_count * std::max<size_t>(1, params.fftsize / params.overlap);
+}
+
+void istft::run(const stft_params& params, const matrix_desc& in, std::vector<float>& samples) {
+    const size_t fftsize = params.fftsize;
+    const size_t fftsize_2 = fftsize / 2;
+    const size_t step = std::max<size_t>(1, fftsize / params.overlap);
+    const size_t num_frames = in.dim[0];
+    const size_t num_bins = std::min<size_t>(fftsize_2, in.dimcount > 1 ? in.dim[1] : 1);
+    //unscaled inverse divided by fftsize * overlap, arma::ifft already divides by fftsize
+    const float scaling = 1.0f / params.overlap;
+
+    if(m_window.size() != fftsize || m_window_type != params.window) {
+        make_window(params.window, fftsize, m_window);
+        m_window_type = params.window;
+    }
+    samples.assign(sample_count(params, num_frames) + fftsize, 0.0f);
+    m_spectrum.set_size(fftsize);
+
+    for(size_t f=0;f<num_frames;f++) {
+        m_spectrum.zeros();
+        for(size_t k=0;k<num_bins;k++) {
+            const std::complex<float> c = in.type == cell_type::float64 ? read_frame<double>(in, f, k, params.polar)
+                                                                        : read_frame<float>(in, f, k, params.polar);
+            m_spectrum[k] = c;
+            if(k > 0) {
+                m_spectrum[fftsize - k] = std::conj(c);
+            }
+        }
+        m_spectrum[fftsize_2] = m_spectrum[0].imag();
+        m_spectrum[0].imag(0.0f);
+
+        m_frame = arma::ifft(m_spectrum);
+
+        float* out = samples.data() + (f * step);
+        for(size_t j=0;j<fftsize;j++) {
+            out[j] += m_frame[j].real() * scaling * m_window[j];
+        }
+    }
+}
+
+}
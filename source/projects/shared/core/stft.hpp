@@ -0,0 +1,81 @@
+/// @file stft.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include <mlpack/prereqs.hpp>
+
+#include "matrix_desc.hpp"
+
+#include <string>
+#include <vector>
+
+namespace mlmat {
+
+enum class window_type { square, triangle, hanning, hamming, blackman };
+
+// unknown names are treated as square
+window_type window_from_string(const std::string& name);
+
+// fills w with n points of the window, using the same (periodic) definitions as vDSP
+void make_window(const window_type type, const size_t n, std::vector<float>& w);
+
+struct stft_params {
+    size_t fftsize = 1024;
+    size_t overlap = 4;
+    window_type window = window_type::hanning;
+    bool full_spectrum = false;
+    bool polar = false;
+};
+
+/*
+ short time fourier transform of one channel of interleaved float samples.
+ output is a 2 plane (real/imag or magnitude/phase) matrix with frames along
+ dim[0] and bins along dim[1]. bins are 0 .. fftsize/2-1, the nyquist bin is
+ dropped, and with full_spectrum they are followed by the same bins reversed.
+ buffers are kept between runs so repeated runs of the same size do not allocate.
+ */
+class stft {
+public:
+    size_t frames(const stft_params& params, const size_t sample_count) const;
+    size_t bins(const stft_params& params) const;
+
+    // out must be float32 or float64 with 2 planes and at least frames x bins cells
+    void run(const stft_params& params,
+             const float* samples,
+             const size_t sample_count,
+             const size_t channel_count,
+             const size_t channel,
+             const matrix_desc& out);
+
+private:
+    std::vector<float> m_window;
+    window_type m_window_type = window_type::square;
+    arma::fvec m_frame;
+    arma::cx_fvec m_spectrum;
+};
+
+/*
+ inverse of stft. reads the first fftsize/2 bins of each frame of a 2 plane
+ frames x bins matrix laid out the way stft::run writes it, with the imaginary
+ part of the dc bin taken as the nyquist bin like vDSP packs it. the frames are
+ windowed and overlap added into samples, which is resized to
+ sample_count + fftsize so the tail of the last frame fits.
+ */
+class istft {
+public:
+    size_t sample_count(const stft_params& params, const size_t frame_count) const;
+
+    // in must be float32 or float64 with 2 planes
+    void run(const stft_params& params, const matrix_desc& in, std::vector<float>& samples);
+
+private:
+    std::vector<float> m_window;
+    window_type m_window_type = window_type::square;
+    arma::cx_fvec m_spectrum;
+    arma::cx_fvec m_frame;
+};
+
+}
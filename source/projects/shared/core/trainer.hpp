@@ -0,0 +1,231 @@
+/// @file trainer.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include <mlpack/prereqs.hpp>
+#include <mlpack/methods/preprocess/scaling_model.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace mlmat {
+
+/*
+ what a training job works with and reports to. the worker writes progress and loss,
+ the object picks them up on the main thread (take_*) and posts them to its dump outlet.
+ notify is called from the worker whenever there is something new to pick up.
+ */
+class training_status
+{
+public:
+    enum class outcome { done, cancelled, failed };
+
+    explicit training_status(std::function<void()> notify) : m_notify(std::move(notify)) {}
+
+    bool cancelled() const { return m_cancel; }
+    void cancel() { m_cancel = true; }
+    bool running() const { return m_running; }
+
+    // done and total count whatever the job counts in (epochs, steps, trials). total is 0 if not known
+    void progress(const size_t done, const size_t total) {
+        m_done = done;
+        m_total = total;
+        m_progress_changed = true;
+        notify();
+    }
+
+    void loss(const double value) {
+        m_loss = value;
+        m_loss_changed = true;
+        notify();
+    }
+
+    void fail(const std::string& error) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = error;
+    }
+
+    void finish() {
+        m_outcome = has_error() ? outcome::failed : (m_cancel ? outcome::cancelled : outcome::done);
+        m_running = false;
+        m_finished = true;
+        notify();
+    }
+
+    bool take_progress(size_t& done, size_t& total) {
+        if(!m_progress_changed.exchange(false)) {
+            return false;
+        }
+        done = m_done;
+        total = m_total;
+        return true;
+    }
+
+    bool take_loss(double& value) {
+        if(!m_loss_changed.exchange(false)) {
+            return false;
+        }
+        value = m_loss;
+        return true;
+    }
+
+    bool take_finished(outcome& result, std::string& error) {
+        if(!m_finished.exchange(false)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        result = m_outcome;
+        error = m_error;
+        return true;
+    }
+
+    // the object is going away, nothing may be notified after this returns
+    void detach() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_notify = nullptr;
+    }
+
+private:
+    void notify() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_notify) {
+            m_notify();
+        }
+    }
+
+    bool has_error() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return !m_error.empty();
+    }
+
+    std::atomic<bool> m_cancel { false };
+    std::atomic<bool> m_running { true };
+    std::atomic<bool> m_finished { false };
+    std::atomic<bool> m_progress_changed { false };
+    std::atomic<bool> m_loss_changed { false };
+    std::atomic<size_t> m_done { 0 };
+    std::atomic<size_t> m_total { 0 };
+    std::atomic<double> m_loss { 0. };
+    std::atomic<outcome> m_outcome { outcome::done };
+    std::function<void()> m_notify;
+    std::string m_error;
+    std::mutex m_mutex;
+};
+
+// what a training job hands back. the model and the scaler it was trained with are published together
+template<class model_type>
+struct trained_model
+{
+    std::unique_ptr<model_type> model { nullptr };
+    std::unique_ptr<mlpack::data::ScalingModel> scaler { nullptr };
+};
+
+/*
+ runs training jobs on a worker thread. a job builds a complete new model on its own
+ copies of the data and never touches the object. when it returns the model is
+ published with an atomic pointer exchange and take() hands it to the object, which
+ keeps using its previous model until then. the thread is detached and shares its
+ state, so freeing the object while training only cancels the job. start runs on the
+ main thread while take and running can be called from matrix_calc, so the state is
+ only swapped and read with atomic loads and stores.
+ */
+template<class model_type>
+class trainer
+{
+public:
+    typedef trained_model<model_type> result_type;
+    typedef std::function<std::unique_ptr<result_type>(training_status&)> job_type;
+
+    ~trainer() {
+        if(auto current = shared()) {
+            current->status.cancel();
+            current->status.detach();
+        }
+    }
+
+    // returns false if a job is still running
+    bool start(job_type job, std::function<void()> notify) {
+        if(running()) {
+            return false;
+        }
+        if(auto previous = shared()) {
+            previous->status.detach();
+        }
+        auto next = std::make_shared<shared_state>(std::move(notify));
+        std::atomic_store_explicit(&m_shared, next, std::memory_order_release);
+
+        std::thread([shared = std::move(next), job = std::move(job)]() {
+            std::unique_ptr<result_type> result;
+            try {
+                result = job(shared->status);
+            } catch (const std::exception& e) {
+                shared->status.fail(e.what());
+            }
+            if(result && !shared->status.cancelled()) {
+                delete shared->result.exchange(result.release());
+                //cancel may have come after the check and before the result was there to drop
+                if(shared->status.cancelled()) {
+                    delete shared->result.exchange(nullptr);
+                }
+            }
+            shared->status.finish();
+        }).detach();
+        return true;
+    }
+
+    // stops a running job and drops a finished model that was not taken yet, so nothing
+    // the job built can be published after this. returns false if there was nothing to cancel
+    bool cancel() {
+        auto current = shared();
+        if(!current) {
+            return false;
+        }
+        const bool was_running = current->status.running();
+        current->status.cancel();
+        std::unique_ptr<result_type> dropped(current->result.exchange(nullptr));
+        return was_running || dropped;
+    }
+
+    bool running() const {
+        auto current = shared();
+        return current && current->status.running();
+    }
+
+    // the finished model, if one was published since the last call. never blocks
+    std::unique_ptr<result_type> take() {
+        auto current = shared();
+        if(!current) {
+            return nullptr;
+        }
+        return std::unique_ptr<result_type>(current->result.exchange(nullptr));
+    }
+
+    // main thread only, the status stays valid until the next start
+    training_status* status() {
+        auto current = shared();
+        return current ? &current->status : nullptr;
+    }
+
+private:
+    struct shared_state {
+        explicit shared_state(std::function<void()> notify) : status(std::move(notify)) {}
+        ~shared_state() { delete result.load(); }
+        training_status status;
+        std::atomic<result_type*> result { nullptr };
+    };
+
+    std::shared_ptr<shared_state> shared() const {
+        return std::atomic_load_explicit(&m_shared, std::memory_order_acquire);
+    }
+
+    std::shared_ptr<shared_state> m_shared { nullptr };
+};
+
+}
@@ -0,0 +1,113 @@
+/// @file worker_pool.cpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#include "worker_pool.hpp"
+
+#include <algorithm>
+
+namespace mlmat {
+
+worker_pool::worker_pool(size_t threads) {
+    resize(threads);
+}
+
+worker_pool::~worker_pool() {
+    stop();
+}
+
+void worker_pool::resize(size_t threads) {
+    threads = std::max<size_t>(threads, 1);
+    if(threads == size()) {
+        return;
+    }
+    stop();
+    m_stop = false;
+    // new threads only wake for runs that start after this, whenever they get going
+    const size_t generation = m_generation;
+    for(size_t i = 1; i < threads; i++) {
+        m_threads.emplace_back([this, generation]() { work(generation); });
+    }
+}
+
+void worker_pool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for(auto& t : m_threads) {
+        t.join();
+    }
+    m_threads.clear();
+}
+
+void worker_pool::drain(const std::function<void(size_t)>& part) {
+    for(size_t i = m_next++; i < m_parts; i = m_next++) {
+        try {
+            part(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(!m_error) {
+                m_error = std::current_exception();
+            }
+        }
+    }
+}
+
+void worker_pool::work(size_t seen) {
+    for(;;) {
+        const std::function<void(size_t)>* part = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]() { return m_stop || m_generation != seen; });
+            if(m_stop) {
+                return;
+            }
+            seen = m_generation;
+            part = m_part;
+        }
+        drain(*part);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(--m_busy == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+}
+
+void worker_pool::run(size_t parts, const std::function<void(size_t)>& part) {
+    if(m_threads.empty() || parts < 2) {
+        for(size_t i = 0; i < parts; i++) {
+            part(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_part = &part;
+        m_parts = parts;
+        m_next = 0;
+        m_error = nullptr;
+        m_busy = m_threads.size();
+        m_generation++;
+    }
+    m_wake.notify_all();
+    drain(part);
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() { return m_busy == 0; });
+        m_part = nullptr;
+        error = m_error;
+        m_error = nullptr;
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}
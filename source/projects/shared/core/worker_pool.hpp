@@ -0,0 +1,64 @@
+/// @file worker_pool.hpp
+/// @ingroup mlmat
+/// @copyright Copyright 2021 Todd Ingalls. All rights reserved.
+/// @license  Use of this source code is governed by the MIT License found in the License.md file.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mlmat {
+
+/*
+ a fixed set of threads for splitting one job into parts. run hands the parts out to
+ the workers and the calling thread and returns once all of them are done. the threads
+ wait between runs, so a run per frame does not start any. one run at a time, and
+ resize must not be called while one is going.
+ */
+class worker_pool {
+public:
+    // threads counts the calling thread, so 1 runs everything on the caller
+    explicit worker_pool(size_t threads = 1);
+    ~worker_pool();
+
+    worker_pool(const worker_pool&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+
+    // does nothing if the pool already has that many threads
+    void resize(size_t threads);
+
+    size_t size() const {
+        return m_threads.size() + 1;
+    }
+
+    // calls part(i) for every i below parts. the first exception a part throws is rethrown once all are done
+    void run(size_t parts, const std::function<void(size_t)>& part);
+
+private:
+    // seen is the run generation the thread was started after
+    void work(size_t seen);
+    void drain(const std::function<void(size_t)>& part);
+    void stop();
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(size_t)>* m_part = nullptr;
+    size_t m_parts = 0;
+    std::atomic<size_t> m_next { 0 };
+    // workers still in the current run
+    size_t m_busy = 0;
+    size_t m_generation = 0;
+    bool m_stop = false;
+    std::exception_ptr m_error { nullptr };
+};
+
+}
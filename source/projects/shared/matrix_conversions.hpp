@@ -8,151 +8,88 @@
 #include <mlpack/core/util/io.hpp>
 
 #include "c74_min.h"
+#include "core/conversions.hpp"
 
-#include <algorithm>
+// jitter side of the conversion layer. the loops themselves live in core/conversions.hpp
+// and work on a mlmat::matrix_desc, these only translate jitter matrices into one.
 
-
-c74::max::t_object* convert_to_float64(c74::max::t_object *matrix, c74::max::t_jit_matrix_info& minfo) {
-    c74::max::t_object *m; // destination matrix
-    if(minfo.type == c74::max::_jit_sym_float64) {
-        return matrix;
+inline mlmat::cell_type jit_cell_type(const c74::max::t_symbol* type) {
+    if(type == c74::max::_jit_sym_char) {
+        return mlmat::cell_type::char8;
+    } else if(type == c74::max::_jit_sym_long) {
+        return mlmat::cell_type::long32;
+    } else if(type == c74::max::_jit_sym_float32) {
+        return mlmat::cell_type::float32;
+    } else if(type == c74::max::_jit_sym_float64) {
+        return mlmat::cell_type::float64;
     }
-    c74::max::t_jit_matrix_info dest_info = minfo;
-    
-    dest_info.type = c74::max::_jit_sym_float64;
-    m = static_cast<c74::max::t_object*>(c74::max::jit_object_new(c74::max::_jit_sym_jit_matrix,&dest_info));
-    c74::max::object_method(m, c74::max::_jit_sym_frommatrix,matrix,NULL);
-    return m;
+    return mlmat::cell_type::unknown;
 }
 
+inline c74::max::t_symbol* jit_type_symbol(const mlmat::cell_type type) {
+    switch(type) {
+        case mlmat::cell_type::char8: return c74::max::_jit_sym_char;
+        case mlmat::cell_type::long32: return c74::max::_jit_sym_long;
+        case mlmat::cell_type::float32: return c74::max::_jit_sym_float32;
+        default: return c74::max::_jit_sym_float64;
+    }
+}
 
-c74::max::t_object* convert_to_long(c74::max::t_object *matrix, c74::max::t_jit_matrix_info& minfo) {
-    c74::max::t_object *m; // destination matrix
-   
-    if(minfo.type == c74::max::_jit_sym_long) {
-        return matrix;
+inline mlmat::matrix_desc jit_matrix_desc(const c74::max::t_jit_matrix_info& minfo, c74::max::uchar* dataptr) {
+    mlmat::matrix_desc desc;
+    desc.type = jit_cell_type(minfo.type);
+    desc.planecount = minfo.planecount;
+    desc.dimcount = minfo.dimcount;
+    for(auto i=0;i<minfo.dimcount && i<mlmat::max_dimcount;i++) {
+        desc.dim[i] = minfo.dim[i];
+        desc.dimstride[i] = minfo.dimstride[i];
     }
-    c74::max::t_jit_matrix_info dest_info = minfo;
-    dest_info.type = c74::max::_jit_sym_long;
-    m = static_cast<c74::max::t_object*>(c74::max::jit_object_new(c74::max::_jit_sym_jit_matrix,&dest_info));
-    c74::max::object_method(m, c74::max::_jit_sym_frommatrix,matrix,NULL);
-    
-    return m;
+    desc.data = dataptr;
+    return desc;
 }
 
-//feel like this template is a little hacky with the coords stuff but keeps other things cleaner
-template <typename M, typename A>
-c74::max::t_jit_err fill_jit_matrix(c74::max::t_object* jitter_matrix, A arma, int mode, bool is_coords = false, long x = 0) {
-    c74::max::uchar *dataptr = nullptr;
-    c74::max::t_jit_err err = c74::max::JIT_ERR_NONE;
-    size_t stepsize = sizeof(M);
+inline mlmat::matrix_desc jit_matrix_desc(const c74::max::t_object* jitter_matrix) {
     c74::max::t_jit_matrix_info minfo;
-    c74::max::uchar *p = nullptr;
-    c74::max::uchar *p2 = nullptr;
-    c74::max::uchar *p1 = nullptr;
-    long aelem = 0;
-    
-    
-    //std::cout << arma << std::endl;
-    
-    err = (c74::max::t_jit_err)c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getinfo,&minfo);
-    err = (c74::max::t_jit_err)c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getdata, &dataptr);
-    
-    switch (mode) {
-        case 0:
-            //if 2 planes and is suppose to contain 2d coords, do the conversion
-            if(is_coords && ((minfo.dimcount == 2) || (minfo.dimcount == 1))) {
-                M pos = 0;
-                for(auto jslice=0;jslice<minfo.dim[2];jslice++) {
-                    p = dataptr + (jslice*minfo.dimstride[2]);
-                    for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                        p2 = p + (jcol*minfo.dimstride[1]);
-                        for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                            p1 = p2 + (jrow*minfo.dimstride[0]);
-                            pos = arma(aelem++);
-                            *(M*)p1 = (M)((long)pos % x);
-                            p1 += stepsize;
-                            *(M*)p1 = (M)((long)pos / x);
-                        }
-                    }
-                }
-                
-            } else if(is_coords && (minfo.dimcount == 3)) {
-                M pos = 0;
-               // std::cout << "is_coords && (minfo.dimcount == 2)" << std::endl;
-                for(auto jslice=0;jslice<minfo.dim[2];jslice++) {
-                    aelem = 0;
-                    p = dataptr + (jslice*minfo.dimstride[2]);
-                    for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                        p2 = p + (jcol*minfo.dimstride[1]);
-                        for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                            p1 = p2 + (jrow*minfo.dimstride[0]);
-                           //00 std::cout << "jslice " << jslice << "aelem " << aelem << std::endl;
-                            pos = arma(jslice, aelem++);
-                            //std::cout << pos << std::endl;
-                            *(M*)p1 = (M)((long)pos % x);
-                            p1 += stepsize;
-                            *(M*)p1 = (M)((long)pos / x);
-                        }
-                    }
-                }
-                
-            } else {
-                for(auto jslice=0;jslice<minfo.dim[2];jslice++) {
-                    aelem = 0;
-                    p = dataptr + (jslice*minfo.dimstride[2]);
-                    // std::cout << "slice " << jslice << " " << (p - dataptr) << std::endl;
-                    for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                        p2 = p +   (jcol*minfo.dimstride[1]);
-                        // std::cout << "  col " << jcol << " " << (p2 - dataptr) << std::endl;
-                        for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                            p1 = p2 + (jrow*minfo.dimstride[0]);
-                            // std::cout << "    row " << jrow << " " << (p1 - dataptr) << std::endl;
-                            for(auto jplane=0;jplane<minfo.planecount;jplane++) {
-                                *(M*)p1 = arma(aelem++);
-                                p1 += stepsize;
-                            }
-                        }
-                    }
-                }
-            }
-            break;
-            
-        case 1:
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    *(M*)p = arma(aelem++);
-                    p += stepsize;
-                }
-            }
-            break;
-            
-        case 2:
-            //stepsize
-//            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-//                p = dataptr + (jcol*minfo.dimstride[1]);
-//                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-//                    *(M*)p = arma(aelem++);
-//                    p += stepsize;
-//                }
-//            }
-
-            for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                p1 = dataptr + (jrow*minfo.dimstride[0]);
-                for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                    p = p1;
-                    *(M*)p = arma(aelem++);
-                    p1 += minfo.dimstride[1];
-                }
-            }
-            break;
-            
-        default:
-            (std::cerr << "could not create matrix" << std::endl);
-            break;
+    c74::max::uchar *dataptr = nullptr;
+    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getinfo, &minfo);
+    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getdata, &dataptr);
+    return jit_matrix_desc(minfo, dataptr);
+}
+
+// calls f with a null pointer to the c type the cells of a jitter matrix are stored as.
+// returns false if the type is not one of char, long, float32 or float64
+template <typename F>
+inline bool jit_type_dispatch(const c74::max::t_symbol* type, F&& f) {
+    return mlmat::type_dispatch(jit_cell_type(type), std::forward<F>(f));
+}
+
+template <typename D, typename S>
+inline void jit_transpose(const c74::max::uchar *src, const long src_stride,
+                          c74::max::uchar *dst, const long dst_stride,
+                          const long rows, const long cols) {
+    mlmat::transpose<D, S>(src, src_stride, dst, dst_stride, rows, cols);
+}
+
+
+// only calls setinfo (and so possibly reallocates) when the output matrix
+// does not already have the type, planecount and dims being asked for
+inline void jit_matrix_setinfo_if_changed(c74::max::t_object* jitter_matrix, c74::max::t_jit_matrix_info& minfo) {
+    c74::max::t_jit_matrix_info current;
+    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getinfo, &current);
+
+    bool same = (current.type == minfo.type) && (current.planecount == minfo.planecount) && (current.dimcount == minfo.dimcount);
+    for(auto i=0;same && i<minfo.dimcount;i++) {
+        same = (current.dim[i] == minfo.dim[i]);
     }
-    return err;
+    if(!same) {
+        c74::max::object_method(jitter_matrix, c74::max::_jit_sym_setinfo, &minfo);
+    }
+}
+
+template <typename M, typename A>
+c74::max::t_jit_err fill_jit_matrix(c74::max::t_object* jitter_matrix, const A& arma, int mode, bool is_coords = false, long x = 0) {
+    mlmat::fill_matrix<M>(jit_matrix_desc(jitter_matrix), arma, mode, is_coords, x);
+    return c74::max::JIT_ERR_NONE;
 }
 
 
@@ -174,7 +111,6 @@ c74::max::t_object* arma_to_jit(const int mode,
                       const long x = 0) {
 //    c74::max::t_jit_err err = c74::max::JIT_ERR_NONE;
     c74::max::t_jit_matrix_info minfo;
-    c74::max::t_object* tmp_matrix = nullptr;
     
     minfo = target_info;
     minfo.type = c74::max::_jit_sym_float64;
@@ -213,18 +149,15 @@ c74::max::t_object* arma_to_jit(const int mode,
             break;
     }
     
-    tmp_matrix = static_cast<c74::max::t_object*>(c74::max::jit_object_new(c74::max::_jit_sym_jit_matrix,&minfo));
-    if(!tmp_matrix) {
+    if(!jitter_matrix) {
         (std::cerr << "could not create matrix" << std::endl);
         return jitter_matrix;
     }
-    
-    fill_jit_matrix<double, arma::Row<double>>(tmp_matrix, arma, mode, is_coords, x);
-    
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_setinfo,&minfo);
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_frommatrix,tmp_matrix,nullptr);
 
-    c74::max::jit_object_free(tmp_matrix);
+    //write straight into the output, it is only resized when the layout changes
+    jit_matrix_setinfo_if_changed(jitter_matrix, minfo);
+    fill_jit_matrix<double, arma::Row<double>>(jitter_matrix, arma, mode, is_coords, x);
+
     return jitter_matrix;
 }
 
@@ -237,7 +170,6 @@ c74::max::t_object* arma_to_jit(const int mode,
                                 const long x = 0) {
 
     c74::max::t_jit_matrix_info minfo;
-    c74::max::t_object* tmp_matrix = nullptr;
     
     minfo.type = c74::max::_jit_sym_long;
     minfo.flags = 0;
@@ -281,21 +213,14 @@ c74::max::t_object* arma_to_jit(const int mode,
             //cerr << "invalid mode for object" << endl;
     }
     
-    //create temporary matrix
-    tmp_matrix = static_cast<c74::max::t_object*>(c74::max::jit_object_new(c74::max::_jit_sym_jit_matrix,&minfo));
-    if(!tmp_matrix) {
+    if(!jitter_matrix) {
         //cerr << "could not create matrix" << endl;
         return jitter_matrix;
     }
-    
-    fill_jit_matrix<c74::max::t_int32, arma::Row<size_t>>(tmp_matrix, arma, mode,is_coords, x);
-    
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_setinfo,&minfo);
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_frommatrix,tmp_matrix,nullptr);
-    
-    jit_object_free(tmp_matrix);
-    
-    
+
+    jit_matrix_setinfo_if_changed(jitter_matrix, minfo);
+    fill_jit_matrix<c74::max::t_int32, arma::Row<size_t>>(jitter_matrix, arma, mode,is_coords, x);
+
     return jitter_matrix;
     
 }
@@ -308,7 +233,6 @@ c74::max::t_object* arma_to_jit(const int mode,
                       const long x = 0) {
     //c74::max::t_jit_err err = c74::max::JIT_ERR_NONE;
     c74::max::t_jit_matrix_info minfo;
-    c74::max::t_object* tmp_matrix = nullptr;
     
     minfo.type = c74::max::_jit_sym_float64;
     minfo.flags = 0;
@@ -352,18 +276,13 @@ c74::max::t_object* arma_to_jit(const int mode,
             break;
     }
     
-    //create temporary matrix
-    tmp_matrix = static_cast<c74::max::t_object*>(c74::max::jit_object_new(c74::max::_jit_sym_jit_matrix,&minfo));
-    if(!tmp_matrix) {
+    if(!jitter_matrix) {
         //cerr << "could not create matrix" << endl;
         return jitter_matrix;
     }
-    
-    fill_jit_matrix<double, arma::Mat<double>>(tmp_matrix, arma, mode, is_coords, x);
-    
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_setinfo,&minfo);
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_frommatrix,tmp_matrix,nullptr);
-    c74::max::jit_object_free(tmp_matrix);
+
+    jit_matrix_setinfo_if_changed(jitter_matrix, minfo);
+    fill_jit_matrix<double, arma::Mat<double>>(jitter_matrix, arma, mode, is_coords, x);
     return jitter_matrix;
 }
 
@@ -375,7 +294,6 @@ c74::max::t_object* arma_to_jit(const int mode,
                       const long x = 0) {
     //c74::max::t_jit_err err = c74::max::JIT_ERR_NONE;
     c74::max::t_jit_matrix_info minfo;
-    c74::max::t_object* tmp_matrix = nullptr;
     
     
     minfo.type = c74::max::_jit_sym_long;
@@ -422,388 +340,77 @@ c74::max::t_object* arma_to_jit(const int mode,
             break;
     }
     
-    //create temporary matrix
-    tmp_matrix = static_cast<c74::max::t_object*>(c74::max::jit_object_new(c74::max::_jit_sym_jit_matrix,&minfo));
-    if(!tmp_matrix) {
+    if(!jitter_matrix) {
         //cerr << "could not create matrix" << endl;
         return jitter_matrix;
     }
-    
-    fill_jit_matrix<c74::max::t_int32, arma::Mat<size_t>>(tmp_matrix, arma, mode, is_coords, x);
-    
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_setinfo,&minfo);
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_frommatrix,tmp_matrix,nullptr);
-    c74::max::jit_object_free(tmp_matrix);
+
+    jit_matrix_setinfo_if_changed(jitter_matrix, minfo);
+    fill_jit_matrix<c74::max::t_int32, arma::Mat<size_t>>(jitter_matrix, arma, mode, is_coords, x);
     return jitter_matrix;
 }
 
 
+
+// lets an input of a mop that was set up with jit_mop_single_type receive any type
+// without jitter converting it first. jit_to_arma does the conversion while reading.
+inline void jit_mop_input_all_types(c74::max::t_object* mop, const long index) {
+    c74::max::t_atom types[4];
+    auto input = c74::max::object_method(mop, c74::max::_jit_sym_getinput, index);
+
+    c74::max::atom_setsym(types, c74::max::_jit_sym_char);
+    c74::max::atom_setsym(types + 1, c74::max::_jit_sym_long);
+    c74::max::atom_setsym(types + 2, c74::max::_jit_sym_float32);
+    c74::max::atom_setsym(types + 3, c74::max::_jit_sym_float64);
+    c74::max::object_method_typed(input, c74::max::_jit_sym_types, 4, types, NULL);
+}
+
+
+
 arma::mat& jit_to_arma(const int mode,
                        const c74::max::t_object *jitter_matrix,
                        arma::Mat<double>& arma_matrix ) {
-    /* this is not optimized for speed */
-    c74::max::t_jit_matrix_info minfo;
-    //c74::max::t_jit_err err = c74::max::JIT_ERR_NONE;
-    c74::max::uchar *dataptr = nullptr;
-    c74::max::uchar *p = nullptr;
-    c74::max::uchar *p1 = nullptr;
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getinfo, &minfo);
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getdata, &dataptr);
-    
-    if(minfo.type != c74::max::_jit_sym_float64) {
-        //ERROR FOR NOW
-        return arma_matrix;
-    }
-    
-    if(minfo.dimcount == 1) { minfo.dim[1] = 1;} //for loops
-    
-    arma_matrix.set_size(minfo.planecount , minfo.dim[0]*minfo.dim[1]);
-    
-    long alem = 0;
-    
-    switch(mode) {
-        case 0:
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    p1 = p + (jrow*minfo.dimstride[0]);
-                    for(auto jplane=0;jplane<minfo.planecount;jplane++) {
-                        arma_matrix(alem++) = *(double*)p1;
-                        
-                        p1 += sizeof(double);
-                    }
-                }
-            }
-            break;
-            
-        case 1:
-            arma_matrix.set_size(minfo.dim[0], minfo.dim[1]);
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    arma_matrix(jrow, jcol) = *(double*)p;
-                    p += sizeof(double);
-                }
-            }
-            break;
-            
-        case 2:
-            //TODO: compare doing same as in mode 1 and then
-            //transposing the arma mat
-            // Will catch earlier if not a 1d or 2d matrix and not 1 plane
-            arma_matrix.set_size(minfo.dim[1],  minfo.dim[0]);
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    arma_matrix(jcol, jrow) = *(double*)p;
-                    p += sizeof(double);
-                }
-            }
-        default:
-            break;
-            
-    }
-    return arma_matrix;
+    return mlmat::to_arma(mode, jit_matrix_desc(jitter_matrix), arma_matrix);
+}
+
+
+/*
+ same as jit_to_arma but in mode 1 a packed float64 matrix is not copied. arma_matrix
+ is pointed at the jitter data instead, so it is only valid while the jitter matrix
+ is locked and must be treated as read only. anything else falls back to a copy.
+ */
+arma::mat& jit_to_arma_view(const int mode,
+                            const c74::max::t_object *jitter_matrix,
+                            arma::Mat<double>& arma_matrix) {
+    return mlmat::to_arma_view(mode, jit_matrix_desc(jitter_matrix), arma_matrix);
 }
 
 arma::Mat<size_t>& jit_to_arma(const int mode,
                                const c74::max::t_object *jitter_matrix,
                                arma::Mat<size_t>& arma_matrix ) {
-    /* this is not optimized for speed */
-    c74::max::t_jit_matrix_info minfo;
-//c74::max::t_jit_err err = c74::max::JIT_ERR_NONE;
-    c74::max::uchar *dataptr = nullptr;
-    c74::max::uchar *p = nullptr;
-    c74::max::object_method((c74::max::t_object*)jitter_matrix, c74::max::_jit_sym_getinfo, &minfo);
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getdata, &dataptr);
-    
-    if(minfo.type != c74::max::_jit_sym_long) {
-        //ERROR FOR NOW
-        return arma_matrix;
-    }
-    
-    if(minfo.dimcount == 1) { minfo.dim[1] = 1;} //for loops
-    
-    arma_matrix.set_size(minfo.planecount , minfo.dim[0]*minfo.dim[1]);
-    
-    long acol = 0;
-    
-    
-    switch(mode) {
-        case 0:
-            arma_matrix.resize(minfo.planecount,  minfo.dim[0]*minfo.dim[1]);
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    size_t *colptr = arma_matrix.colptr(acol++);
-                    for(auto jplane=0;jplane<minfo.planecount;jplane++) {
-                        *colptr++ = *(c74::max::t_int32*)p;
-                        p += sizeof(c74::max::t_int32);
-                    }
-                }
-            }
-            break;
-            
-        case 1:
-            arma_matrix.resize(minfo.dim[0], minfo.dim[1]);
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    arma_matrix(jrow, jcol) = *(c74::max::t_int32*)p;
-                    p += sizeof(c74::max::t_int32);
-                }
-            }
-            break;
-            
-        case 2:
-            //TODO: compare doing same as in mode 1 and then
-            //transposing the arma mat
-            // Will catch earlier if not a 1d or 2d matrix and not 1 plane
-            arma_matrix.resize(minfo.dim[1],  minfo.dim[0]);
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    arma_matrix(jcol, jrow) = *(c74::max::t_int32*)p;
-                    p += sizeof(c74::max::t_int32);
-                }
-            }
-        default:
-            break;
-            
-    }
-    return arma_matrix;
+    return mlmat::to_arma(mode, jit_matrix_desc(jitter_matrix), arma_matrix);
 }
 
+//think that the plane should be limited to 1
 arma::Row<size_t>& jit_to_arma(const int mode,
-                                 c74::max::t_object *jitter_matrix,
+                               c74::max::t_object *jitter_matrix,
                                arma::Row<size_t>& arma_row ) {
-    /* this is not optimized for speed */
-    c74::max::t_jit_matrix_info minfo;
-    //c74::max::t_jit_err err = c74::max::JIT_ERR_NONE;
-    c74::max::uchar *dataptr = nullptr;
-    c74::max::uchar *p = nullptr;
-    c74::max::uchar *p1 = nullptr;
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getinfo, &minfo);
-    c74::max::object_method(jitter_matrix, c74::max:: _jit_sym_getdata, &dataptr);
-    
-    if(minfo.type != c74::max::_jit_sym_long) {
-        //ERROR FOR NOW
-        return arma_row;
-    }
-    
-    //think that the plane should be limited to 1
-    
-    if(minfo.dimcount == 1) { minfo.dim[1] = 1;} //for loops
-    
-    arma_row.set_size(minfo.dim[0]*minfo.dim[1]);
-    
-    long arow = 0;
-    
-    switch(mode) {
-        case 0:
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    p1 = p + (jrow*minfo.dimstride[0]);
-                    for(auto jplane=0;jplane<minfo.planecount;jplane++) {
-                        arma_row(arow++) = *(c74::max::t_int32*)p1;
-                        p1 += sizeof(c74::max::t_int32);
-                    }
-                }
-            }
-            break;
-            
-        case 1:
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    arma_row(arow++) = *(c74::max::t_int32*)p;
-                    p += sizeof(c74::max::t_int32);
-                }
-            }
-            break;
-            
-        case 2:
-            //TODO: compare doing same as in mode 1 and then
-            //transposing the arma mat
-            // Will catch earlier if not a 1d or 2d matrix and not 1 plane
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    arma_row(arow++) = *(c74::max::t_int32*)p;
-                    p += sizeof(c74::max::t_int32);
-                }
-            }
-        default:
-            break;
-            
-    }
-    return arma_row;
+    return mlmat::to_arma(mode, jit_matrix_desc(jitter_matrix), arma_row);
 }
 
-/// TODO: The jit matrix iter is wrong here!!!
 arma::Col<arma::uword>& jit_to_arma(const int mode,
                                     const c74::max::t_object *jitter_matrix,
                                     arma::Col<arma::uword>& arma_col) {
-    /* this is not optimized for speed */
-    c74::max::t_jit_matrix_info minfo;
-    //c74::max::t_jit_err err = c74::max::JIT_ERR_NONE;
-    c74::max::uchar *dataptr = nullptr;
-    c74::max::uchar *p = nullptr;
-    c74::max::uchar *p1 = nullptr;
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getinfo, &minfo);
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getdata, &dataptr);
-    
-    if(minfo.type != c74::max::_jit_sym_long) {
-        //ERROR FOR NOW
-        return arma_col;
-    }
-    
-    if(minfo.dimcount == 1) { minfo.dim[1] = 1;}
-    
-    arma_col.set_size(minfo.dim[0]*minfo.dim[1]);
-    
-    long acol = 0;
-    long alem = 0;
-    // t_int32 pos = 0;
-    switch(mode) {
-        case 0:
-            
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    p1 = p + (jrow*minfo.dimstride[0]);
-                    for(auto jplane=0;jplane<minfo.planecount;jplane++) {
-                        arma_col(alem++) = *(c74::max::t_int32*)p1;
-                        p1 += sizeof(c74::max::t_int32);
-                    }
-                }
-            }
-            
-            break;
-            
-        case 1:
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    arma_col(acol++) = *(c74::max::t_int32*)p;
-                    p += sizeof(c74::max::t_int32);
-                }
-            }
-            break;
-            
-        case 2:
-            //TODO: compare doing same as in mode 1 and then
-            //transposing the arma mat
-            // Will catch earlier if not a 1d or 2d matrix and not 1 plane
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    arma_col(acol++) = *(c74::max::t_int32*)p;
-                    p += sizeof(c74::max::t_int32);
-                }
-            }
-        default:
-            break;
-            
-    }
-    return arma_col;
+    return mlmat::to_arma(mode, jit_matrix_desc(jitter_matrix), arma_col);
 }
 
 
-
-
+// reads cells as long, clamped to the range of the matrix being looked up into.
+// in mode 0 a 2 plane matrix holds x/y coords which are turned into a single index
 arma::Col<arma::uword>& jit_to_arma_limit(const int mode,
                                           const c74::max::t_object *jitter_matrix,
                                           arma::Col<arma::uword>& arma_col,
-                                 c74::max::t_int32 max_x,
-                                    c74::max::t_int32 max_y) {
-    /* this is not optimized for speed */
-    c74::max::t_jit_matrix_info minfo;
-    //c74::max::t_jit_err err = c74::max::JIT_ERR_NONE;
-    c74::max::uchar *dataptr = nullptr;
-    c74::max::uchar *p = nullptr;
-    c74::max::uchar *p1 = nullptr;
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getinfo, &minfo);
-    c74::max::object_method(jitter_matrix, c74::max::_jit_sym_getdata, &dataptr);
-    
-    if(minfo.type != c74::max::_jit_sym_long) {
-        //ERROR FOR NOW
-        return arma_col;
-    }
-    
-    if(minfo.dimcount == 1) { minfo.dim[1] = 1;}
-    
-    arma_col.set_size(minfo.dim[0]*minfo.dim[1]);
-    
-    long acol = 0;
-    long alem = 0;
-    // t_int32 pos = 0;
-    switch(mode) {
-        case 0:
-            if(minfo.planecount == 1) {
-                c74::max::t_int32 m = (max_x * max_y)-1;
-                for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                    p = dataptr + (jcol*minfo.dimstride[1]);
-                    for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                        p1 = p + (jrow*minfo.dimstride[0]);
-                        for(auto jplane=0;jplane<minfo.planecount;jplane++) {
-                            c74::max::t_int32 d = *(c74::max::t_int32*)p1;
-                            d = std::clamp(d, 0, m);
-                            arma_col(alem++) = d;
-                            p1 += sizeof(c74::max::t_int32);
-                        }
-                    }
-                }
-            } else if (minfo.planecount == 2) {
-                for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                    p = dataptr + (jcol*minfo.dimstride[1]);
-                    for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                        
-                        c74::max::t_int32 xpos = *(c74::max::t_int32*)p;
-                        xpos = std::clamp(xpos, 0, max_x-1);
-                        
-                        p += sizeof(c74::max::t_int32);
-                        c74::max::t_int32 ypos = *(c74::max::t_int32*)p;
-                        ypos = std::clamp(ypos, 0, max_y-1);
-                        p += sizeof(c74::max::t_int32);
-                        
-                        ypos *= max_x;//
-                        arma_col(acol++) =  xpos + ypos;
-                    }
-                }
-            } else {
-                //ERROR
-            }
-            break;
-            
-        case 1:
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    c74::max::t_int32 tmp = *(c74::max::t_int32*)p; //added to stop VS from complaining
-                    arma_col(acol++) = std::clamp(tmp, 0, (max_y)-1);;
-                    p += sizeof(c74::max::t_int32);
-                }
-            }
-            break;
-            
-        case 2:
-            //TODO: compare doing same as in mode 1 and then
-            //transposing the arma mat
-            // Will catch earlier if not a 1d or 2d matrix and not 1 plane
-            for(auto jcol=0;jcol<minfo.dim[1];jcol++) {
-                p = dataptr + (jcol*minfo.dimstride[1]);
-                for(auto jrow=0;jrow<minfo.dim[0];jrow++) {
-                    c74::max::t_int32 tmp = *(c74::max::t_int32*)p; //added to stop VS from complaining
-                    arma_col(acol++) = std::clamp(tmp,0, (max_x)-1);
-                    p += sizeof(c74::max::t_int32);
-                }
-            }
-        default:
-            break;
-            
-    }
-    return arma_col;
+                                          c74::max::t_int32 max_x,
+                                          c74::max::t_int32 max_y) {
+    return mlmat::to_arma_limit(mode, jit_matrix_desc(jitter_matrix), arma_col, max_x, max_y);
 }
-
@@ -41,14 +41,7 @@ inline void check_mode(const c74::max::t_jit_matrix_info& minfo,
                        const std::string& callerDescription,
                        const std::string& addInfo = "matrix")
 {
-    if(mode > 0) {
-        if(minfo.planecount > 1) {
-            std::ostringstream oss;
-            oss << callerDescription << ": number of planes (" << minfo.planecount << ") in matrix "
-            << "is not valid in mode "  << mode << ". Expecting 1 plane!";
-            throw std::invalid_argument(oss.str());
-        }
-    }
+    mlmat::check_mode(minfo.planecount, mode, callerDescription);
 }
 
 
@@ -6,6 +6,15 @@
 //#include <mlpack/core/util/io.hpp>
 #include <mlpack/methods/preprocess/scaling_model.hpp>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
 
 // retrieve maxob from jitter obj
 c74::max::t_object* maxob_from_jitob(c74::max::t_object* job) {
@@ -15,41 +24,81 @@ c74::max::t_object* maxob_from_jitob(c74::max::t_object* job) {
 }
 
 
+// the file named by args, or one picked in a save dialog. false if the dialog was cancelled
+inline bool save_file_path(const c74::min::atoms& args, std::string& out) {
+    short path = 0;
+    char filename[c74::max::MAX_FILENAME_CHARS] = { 0 };
+    char fullpath[c74::max::MAX_PATH_CHARS] = { 0 };
+    char native_path[c74::max::MAX_PATH_CHARS] = { 0 };
+
+    if (!args.empty()) {
+        std::string name = std::string(args[0]);
+        path = c74::max::path_getdefault();
+        strncpy_zero(filename, name.c_str(), c74::max::MAX_FILENAME_CHARS);
+    }
+    else if (c74::max::saveas_dialog(filename, &path, NULL)) {
+        return false;
+    }
+    c74::max::path_toabsolutesystempath(path, filename, fullpath);
+    c74::max::path_nameconform(fullpath, native_path, c74::max::PATH_STYLE_NATIVE, c74::max::PATH_TYPE_PATH);
+    out = fullpath;
+    return true;
+}
+
+
+// the file named by args, or one picked in an open dialog. false if it was not found or the dialog was cancelled
+inline bool load_file_path(const c74::min::atoms& args, std::string& out) {
+    c74::min::atoms f{};
+
+    if (!args.empty()) {
+        f.push_back(args[0]);
+    }
+    c74::min::path p {f, c74::min::path::filetype::any};
+
+    if (!p) {
+        return false;
+    }
+    out = std::string(p);
+    return true;
+}
+
+
+// saves anything mlpack can serialize to the file named by args or picked in a save dialog
+template<typename ObjectType>
+inline void save_object_file(const c74::min::atoms& args,
+    const ObjectType& object,
+    const std::string& description) {
+    std::string fullpath;
+    if (save_file_path(args, fullpath)) {
+        try {
+            mlpack::data::Save(fullpath, description, object, true);
+        }
+        catch (const std::runtime_error& s) {
+            std::throw_with_nested(std::runtime_error("Error writing model file to disk."));
+        }
+    }
+}
+
+
+template<typename ObjectType>
+inline void load_object_file(const std::string& path,
+    const std::string& description,
+    ObjectType& object) {
+    try {
+        mlpack::data::Load(path, description, object, true);
+    }
+    catch (const std::runtime_error& s) {
+        std::throw_with_nested(std::runtime_error("Error reading model file to disk."));
+    }
+}
+
+
 template<typename ModelType>
 inline void save_model_file(const c74::min::atoms& args,
     const ModelType& model,
     const std::string& model_description) {
     if (model.model) {
-        short path = 0;
-        char filename[c74::max::MAX_FILENAME_CHARS] = { 0 };
-        char fullpath[c74::max::MAX_PATH_CHARS] = { 0 };
-        char native_path[c74::max::MAX_PATH_CHARS] = { 0 };
-
-        if (!args.empty()) {
-            std::string name = std::string(args[0]);
-            path = c74::max::path_getdefault();
-            strncpy_zero(filename, name.c_str(), c74::max::MAX_FILENAME_CHARS);
-            c74::max::path_toabsolutesystempath(path, filename, fullpath);
-            c74::max::path_nameconform(fullpath, native_path, c74::max::PATH_STYLE_NATIVE, c74::max::PATH_TYPE_PATH);
-            try {
-                mlpack::data::Save(std::string(fullpath), model_description, model, true);
-            }
-            catch (const std::runtime_error& s) {
-                std::throw_with_nested(std::runtime_error("Error writing model file to disk."));
-            }
-        }
-        else {
-            if (!c74::max::saveas_dialog(filename, &path, NULL)) {
-                c74::max::path_toabsolutesystempath(path, filename, fullpath);
-                c74::max::path_nameconform(fullpath, native_path, c74::max::PATH_STYLE_NATIVE, c74::max::PATH_TYPE_PATH);
-                try {
-                    mlpack::data::Save(std::string(fullpath), model_description, model, true);
-                }
-                catch (const std::runtime_error& s) {
-                    std::throw_with_nested(std::runtime_error("Error writing model file to disk."));
-                }
-            }
-        }
+        save_object_file(args, model, model_description);
     }
     else {
         throw std::runtime_error("No trained model to save!");
@@ -58,6 +107,9 @@ inline void save_model_file(const c74::min::atoms& args,
 
 
 #include "matrix_conversions.hpp"
+#include "core/result_cache.hpp"
+#include "core/scaler.hpp"
+#include "core/trainer.hpp"
 
 template<class class_type>
 class mlmat_serializable_model
@@ -70,6 +122,26 @@ public:
     long dim0 = 0;//this is lame but cant see how else to do this. only needed for mode 0 with 2d reference matrix
     long dimcount = 1; //the horror
     bool autoscale = false;
+    // only used by knn and kfn and not saved. the scaled reference set in input order, kept so the tree
+    // can be rebuilt with the same indices or written with write_mapped (possibly a mapping of such a
+    // file), and the points appended since it was built. appended is the one thing swapped on a
+    // published version, always with atomic_load/atomic_store
+    std::shared_ptr<const arma::mat> reference { nullptr };
+    std::shared_ptr<const arma::mat> appended { nullptr };
+
+    mlmat_serializable_model() {}
+
+    // deep copy for writers that add to a published model. only instantiated where it is used
+    mlmat_serializable_model(const mlmat_serializable_model& other) :
+        model(other.model ? std::make_unique<class_type>(*other.model) : nullptr),
+        scaler(other.scaler ? std::make_unique<mlpack::data::ScalingModel>(*other.scaler) : nullptr),
+        scaler_changed(other.scaler_changed),
+        dim0(other.dim0),
+        dimcount(other.dimcount),
+        autoscale(other.autoscale),
+        reference(other.reference),
+        appended(std::atomic_load(&other.appended)) {}
+
     template<typename Archive>
 
     void serialize(Archive& ar, const uint32_t /* version */)
@@ -84,6 +156,148 @@ public:
     }
 };
 
+/*
+ read-copy-update handle for the model of an object. matrix_calc takes a snapshot
+ without locking anything the writers hold and uses it for the whole frame. read,
+ train and clear publish a complete new version instead of changing the current one,
+ and a replaced version is freed when the last snapshot of it goes away. a published
+ version is never modified, writers that add to a model publish a changed copy.
+ */
+template<class class_type>
+class mlmat_model_handle
+{
+public:
+    typedef mlmat_serializable_model<class_type> version_type;
+    typedef std::shared_ptr<version_type> pointer;
+
+    // never null, but its model is until something has been trained or read
+    pointer snapshot() const {
+        return std::atomic_load_explicit(&m_current, std::memory_order_acquire);
+    }
+
+    void publish(pointer next) {
+        if(!next) {
+            next = std::make_shared<version_type>();
+        }
+        std::atomic_store_explicit(&m_current, std::move(next), std::memory_order_release);
+        m_generation++;
+    }
+
+    void clear() {
+        publish(nullptr);
+    }
+
+    // for writers that swap appended on the published version
+    void changed() {
+        m_generation++;
+    }
+
+    // goes up after every publish and change, so one read before a snapshot is never newer than it
+    size_t generation() const {
+        return m_generation;
+    }
+
+private:
+    pointer m_current { std::make_shared<version_type>() };
+    std::atomic<size_t> m_generation { 0 };
+};
+
+
+/*
+ per object buffers for matrix_calc. they persist across frames so armadillo only
+ goes to the heap when a buffer has to grow (set_size and assignment reuse memory
+ that already fits). begin_frame/end_frame bracket a matrix_calc and count the
+ buffers that had to be (re)allocated, which can be queried with the allocations message.
+ */
+class mlmat_scratch
+{
+public:
+    arma::mat query;
+    arma::mat scaled_query;
+    arma::mat results;
+    arma::mat distances;
+    arma::Mat<size_t> indices;
+    arma::Row<double> values;
+    arma::Row<double> log_values;
+    arma::Row<size_t> labels;
+    arma::Col<arma::uword> lookup;
+
+    size_t frame_allocations = 0;
+    size_t total_allocations = 0;
+
+    void begin_frame() {
+        size_t i = 0;
+        for_each([&](auto& m) {
+            //a view of last frame's jitter data must not be written through
+            if(m.mem_state == 1) {
+                m.reset();
+            }
+            m_mem[i++] = m.memptr();
+        });
+    }
+
+    void end_frame() {
+        size_t i = 0;
+        frame_allocations = 0;
+        for_each([&](auto& m) {
+            //n_alloc is zero for views and for armadillo's small local storage
+            if(m.mem_state == 0 && m.n_alloc > 0 && m.memptr() != m_mem[i]) {
+                frame_allocations++;
+            }
+            i++;
+        });
+        total_allocations += frame_allocations;
+    }
+
+    void report(void* outlet) const {
+        c74::max::t_atom a[2];
+        c74::max::atom_setlong(a, frame_allocations);
+        c74::max::atom_setlong(a+1, total_allocations);
+        c74::max::outlet_anything(outlet, c74::max::gensym("allocations"), 2, a);
+    }
+
+private:
+    template<typename F>
+    void for_each(F&& f) {
+        f(query); f(scaled_query); f(results); f(distances); f(indices);
+        f(values); f(log_values); f(labels); f(lookup);
+    }
+
+    const void* m_mem[9] {};
+};
+
+// the training worker is in core so mlmat_check can run it without max
+typedef mlmat::training_status mlmat_training_status;
+
+template<class model_type>
+using mlmat_trained_model = mlmat::trained_model<model_type>;
+
+template<class model_type>
+using mlmat_trainer = mlmat::trainer<model_type>;
+
+// the scaler attributes as they were when training was started, so a job never reads attributes
+struct mlmat_scaler_settings
+{
+    bool autoscale = false;
+    std::string type;
+    int min = 0;
+    int max = 1;
+    double epsilon = 0.;
+
+    // fits a new scaler to data and returns the scaled data, or data itself when autoscale is off
+    arma::mat& fit_transform(std::unique_ptr<mlpack::data::ScalingModel>& scaler, arma::mat& data, arma::mat& output) const {
+        scaler.reset();
+        if(autoscale) {
+            scaler = mlmat::make_scaler(type, min, max, epsilon);
+        }
+        if(!scaler) {
+            return data;
+        }
+        scaler->Fit(data);
+        return mlmat::scaler_transform(scaler.get(), data, output);
+    }
+};
+
 template<class min_class_type, c74::min::threadsafe threadsafety = c74::min::threadsafe::no>
 class mlmat_object :  public c74::min::object<min_class_type>, public c74::min::matrix_operator<> {
 public:
@@ -112,10 +326,17 @@ public:
     }
     
     
+    c74::min::message<> allocations {this, "allocations", "Outputs the number of scratch buffer allocations made by the last frame and since the object was created via dump outlet.",
+        MIN_FUNCTION {
+            m_scratch.report(m_dumpoutlet);
+            return {};
+    }};
+    
 protected:
     
     bool m_mode_changed = true;
     void* m_dumpoutlet { nullptr };
+    mlmat_scratch m_scratch;
 private:
     mlmat_object() {};
     friend min_class_type;
@@ -196,8 +417,7 @@ public:
         MIN_FUNCTION {
             using namespace c74::min;
             try {
-                m_model.autoscale = autoscale;
-                save_model_file(args, m_model, std::string(classname()));
+                save_model_file(args, *m_model.snapshot(), std::string(classname()));
             } catch (const std::runtime_error& s) {
                 cerr << s.what() << endl;
             }
@@ -210,7 +430,7 @@ public:
             using namespace c74::min;
             try {
                 load_model_file(args);
-                autoscale = m_model.autoscale;
+                autoscale = m_model.snapshot()->autoscale;
                 m_mode_changed = false;
             } catch (const std::runtime_error& s) {
                 cerr << s.what() << endl;
@@ -222,20 +442,12 @@ public:
     
     
     void load_model_file(const c74::min::atoms& args) {
-        c74::min::atoms f{};
-        
-        if(!args.empty()) {
-            f.push_back(args[0]);
-        }
-        
-        c74::min::path p {f, c74::min::path::filetype::any};
+        std::string path;
         
-        if(p) {
-            try {
-                mlpack::data::Load(std::string(p), classname(), m_model, true);
-            } catch (const std::runtime_error& s) {
-                std::throw_with_nested(std::runtime_error("Error reading model file to disk."));
-            }
+        if(load_file_path(args, path)) {
+            auto next = std::make_shared<model_version>();
+            load_object_file(path, std::string(classname()), *next);
+            m_model.publish(std::move(next));
         }
     }
     
@@ -250,36 +462,21 @@ public:
     
     template<typename ModelType>
     void scaler_fit(ModelType& s, arma::Mat<double>& arma_matrix) {
-        const std::string scalertype_string = scaler.get().c_str();
-        
         if(autoscale) {
-            s.scaler = std::make_unique<mlpack::data::ScalingModel>(scaler_min, scaler_max, scaler_epsilon);
-            if(scalertype_string == "standard") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::STANDARD_SCALER;
-            } else if(scalertype_string == "min_max") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::MIN_MAX_SCALER;
-            } else if(scalertype_string == "normalization") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::MEAN_NORMALIZATION;
-            } else if(scalertype_string == "abs") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::MAX_ABS_SCALER;
-            } else if(scalertype_string == "pca_whitening") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::PCA_WHITENING;
-            } else if(scalertype_string == "zca_whitening") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::PCA_WHITENING;
+            s.scaler = mlmat::make_scaler(scaler.get().c_str(), scaler_min, scaler_max, scaler_epsilon);
+            if(s.scaler) {
+                s.scaler->Fit(arma_matrix);
             }
-            s.scaler->Fit(arma_matrix);
         }
     }
     
     template<typename ModelType>
     arma::mat& scaler_transform(ModelType& s, arma::Mat<double>& input, arma::Mat<double> &output) {
         if(autoscale) {
-            try {
-                s.scaler->Transform(input, output);
-            } catch (const std::runtime_error& s) {
-                std::throw_with_nested(std::runtime_error("Fit must be called before transform"));
+            if(!s.scaler) {
+                throw std::runtime_error("Fit must be called before transform");
             }
-            return output;
+            return mlmat::scaler_transform(s.scaler.get(), input, output);
         } else {
             return input;
         }
@@ -288,8 +485,7 @@ public:
     template<typename ModelType>
     arma::mat& scaler_inverse_transform(ModelType& s, arma::Mat<double>& input, arma::Mat<double> &output) {
         if(autoscale) {
-            s.scaler->InverseTransform(input, output);
-            return output;
+            return mlmat::scaler_inverse_transform(s.scaler.get(), input, output);
         } else {
             return input;
         }
@@ -303,11 +499,26 @@ public:
             return {};
     }};
     
+    c74::min::message<> allocations {this, "allocations", "Outputs the number of scratch buffer allocations made by the last frame and since the object was created via dump outlet.",
+        MIN_FUNCTION {
+            m_scratch.report(m_dumpoutlet);
+            return {};
+    }};
+    
 protected:
+    typedef mlmat_serializable_model<model_type> model_version;
+    
+    // publishes a version built by this object, recording whether it was scaled
+    void publish_model(std::shared_ptr<model_version> next) {
+        next->autoscale = autoscale;
+        m_model.publish(std::move(next));
+    }
+    
     bool m_mode_changed = true;
     bool m_scaler_changed = true;
     void* m_dumpoutlet { nullptr };
-    mlmat_serializable_model<model_type> m_model;
+    mlmat_model_handle<model_type> m_model;
+    mlmat_scratch m_scratch;
 };
 
 
@@ -386,11 +597,11 @@ public:
         MIN_FUNCTION {
             using namespace c74::min;
             try {
-                m_model.autoscale = autoscale;
+                adopt_trained_model();
                 c74::min::symbol c = classname();
                 const char* buf = (const char*)c;
                 const std::string s = std::string(buf);
-                save_model_file(args, m_model, s);
+                save_model_file(args, *static_cast<min_class_type*>(this)->version_to_write(), s);
             } catch (const std::runtime_error& s) {
                 cerr << s.what() << endl;
             }
@@ -403,7 +614,7 @@ public:
             using namespace c74::min;
             try {
                 load_model_file(args);
-                autoscale = m_model.autoscale;
+                autoscale = m_model.snapshot()->autoscale;
                 m_mode_changed = false;
             } catch (const std::runtime_error& s) {
                 cerr << s.what() << endl;
@@ -415,20 +626,15 @@ public:
     
     
     void load_model_file(const c74::min::atoms& args) {
-        c74::min::atoms f{};
+        std::string path;
         
-        if(!args.empty()) {
-            f.push_back(args[0]);
-        }
-        
-        c74::min::path p {f, c74::min::path::filetype::any};
-        
-        if(p) {
-            try {
-                mlpack::data::Load(std::string(p), classname(), m_model, true);
-            } catch (const std::runtime_error& s) {
-                std::throw_with_nested(std::runtime_error("Error reading model file to disk."));
+        if(load_file_path(args, path)) {
+            if(static_cast<min_class_type*>(this)->read_mapped_model(path)) {
+                return;
             }
+            auto next = std::make_shared<model_version>();
+            load_object_file(path, std::string(classname()), *next);
+            m_model.publish(std::move(next));
         }
     }
     
@@ -443,36 +649,21 @@ public:
     
     template<typename ModelType>
     void scaler_fit(ModelType& s, arma::Mat<double>& arma_matrix) {
-        const std::string scalertype_string = scaler.get().c_str();
-        
         if(autoscale) {
-            s.scaler = std::make_unique<mlpack::data::ScalingModel>(scaler_min, scaler_max, scaler_epsilon);
-            if(scalertype_string == "standard") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::STANDARD_SCALER;
-            } else if(scalertype_string == "min_max") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::MIN_MAX_SCALER;
-            } else if(scalertype_string == "normalization") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::MEAN_NORMALIZATION;
-            } else if(scalertype_string == "abs") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::MAX_ABS_SCALER;
-            } else if(scalertype_string == "pca_whitening") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::PCA_WHITENING;
-            } else if(scalertype_string == "zca_whitening") {
-                s.scaler->ScalerType() = mlpack::data::ScalingModel::PCA_WHITENING;
+            s.scaler = mlmat::make_scaler(scaler.get().c_str(), scaler_min, scaler_max, scaler_epsilon);
+            if(s.scaler) {
+                s.scaler->Fit(arma_matrix);
             }
-            s.scaler->Fit(arma_matrix);
         }
     }
     
     template<typename ModelType>
     arma::mat& scaler_transform(ModelType& s, arma::Mat<double>& input, arma::Mat<double> &output) {
         if(autoscale) {
-            try {
-                s.scaler->Transform(input, output);
-            } catch (const std::runtime_error& s) {
-                std::throw_with_nested(std::runtime_error("Fit must be called before transform"));
+            if(!s.scaler) {
+                throw std::runtime_error("Fit must be called before transform");
             }
-            return output;
+            return mlmat::scaler_transform(s.scaler.get(), input, output);
         } else {
             return input;
         }
@@ -481,8 +672,7 @@ public:
     template<typename ModelType>
     arma::mat& scaler_inverse_transform(ModelType& s, arma::Mat<double>& input, arma::Mat<double> &output) {
         if(autoscale) {
-            s.scaler->InverseTransform(input, output);
-            return output;
+            return mlmat::scaler_inverse_transform(s.scaler.get(), input, output);
         } else {
             return input;
         }
@@ -496,38 +686,301 @@ public:
     }};
     
     
+    c74::min::message<> allocations {this, "allocations", "Outputs the number of scratch buffer allocations made by the last frame and since the object was created via dump outlet.",
+        MIN_FUNCTION {
+            m_scratch.report(m_dumpoutlet);
+            return {};
+    }};
+    
+    c74::min::message<> cancel {this, "cancel", "Cancel training running in the background. The previous model is kept.",
+        MIN_FUNCTION {
+            using namespace c74::min;
+            if(!m_trainer.cancel()) {
+                cerr << "no training running" << endl;
+            }
+            return {};
+    }};
+    
+    // posts what the training worker reported and takes over its model once it is done
+    c74::min::queue<> training_deliverer { this,
+        MIN_FUNCTION {
+            deliver_training();
+            return {};
+        }
+    };
+    
 protected:
+    typedef mlmat_serializable_model<model_type> model_version;
+    
+    // called on the main thread after a model from a training job has been taken over. objects hide this to output something
+    void model_published() {}
+    
+    // called with m_publish_mutex held before a trained model is published over current. objects
+    // hide this to carry more over or to turn down a result that is out of date
+    bool accept_trained_model(model_version& next, const model_version& current) {
+        next.dim0 = current.dim0;
+        next.dimcount = current.dimcount;
+        return true;
+    }
+    
+    // called by read before the file is loaded as an mlpack model. objects hide this to read a file of
+    // their own kind instead, returning true if they did. throws std::runtime_error
+    bool read_mapped_model(const std::string& path) {
+        return false;
+    }
+    
+    // what write saves. objects hide this when the published version is missing something
+    std::shared_ptr<model_version> version_to_write() {
+        return m_model.snapshot();
+    }
+    
+    // publishes a version built by this object, recording whether it was scaled
+    void publish_model(std::shared_ptr<model_version> next) {
+        next->autoscale = autoscale;
+        m_model.publish(std::move(next));
+    }
+    
+    // the scaler attributes for a training job
+    mlmat_scaler_settings scaler_settings() {
+        mlmat_scaler_settings settings;
+        settings.autoscale = autoscale;
+        settings.type = scaler.get().c_str();
+        settings.min = scaler_min;
+        settings.max = scaler_max;
+        settings.epsilon = scaler_epsilon;
+        return settings;
+    }
+    
+    // runs job on the training worker. only one job runs at a time
+    bool train_in_background(typename mlmat_trainer<model_type>::job_type job) {
+        using namespace c74::min;
+        if(!m_trainer.start(std::move(job), [this]() { training_deliverer.set(); })) {
+            cerr << "training is already running. send cancel to stop it." << endl;
+            return false;
+        }
+        return true;
+    }
+    
+    bool training() const {
+        return m_trainer.running();
+    }
+    
+    // takes over a model the training worker has finished, if there is one. never blocks
+    bool adopt_trained_model() {
+        auto trained = m_trainer.take();
+        if(!trained) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_publish_mutex);
+        auto next = std::make_shared<model_version>();
+        auto current = m_model.snapshot();
+        next->model = std::move(trained->model);
+        next->scaler = std::move(trained->scaler);
+        if(!static_cast<min_class_type*>(this)->accept_trained_model(*next, *current)) {
+            return false;
+        }
+        publish_model(std::move(next));
+        return true;
+    }
+    
+    // what a cached result depends on besides its input: the model version, mode, autoscale and the
+    // attribute values the caller passes. hashed straight from the values, this runs every frame. taken
+    // before the snapshot a frame works with, so a model published in between only makes a later frame
+    // miss. keeps capacity entries, dropping them when the model has changed
+    template<typename... values_type>
+    uint64_t cache_key(const size_t capacity, const values_type&... values) {
+        const size_t generation = m_model.generation();
+        
+        m_cache.resize(capacity);
+        if(generation != m_cache_generation) {
+            m_cache.clear();
+            m_cache_generation = generation;
+        }
+        uint64_t key = mlmat::hash_bytes(&generation, sizeof(generation));
+        key = cache_hash(key, mode.get());
+        key = cache_hash(key, autoscale.get());
+        ((key = cache_hash(key, values)), ...);
+        return key;
+    }
+    
+    template<typename value_type>
+    static uint64_t cache_hash(const uint64_t key, const value_type& value) {
+        static_assert(std::is_arithmetic<value_type>::value, "cache keys hash numbers and symbols");
+        return mlmat::hash_bytes(&value, sizeof(value), key);
+    }
+    
+    // symbols are interned, the pointer names the value
+    static uint64_t cache_hash(const uint64_t key, const c74::min::symbol& value) {
+        const c74::max::t_symbol* s = value;
+        return mlmat::hash_bytes(&s, sizeof(s), key);
+    }
+    
+    // writes what the first count outputs held the last time input came with key, if the cache
+    // still has it. true if it did, the frame is done then
+    bool cached_outputs(const uint64_t key, c74::max::t_object* input, c74::max::t_object* outputs, const long count) {
+        return cached_outputs(key, input, output_matrices(outputs, count));
+    }
+    
+    // the same for matrices the object outputs itself as well as the mop outputs
+    bool cached_outputs(const uint64_t key, c74::max::t_object* input, const std::vector<c74::max::t_object*>& matrices) {
+        if(m_cache.capacity() == 0) {
+            return false;
+        }
+        const mlmat::matrix_desc desc = jit_matrix_desc(input);
+        m_cache_input_hash = mlmat::hash_cells(desc);
+        const std::vector<mlmat::cached_matrix>* found = m_cache.find(desc, m_cache_input_hash, key);
+        
+        if(!found || found->size() != matrices.size()) {
+            return false;
+        }
+        for(size_t i = 0; i < matrices.size(); i++) {
+            const mlmat::cached_matrix& kept = (*found)[i];
+            c74::max::t_object* out = matrices[i];
+            c74::max::t_jit_matrix_info minfo;
+            c74::max::object_method(out, c74::max::_jit_sym_getinfo, &minfo);
+            minfo.type = jit_type_symbol(kept.layout.type);
+            minfo.flags = 0;
+            minfo.planecount = kept.layout.planecount;
+            minfo.dimcount = kept.layout.dimcount;
+            for(long d = 0; d < kept.layout.dimcount; d++) {
+                minfo.dim[d] = kept.layout.dim[d];
+            }
+            jit_matrix_setinfo_if_changed(out, minfo);
+            mlmat::matrix_desc from = kept.layout;
+            from.data = const_cast<unsigned char*>(kept.cells.data());
+            mlmat::copy_cells(from, jit_matrix_desc(out));
+        }
+        return true;
+    }
+    
+    // keeps what this frame wrote to the first count outputs for input, which cached_outputs
+    // looked up earlier in the same frame and hashed
+    void cache_outputs(const uint64_t key, c74::max::t_object* input, c74::max::t_object* outputs, const long count) {
+        cache_outputs(key, input, output_matrices(outputs, count));
+    }
+    
+    void cache_outputs(const uint64_t key, c74::max::t_object* input, const std::vector<c74::max::t_object*>& matrices) {
+        if(m_cache.capacity() == 0) {
+            return;
+        }
+        m_cache_outputs.resize(matrices.size());
+        for(size_t i = 0; i < matrices.size(); i++) {
+            m_cache_outputs[i] = jit_matrix_desc(matrices[i]);
+        }
+        m_cache.store(jit_matrix_desc(input), m_cache_input_hash, key, m_cache_outputs);
+    }
+    
+    // the first count outputs of the mop
+    const std::vector<c74::max::t_object*>& output_matrices(c74::max::t_object* outputs, const long count) {
+        m_cache_matrices.resize(count);
+        for(long i = 0; i < count; i++) {
+            m_cache_matrices[i] = static_cast<c74::max::t_object*>(c74::max::object_method(outputs, c74::max::_jit_sym_getindex, i));
+        }
+        return m_cache_matrices;
+    }
+    
+    // posts cache_hits with the frames the cache answered and missed
+    void report_cache() {
+        c74::max::t_atom a[2];
+        c74::max::atom_setlong(a, m_cache.hits());
+        c74::max::atom_setlong(a+1, m_cache.misses());
+        c74::max::outlet_anything(m_dumpoutlet, c74::max::gensym("cache_hits"), 2, a);
+    }
+    
+    void deliver_training() {
+        using namespace c74::min;
+        mlmat_training_status* status = m_trainer.status();
+        c74::max::t_atom a[2];
+        size_t done = 0;
+        size_t total = 0;
+        double loss = 0.;
+        mlmat_training_status::outcome result;
+        std::string error;
+        
+        if(!status) {
+            return;
+        }
+        // looked at first so everything the job reported before finishing is posted below
+        const bool finished = status->take_finished(result, error);
+        
+        if(status->take_progress(done, total)) {
+            c74::max::atom_setlong(a, done);
+            c74::max::atom_setlong(a+1, total);
+            c74::max::outlet_anything(m_dumpoutlet, c74::max::gensym("progress"), 2, a);
+        }
+        if(status->take_loss(loss)) {
+            m_last_loss = loss;
+            c74::max::atom_setfloat(a, loss);
+            c74::max::outlet_anything(m_dumpoutlet, c74::max::gensym("loss"), 1, a);
+        }
+        if(finished) {
+            //a cancel after the job finished dropped its model
+            if(result == mlmat_training_status::outcome::done && !status->cancelled()) {
+                //matrix_calc may have taken it over already
+                adopt_trained_model();
+                static_cast<min_class_type*>(this)->model_published();
+                c74::max::atom_setsym(a, c74::max::gensym("done"));
+            } else if(result == mlmat_training_status::outcome::failed) {
+                cerr << "training failed: " << error << endl;
+                c74::max::atom_setsym(a, c74::max::gensym("failed"));
+            } else {
+                c74::max::atom_setsym(a, c74::max::gensym("cancelled"));
+            }
+            c74::max::outlet_anything(m_dumpoutlet, c74::max::gensym("training"), 1, a);
+        }
+    }
+    
     bool m_mode_changed = true;
     bool m_scaler_changed = true;
     void* m_dumpoutlet { nullptr };
-    mlmat_serializable_model<model_type> m_model;
+    mlmat_model_handle<model_type> m_model;
+    // held by writers that derive a new version from the current one
+    std::mutex m_publish_mutex;
+    mlmat_scratch m_scratch;
+    // last loss the training worker reported
+    double m_last_loss = 0.;
+    // outputs of recent inputs, for objects with a cache attribute
+    mlmat::result_cache m_cache;
+    size_t m_cache_generation = 0;
+    std::vector<mlmat::matrix_desc> m_cache_outputs;
+    std::vector<c74::max::t_object*> m_cache_matrices;
+    // of this frame's input, made by cached_outputs for the cache_outputs after a miss
+    uint64_t m_cache_input_hash = 0;
+    // declared last so it detaches from training_deliverer before that goes away
+    mlmat_trainer<model_type> m_trainer;
 };
 
 
 
-//class MyPrintLoss
-//{
-//public:
-//    MyPrintLoss(void* outlet) : outlet(outlet)
-//    {}
-//
-//    template<typename OptimizerType, typename FunctionType, typename MatType>
-//    void EndEpoch(OptimizerType& /* optimizer */,
-//                  FunctionType& /* function */,
-//                  const MatType& /* coordinates */,
-//                  const size_t /* epoch */,
-//                  const double objective)
-//    {
-//
-//        t_atom a[1];
-//
-//        atom_setfloat(a,objective);
-//        outlet_anything(outlet, gensym("loss"), 1, a);
-//
-//    }
-//private:
-//
-//    void* outlet;
-//
-//
-//};
+/*
+ ensmallen callback for training jobs. posts the objective as loss and the number of
+ optimizer steps as progress, and stops the optimizer once the job has been cancelled.
+ */
+class mlmat_training_callback
+{
+public:
+    explicit mlmat_training_callback(mlmat_training_status& status, const size_t total_steps = 0)
+    : m_status(status), m_total(total_steps) {}
+
+    template<typename OptimizerType, typename FunctionType, typename MatType>
+    bool StepTaken(OptimizerType& /* optimizer */,
+                   FunctionType& /* function */,
+                   MatType& /* coordinates */) {
+        m_status.progress(++m_steps, m_total);
+        return m_status.cancelled();
+    }
+
+    template<typename OptimizerType, typename FunctionType, typename MatType>
+    bool Evaluate(OptimizerType& /* optimizer */,
+                  FunctionType& /* function */,
+                  const MatType& /* coordinates */,
+                  const double objective) {
+        m_status.loss(objective);
+        return m_status.cancelled();
+    }
+
+private:
+    mlmat_training_status& m_status;
+    size_t m_steps = 0;
+    size_t m_total = 0;
+};